@@ -144,7 +144,15 @@ engine_config(const char* cfgfile,
         ecfg->num_worker_threads_enforcer = parse_conf_worker_threads(cfgfile, 1);
         ecfg->num_worker_threads_signer = parse_conf_worker_threads(cfgfile, 0);
         ecfg->num_signer_threads = parse_conf_signer_threads(cfgfile);
+        ecfg->sign_chunk_size = parse_conf_sign_chunk_size(cfgfile);
+        ecfg->num_hsm_sessions = parse_conf_hsm_sessions(cfgfile);
+        ecfg->num_listener_threads = parse_conf_listener_threads(cfgfile);
+        ecfg->num_transfer_connections =
+            parse_conf_transfer_connections(cfgfile, 0);
+        ecfg->num_transfer_connections_master =
+            parse_conf_transfer_connections(cfgfile, 1);
         ecfg->manual_keygen = parse_conf_manual_keygen(cfgfile);
+        ecfg->batch_enforce = parse_conf_batch_enforce(cfgfile);
         ecfg->repositories = parse_conf_repositories(cfgfile);
         /* If any verbosity has been specified at cmd line we will use that */
         ecfg->verbosity = cmdline_verbosity > 0 ?
@@ -376,6 +384,9 @@ engine_config_print(FILE* out, engineconfig_type* config)
         if (config->manual_keygen) {
             fprintf(out, "\t\t<ManualKeyGeneration/>\n");
         }
+        if (config->batch_enforce) {
+            fprintf(out, "\t\t<BatchEnforce/>\n");
+        }
         if (config->delegation_signer_submit_command) {
             fprintf(out, "\t\t<DelegationSignerSubmitCommand>%s</DelegationSignerSubmitCommand>\n",
                 config->delegation_signer_submit_command);
@@ -424,6 +435,15 @@ engine_config_print(FILE* out, engineconfig_type* config)
             }
             fprintf(out, "\t\t</Listener>\n");
         }
+        fprintf(out, "\t\t<ListenerThreads>%i</ListenerThreads>\n",
+            config->num_listener_threads);
+        fprintf(out, "\t\t<TransferConnections>%i</TransferConnections>\n",
+            config->num_transfer_connections);
+        if (config->num_transfer_connections_master) {
+            fprintf(out, "\t\t<TransferConnectionsPerMaster>%i"
+                "</TransferConnectionsPerMaster>\n",
+                config->num_transfer_connections_master);
+        }
 
         fprintf(out, "\t\t<WorkingDirectory>%s</WorkingDirectory>\n",
             config->working_dir_signer);
@@ -431,6 +451,10 @@ engine_config_print(FILE* out, engineconfig_type* config)
             config->num_worker_threads_signer);
         fprintf(out, "\t\t<SignerThreads>%i</SignerThreads>\n",
             config->num_signer_threads);
+        fprintf(out, "\t\t<SignChunkSize>%i</SignChunkSize>\n",
+            config->sign_chunk_size);
+        fprintf(out, "\t\t<HSMSessions>%i</HSMSessions>\n",
+            config->num_hsm_sessions);
         if (config->notify_command) {
             fprintf(out, "\t\t<NotifyCommand>%s</NotifyCommand>\n",
                 config->notify_command);
@@ -97,7 +97,13 @@ struct engineconfig_struct {
     int num_worker_threads_enforcer;
     int num_worker_threads_signer;
     int num_signer_threads;
+    int sign_chunk_size;
+    int num_hsm_sessions;
+    int num_listener_threads;
+    int num_transfer_connections;
+    int num_transfer_connections_master;
     int manual_keygen;
+    int batch_enforce;
     int verbosity;
     int db_port; /* Datastore/MySQL/Host/@Port */
     time_t automatic_keygen_duration;
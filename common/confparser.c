@@ -704,6 +704,19 @@ parse_conf_manual_keygen(const char* cfgfile)
     return 0;
 }
 
+int
+parse_conf_batch_enforce(const char* cfgfile)
+{
+    const char* str = parse_conf_string(cfgfile,
+                                        "//Configuration/Enforcer/BatchEnforce",
+                                        0);
+    if (str) {
+        free((void*)str);
+        return 1;
+    }
+    return 0;
+}
+
 int
 parse_conf_db_port(const char* cfgfile)
 {
@@ -896,3 +909,70 @@ parse_conf_signer_threads(const char* cfgfile)
     /* no SignerThreads value configured, look at WorkerThreads */
     return parse_conf_worker_threads(cfgfile, 0);
 }
+
+int
+parse_conf_sign_chunk_size(const char* cfgfile)
+{
+    int chunksize = ODS_SE_SIGNCHUNKSIZE;
+    const char* str = parse_conf_string(cfgfile,
+                                        "//Configuration/Signer/SignChunkSize",
+                                        0);
+    if (str) {
+        if (strlen(str) > 0) {
+            chunksize = atoi(str);
+        }
+        free((void*)str);
+    }
+    return chunksize;
+}
+
+int
+parse_conf_hsm_sessions(const char* cfgfile)
+{
+    int numhs = 0;
+    const char* str = parse_conf_string(cfgfile,
+                                        "//Configuration/Signer/HSMSessions",
+                                        0);
+    if (str) {
+        if (strlen(str) > 0) {
+            numhs = atoi(str);
+        }
+        free((void*)str);
+        return numhs;
+    }
+    /* no HSMSessions value configured, one for each signer thread */
+    return parse_conf_signer_threads(cfgfile);
+}
+
+int
+parse_conf_listener_threads(const char* cfgfile)
+{
+    int numlt = ODS_SE_LISTENERTHREADS;
+    const char* str = parse_conf_string(cfgfile,
+                                        "//Configuration/Signer/ListenerThreads",
+                                        0);
+    if (str) {
+        if (strlen(str) > 0) {
+            numlt = atoi(str);
+        }
+        free((void*)str);
+    }
+    return numlt;
+}
+
+int
+parse_conf_transfer_connections(const char* cfgfile, int per_master)
+{
+    int numtc = per_master ? 0 : ODS_SE_TRANSFERCONNECTIONS;
+    const char* str = parse_conf_string(cfgfile,
+        per_master ? "//Configuration/Signer/TransferConnectionsPerMaster" :
+                     "//Configuration/Signer/TransferConnections",
+        0);
+    if (str) {
+        if (strlen(str) > 0) {
+            numtc = atoi(str);
+        }
+        free((void*)str);
+    }
+    return numtc;
+}
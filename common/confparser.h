@@ -102,7 +102,12 @@ int parse_conf_verbosity(const char* cfgfile);
 /** Enforcer and signer specific */
 int parse_conf_worker_threads(const char* cfgfile, int is_enforcer);
 int parse_conf_signer_threads(const char* cfgfile);
+int parse_conf_sign_chunk_size(const char* cfgfile);
+int parse_conf_hsm_sessions(const char* cfgfile);
+int parse_conf_listener_threads(const char* cfgfile);
+int parse_conf_transfer_connections(const char* cfgfile, int per_master);
 int parse_conf_manual_keygen(const char* cfgfile);
+int parse_conf_batch_enforce(const char* cfgfile);
 int parse_conf_db_port(const char *cfgfile);
 time_t parse_conf_automatic_keygen_period(const char* cfgfile);
 time_t parse_conf_rollover_notification(const char* cfgfile);
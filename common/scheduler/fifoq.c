@@ -67,6 +67,7 @@ fifoq_wipe(fifoq_type* q)
         q->blob[i] = NULL;
         q->owner[i] = NULL;
     }
+    q->head = 0;
     q->count = 0;
 }
 
@@ -79,16 +80,14 @@ void*
 fifoq_pop(fifoq_type* q, void** context)
 {
     void* pop = NULL;
-    size_t i = 0;
     if (!q || q->count <= 0) {
         return NULL;
     }
-    pop = q->blob[0];
-    *context = q->owner[0];
-    for (i = 0; i < q->count-1; i++) {
-        q->blob[i] = q->blob[i+1];
-        q->owner[i] = q->owner[i+1];
-    }
+    pop = q->blob[q->head];
+    *context = q->owner[q->head];
+    q->blob[q->head] = NULL;
+    q->owner[q->head] = NULL;
+    q->head = (q->head + 1) % FIFOQ_MAX_COUNT;
     q->count -= 1;
     if (q->count <= (size_t) FIFOQ_MAX_COUNT * 0.1) {
         /**
@@ -111,6 +110,25 @@ fifoq_push(fifoq_type* q, void* item, void* context, int* tries)
     if (!q || !item) {
         return ODS_STATUS_ASSERT_ERR;
     }
+    if (fifoq_pushbatch(q, &item, 1, context, tries) == 0) {
+        return ODS_STATUS_UNCHANGED;
+    }
+    return ODS_STATUS_OK;
+}
+
+
+/**
+ * Push as many items of a batch to queue as fit.
+ *
+ */
+size_t
+fifoq_pushbatch(fifoq_type* q, void** items, size_t nitems, void* context,
+    int* tries)
+{
+    size_t i, n, tail;
+    if (!q || !items || nitems == 0) {
+        return 0;
+    }
     if (q->count >= FIFOQ_MAX_COUNT) {
         /**
          * #262:
@@ -123,45 +141,54 @@ fifoq_push(fifoq_type* q, void* item, void* context, int* tries)
             /* reset tries */
             *tries = 0;
         }
-        return ODS_STATUS_UNCHANGED;
+        return 0;
+    }
+    n = FIFOQ_MAX_COUNT - q->count;
+    if (n > nitems) {
+        n = nitems;
     }
-    q->blob[q->count] = item;
-    q->owner[q->count] = context;
-    q->count += 1;
-    if (q->count == 1) {
+    tail = (q->head + q->count) % FIFOQ_MAX_COUNT;
+    for (i = 0; i < n; i++) {
+        q->blob[tail] = items[i];
+        q->owner[tail] = context;
+        tail = (tail + 1) % FIFOQ_MAX_COUNT;
+    }
+    q->count += n;
+    if (q->count == n) {
         ods_log_deeebug("[%s] threshold %lu reached, notify drudgers",
             fifoq_str, (unsigned long) q->count);
         /* If no drudgers are waiting, this call has no effect. */
         pthread_cond_broadcast(&q->q_threshold);
     }
-    return ODS_STATUS_OK;
+    return n;
 }
 
 void
 fifoq_report(fifoq_type* q, worker_type* superior, ods_status subtaskstatus)
 {
-    pthread_mutex_lock(&q->q_lock);
     if (subtaskstatus != ODS_STATUS_OK) {
-        superior->tasksFailed += 1;
+        (void) __sync_add_and_fetch(&superior->tasksFailed, 1);
     }
-    superior->tasksOutstanding -= 1;
-    if (superior->tasksOutstanding == 0) {
+    if (__sync_sub_and_fetch(&superior->tasksOutstanding, 1) == 0) {
+        /* taking the lock orders the wakeup after the check in
+         * fifoq_waitfor, so it can not be lost */
+        pthread_mutex_lock(&q->q_lock);
         pthread_cond_signal(&superior->tasksBlocker);
+        pthread_mutex_unlock(&q->q_lock);
     }
-    pthread_mutex_unlock(&q->q_lock);
 }
 
 void
 fifoq_waitfor(fifoq_type* q, worker_type* worker, long nsubtasks, long* nsubtasksfailed)
 {
+    (void) __sync_add_and_fetch(&worker->tasksOutstanding, (int) nsubtasks);
     pthread_mutex_lock(&q->q_lock);
-    worker->tasksOutstanding += nsubtasks;
-    while (worker->tasksOutstanding > 0 && !worker->need_to_exit) {
+    while (__sync_add_and_fetch(&worker->tasksOutstanding, 0) > 0 &&
+        !worker->need_to_exit) {
         pthread_cond_wait(&worker->tasksBlocker, &q->q_lock);
     }
-    *nsubtasksfailed = worker->tasksFailed;
-    worker->tasksFailed = 0;
     pthread_mutex_unlock(&q->q_lock);
+    *nsubtasksfailed = __sync_fetch_and_and(&worker->tasksFailed, 0);
 }
 
 
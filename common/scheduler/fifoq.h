@@ -52,13 +52,15 @@ typedef struct fifoq_struct fifoq_type;
 
 #define FIFOQ_MAX_COUNT 1000
 #define FIFOQ_TRIES_COUNT 10
+#define FIFOQ_BATCH_COUNT 64
 
 /**
- * FIFO Queue.
+ * FIFO Queue, a ring buffer of FIFOQ_MAX_COUNT items starting at head.
  */
 struct fifoq_struct {
     void* blob[FIFOQ_MAX_COUNT];
     void* owner[FIFOQ_MAX_COUNT];
+    size_t head;
     size_t count;
     pthread_mutex_t q_lock;
     pthread_cond_t q_threshold;
@@ -100,6 +102,19 @@ void* fifoq_pop(fifoq_type* q, void** worker);
  */
 ods_status fifoq_push(fifoq_type* q, void* item, void* worker, int* tries);
 
+/**
+ * Push as many items of a batch to queue as fit.
+ * \param[in] q queue
+ * \param[in] items items
+ * \param[in] nitems number of items
+ * \param[in] worker owner of the items
+ * \param[out] tries number of tries
+ * \return size_t number of items pushed
+ *
+ */
+size_t fifoq_pushbatch(fifoq_type* q, void** items, size_t nitems,
+    void* worker, int* tries);
+
 /**
  * Clean up queue.
  * \param[in] q queue to be cleaned up
@@ -107,6 +122,14 @@ ods_status fifoq_push(fifoq_type* q, void* item, void* worker, int* tries);
  */
 void fifoq_cleanup(fifoq_type* q);
 
+/**
+ * Report completion of an item to its owner. Does not take the queue lock,
+ * except to wake the owner when its last item completes.
+ * \param[in] q queue
+ * \param[in] superior owner of the item
+ * \param[in] subtaskstatus status of the item
+ *
+ */
 void fifoq_report(fifoq_type* q, worker_type* superior, ods_status subtaskstatus);
 void fifoq_waitfor(fifoq_type* q, worker_type* worker, long nsubtasks, long* nsubtasksfailed);
 void fifoq_notifyall(fifoq_type* q);
@@ -40,6 +40,7 @@
 #include <ldns/ldns.h>
 #include <pthread.h>
 #include <signal.h>
+#include <time.h>
 
 #include "scheduler/schedule.h"
 #include "scheduler/task.h"
@@ -51,6 +52,10 @@
 
 static const char* schedule_str = "scheduler";
 
+/* How long a worker backs off when all due tasks are held up by busy
+ * locks that might be released outside of task_perform() */
+#define SCHEDULE_BUSY_WAIT_MSEC 100
+
 /**
  * Convert task to a tree node.
  * NULL on malloc failure
@@ -66,6 +71,30 @@ task2node(task_type* task)
     return node;
 }
 
+/**
+ * Add task to the queue of its priority class. Caller must hold
+ * schedule->schedule_lock.
+ */
+static void
+queue_insert(schedule_type* schedule, task_type* task)
+{
+    ldns_rbnode_t* node = task2node(task);
+    if (node) {
+        ods_log_assert(ldns_rbtree_insert(schedule->queues[task->priority], node));
+    }
+}
+
+/**
+ * Remove task from the queue of its priority class. Must be called
+ * before the due_date of the task changes. Caller must hold
+ * schedule->schedule_lock.
+ */
+static void
+queue_delete(schedule_type* schedule, task_type* task)
+{
+    free(ldns_rbtree_delete(schedule->queues[task->priority], task));
+}
+
 /**
  * Get the first scheduled task. As long as return value is used
  * caller should hold schedule->schedule_lock.
@@ -106,7 +135,8 @@ pop_first_task(schedule_type* schedule)
 
     if (!schedule || !schedule->tasks) return NULL;
     node = ldns_rbtree_first(schedule->tasks);
-    if (!node) return NULL;
+    if (!node || node == LDNS_RBTREE_NULL) return NULL;
+    queue_delete(schedule, (task_type*) node->data);
     delnode = ldns_rbtree_delete(schedule->tasks, node->data);
     /* delnode == node, but we don't free it just yet, data is shared
      * with tasks_by_name tree */
@@ -171,6 +201,7 @@ fetch_node_pair(schedule_type *schedule, task_type *task,
         originalTask = (task_type*) (*nodeFromNameTree)->key; /* This is the original task, it has the correct time so we can find it in tasks */
         ods_log_assert(originalTask);
         if (remove) {
+            queue_delete(schedule, originalTask);
             *nodeFromTimeTree = ldns_rbtree_delete(schedule->tasks, originalTask);
         } else {
             *nodeFromTimeTree = ldns_rbtree_search(schedule->tasks, originalTask);
@@ -188,15 +219,20 @@ schedule_type*
 schedule_create()
 {
     schedule_type* schedule;
+    int i;
     CHECKALLOC(schedule = (schedule_type*) malloc(sizeof(schedule_type)));
 
     schedule->tasks = ldns_rbtree_create(task_compare_time_then_ttuple);
     schedule->tasks_by_name = ldns_rbtree_create(task_compare_ttuple);
     schedule->locks_by_name = ldns_rbtree_create(task_compare_ttuple_lock);
+    for (i = 0; i < TASK_PRIORITY_COUNT; i++) {
+        schedule->queues[i] = ldns_rbtree_create(task_compare_time_then_ttuple);
+    }
 
     pthread_mutex_init(&schedule->schedule_lock, NULL);
     pthread_cond_init(&schedule->schedule_cond, NULL);
     schedule->num_waiting = 0;
+    schedule->num_busywait = 0;
     schedule->handlers = NULL;
     schedule->nhandlers = 0;
     
@@ -212,12 +248,17 @@ schedule_create()
 void
 schedule_cleanup(schedule_type* schedule)
 {
+    int i;
     if (!schedule) return;
     ods_log_debug("[%s] cleanup schedule", schedule_str);
 
     if (schedule->tasks) {
         task_delfunc(schedule->tasks->root);
         task_delfunc2(schedule->tasks_by_name->root);
+        for (i = 0; i < TASK_PRIORITY_COUNT; i++) {
+            task_delfunc2(schedule->queues[i]->root);
+            ldns_rbtree_free(schedule->queues[i]);
+        }
         ldns_rbtree_free(schedule->tasks);
         ldns_rbtree_free(schedule->tasks_by_name);
         ldns_rbtree_free(schedule->locks_by_name);
@@ -234,7 +275,8 @@ void
 schedule_purge(schedule_type* schedule)
 {
     ldns_rbnode_t* node;
-    
+    int i;
+
     if (!schedule || !schedule->tasks) return;
 
     pthread_mutex_lock(&schedule->schedule_lock);
@@ -246,6 +288,11 @@ schedule_purge(schedule_type* schedule)
             if (node == 0) break;
             free(node);
         }
+        for (i = 0; i < TASK_PRIORITY_COUNT; i++) {
+            task_delfunc2(schedule->queues[i]->root);
+            schedule->queues[i]->root = LDNS_RBTREE_NULL;
+            schedule->queues[i]->count = 0;
+        }
         /* also clean up name tree */
         while ((node = ldns_rbtree_first(schedule->tasks_by_name)) !=
             LDNS_RBTREE_NULL)
@@ -368,6 +415,7 @@ schedule_task(schedule_type* schedule, task_type* task, int replace, int log)
         }
         ods_log_assert(ldns_rbtree_insert(schedule->tasks, node1));
         ods_log_assert(ldns_rbtree_insert(schedule->tasks_by_name, node2));
+        queue_insert(schedule, task);
     } else {
         if (!replace) {
             ods_log_error("[%s] unable to schedule task %s for zone %s: already present", schedule_str, task->type, task->owner);
@@ -377,6 +425,8 @@ schedule_task(schedule_type* schedule, task_type* task, int replace, int log)
             existing_task = (task_type*) node1->key;
             if (task->due_date < existing_task->due_date)
                 existing_task->due_date = task->due_date;
+            if (task->priority < existing_task->priority)
+                existing_task->priority = task->priority;
             if (existing_task->freedata)
                 existing_task->freedata(existing_task->userdata);
             existing_task->userdata = task->userdata;
@@ -385,6 +435,7 @@ schedule_task(schedule_type* schedule, task_type* task, int replace, int log)
             task_destroy(task);
             ods_log_assert(ldns_rbtree_insert(schedule->tasks, node1));
             ods_log_assert(ldns_rbtree_insert(schedule->tasks_by_name, node2));
+            queue_insert(schedule, existing_task);
             task = existing_task;
         }
     }
@@ -420,6 +471,7 @@ unschedule_task(schedule_type* schedule, task_type* task)
     del_node = ldns_rbtree_delete(schedule->tasks, (const void*) task);
     if (del_node) {
         del_task = (task_type*) del_node->data;
+        queue_delete(schedule, del_task);
         node2 = ldns_rbtree_delete(schedule->tasks_by_name, del_task);
         if (node2 != NULL && node2 != LDNS_RBTREE_NULL) {
             free(node2);
@@ -441,19 +493,65 @@ schedule_unschedule(schedule_type* schedule, task_type* task)
     return originalTask;
 }
 
+/**
+ * Take the first due task of the most urgent priority class whose lock
+ * can be acquired without waiting. Tasks of zones that are busy are
+ * left in place and counted in busy. Caller must hold
+ * schedule->schedule_lock.
+ */
+static task_type*
+pop_runnable_task(schedule_type* schedule, time_t now, int* busy)
+{
+    ldns_rbnode_t* node;
+    task_type* task;
+    int i;
+
+    for (i = 0; i < TASK_PRIORITY_COUNT; i++) {
+        for (node = ldns_rbtree_first(schedule->queues[i]);
+             node != LDNS_RBTREE_NULL; node = ldns_rbtree_next(node)) {
+            task = (task_type*) node->data;
+            if (task->due_date > now) break;
+            if (task->lock && pthread_mutex_trylock(task->lock)) {
+                *busy += 1;
+                continue;
+            }
+            task->lockheld = (task->lock != NULL);
+            return unschedule_task(schedule, task);
+        }
+    }
+    return NULL;
+}
+
 task_type*
 schedule_pop_task(schedule_type* schedule)
 {
     time_t timeout, now = time_now();
     task_type* task;
+    struct timespec deadline;
+    int busy = 0;
 
     pthread_mutex_lock(&schedule->schedule_lock);
-    task = schedule_get_first_task(schedule);
-    if (task && (task->due_date <= now)) {
+    task = pop_runnable_task(schedule, now, &busy);
+    if (task) {
         ods_log_debug("[%s] pop task for zone %s", schedule_str, task->owner);
-        task = unschedule_task(schedule, task);
+    } else if (busy) {
+        /* Everything due waits for a zone in use. Retry as soon as a
+         * task releases its lock, or shortly for locks taken outside
+         * the scheduler. */
+        schedule->num_waiting += 1;
+        schedule->num_busywait += 1;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += SCHEDULE_BUSY_WAIT_MSEC * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&schedule->schedule_cond, &schedule->schedule_lock, &deadline);
+        schedule->num_busywait -= 1;
+        schedule->num_waiting -= 1;
     } else {
         /* nothing to do now, sleep and wait for signal */
+        task = schedule_get_first_task(schedule);
         schedule->num_waiting += 1;
         timeout = clamp((task ? (task->due_date - now) : 0),
                         ((task && !strcmp(task->class, TASK_CLASS_ENFORCER)) ? 0 : 60),
@@ -496,9 +594,11 @@ schedule_flush(schedule_type* schedule)
                 /* we only need to delete the node from the tasks tree as we
                  * are immediately inserting it again.
                  */
+                queue_delete(schedule, task);
                 ldns_rbtree_delete(schedule->tasks, task);
                 task->due_date = time_now();
                 ldns_rbtree_insert(schedule->tasks, node);
+                queue_insert(schedule, task);
             } else {
                 /* the last in the ordered tree is already executing
                  * immediately so this means that all of them are, we can abort
@@ -551,6 +651,15 @@ schedule_release_all(schedule_type* schedule)
     fifoq_notifyall(schedule->signq);
 }
 
+void
+schedule_release_busy(schedule_type* schedule)
+{
+    pthread_mutex_lock(&schedule->schedule_lock);
+    if (schedule->num_busywait)
+        pthread_cond_broadcast(&schedule->schedule_cond);
+    pthread_mutex_unlock(&schedule->schedule_lock);
+}
+
 void
 schedule_task_destroy(schedule_type* sched, task_type* task)
 {
@@ -596,13 +705,14 @@ schedule_task_istype(task_type* task, task_id type)
 }
 
 void
-schedule_registertask(schedule_type* schedule, task_id taskclass, task_id tasktype, time_t (*callback)(task_type* task, char const *owner, void *userdata, void *context))
+schedule_registertask(schedule_type* schedule, task_id taskclass, task_id tasktype, int priority, time_t (*callback)(task_type* task, char const *owner, void *userdata, void *context))
 {
     struct schedule_handler* handlers;
     handlers = realloc(schedule->handlers, sizeof(struct schedule_handler)*(schedule->nhandlers+1));
     if (handlers != NULL) {
         handlers[schedule->nhandlers].class    = taskclass;
         handlers[schedule->nhandlers].type     = tasktype;
+        handlers[schedule->nhandlers].priority = priority;
         handlers[schedule->nhandlers].callback = callback;
         schedule->handlers = handlers;
         schedule->nhandlers += 1;
@@ -623,6 +733,7 @@ schedule_scheduletask(schedule_type* schedule, task_id type, const char* owner,
     if (handler) {
         task = task_create(strdup(owner), handler->class, type, handler->callback, userdata, NULL, when);
         task->lock = resource;
+        task->priority = handler->priority;
         schedule_task(schedule, task, 0, 0);
     }
 }
@@ -58,6 +58,7 @@ typedef struct schedule_struct schedule_type;
 struct schedule_handler {
     task_id type;
     task_id class;
+    int priority;
     time_t (*callback)(task_type* task, char const *owner, void *userdata, void *context);
 };
 
@@ -69,12 +70,17 @@ struct schedule_struct {
     ldns_rbtree_t* tasks_by_name;
     /* For every ttuple contains a task structure with an unique lock */
     ldns_rbtree_t* locks_by_name;
+    /* Per priority class the same tasks again sorted by due_date, so
+     * workers pick due tasks of the most urgent class first. */
+    ldns_rbtree_t* queues[TASK_PRIORITY_COUNT];
     fifoq_type* signq;
     pthread_cond_t schedule_cond;
     pthread_mutex_t schedule_lock;
     /* For testing. So we can verify al workers are waiting and nothing
      * is to be done. Used by enforcer_idle. */
     int num_waiting;
+    /* Workers waiting only because all due tasks belong to busy zones */
+    int num_busywait;
     struct schedule_handler* handlers;
     int nhandlers;
 };
@@ -93,7 +99,7 @@ schedule_type* schedule_create(void);
  */
 void schedule_cleanup(schedule_type* schedule);
 
-void schedule_registertask(schedule_type* schedule, task_id class, task_id type, time_t (*callback)(task_type* task, char const *owner, void *userdata, void *context));
+void schedule_registertask(schedule_type* schedule, task_id class, task_id type, int priority, time_t (*callback)(task_type* task, char const *owner, void *userdata, void *context));
 
 
 /**
@@ -137,6 +143,10 @@ void schedule_unscheduletask(schedule_type* schedule, task_id task, const char*
  * available it will be returned. Else the call will block and return
  * NULL when the caller is awoken. 
  *
+ * Due tasks are taken from the most urgent priority class first. A task
+ * whose lock is held elsewhere is skipped rather than waited for, the
+ * returned task has its lock acquired already.
+ *
  * \param[in] schedule schedule
  * \return task_type* popped task, or NULL when no task available or
  * no task due
@@ -162,6 +172,12 @@ int schedule_info(schedule_type* schedule, time_t* firstFireTime, int* idleWorke
  */
 void schedule_release_all(schedule_type* schedule);
 
+/**
+ * Wake up threads that skipped due tasks because their lock was taken.
+ * Called whenever a task lock is released.
+ */
+void schedule_release_busy(schedule_type* schedule);
+
 void schedule_task_destroy(schedule_type* sched, task_type* task);
 time_t sched_task_due(task_type* task);
 int schedule_task_istype(task_type* task, task_id type);
@@ -64,6 +64,7 @@ const char* TASK_SIGN           = "[sign]";
 const char* TASK_WRITE          = "[write]";
 const char* TASK_FORCESIGNCONF  = "[forcesignconf]";
 const char* TASK_FORCEREAD      = "[forceread]";
+const char* TASK_FORCESIGN      = "[forcesign]";
 
 task_type*
 task_create(const char *owner, char const *class, char const *type,
@@ -84,8 +85,10 @@ task_create(const char *owner, char const *class, char const *type,
     task->freedata = freedata;
     task->due_date = due_date;
     task->lock = NULL;
+    task->lockheld = 0;
 
     task->backoff = 0;
+    task->priority = TASK_PRIORITY_RESIGN;
 
     return task;
 }
@@ -108,17 +111,26 @@ task_perform(schedule_type* scheduler, task_type* task, void* context)
 
     if (task->callback) {
         if (task->lock) {
-            pthread_mutex_lock(task->lock);
+            if (!task->lockheld)
+                pthread_mutex_lock(task->lock);
             ods_log_debug("START TASK: %s %s", task->owner, task->type);
             rescheduleTime = task->callback(task, task->owner, task->userdata, context);
             ods_log_debug("END TASK: %s %s", task->owner, task->type);
+            task->lockheld = 0;
             pthread_mutex_unlock(task->lock);
+            schedule_release_busy(scheduler);
         } else {
             ods_log_debug("START TASK WITHOUT LOCK");
             rescheduleTime = task->callback(task, task->owner, task->userdata, context);
         }
     } else {
-        /* We'll allow a task without callback, just don't reschedule. */
+        /* We'll allow a task without callback, just don't reschedule.
+         * The lock may still have been taken when it was popped. */
+        if (task->lockheld) {
+            task->lockheld = 0;
+            pthread_mutex_unlock(task->lock);
+            schedule_release_busy(scheduler);
+        }
         rescheduleTime = schedule_SUCCESS;
     }
     if (rescheduleTime == schedule_PROMPTLY) {
@@ -155,6 +167,8 @@ task_duplicate_shallow(task_type *task)
     dup->type = task->type;
     dup->class = task->class;
     dup->lock = NULL;
+    dup->lockheld = 0;
+    dup->priority = task->priority;
     return dup;
 }
 
@@ -85,10 +85,21 @@ struct task_struct {
      * on scheduler_push_task(). All tasks with the same ttuple will
      * get the same lock. */
     pthread_mutex_t *lock;
+    /* Set when the scheduler already acquired lock when handing out the
+     * task, task_perform() must then not lock it again. */
+    int lockheld;
 
     time_t backoff;
+    /* One of TASK_PRIORITY_*. Of all tasks that are due, those in the
+     * lowest priority class are handed out first. */
+    int priority;
 };
 
+#define TASK_PRIORITY_INTERACTIVE 0 /* operator or update triggered */
+#define TASK_PRIORITY_RESIGN      1 /* signing and writing, the default */
+#define TASK_PRIORITY_BULK        2 /* reading and loading of zones */
+#define TASK_PRIORITY_COUNT       3
+
 extern const char* TASK_CLASS_ENFORCER;
 extern const char* TASK_CLASS_SIGNER;
 
@@ -107,6 +118,7 @@ extern const char* TASK_SIGN;
 extern const char* TASK_WRITE;
 extern const char* TASK_FORCESIGNCONF;
 extern const char* TASK_FORCEREAD;
+extern const char* TASK_FORCESIGN;
 
 /*
  * owner: string is owned by task.
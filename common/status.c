@@ -62,6 +62,7 @@ ods_lookup_table ods_status_str[] = {
     { ODS_STATUS_SOCK_GETADDRINFO, "Unable to retrieve address information"},
     { ODS_STATUS_SOCK_LISTEN, "Unable to listen on socket"},
     { ODS_STATUS_SOCK_SETSOCKOPT_V6ONLY, "Unable to set socket to v6only"},
+    { ODS_STATUS_SOCK_SETSOCKOPT_REUSEPORT, "Unable to set socket to reuse port"},
     { ODS_STATUS_SOCK_SOCKET_UDP, "Unable to create udp socket"},
     { ODS_STATUS_SOCK_SOCKET_TCP, "Unable to create tcp socket"},
 
@@ -48,6 +48,8 @@ static int db_backend_mysql_transaction_rollback(void*);
  */
 static int __mysql_initialized = 0;
 
+typedef struct db_backend_mysql_statement db_backend_mysql_statement_t;
+
 /**
  * The MySQL database backend specific data.
  */
@@ -55,6 +57,10 @@ typedef struct db_backend_mysql {
     MYSQL* db;
     int transaction;
     unsigned int timeout;
+    db_backend_mysql_statement_t* cache[DB_BACKEND_MYSQL_CACHE_SIZE];
+    unsigned long cache_clock;
+    unsigned long cache_hits;
+    unsigned long cache_misses;
 } db_backend_mysql_t;
 
 
@@ -75,8 +81,11 @@ struct db_backend_mysql_bind {
 
 /**
  * The MySQL database backend specific data for statements.
+ *
+ * Prepared statements are kept in the statement cache of the backend, keyed
+ * by their SQL and the object field list of the output binding.
  */
-typedef struct db_backend_mysql_statement {
+struct db_backend_mysql_statement {
     db_backend_mysql_t* backend_mysql;
     MYSQL_STMT* statement;
     MYSQL_BIND* mysql_bind_input;
@@ -88,14 +97,19 @@ typedef struct db_backend_mysql_statement {
     db_object_field_list_t* object_field_list;
     int fields;
     int bound;
-} db_backend_mysql_statement_t;
+    char* sql;
+    int cached;
+    int in_use;
+    unsigned long last_used;
+};
 
 
 
 /**
  * MySQL finish function.
  *
- * Frees all data related to a db_backend_mysql_statement_t.
+ * Returns a cached db_backend_mysql_statement_t to the statement cache,
+ * otherwise frees all data related to it.
  */
 static inline void __db_backend_mysql_finish(db_backend_mysql_statement_t* statement) {
     db_backend_mysql_bind_t* bind;
@@ -104,6 +118,14 @@ static inline void __db_backend_mysql_finish(db_backend_mysql_statement_t* state
         return;
     }
 
+    if (statement->cached) {
+        mysql_stmt_free_result(statement->statement);
+        mysql_stmt_reset(statement->statement);
+        statement->bound = 0;
+        statement->in_use = 0;
+        return;
+    }
+
     if (statement->statement) {
         mysql_stmt_close(statement->statement);
     }
@@ -129,18 +151,69 @@ static inline void __db_backend_mysql_finish(db_backend_mysql_statement_t* state
     if (statement->object_field_list) {
         db_object_field_list_free(statement->object_field_list);
     }
+    free(statement->sql);
 
     free(statement);
 }
 
+/**
+ * Check if the output binding of a statement can be used for the given object
+ * field list. Statements without a result have no output binding.
+ */
+static int __db_backend_mysql_fields_match(const db_backend_mysql_statement_t* statement, const db_object_field_list_t* object_field_list) {
+    const db_object_field_t* cached_field;
+    const db_object_field_t* object_field;
+
+    if (!statement->object_field_list) {
+        return 1;
+    }
+    if (!object_field_list) {
+        return 0;
+    }
+
+    cached_field = db_object_field_list_begin(statement->object_field_list);
+    object_field = db_object_field_list_begin(object_field_list);
+    while (cached_field && object_field) {
+        if (db_object_field_type(cached_field) != db_object_field_type(object_field)
+            || strcmp(db_object_field_name(cached_field), db_object_field_name(object_field)))
+        {
+            return 0;
+        }
+        cached_field = db_object_field_next(cached_field);
+        object_field = db_object_field_next(object_field);
+    }
+    return !cached_field && !object_field;
+}
+
+/**
+ * Free all statements in the statement cache.
+ */
+static void __db_backend_mysql_cache_clear(db_backend_mysql_t* backend_mysql) {
+    int i;
+
+    ods_log_debug("db_backend_mysql: statement cache %lu hits, %lu misses",
+        backend_mysql->cache_hits, backend_mysql->cache_misses);
+    for (i = 0; i < DB_BACKEND_MYSQL_CACHE_SIZE; i++) {
+        if (backend_mysql->cache[i]) {
+            backend_mysql->cache[i]->cached = 0;
+            __db_backend_mysql_finish(backend_mysql->cache[i]);
+            backend_mysql->cache[i] = NULL;
+        }
+    }
+}
+
 /**
  * MySQL prepare function.
  *
  * Creates a db_backend_mysql_statement_t based on a SQL string and an object
- * field list.
+ * field list. If the same statement has been prepared before and is not in
+ * use it is taken from the statement cache instead, otherwise the new
+ * statement is added to the cache replacing the least recently used one.
  */
 static inline int __db_backend_mysql_prepare(db_backend_mysql_t* backend_mysql, db_backend_mysql_statement_t** statement, const char* sql, size_t size, const db_object_field_list_t* object_field_list) {
     unsigned long i, params;
+    db_backend_mysql_statement_t* cached;
+    int slot = -1, busy = 0, c;
     db_backend_mysql_bind_t* bind;
     const db_object_field_t* object_field;
     MYSQL_BIND* mysql_bind;
@@ -163,10 +236,42 @@ static inline int __db_backend_mysql_prepare(db_backend_mysql_t* backend_mysql,
         return DB_ERROR_UNKNOWN;
     }
 
+    ods_log_debug("%s", sql);
+
+    /*
+     * Look for the statement in the cache.
+     */
+    for (c = 0; c < DB_BACKEND_MYSQL_CACHE_SIZE; c++) {
+        if (!(cached = backend_mysql->cache[c])) {
+            if (slot < 0 || backend_mysql->cache[slot]) {
+                slot = c;
+            }
+            continue;
+        }
+        if (!strcmp(cached->sql, sql)
+            && __db_backend_mysql_fields_match(cached, object_field_list))
+        {
+            if (!cached->in_use) {
+                cached->in_use = 1;
+                cached->last_used = ++backend_mysql->cache_clock;
+                backend_mysql->cache_hits++;
+                *statement = cached;
+                return DB_OK;
+            }
+            busy = 1;
+        }
+        else if (!cached->in_use
+            && (slot < 0 || (backend_mysql->cache[slot]
+                && cached->last_used < backend_mysql->cache[slot]->last_used)))
+        {
+            slot = c;
+        }
+    }
+    backend_mysql->cache_misses++;
+
     /*
      * Prepare the statement.
      */
-    ods_log_debug("%s", sql);
     if (!(*statement = calloc(1, sizeof(db_backend_mysql_statement_t)))
         || !((*statement)->statement = mysql_stmt_init(backend_mysql->db))
         || mysql_stmt_prepare((*statement)->statement, sql, size))
@@ -500,6 +605,24 @@ static inline int __db_backend_mysql_prepare(db_backend_mysql_t* backend_mysql,
         mysql_free_result(result_metadata);
     }
 
+    /*
+     * Do not cache a second copy of a statement that is in use, it will be
+     * freed when done.
+     */
+    if (!busy && slot >= 0) {
+        if (backend_mysql->cache[slot]) {
+            backend_mysql->cache[slot]->cached = 0;
+            __db_backend_mysql_finish(backend_mysql->cache[slot]);
+            backend_mysql->cache[slot] = NULL;
+        }
+        if (((*statement)->sql = strdup(sql))) {
+            (*statement)->cached = 1;
+            (*statement)->in_use = 1;
+            (*statement)->last_used = ++backend_mysql->cache_clock;
+            backend_mysql->cache[slot] = *statement;
+        }
+    }
+
     return DB_OK;
 }
 
@@ -741,6 +864,7 @@ static int db_backend_mysql_disconnect(void* data) {
         db_backend_mysql_transaction_rollback(backend_mysql);
     }
 
+    __db_backend_mysql_cache_clear(backend_mysql);
     mysql_close(backend_mysql->db);
     backend_mysql->db = NULL;
 
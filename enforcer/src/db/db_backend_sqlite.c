@@ -60,6 +60,18 @@ static int __sqlite3_initialized = 0;
 static pthread_mutex_t __sqlite_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t __sqlite_cond = PTHREAD_COND_INITIALIZER;
 
+/**
+ * A prepared statement kept for reuse. The SQL is built from the object, the
+ * field list and the shape of the clauses while all values are bound, so it
+ * identifies the statement.
+ */
+typedef struct db_backend_sqlite_cached {
+    char* sql;
+    sqlite3_stmt* statement;
+    int in_use;
+    unsigned long last_used;
+} db_backend_sqlite_cached_t;
+
 /**
  * The SQLite database backend specific data.
  */
@@ -69,6 +81,10 @@ typedef struct db_backend_sqlite {
     int timeout;
     int time;
     long usleep;
+    db_backend_sqlite_cached_t cache[DB_BACKEND_SQLITE_CACHE_SIZE];
+    unsigned long cache_clock;
+    unsigned long cache_hits;
+    unsigned long cache_misses;
 } db_backend_sqlite_t;
 
 
@@ -138,9 +154,15 @@ static int __db_backend_sqlite_busy_handler(void *data, int retry) {
 
 /**
  * SQLite prepare function.
+ *
+ * Statements are taken from the statement cache of the backend if the same
+ * SQL has been prepared before and is not in use, otherwise a new statement
+ * is prepared and added to the cache replacing the least recently used one.
  */
 static inline int __db_backend_sqlite_prepare(db_backend_sqlite_t* backend_sqlite, sqlite3_stmt** statement, const char* sql, size_t size) {
-    int ret;
+    db_backend_sqlite_cached_t* cached;
+    db_backend_sqlite_cached_t* slot = NULL;
+    int ret, i, busy = 0;
 
     if (!backend_sqlite) {
         return DB_ERROR_UNKNOWN;
@@ -160,6 +182,33 @@ static inline int __db_backend_sqlite_prepare(db_backend_sqlite_t* backend_sqlit
 
     ods_log_debug("%s", sql);
     backend_sqlite->time = time(NULL);
+
+    for (i = 0; i < DB_BACKEND_SQLITE_CACHE_SIZE; i++) {
+        cached = &(backend_sqlite->cache[i]);
+        if (!cached->sql) {
+            if (!slot || slot->sql) {
+                slot = cached;
+            }
+            continue;
+        }
+        if (!strcmp(cached->sql, sql)) {
+            if (!cached->in_use) {
+                cached->in_use = 1;
+                cached->last_used = ++backend_sqlite->cache_clock;
+                backend_sqlite->cache_hits++;
+                *statement = cached->statement;
+                return DB_OK;
+            }
+            busy = 1;
+        }
+        else if (!cached->in_use
+            && (!slot || (slot->sql && cached->last_used < slot->last_used)))
+        {
+            slot = cached;
+        }
+    }
+    backend_sqlite->cache_misses++;
+
     ret = sqlite3_prepare_v2(backend_sqlite->db,
         sql,
         size,
@@ -175,6 +224,24 @@ static inline int __db_backend_sqlite_prepare(db_backend_sqlite_t* backend_sqlit
         return DB_ERROR_UNKNOWN;
     }
 
+    /*
+     * Do not cache a second copy of a statement that is in use, it will be
+     * finalized when done.
+     */
+    if (!busy && slot) {
+        if (slot->sql) {
+            sqlite3_finalize(slot->statement);
+            free(slot->sql);
+        }
+        slot->statement = NULL;
+        slot->in_use = 0;
+        if ((slot->sql = strdup(sql))) {
+            slot->statement = *statement;
+            slot->in_use = 1;
+            slot->last_used = ++backend_sqlite->cache_clock;
+        }
+    }
+
     return DB_OK;
 }
 
@@ -239,10 +306,24 @@ static inline int __db_backend_sqlite_step(db_backend_sqlite_t* backend_sqlite,
 /**
  * SQLite finalize function.
  *
- * This will also signal the pthread cond that is used for busy handler.
+ * Statements from the statement cache are reset and returned to the cache,
+ * other statements are finalized. This will also signal the pthread cond that
+ * is used for busy handler.
  */
-static inline int __db_backend_sqlite_finalize(sqlite3_stmt* statement) {
-    int ret;
+static inline int __db_backend_sqlite_finalize(db_backend_sqlite_t* backend_sqlite, sqlite3_stmt* statement) {
+    int ret, i;
+
+    for (i = 0; statement && i < DB_BACKEND_SQLITE_CACHE_SIZE; i++) {
+        if (backend_sqlite->cache[i].sql
+            && backend_sqlite->cache[i].statement == statement)
+        {
+            ret = sqlite3_reset(statement);
+            sqlite3_clear_bindings(statement);
+            backend_sqlite->cache[i].in_use = 0;
+            pthread_cond_broadcast(&__sqlite_cond);
+            return ret;
+        }
+    }
 
     ret = sqlite3_finalize(statement);
     pthread_cond_broadcast(&__sqlite_cond);
@@ -250,6 +331,25 @@ static inline int __db_backend_sqlite_finalize(sqlite3_stmt* statement) {
     return ret;
 }
 
+/**
+ * Finalize all statements in the statement cache.
+ */
+static void __db_backend_sqlite_cache_clear(db_backend_sqlite_t* backend_sqlite) {
+    int i;
+
+    ods_log_debug("db_backend_sqlite: statement cache %lu hits, %lu misses",
+        backend_sqlite->cache_hits, backend_sqlite->cache_misses);
+    for (i = 0; i < DB_BACKEND_SQLITE_CACHE_SIZE; i++) {
+        if (backend_sqlite->cache[i].sql) {
+            sqlite3_finalize(backend_sqlite->cache[i].statement);
+            free(backend_sqlite->cache[i].sql);
+        }
+        backend_sqlite->cache[i].sql = NULL;
+        backend_sqlite->cache[i].statement = NULL;
+        backend_sqlite->cache[i].in_use = 0;
+    }
+}
+
 static int db_backend_sqlite_initialize(void* data) {
     db_backend_sqlite_t* backend_sqlite = (db_backend_sqlite_t*)data;
 
@@ -365,6 +465,7 @@ static int db_backend_sqlite_disconnect(void* data) {
     if (backend_sqlite->transaction) {
         db_backend_sqlite_transaction_rollback(backend_sqlite);
     }
+    __db_backend_sqlite_cache_clear(backend_sqlite);
     ret = sqlite3_close(backend_sqlite->db);
     if (ret != SQLITE_OK) {
         return DB_ERROR_UNKNOWN;
@@ -679,7 +780,7 @@ static db_result_t* db_backend_sqlite_next(void* data, int finish) {
     }
 
     if (finish) {
-        __db_backend_sqlite_finalize(statement->statement);
+        __db_backend_sqlite_finalize(statement->backend_sqlite, statement->statement);
         free(statement);
         return NULL;
     }
@@ -833,16 +934,16 @@ db_backend_sqlite_last_id(void* data, int *last_id)
     }
     int ret = __db_backend_sqlite_step(backend_sqlite, statement);
     if (ret != SQLITE_DONE && ret != SQLITE_ROW) {
-        __db_backend_sqlite_finalize(statement);
+        __db_backend_sqlite_finalize(backend_sqlite, statement);
         return DB_ERROR_UNKNOWN;
     }
     *last_id = sqlite3_column_int(statement, 0);
     ret = sqlite3_errcode(backend_sqlite->db);
     if ((ret != SQLITE_OK && ret != SQLITE_ROW && ret != SQLITE_DONE)) {
-        __db_backend_sqlite_finalize(statement);
+        __db_backend_sqlite_finalize(backend_sqlite, statement);
         return DB_ERROR_UNKNOWN;
     }
-    __db_backend_sqlite_finalize(statement);
+    __db_backend_sqlite_finalize(backend_sqlite, statement);
     return DB_OK;
 }
 
@@ -1028,59 +1129,59 @@ static int db_backend_sqlite_create(void* data, const db_object_t* object, const
     bind = 1;
     for (value_pos = 0; value_pos < db_value_set_size(value_set); value_pos++) {
         if (!(value = db_value_set_at(value_set, value_pos))) {
-            __db_backend_sqlite_finalize(statement);
+            __db_backend_sqlite_finalize(backend_sqlite, statement);
             return DB_ERROR_UNKNOWN;
         }
 
         switch (db_value_type(value)) {
         case DB_TYPE_INT32:
             if (db_value_to_int32(value, &int32)) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             to_int = int32;
             ret = sqlite3_bind_int(statement, bind++, to_int);
             if (ret != SQLITE_OK) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             break;
 
         case DB_TYPE_UINT32:
             if (db_value_to_uint32(value, &uint32)) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             to_int = uint32;
             ret = sqlite3_bind_int(statement, bind++, to_int);
             if (ret != SQLITE_OK) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             break;
 
         case DB_TYPE_INT64:
             if (db_value_to_int64(value, &int64)) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             to_int64 = int64;
             ret = sqlite3_bind_int64(statement, bind++, to_int64);
             if (ret != SQLITE_OK) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             break;
 
         case DB_TYPE_UINT64:
             if (db_value_to_uint64(value, &uint64)) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             to_int64 = uint64;
             ret = sqlite3_bind_int64(statement, bind++, to_int64);
             if (ret != SQLITE_OK) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             break;
@@ -1088,25 +1189,25 @@ static int db_backend_sqlite_create(void* data, const db_object_t* object, const
         case DB_TYPE_TEXT:
             ret = sqlite3_bind_text(statement, bind++, db_value_text(value), -1, SQLITE_TRANSIENT);
             if (ret != SQLITE_OK) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             break;
 
         case DB_TYPE_ENUM:
             if (db_value_enum_value(value, &to_int)) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             ret = sqlite3_bind_int(statement, bind++, to_int);
             if (ret != SQLITE_OK) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             break;
 
         default:
-            __db_backend_sqlite_finalize(statement);
+            __db_backend_sqlite_finalize(backend_sqlite, statement);
             return DB_ERROR_UNKNOWN;
         }
     }
@@ -1117,7 +1218,7 @@ static int db_backend_sqlite_create(void* data, const db_object_t* object, const
     if (revision_field) {
         ret = sqlite3_bind_int(statement, bind++, 1);
         if (ret != SQLITE_OK) {
-            __db_backend_sqlite_finalize(statement);
+            __db_backend_sqlite_finalize(backend_sqlite, statement);
             return DB_ERROR_UNKNOWN;
         }
     }
@@ -1126,10 +1227,10 @@ static int db_backend_sqlite_create(void* data, const db_object_t* object, const
      * Execute the SQL.
      */
     if (__db_backend_sqlite_step(backend_sqlite, statement) != SQLITE_DONE) {
-        __db_backend_sqlite_finalize(statement);
+        __db_backend_sqlite_finalize(backend_sqlite, statement);
         return DB_ERROR_UNKNOWN;
     }
-    __db_backend_sqlite_finalize(statement);
+    __db_backend_sqlite_finalize(backend_sqlite, statement);
 
     return DB_OK;
 }
@@ -1240,7 +1341,7 @@ static db_result_list_t* db_backend_sqlite_read(void* data, const db_object_t* o
     if (clause_list) {
         bind = 1;
         if (__db_backend_sqlite_bind_clause(statement->statement, clause_list, &bind)) {
-            __db_backend_sqlite_finalize(statement->statement);
+            __db_backend_sqlite_finalize(statement->backend_sqlite, statement->statement);
             free(statement);
             return NULL;
         }
@@ -1250,7 +1351,7 @@ static db_result_list_t* db_backend_sqlite_read(void* data, const db_object_t* o
         || db_result_list_set_next(result_list, db_backend_sqlite_next, statement, 0))
     {
         db_result_list_free(result_list);
-        __db_backend_sqlite_finalize(statement->statement);
+        __db_backend_sqlite_finalize(statement->backend_sqlite, statement->statement);
         free(statement);
         return NULL;
     }
@@ -1441,59 +1542,59 @@ static int db_backend_sqlite_update(void* data, const db_object_t* object, const
     bind = 1;
     for (value_pos = 0; value_pos < db_value_set_size(value_set); value_pos++) {
         if (!(value = db_value_set_at(value_set, value_pos))) {
-            __db_backend_sqlite_finalize(statement);
+            __db_backend_sqlite_finalize(backend_sqlite, statement);
             return DB_ERROR_UNKNOWN;
         }
 
         switch (db_value_type(value)) {
         case DB_TYPE_INT32:
             if (db_value_to_int32(value, &int32)) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             to_int = int32;
             ret = sqlite3_bind_int(statement, bind++, to_int);
             if (ret != SQLITE_OK) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             break;
 
         case DB_TYPE_UINT32:
             if (db_value_to_uint32(value, &uint32)) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             to_int = uint32;
             ret = sqlite3_bind_int(statement, bind++, to_int);
             if (ret != SQLITE_OK) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             break;
 
         case DB_TYPE_INT64:
             if (db_value_to_int64(value, &int64)) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             to_int64 = int64;
             ret = sqlite3_bind_int64(statement, bind++, to_int64);
             if (ret != SQLITE_OK) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             break;
 
         case DB_TYPE_UINT64:
             if (db_value_to_uint64(value, &uint64)) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             to_int64 = uint64;
             ret = sqlite3_bind_int64(statement, bind++, to_int64);
             if (ret != SQLITE_OK) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             break;
@@ -1501,25 +1602,25 @@ static int db_backend_sqlite_update(void* data, const db_object_t* object, const
         case DB_TYPE_TEXT:
             ret = sqlite3_bind_text(statement, bind++, db_value_text(value), -1, SQLITE_TRANSIENT);
             if (ret != SQLITE_OK) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             break;
 
         case DB_TYPE_ENUM:
             if (db_value_enum_value(value, &to_int)) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             ret = sqlite3_bind_int(statement, bind++, to_int);
             if (ret != SQLITE_OK) {
-                __db_backend_sqlite_finalize(statement);
+                __db_backend_sqlite_finalize(backend_sqlite, statement);
                 return DB_ERROR_UNKNOWN;
             }
             break;
 
         default:
-            __db_backend_sqlite_finalize(statement);
+            __db_backend_sqlite_finalize(backend_sqlite, statement);
             return DB_ERROR_UNKNOWN;
         }
     }
@@ -1530,7 +1631,7 @@ static int db_backend_sqlite_update(void* data, const db_object_t* object, const
     if (revision_field) {
         ret = sqlite3_bind_int64(statement, bind++, revision_number + 1);
         if (ret != SQLITE_OK) {
-            __db_backend_sqlite_finalize(statement);
+            __db_backend_sqlite_finalize(backend_sqlite, statement);
             return DB_ERROR_UNKNOWN;
         }
     }
@@ -1540,7 +1641,7 @@ static int db_backend_sqlite_update(void* data, const db_object_t* object, const
      */
     if (clause_list) {
         if (__db_backend_sqlite_bind_clause(statement, clause_list, &bind)) {
-            __db_backend_sqlite_finalize(statement);
+            __db_backend_sqlite_finalize(backend_sqlite, statement);
             return DB_ERROR_UNKNOWN;
         }
     }
@@ -1549,10 +1650,10 @@ static int db_backend_sqlite_update(void* data, const db_object_t* object, const
      * Execute the SQL.
      */
     if (__db_backend_sqlite_step(backend_sqlite, statement) != SQLITE_DONE) {
-        __db_backend_sqlite_finalize(statement);
+        __db_backend_sqlite_finalize(backend_sqlite, statement);
         return DB_ERROR_UNKNOWN;
     }
-    __db_backend_sqlite_finalize(statement);
+    __db_backend_sqlite_finalize(backend_sqlite, statement);
 
     /*
      * If we are using revision we have to have a positive number of changes
@@ -1651,16 +1752,16 @@ static int db_backend_sqlite_delete(void* data, const db_object_t* object, const
     if (clause_list) {
         bind = 1;
         if (__db_backend_sqlite_bind_clause(statement, clause_list, &bind)) {
-            __db_backend_sqlite_finalize(statement);
+            __db_backend_sqlite_finalize(backend_sqlite, statement);
             return DB_ERROR_UNKNOWN;
         }
     }
 
     if (__db_backend_sqlite_step(backend_sqlite, statement) != SQLITE_DONE) {
-        __db_backend_sqlite_finalize(statement);
+        __db_backend_sqlite_finalize(backend_sqlite, statement);
         return DB_ERROR_UNKNOWN;
     }
-    __db_backend_sqlite_finalize(statement);
+    __db_backend_sqlite_finalize(backend_sqlite, statement);
 
     /*
      * If we are using revision we have to have a positive number of changes
@@ -1751,26 +1852,26 @@ static int db_backend_sqlite_count(void* data, const db_object_t* object, const
     if (clause_list) {
         bind = 1;
         if (__db_backend_sqlite_bind_clause(statement, clause_list, &bind)) {
-            __db_backend_sqlite_finalize(statement);
+            __db_backend_sqlite_finalize(backend_sqlite, statement);
             return DB_ERROR_UNKNOWN;
         }
     }
 
     ret = __db_backend_sqlite_step(backend_sqlite, statement);
     if (ret != SQLITE_DONE && ret != SQLITE_ROW) {
-        __db_backend_sqlite_finalize(statement);
+        __db_backend_sqlite_finalize(backend_sqlite, statement);
         return DB_ERROR_UNKNOWN;
     }
 
     sqlite_count = sqlite3_column_int(statement, 0);
     ret = sqlite3_errcode(backend_sqlite->db);
     if ((ret != SQLITE_OK && ret != SQLITE_ROW && ret != SQLITE_DONE)) {
-        __db_backend_sqlite_finalize(statement);
+        __db_backend_sqlite_finalize(backend_sqlite, statement);
         return DB_ERROR_UNKNOWN;
     }
 
     *count = sqlite_count;
-    __db_backend_sqlite_finalize(statement);
+    __db_backend_sqlite_finalize(backend_sqlite, statement);
     return DB_OK;
 }
 
@@ -1805,10 +1906,10 @@ static int db_backend_sqlite_transaction_begin(void* data) {
     }
 
     if (__db_backend_sqlite_step(backend_sqlite, statement) != SQLITE_DONE) {
-        __db_backend_sqlite_finalize(statement);
+        __db_backend_sqlite_finalize(backend_sqlite, statement);
         return DB_ERROR_UNKNOWN;
     }
-    __db_backend_sqlite_finalize(statement);
+    __db_backend_sqlite_finalize(backend_sqlite, statement);
 
     backend_sqlite->transaction = 1;
     return DB_OK;
@@ -1834,10 +1935,10 @@ static int db_backend_sqlite_transaction_commit(void* data) {
     }
 
     if (__db_backend_sqlite_step(backend_sqlite, statement) != SQLITE_DONE) {
-        __db_backend_sqlite_finalize(statement);
+        __db_backend_sqlite_finalize(backend_sqlite, statement);
         return DB_ERROR_UNKNOWN;
     }
-    __db_backend_sqlite_finalize(statement);
+    __db_backend_sqlite_finalize(backend_sqlite, statement);
 
     backend_sqlite->transaction = 0;
     return DB_OK;
@@ -1863,10 +1964,10 @@ static int db_backend_sqlite_transaction_rollback(void* data) {
     }
 
     if (__db_backend_sqlite_step(backend_sqlite, statement) != SQLITE_DONE) {
-        __db_backend_sqlite_finalize(statement);
+        __db_backend_sqlite_finalize(backend_sqlite, statement);
         return DB_ERROR_UNKNOWN;
     }
-    __db_backend_sqlite_finalize(statement);
+    __db_backend_sqlite_finalize(backend_sqlite, statement);
 
     backend_sqlite->transaction = 0;
     return DB_OK;
@@ -34,6 +34,7 @@
 
 #define DB_BACKEND_SQLITE_DEFAULT_TIMEOUT 30
 #define DB_BACKEND_SQLITE_DEFAULT_USLEEP 200000
+#define DB_BACKEND_SQLITE_CACHE_SIZE 64
 
 /**
  * Create a new database backend handle for SQLite.
@@ -151,6 +151,25 @@ int db_clause_set_operator(db_clause_t* clause, db_clause_operator_t clause_oper
     return DB_OK;
 }
 
+int db_clause_set_list(db_clause_t* clause, db_clause_list_t* clause_list) {
+    if (!clause) {
+        return DB_ERROR_UNKNOWN;
+    }
+    if (!clause_list) {
+        return DB_ERROR_UNKNOWN;
+    }
+    if (clause->field) {
+        return DB_ERROR_UNKNOWN;
+    }
+    if (clause->clause_list) {
+        return DB_ERROR_UNKNOWN;
+    }
+
+    clause->type = DB_CLAUSE_NESTED;
+    clause->clause_list = clause_list;
+    return DB_OK;
+}
+
 int db_clause_not_empty(const db_clause_t* clause) {
     if (!clause) {
         return DB_ERROR_UNKNOWN;
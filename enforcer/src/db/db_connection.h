@@ -139,4 +139,26 @@ int db_connection_delete(const db_connection_t* connection, const db_object_t* o
  */
 int db_connection_count(const db_connection_t* connection, const db_object_t* object, const db_join_list_t* join_list, const db_clause_list_t* clause_list, size_t* count);
 
+/**
+ * Begin a transaction on the database connection. Every create, update and
+ * delete until the commit or rollback is part of the transaction.
+ * \param[in] connection a db_connection_t pointer.
+ * \return DB_ERROR_* on failure, otherwise DB_OK.
+ */
+int db_connection_transaction_begin(const db_connection_t* connection);
+
+/**
+ * Commit the transaction started on the database connection.
+ * \param[in] connection a db_connection_t pointer.
+ * \return DB_ERROR_* on failure, otherwise DB_OK.
+ */
+int db_connection_transaction_commit(const db_connection_t* connection);
+
+/**
+ * Roll back the transaction started on the database connection.
+ * \param[in] connection a db_connection_t pointer.
+ * \return DB_ERROR_* on failure, otherwise DB_OK.
+ */
+int db_connection_transaction_rollback(const db_connection_t* connection);
+
 #endif
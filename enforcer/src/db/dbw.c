@@ -1,3 +1,4 @@
+#include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
 
@@ -135,75 +136,7 @@ dbxvalue2int(struct db_value const *val)
     }
 }
 
-static int dbw_policy_revision(const db_connection_t *dbconn, struct db_value *id)
-{
-    policy_t *dbx_obj = policy_new(dbconn);
-    int rev = -1;
-    if (dbx_obj && !policy_get_by_id(dbx_obj, id))
-        rev = dbxvalue2int(&dbx_obj->rev);
-    policy_free(dbx_obj);
-    return rev;
-}
-
-static int dbw_policykey_revision(const db_connection_t *dbconn, struct db_value *id)
-{
-    policy_key_t *dbx_obj = policy_key_new(dbconn);
-    int rev = -1;
-    if (dbx_obj && !policy_key_get_by_id(dbx_obj, id))
-        rev = dbxvalue2int(&dbx_obj->rev);
-    policy_key_free(dbx_obj);
-    return rev;
-}
-
-static int dbw_zone_revision(const db_connection_t *dbconn, struct db_value *id)
-{
-    zone_db_t *dbx_obj = zone_db_new(dbconn);
-    int rev = -1;
-    if (dbx_obj && !zone_db_get_by_id(dbx_obj, id))
-        rev = dbxvalue2int(&dbx_obj->rev);
-    zone_db_free(dbx_obj);
-    return rev;
-}
-
-static int dbw_key_revision(const db_connection_t *dbconn, struct db_value *id)
-{
-    key_data_t *dbx_obj = key_data_new(dbconn);
-    int rev = -1;
-    if (dbx_obj && !key_data_get_by_id(dbx_obj, id))
-        rev = dbxvalue2int(&dbx_obj->rev);
-    key_data_free(dbx_obj);
-    return rev;
-}
-
-static int dbw_keystate_revision(const db_connection_t *dbconn, struct db_value *id)
-{
-    key_state_t *dbx_obj = key_state_new(dbconn);
-    int rev = -1;
-    if (dbx_obj && !key_state_get_by_id(dbx_obj, id))
-        rev = dbxvalue2int(&dbx_obj->rev);
-    key_state_free(dbx_obj);
-    return rev;
-}
-
-static int dbw_keydependency_revision(const db_connection_t *dbconn, struct db_value *id)
-{
-    key_dependency_t *dbx_obj = key_dependency_new(dbconn);
-    int rev = -1;
-    if (dbx_obj && !key_dependency_get_by_id(dbx_obj, id))
-        rev = dbxvalue2int(&dbx_obj->rev);
-    key_dependency_free(dbx_obj);
-    return rev;
-}
-
-static int dbw_hsmkey_revision(const db_connection_t *dbconn, struct db_value *id)
-{
-    hsm_key_t *dbx_obj = hsm_key_new(dbconn);
-    int rev = -1;
-    if (dbx_obj && !hsm_key_get_by_id(dbx_obj, id))
-        rev = dbxvalue2int(&dbx_obj->rev);
-    hsm_key_free(dbx_obj);
-    return rev;
-}
+static void dbw_policy_cache_evict(int id);
 
 static int
 dbw_policy_update(const db_connection_t *dbconn, struct dbrow *row)
@@ -224,6 +157,7 @@ dbw_policy_update(const db_connection_t *dbconn, struct dbrow *row)
                 return 1;
             ret = policy_delete(dbx_obj);
             policy_free(dbx_obj);
+            if (!ret) dbw_policy_cache_evict(row->id);
             return ret;
         case DBW_UPDATE:
             if (db_value_from_int32(&id, row->id) || policy_get_by_id(dbx_obj, &id))
@@ -978,13 +912,17 @@ hsmkey_dbx_to_dbw(const hsm_key_t *dbx_item)
  */
 
 static struct dbw_list *
-dbw_zones(db_connection_t *dbconn, int fetch)
+dbw_zones(const db_connection_t *dbconn, int fetch, const db_clause_list_t *clauses)
 {
     zone_list_db_t* dbx_list = NULL;
     size_t n = 0;
     if (fetch) {
-        dbx_list = zone_list_db_new_get(dbconn);
+        dbx_list = clauses ? zone_list_db_new(dbconn) : zone_list_db_new_get(dbconn);
         if (!dbx_list) return NULL;
+        if (clauses && zone_list_db_get_by_clauses(dbx_list, clauses)) {
+            zone_list_db_free(dbx_list);
+            return NULL;
+        }
         n = zone_list_db_size(dbx_list);
     }
     struct dbw_list *list = calloc(1, sizeof (struct dbw_list));
@@ -994,7 +932,7 @@ dbw_zones(db_connection_t *dbconn, int fetch)
     }
     list->free = dbw_zone_free;
     list->update = dbw_zone_update;
-    list->revision = dbw_zone_revision;
+    list->fetch = dbw_zones;
     if (fetch) {
         list->set = calloc(n, sizeof (struct dbw_zone *));
         if (!list->set) {
@@ -1018,13 +956,17 @@ dbw_zones(db_connection_t *dbconn, int fetch)
 }
 
 static struct dbw_list *
-dbw_keys(db_connection_t *dbconn, int fetch)
+dbw_keys(const db_connection_t *dbconn, int fetch, const db_clause_list_t *clauses)
 {
     key_data_list_t* dbx_list = NULL;
     size_t n = 0;
     if (fetch) {
-        dbx_list = key_data_list_new_get(dbconn);
+        dbx_list = clauses ? key_data_list_new(dbconn) : key_data_list_new_get(dbconn);
         if (!dbx_list) return NULL;
+        if (clauses && key_data_list_get_by_clauses(dbx_list, clauses)) {
+            key_data_list_free(dbx_list);
+            return NULL;
+        }
         n = key_data_list_size(dbx_list);
     }
     struct dbw_list *list = calloc(1, sizeof (struct dbw_list));
@@ -1034,7 +976,7 @@ dbw_keys(db_connection_t *dbconn, int fetch)
     }
     list->free = dbw_key_free;
     list->update = dbw_key_update;
-    list->revision = dbw_key_revision;
+    list->fetch = dbw_keys;
     if (fetch) {
         list->set = calloc(n, sizeof (struct dbw_key *));
         if (!list->set) {
@@ -1058,13 +1000,17 @@ dbw_keys(db_connection_t *dbconn, int fetch)
 }
 
 static struct dbw_list *
-dbw_keystates(db_connection_t *dbconn, int fetch)
+dbw_keystates(const db_connection_t *dbconn, int fetch, const db_clause_list_t *clauses)
 {
     key_state_list_t* dbx_list = NULL;
     size_t n = 0;
     if (fetch) {
-        dbx_list = key_state_list_new_get(dbconn);
+        dbx_list = clauses ? key_state_list_new(dbconn) : key_state_list_new_get(dbconn);
         if (!dbx_list) return NULL;
+        if (clauses && key_state_list_get_by_clauses(dbx_list, clauses)) {
+            key_state_list_free(dbx_list);
+            return NULL;
+        }
         n = key_state_list_size(dbx_list);
     }
     struct dbw_list *list = calloc(1, sizeof (struct dbw_list));
@@ -1074,7 +1020,7 @@ dbw_keystates(db_connection_t *dbconn, int fetch)
     }
     list->free = dbw_keystate_free;
     list->update = dbw_keystate_update;
-    list->revision = dbw_keystate_revision;
+    list->fetch = dbw_keystates;
     if (fetch) {
         list->set = calloc(n, sizeof (struct dbw_keystate *));
         if (!list->set) {
@@ -1098,13 +1044,17 @@ dbw_keystates(db_connection_t *dbconn, int fetch)
 }
 
 static struct dbw_list *
-dbw_keydependencies(db_connection_t *dbconn, int fetch)
+dbw_keydependencies(const db_connection_t *dbconn, int fetch, const db_clause_list_t *clauses)
 {
     key_dependency_list_t* dbx_list = NULL;
     size_t n = 0;
     if (fetch) {
-        dbx_list = key_dependency_list_new_get(dbconn);
+        dbx_list = clauses ? key_dependency_list_new(dbconn) : key_dependency_list_new_get(dbconn);
         if (!dbx_list) return NULL;
+        if (clauses && key_dependency_list_get_by_clauses(dbx_list, clauses)) {
+            key_dependency_list_free(dbx_list);
+            return NULL;
+        }
         n = key_dependency_list_size(dbx_list);
     }
     struct dbw_list *list = calloc(1, sizeof (struct dbw_list));
@@ -1114,7 +1064,7 @@ dbw_keydependencies(db_connection_t *dbconn, int fetch)
     }
     list->free = dbw_keydependency_free;
     list->update = dbw_keydependency_update;
-    list->revision = dbw_keydependency_revision;
+    list->fetch = dbw_keydependencies;
     if (fetch) {
     list->set = calloc(n, sizeof (struct dbw_keydependency *));
         if (!list->set) {
@@ -1138,13 +1088,17 @@ dbw_keydependencies(db_connection_t *dbconn, int fetch)
 }
 
 static struct dbw_list *
-dbw_hsmkeys(db_connection_t *dbconn, int fetch)
+dbw_hsmkeys(const db_connection_t *dbconn, int fetch, const db_clause_list_t *clauses)
 {
     hsm_key_list_t* dbx_list = NULL;
     size_t n = 0;
     if (fetch) {
-        dbx_list = hsm_key_list_new_get(dbconn);
+        dbx_list = clauses ? hsm_key_list_new(dbconn) : hsm_key_list_new_get(dbconn);
         if (!dbx_list) return NULL;
+        if (clauses && hsm_key_list_get_by_clauses(dbx_list, clauses)) {
+            hsm_key_list_free(dbx_list);
+            return NULL;
+        }
         n = hsm_key_list_size(dbx_list);
     }
     struct dbw_list *list = calloc(1, sizeof (struct dbw_list));
@@ -1154,7 +1108,7 @@ dbw_hsmkeys(db_connection_t *dbconn, int fetch)
     }
     list->free = dbw_hsmkey_free;
     list->update = dbw_hsmkey_update;
-    list->revision = dbw_hsmkey_revision;
+    list->fetch = dbw_hsmkeys;
     if (fetch) {
         list->set = calloc(n, sizeof (struct dbw_hsmkey *));
         if (!list->set) {
@@ -1179,13 +1133,17 @@ dbw_hsmkeys(db_connection_t *dbconn, int fetch)
 
 
 static struct dbw_list *
-dbw_policies(db_connection_t *dbconn, int fetch)
+dbw_policies(const db_connection_t *dbconn, int fetch, const db_clause_list_t *clauses)
 {
     policy_list_t* dbx_list = NULL;
     size_t n = 0;
     if (fetch) {
-        dbx_list = policy_list_new_get(dbconn);
+        dbx_list = clauses ? policy_list_new(dbconn) : policy_list_new_get(dbconn);
         if (!dbx_list) return NULL;
+        if (clauses && policy_list_get_by_clauses(dbx_list, clauses)) {
+            policy_list_free(dbx_list);
+            return NULL;
+        }
         n = policy_list_size(dbx_list);
     }
     struct dbw_list *list = calloc(1, sizeof (struct dbw_list));
@@ -1195,7 +1153,7 @@ dbw_policies(db_connection_t *dbconn, int fetch)
     }
     list->free = dbw_policy_free;
     list->update = dbw_policy_update;
-    list->revision = dbw_policy_revision;
+    list->fetch = dbw_policies;
     if (fetch) {
         list->set = calloc(n, sizeof (struct dbw_policy *));
         if (!list->set) {
@@ -1219,13 +1177,17 @@ dbw_policies(db_connection_t *dbconn, int fetch)
 }
 
 static struct dbw_list *
-dbw_policykeys(db_connection_t *dbconn, int fetch)
+dbw_policykeys(const db_connection_t *dbconn, int fetch, const db_clause_list_t *clauses)
 {
     policy_key_list_t* dbx_list = NULL;
     size_t n = 0;
     if (fetch) {
-        dbx_list = policy_key_list_new_get(dbconn);
+        dbx_list = clauses ? policy_key_list_new(dbconn) : policy_key_list_new_get(dbconn);
         if (!dbx_list) return NULL;
+        if (clauses && policy_key_list_get_by_clauses(dbx_list, clauses)) {
+            policy_key_list_free(dbx_list);
+            return NULL;
+        }
         n = policy_key_list_size(dbx_list);
     }
     struct dbw_list *list = calloc(1, sizeof (struct dbw_list));
@@ -1235,7 +1197,7 @@ dbw_policykeys(db_connection_t *dbconn, int fetch)
     }
     list->free = dbw_policykey_free;
     list->update = dbw_policykey_update;
-    list->revision = dbw_policykey_revision;
+    list->fetch = dbw_policykeys;
     if (fetch) {
         list->set = calloc(n, sizeof (struct dbw_policykey *));
         if (!list->set) {
@@ -1286,13 +1248,13 @@ dbw_fetch_filtered(db_connection_t *conn, int mask)
         return NULL;
     }
     db->conn            = conn;
-    db->policies        = dbw_policies(conn, mask&DBW_F_POLICY);
-    db->zones           = dbw_zones(conn, mask&DBW_F_ZONE);
-    db->keys            = dbw_keys(conn, mask&DBW_F_KEY);
-    db->keystates       = dbw_keystates(conn, mask&DBW_F_KEYSTATE);
-    db->hsmkeys         = dbw_hsmkeys(conn, mask&DBW_F_HSMKEY);
-    db->policykeys      = dbw_policykeys(conn, mask&DBW_F_POLICYKEY);
-    db->keydependencies = dbw_keydependencies(conn, mask&DBW_F_KEYDEPENDENCY);
+    db->policies        = dbw_policies(conn, mask&DBW_F_POLICY, NULL);
+    db->zones           = dbw_zones(conn, mask&DBW_F_ZONE, NULL);
+    db->keys            = dbw_keys(conn, mask&DBW_F_KEY, NULL);
+    db->keystates       = dbw_keystates(conn, mask&DBW_F_KEYSTATE, NULL);
+    db->hsmkeys         = dbw_hsmkeys(conn, mask&DBW_F_HSMKEY, NULL);
+    db->policykeys      = dbw_policykeys(conn, mask&DBW_F_POLICYKEY, NULL);
+    db->keydependencies = dbw_keydependencies(conn, mask&DBW_F_KEYDEPENDENCY, NULL);
     (void)pthread_rwlock_unlock(&db_lock);
 
     if (!db->policies || !db->zones || !db->keys || !db->keystates ||
@@ -1320,6 +1282,572 @@ dbw_fetch(db_connection_t *conn)
     return dbw_fetch_filtered(conn, DBW_F_ALL);
 }
 
+/* Add object to array */
+static int
+append(void ***array, int *count, void *obj)
+{
+    int c = (*count) + 1;
+    void **new = realloc((*array), c * sizeof(void *));
+    if (!new) return 1;
+    new[*count] = obj;
+    (*array) = new;
+    (*count) = c;
+    return 0;
+}
+
+static int
+list_add(struct dbw_list *list, struct dbrow *row)
+{
+    size_t c = list->n + 1;
+    struct dbrow **new = realloc(list->set, c * sizeof(struct dbrow *));
+    if (!new) return 1;
+    new[list->n] = row;
+    list->set = new;
+    list->n = c;
+    return 0;
+}
+
+/**
+ *  ZONE SCOPED FETCHES
+ *
+ */
+
+/* Upper bound on the number of ids in a single "id IN (...)" clause. The
+ * backends render the query in a fixed size buffer. */
+#define DBW_IDS_PER_QUERY 32
+
+/* Move all rows of src to the end of dst. src is freed. */
+static int
+list_extend(struct dbw_list *dst, struct dbw_list *src)
+{
+    if (src->n) {
+        struct dbrow **new = realloc(dst->set,
+            (dst->n + src->n) * sizeof(struct dbrow *));
+        if (!new) return 1;
+        memcpy(new + dst->n, src->set, src->n * sizeof(struct dbrow *));
+        dst->set = new;
+        dst->n += src->n;
+    }
+    free(src->set);
+    free(src);
+    return 0;
+}
+
+static int
+list_contains(struct dbw_list *list, int id)
+{
+    for (size_t i = 0; i < list->n; i++) {
+        if (list->set[i]->id == id) return 1;
+    }
+    return 0;
+}
+
+/**
+ * Create a clause list matching field against any of the n values in ids.
+ */
+static db_clause_list_t *
+dbw_clause_in(const char *field, const int *ids, size_t n)
+{
+    db_clause_list_t *clauses, *nested;
+    db_clause_t *clause;
+
+    if (!(clauses = db_clause_list_new())) return NULL;
+    if (!(nested = db_clause_list_new())) {
+        db_clause_list_free(clauses);
+        return NULL;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (!(clause = db_clause_new())
+            || db_clause_set_field(clause, field)
+            || db_clause_set_type(clause, DB_CLAUSE_EQUAL)
+            || db_clause_set_operator(clause, DB_CLAUSE_OPERATOR_OR)
+            || db_value_from_int32(db_clause_get_value(clause), ids[i])
+            || db_clause_list_add(nested, clause))
+        {
+            db_clause_free(clause);
+            db_clause_list_free(nested);
+            db_clause_list_free(clauses);
+            return NULL;
+        }
+    }
+    if (!(clause = db_clause_new()) || db_clause_set_list(clause, nested)) {
+        db_clause_free(clause);
+        db_clause_list_free(nested);
+        db_clause_list_free(clauses);
+        return NULL;
+    }
+    if (db_clause_list_add(clauses, clause)) {
+        db_clause_free(clause);
+        db_clause_list_free(clauses);
+        return NULL;
+    }
+    return clauses;
+}
+
+/**
+ * Fetch all rows of a table where field matches one of the given ids. The
+ * ids are split over as many queries as needed. With n == 0 an empty list
+ * is returned without touching the database.
+ */
+static struct dbw_list *
+dbw_fetch_by_ids(const db_connection_t *conn,
+    struct dbw_list *(*fetch)(const db_connection_t *, int, const db_clause_list_t *),
+    const char *field, const int *ids, size_t n)
+{
+    struct dbw_list *list = fetch(conn, 0, NULL);
+    for (size_t i = 0; list && i < n; i += DBW_IDS_PER_QUERY) {
+        size_t c = (n - i < DBW_IDS_PER_QUERY) ? n - i : DBW_IDS_PER_QUERY;
+        db_clause_list_t *clauses = dbw_clause_in(field, ids + i, c);
+        struct dbw_list *part = clauses ? fetch(conn, 1, clauses) : NULL;
+        db_clause_list_free(clauses);
+        if (!part || list_extend(list, part)) {
+            dbw_list_free(part);
+            dbw_list_free(list);
+            return NULL;
+        }
+    }
+    return list;
+}
+
+/**
+ * Cache of policies and their policykeys. The enforcer reads the same handful
+ * of policies for every zone it enforces. An entry is valid for as long as the
+ * revision of its policy row is unchanged. Policykeys are never modified
+ * without also updating their policy (see policy_import.c) so the revision of
+ * the policy covers those as well.
+ */
+struct dbw_policy_cache {
+    struct dbw_policy *policy;
+    struct dbw_policy_cache *next;
+};
+static struct dbw_policy_cache *policy_cache = NULL;
+static pthread_mutex_t policy_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Copy the data of a policy, not its relations */
+static struct dbw_policy *
+dbw_policy_dup(const struct dbw_policy *policy)
+{
+    struct dbw_policy *copy = malloc(sizeof (struct dbw_policy));
+    if (!copy) return NULL;
+    memcpy(copy, policy, sizeof (struct dbw_policy));
+    copy->dirty = DBW_CLEAN;
+    copy->scratch = 0;
+    copy->policykey_count = 0;
+    copy->policykey = NULL;
+    copy->hsmkey_count = 0;
+    copy->hsmkey = NULL;
+    copy->zone_count = 0;
+    copy->zone = NULL;
+    copy->name = strdup(policy->name);
+    copy->description = strdup(policy->description);
+    copy->denial_salt = strdup(policy->denial_salt);
+    if (!copy->name || !copy->description || !copy->denial_salt) {
+        dbw_policy_free((struct dbrow *)copy);
+        return NULL;
+    }
+    return copy;
+}
+
+/* Copy the data of a policykey, not its relations */
+static struct dbw_policykey *
+dbw_policykey_dup(const struct dbw_policykey *policykey)
+{
+    struct dbw_policykey *copy = malloc(sizeof (struct dbw_policykey));
+    if (!copy) return NULL;
+    memcpy(copy, policykey, sizeof (struct dbw_policykey));
+    copy->dirty = DBW_CLEAN;
+    copy->scratch = 0;
+    copy->policy = NULL;
+    if (!(copy->repository = strdup(policykey->repository))) {
+        free(copy);
+        return NULL;
+    }
+    return copy;
+}
+
+/* Deep copy policy, including policykeys, into the lists of db. On failure
+ * nothing is added, so the caller can still read the policy from the
+ * database. */
+static int
+dbw_policy_dup_into(struct dbw_db *db, const struct dbw_policy *policy)
+{
+    size_t npolicykeys = db->policykeys->n;
+    struct dbw_policy *copy = dbw_policy_dup(policy);
+    if (!copy || list_add(db->policies, (struct dbrow *)copy)) {
+        dbw_policy_free((struct dbrow *)copy);
+        return 1;
+    }
+    for (int i = 0; i < policy->policykey_count; i++) {
+        struct dbw_policykey *pk = dbw_policykey_dup(policy->policykey[i]);
+        if (!pk || list_add(db->policykeys, (struct dbrow *)pk)) {
+            dbw_policykey_free((struct dbrow *)pk);
+            while (db->policykeys->n > npolicykeys)
+                dbw_policykey_free(db->policykeys->set[--db->policykeys->n]);
+            dbw_policy_free(db->policies->set[--db->policies->n]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void
+dbw_policy_cache_entry_free(struct dbw_policy_cache *entry)
+{
+    for (int i = 0; i < entry->policy->policykey_count; i++)
+        dbw_policykey_free((struct dbrow *)entry->policy->policykey[i]);
+    dbw_policy_free((struct dbrow *)entry->policy);
+    free(entry);
+}
+
+/* Store a copy of policy and its policykeys, replacing any older entry */
+static void
+dbw_policy_cache_store(const struct dbw_policy *policy)
+{
+    struct dbw_policy_cache *entry, **prev;
+    struct dbw_policy *copy;
+
+    if (!(entry = calloc(1, sizeof (struct dbw_policy_cache)))) return;
+    if (!(entry->policy = copy = dbw_policy_dup(policy))) {
+        free(entry);
+        return;
+    }
+    for (int i = 0; i < policy->policykey_count; i++) {
+        struct dbw_policykey *pk = dbw_policykey_dup(policy->policykey[i]);
+        if (!pk || append((void ***)&copy->policykey, &copy->policykey_count, pk)) {
+            dbw_policykey_free((struct dbrow *)pk);
+            dbw_policy_cache_entry_free(entry);
+            return;
+        }
+        pk->policy = copy;
+    }
+    pthread_mutex_lock(&policy_cache_lock);
+    for (prev = &policy_cache; *prev; prev = &(*prev)->next) {
+        if ((*prev)->policy->id != policy->id) continue;
+        struct dbw_policy_cache *old = *prev;
+        *prev = old->next;
+        dbw_policy_cache_entry_free(old);
+        break;
+    }
+    entry->next = policy_cache;
+    policy_cache = entry;
+    pthread_mutex_unlock(&policy_cache_lock);
+}
+
+/* Copy policy with given id and revision from cache into db.
+ * return 0 on cache hit, 1 otherwise */
+static int
+dbw_policy_cache_fetch(struct dbw_db *db, int id, int revision)
+{
+    int r = 1;
+    pthread_mutex_lock(&policy_cache_lock);
+    for (struct dbw_policy_cache *entry = policy_cache; entry; entry = entry->next) {
+        if (entry->policy->id != id) continue;
+        if (entry->policy->revision == revision)
+            r = dbw_policy_dup_into(db, entry->policy);
+        break;
+    }
+    pthread_mutex_unlock(&policy_cache_lock);
+    return r;
+}
+
+/* Drop the entry of a policy that no longer exists */
+static void
+dbw_policy_cache_evict(int id)
+{
+    struct dbw_policy_cache **prev;
+    pthread_mutex_lock(&policy_cache_lock);
+    for (prev = &policy_cache; *prev; prev = &(*prev)->next) {
+        if ((*prev)->policy->id != id) continue;
+        struct dbw_policy_cache *old = *prev;
+        *prev = old->next;
+        dbw_policy_cache_entry_free(old);
+        break;
+    }
+    pthread_mutex_unlock(&policy_cache_lock);
+}
+
+void
+dbw_policy_cache_clear(void)
+{
+    pthread_mutex_lock(&policy_cache_lock);
+    while (policy_cache) {
+        struct dbw_policy_cache *entry = policy_cache;
+        policy_cache = entry->next;
+        dbw_policy_cache_entry_free(entry);
+    }
+    pthread_mutex_unlock(&policy_cache_lock);
+}
+
+/**
+ * Add policy with given id and its policykeys to db. Only the policy row is
+ * read when the cached copy is still current.
+ */
+static int
+dbw_fetch_policy(struct dbw_db *db, db_connection_t *conn, int id)
+{
+    struct db_value dbid;
+    policy_t *dbx_obj;
+    struct dbw_policy *policy;
+    struct dbw_list *policykeys;
+
+    if (list_contains(db->policies, id)) return 0;
+
+    memset(&dbid, 0, sizeof (dbid));
+    if (db_value_from_int32(&dbid, id) || !(dbx_obj = policy_new(conn)))
+        return 1;
+    if (policy_get_by_id(dbx_obj, &dbid)) {
+        policy_free(dbx_obj);
+        return 1;
+    }
+    if (!dbw_policy_cache_fetch(db, id, dbxvalue2int(&dbx_obj->rev))) {
+        policy_free(dbx_obj);
+        return 0;
+    }
+    policy = policy_dbx_to_dbw(dbx_obj);
+    policy_free(dbx_obj);
+    if (!policy) return 1;
+    if (list_add(db->policies, (struct dbrow *)policy)) {
+        dbw_policy_free((struct dbrow *)policy);
+        return 1;
+    }
+    policykeys = dbw_fetch_by_ids(conn, dbw_policykeys, "policyId", &id, 1);
+    if (!policykeys) return 1;
+    /* Link them temporarily to fill the cache, merge will redo this. */
+    for (size_t i = 0; i < policykeys->n; i++) {
+        if (append((void ***)&policy->policykey, &policy->policykey_count,
+                policykeys->set[i]))
+        {
+            dbw_list_free(policykeys);
+            return 1;
+        }
+    }
+    dbw_policy_cache_store(policy);
+    free(policy->policykey);
+    policy->policykey = NULL;
+    policy->policykey_count = 0;
+    return list_extend(db->policykeys, policykeys);
+}
+
+/**
+ * Count the keys, not belonging to zone, that use hsmkey. Needed to
+ * decide if a shared hsmkey can be released.
+ */
+static int
+dbw_count_foreign_keys(db_connection_t *conn, struct dbw_hsmkey *hsmkey,
+    int zone_id)
+{
+    struct db_value hsmkey_id, zid;
+    db_clause_list_t *clauses;
+    db_clause_t *clause;
+    key_data_t *dbx_obj;
+    size_t count = 0;
+
+    memset(&hsmkey_id, 0, sizeof (hsmkey_id));
+    memset(&zid, 0, sizeof (zid));
+    if (db_value_from_int32(&hsmkey_id, hsmkey->id)
+        || db_value_from_int32(&zid, zone_id)
+        || !(clauses = db_clause_list_new()))
+    {
+        return 1;
+    }
+    if (!key_data_hsm_key_id_clause(clauses, &hsmkey_id)
+        || !(clause = key_data_zone_id_clause(clauses, &zid))
+        || db_clause_set_type(clause, DB_CLAUSE_NOT_EQUAL)
+        || !(dbx_obj = key_data_new(conn)))
+    {
+        db_clause_list_free(clauses);
+        return 1;
+    }
+    int r = key_data_count(dbx_obj, clauses, &count);
+    key_data_free(dbx_obj);
+    db_clause_list_free(clauses);
+    hsmkey->foreign_key_count = count;
+    return r;
+}
+
+/**
+ * Fetch the hsmkeys of the policy update() might assign to the zone: the
+ * unused ones and, for policies sharing keys, the shared ones.
+ */
+static struct dbw_list *
+dbw_fetch_hsmkey_pool(db_connection_t *conn, struct dbw_policy *policy)
+{
+    struct db_value policy_id;
+    db_clause_list_t *clauses, *states;
+    db_clause_t *clause;
+    struct dbw_list *list;
+
+    memset(&policy_id, 0, sizeof (policy_id));
+    if (db_value_from_int32(&policy_id, policy->id)
+        || !(clauses = db_clause_list_new()))
+    {
+        return NULL;
+    }
+    if (!(states = db_clause_list_new())) {
+        db_clause_list_free(clauses);
+        return NULL;
+    }
+    if (!hsm_key_state_clause(states, HSM_KEY_STATE_UNUSED)
+        || (policy->keys_shared
+            && (!(clause = hsm_key_state_clause(states, HSM_KEY_STATE_SHARED))
+                || db_clause_set_operator(clause, DB_CLAUSE_OPERATOR_OR))))
+    {
+        db_clause_list_free(states);
+        db_clause_list_free(clauses);
+        return NULL;
+    }
+    if (!hsm_key_policy_id_clause(clauses, &policy_id)
+        || !(clause = db_clause_new()))
+    {
+        db_clause_list_free(states);
+        db_clause_list_free(clauses);
+        return NULL;
+    }
+    if (db_clause_set_list(clause, states)) {
+        db_clause_free(clause);
+        db_clause_list_free(states);
+        db_clause_list_free(clauses);
+        return NULL;
+    }
+    if (db_clause_list_add(clauses, clause)) {
+        db_clause_free(clause);
+        db_clause_list_free(clauses);
+        return NULL;
+    }
+    list = dbw_hsmkeys(conn, 1, clauses);
+    db_clause_list_free(clauses);
+    return list;
+}
+
+static int
+dbw_fetch_zone_rows(struct dbw_db *db, db_connection_t *conn,
+    char const *zonename)
+{
+    struct dbw_zone *zone;
+    struct dbw_list *list;
+    int *ids = NULL;
+    size_t n = 0;
+
+    /* Zone. Not finding it is not an error, the caller will notice. */
+    zone_db_t *dbx_zone = zone_db_new_get_by_name(conn, zonename);
+    if (!dbx_zone) return 0;
+    zone = zone_dbx_to_dbw(dbx_zone);
+    zone_db_free(dbx_zone);
+    if (!zone) return 1;
+    if (list_add(db->zones, (struct dbrow *)zone)) {
+        dbw_zone_free((struct dbrow *)zone);
+        return 1;
+    }
+
+    /* Its policy */
+    if (dbw_fetch_policy(db, conn, zone->policy_id)) return 1;
+
+    /* Keys and key dependencies of the zone */
+    list = dbw_fetch_by_ids(conn, dbw_keys, "zoneId", &zone->id, 1);
+    if (!list || list_extend(db->keys, list)) {
+        dbw_list_free(list);
+        return 1;
+    }
+    list = dbw_fetch_by_ids(conn, dbw_keydependencies, "zoneId", &zone->id, 1);
+    if (!list || list_extend(db->keydependencies, list)) {
+        dbw_list_free(list);
+        return 1;
+    }
+
+    /* Keystates of those keys */
+    if (db->keys->n && !(ids = calloc(db->keys->n, sizeof (int)))) return 1;
+    for (n = 0; n < db->keys->n; n++)
+        ids[n] = db->keys->set[n]->id;
+    list = dbw_fetch_by_ids(conn, dbw_keystates, "keyDataId", ids, n);
+    if (!list || list_extend(db->keystates, list)) {
+        free(ids);
+        dbw_list_free(list);
+        return 1;
+    }
+
+    /* Hsmkeys available to the policy and those referenced by the keys */
+    list = dbw_fetch_hsmkey_pool(conn, (struct dbw_policy *)db->policies->set[0]);
+    if (!list || list_extend(db->hsmkeys, list)) {
+        free(ids);
+        dbw_list_free(list);
+        return 1;
+    }
+    n = 0;
+    for (size_t k = 0; k < db->keys->n; k++) {
+        int hsmkey_id = ((struct dbw_key *)db->keys->set[k])->hsmkey_id;
+        int dup = list_contains(db->hsmkeys, hsmkey_id);
+        for (size_t i = 0; i < n && !dup; i++) dup = (ids[i] == hsmkey_id);
+        if (!dup) ids[n++] = hsmkey_id;
+    }
+    list = dbw_fetch_by_ids(conn, dbw_hsmkeys, "id", ids, n);
+    free(ids);
+    if (!list || list_extend(db->hsmkeys, list)) {
+        dbw_list_free(list);
+        return 1;
+    }
+    for (size_t h = 0; h < db->hsmkeys->n; h++) {
+        struct dbw_hsmkey *hsmkey = (struct dbw_hsmkey *)db->hsmkeys->set[h];
+        /* A key of this zone may still use an hsmkey of its previous
+         * policy. */
+        if (dbw_fetch_policy(db, conn, hsmkey->policy_id)) return 1;
+        if (hsmkey->state == DBW_HSMKEY_SHARED
+            && dbw_count_foreign_keys(conn, hsmkey, zone->id))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+struct dbw_db *
+dbw_fetch_zone(db_connection_t *conn, char const *zonename)
+{
+    struct dbw_db *db = calloc(1, sizeof(struct dbw_db));
+    if (!db) {
+        ods_log_error("[dbw_fetch_zone] Memory allocation failure.");
+        return NULL;
+    }
+    db->conn            = conn;
+    db->policies        = dbw_policies(conn, 0, NULL);
+    db->zones           = dbw_zones(conn, 0, NULL);
+    db->keys            = dbw_keys(conn, 0, NULL);
+    db->keystates       = dbw_keystates(conn, 0, NULL);
+    db->hsmkeys         = dbw_hsmkeys(conn, 0, NULL);
+    db->policykeys      = dbw_policykeys(conn, 0, NULL);
+    db->keydependencies = dbw_keydependencies(conn, 0, NULL);
+    if (!db->policies || !db->zones || !db->keys || !db->keystates ||
+            !db->hsmkeys || !db->policykeys || !db->keydependencies)
+    {
+        dbw_free(db);
+        ods_log_error("[dbw_fetch_zone] Memory allocation failure.");
+        return NULL;
+    }
+
+    if (pthread_rwlock_rdlock(&db_lock)) {
+        ods_log_error("[dbw_fetch_zone] Unable to obtain database read lock.");
+        dbw_free(db);
+        return NULL;
+    }
+    int r = dbw_fetch_zone_rows(db, conn, zonename);
+    (void)pthread_rwlock_unlock(&db_lock);
+    if (r) {
+        dbw_free(db);
+        ods_log_error("[dbw_fetch_zone] Failed to read zone %s from database.",
+            zonename);
+        return NULL;
+    }
+    merge_pl_pk(db->policies, db->policykeys);
+    merge_pl_hk(db->policies, db->hsmkeys);
+    merge_pl_zn(db->policies, db->zones);
+    merge_zn_kd(db->zones,    db->keys);
+    merge_kd_ks(db->keys,     db->keystates);
+    merge_hk_kd(db->hsmkeys,  db->keys);
+    merge_zn_dp(db->zones,    db->keydependencies);
+    merge_kt_dp(db->keys,     db->keydependencies);
+    merge_kf_dp(db->keys,     db->keydependencies);
+    return db;
+}
+
 static int
 dbw_commit_list(const db_connection_t *conn, struct dbw_list *list)
 {
@@ -1336,25 +1864,63 @@ dbw_commit_list(const db_connection_t *conn, struct dbw_list *list)
     return 0;
 }
 
+static int
+cmp_int(const void *a, const void *b)
+{
+    int l = *(const int *)a, r = *(const int *)b;
+    return (l > r) - (l < r);
+}
+
+static int
+cmp_row_id(const void *a, const void *b)
+{
+    int l = (*(struct dbrow * const *)a)->id;
+    int r = (*(struct dbrow * const *)b)->id;
+    return (l > r) - (l < r);
+}
+
+/**
+ * Verify that none of the rows marked for update has been modified in the
+ * database since it was read. The current revisions are read with one query
+ * per DBW_IDS_PER_QUERY rows rather than one query per row.
+ */
 static int
 dbw_verify_list_revisions(const db_connection_t *conn, struct dbw_list *list)
 {
-    struct db_value id;
-    memset(&id, 0, sizeof(struct db_value));
-    id.type = DB_TYPE_INT64;
+    size_t n = 0;
+    int *ids = malloc(list->n * sizeof(int));
+    if (list->n && !ids) return 1;
     for (size_t i = 0; i < list->n; i++) {
         struct dbrow *row = list->set[i];
         if (row->dirty != DBW_UPDATE) continue;
-        id.int64 = row->id;
-        if (list->revision(conn, &id) != row->revision) {
+        ids[n++] = row->id;
+    }
+    if (!n) {
+        free(ids);
+        return 0;
+    }
+    qsort(ids, n, sizeof(int), cmp_int);
+    struct dbw_list *current = dbw_fetch_by_ids(conn, list->fetch, "id", ids, n);
+    free(ids);
+    if (!current) return 1;
+    qsort(current->set, current->n, sizeof(struct dbrow *), cmp_row_id);
+    int r = 0;
+    for (size_t i = 0; i < list->n; i++) {
+        struct dbrow *row = list->set[i];
+        if (row->dirty != DBW_UPDATE) continue;
+        struct dbrow key = {.id = row->id}, *keyp = &key;
+        struct dbrow **found = bsearch(&keyp, current->set, current->n,
+            sizeof(struct dbrow *), cmp_row_id);
+        if (!found || (*found)->revision != row->revision) {
             ods_log_debug("[dbw_verify_revisions] collision detected on id %d", row->id);
-            return 1;
+            r = 1;
+            break;
         }
     }
-    return 0;
+    dbw_list_free(current);
+    return r;
 }
 
-
 static int
 dbw_verify_revisions(struct dbw_db *db)
 {
@@ -1388,6 +1954,11 @@ dbw_commit(struct dbw_db *db)
         (void)pthread_rwlock_unlock(&db_lock);
         return 1;
     }
+    if (db_connection_transaction_begin(db->conn)) {
+        ods_log_error("[dbw_commit] Unable to start database transaction.");
+        (void)pthread_rwlock_unlock(&db_lock);
+        return 1;
+    }
     int r = 0;
     r |= dbw_commit_list(db->conn, db->policies);
     r |= dbw_commit_list(db->conn, db->policykeys);
@@ -1396,6 +1967,13 @@ dbw_commit(struct dbw_db *db)
     r |= dbw_commit_list(db->conn, db->keys);
     r |= dbw_commit_list(db->conn, db->keystates);
     r |= dbw_commit_list(db->conn, db->keydependencies);
+    if (r) {
+        ods_log_error("[dbw_commit] Failed to write changes, rolling back.");
+        (void)db_connection_transaction_rollback(db->conn);
+    } else if (db_connection_transaction_commit(db->conn)) {
+        ods_log_error("[dbw_commit] Unable to commit database transaction.");
+        r = 1;
+    }
     (void)pthread_rwlock_unlock(&db_lock);
     return r;
 }
@@ -1455,31 +2033,6 @@ dbw_get_hsmkey(struct dbw_db *db, char const *locator)
     return NULL;
 }
 
-/* Add object to array */
-static int
-append(void ***array, int *count, void *obj)
-{
-    int c = (*count) + 1;
-    void **new = realloc((*array), c * sizeof(void *));
-    if (!new) return 1;
-    new[*count] = obj;
-    (*array) = new;
-    (*count) = c;
-    return 0;
-}
-
-static int
-list_add(struct dbw_list *list, struct dbrow *row)
-{
-    size_t c = list->n + 1;
-    struct dbrow **new = realloc(list->set, c * sizeof(struct dbrow *));
-    if (!new) return 1;
-    new[list->n] = row;
-    list->set = new;
-    list->n = c;
-    return 0;
-}
-
 int
 dbw_add_keystate(struct dbw_db *db, struct dbw_key *key, struct dbw_keystate *keystate)
 {
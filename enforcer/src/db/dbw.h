@@ -307,6 +307,9 @@ struct dbw_hsmkey {
     unsigned int is_revoked;
     unsigned int key_type;
     unsigned int backup;
+    /** Keys of zones not in this dbw_db using this hsmkey. Only set by
+     * dbw_fetch_zone() */
+    unsigned int foreign_key_count;
 };
 
 struct dbw_zone {
@@ -347,7 +350,8 @@ struct dbw_list {
     size_t n;
     void (*free)(struct dbrow *);
     int (*update)(const db_connection_t *, struct dbrow *);
-    int (*revision)(const db_connection_t *, struct db_value *);
+    struct dbw_list *(*fetch)(const db_connection_t *, int,
+        const db_clause_list_t *);
 };
 
 struct dbw_db {
@@ -390,6 +394,24 @@ struct dbw_db *dbw_fetch(db_connection_t *conn);
  */
 struct dbw_db *dbw_fetch_filtered(db_connection_t *conn, int mask);
 
+/**
+ * Read only the records a single zone depends on: the zone, its policy and
+ * policykeys, its keys, keystates and keydependencies, the hsmkeys used by
+ * its keys and the hsmkeys the policy can still hand out. The amount of work
+ * does not depend on the number of zones in the database. Policies are
+ * served from a cache when their revision did not change. Guarded by a R/W
+ * lock.
+ *
+ * If the zone does not exist an empty structure is returned.
+ * return NULL on failure
+ */
+struct dbw_db *dbw_fetch_zone(db_connection_t *conn, char const *zonename);
+
+/**
+ * Drop all cached policies.
+ */
+void dbw_policy_cache_clear(void);
+
 /**
  * Commit changes to the database. Guarded by a R/W lock. Only records marked
  * as dirty will be considered for writing.
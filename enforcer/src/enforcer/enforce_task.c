@@ -48,6 +48,22 @@
 
 static const char *module_str = "enforce_task";
 
+/* Owner of the task enforcing all zones at once when BatchEnforce is set */
+static const char *batch_owner = "[all zones]";
+
+/* Set by enforce_task_flush_all() to have the next batch pass enforce every
+ * zone rather than just the zones that are due. */
+static pthread_mutex_t batch_lock = PTHREAD_MUTEX_INITIALIZER;
+static int batch_flush_pending = 0;
+
+static void
+set_batch_flush_pending(int pending)
+{
+    pthread_mutex_lock(&batch_lock);
+    batch_flush_pending |= pending;
+    pthread_mutex_unlock(&batch_lock);
+}
+
 static void
 schedule_ds_tasks(engine_type *engine, struct dbw_zone *zone)
 {
@@ -86,7 +102,7 @@ static time_t
 perform_enforce(int sockfd, engine_type *engine, char const *zonename,
     db_connection_t *dbconn)
 {
-    struct dbw_db *db = dbw_fetch(dbconn);
+    struct dbw_db *db = dbw_fetch_zone(dbconn, zonename);
     if (!db) {
         ods_log_error("[%s] Error reading database", module_str);
         return -1;
@@ -133,11 +149,109 @@ perform_enforce(int sockfd, engine_type *engine, char const *zonename,
     return t_next;
 }
 
+/**
+ * Enforce all zones that are due (or all zones after a flush) against a
+ * single snapshot of the database and commit the result in one transaction.
+ * Returns the earliest next_change of all zones.
+ */
+static time_t
+perform_enforce_batch(engine_type *engine, db_connection_t *dbconn)
+{
+    pthread_mutex_lock(&batch_lock);
+    int all = batch_flush_pending;
+    batch_flush_pending = 0;
+    pthread_mutex_unlock(&batch_lock);
+
+    struct dbw_db *db = dbw_fetch(dbconn);
+    char *enforced = db ? calloc(db->zones->n + 1, sizeof(char)) : NULL;
+    if (!enforced) {
+        ods_log_error("[%s] Error reading database", module_str);
+        dbw_free(db);
+        set_batch_flush_pending(all);
+        return schedule_DEFER;
+    }
+    time_t now = time_now();
+    time_t t_first = -1;
+    size_t count = 0, updated = 0;
+    for (size_t z = 0; z < db->zones->n; z++) {
+        struct dbw_zone *zone = (struct dbw_zone *)db->zones->set[z];
+        if (!all && (zone->next_change < 0 || zone->next_change > now)) {
+            if (zone->next_change >= 0 && (t_first < 0 || zone->next_change < t_first))
+                t_first = zone->next_change;
+            continue;
+        }
+        time_t t_next;
+        int zone_updated = 0;
+        if (zone->policy->passthrough) {
+            ods_log_info("Passing through zone %s.\n", zone->name);
+            t_next = schedule_SUCCESS;
+        } else {
+            t_next = update(engine, db, zone, now, &zone_updated);
+        }
+        if (zone->next_change != t_next && t_next >= 0) {
+            zone_updated = 1;
+            dbw_mark_dirty((struct dbrow *)zone);
+        }
+        if (zone_updated) {
+            zone->next_change = t_next;
+            updated++;
+        }
+        if (t_next >= 0 && (t_first < 0 || t_next < t_first))
+            t_first = t_next;
+        enforced[z] = 1;
+        count++;
+    }
+    /* Commit all zones to database before we schedule signconf */
+    if (updated && dbw_commit(db)) {
+        ods_log_error("[%s] Unable to commit changes to %zu zones to "
+            "database, deferring.", module_str, updated);
+        free(enforced);
+        dbw_free(db);
+        set_batch_flush_pending(all);
+        return schedule_DEFER;
+    }
+    for (size_t z = 0; z < db->zones->n; z++) {
+        struct dbw_zone *zone = (struct dbw_zone *)db->zones->set[z];
+        if (!enforced[z]) continue;
+        if (zone->signconf_needs_writing || zone->policy->passthrough) {
+            signconf_task_flush_zone(engine, dbconn, zone->name);
+        }
+        schedule_ds_tasks(engine, zone);
+    }
+    ods_log_info("[%s] enforced %zu zones, %zu updated", module_str,
+        count, updated);
+    free(enforced);
+    dbw_free(db);
+    return t_first < 0 ? schedule_SUCCESS : t_first;
+}
+
+static time_t
+enforce_task_perform_batch(task_type* task, char const *owner, void *userdata,
+    void *context)
+{
+    (void)task; (void)owner;
+    db_connection_t* dbconn = (db_connection_t*) context;
+    return perform_enforce_batch((engine_type *)userdata, dbconn);
+}
+
+static task_type *
+enforce_task_batch(engine_type *engine, time_t due)
+{
+    return task_create(strdup(batch_owner), TASK_CLASS_ENFORCER,
+        TASK_TYPE_ENFORCE, enforce_task_perform_batch, engine, NULL, due);
+}
+
 time_t
 enforce_task_perform(task_type* task, char const *owner, void *userdata, void *context)
 {
     db_connection_t* dbconn = (db_connection_t*) context;
-    return perform_enforce(-1, (engine_type *)userdata, owner, dbconn);
+    engine_type *engine = (engine_type *)userdata;
+    time_t t_next = perform_enforce(-1, engine, owner, dbconn);
+    if (!engine->config->batch_enforce || t_next < 0) return t_next;
+    /* Leave the next run of this zone to the batch task. Scheduling
+     * replaces an existing batch task keeping the earliest due date. */
+    (void)schedule_task(engine->taskq, enforce_task_batch(engine, t_next), 1, 0);
+    return schedule_SUCCESS;
 }
 
 task_type *
@@ -165,6 +279,11 @@ enforce_task_flush_policy(engine_type *engine, struct dbw_policy *policy)
 void
 enforce_task_flush_all(engine_type *engine, db_connection_t *dbconn)
 {
+    if (engine->config->batch_enforce) {
+        set_batch_flush_pending(1);
+        (void)schedule_task(engine->taskq, enforce_task_batch(engine, time_now()), 1, 0);
+        return;
+    }
     struct dbw_db *db = dbw_fetch(dbconn);
     if (!db) ods_fatal_exit("[%s] failed to list zones from DB", module_str);
     for (size_t z = 0; z < db->zones->n; z++) {
@@ -46,7 +46,8 @@ void enforce_task_flush_zone(engine_type *engine, char const *zonename);
 /* Schedule enforce tasks for *now* for ALL zones of policy. */
 void enforce_task_flush_policy(engine_type *engine, struct dbw_policy *policy);
 
-/* Schedule enforce tasks for *now* for ALL zones. */
+/* Schedule enforce tasks for *now* for ALL zones. With BatchEnforce
+ * configured a single task enforces all zones in one pass. */
 void enforce_task_flush_all(engine_type *engine, db_connection_t *dbconn);
 
 #endif
@@ -36,6 +36,7 @@
 #include "daemon/engine.h"
 #include "duration.h"
 #include "libhsm.h"
+#include "libhsmdns.h"
 
 #include <pthread.h>
 #include <math.h>
@@ -214,6 +215,12 @@ generate_libhsm_key(hsm_ctx_t *ctx, struct dbw_policykey *policykey)
         case LDNS_ECDSAP384SHA384:
             key = hsm_generate_ecdsa_key(ctx, policykey->repository, "P-384");
             break;
+        case LDNS_ED25519:
+            key = hsm_generate_eddsa_key(ctx, policykey->repository, "edwards25519");
+            break;
+        case LDNS_ED448:
+            key = hsm_generate_eddsa_key(ctx, policykey->repository, "edwards448");
+            break;
         default:
             ods_log_error("[hsmkey_factory] Unsupported algorithm (%d) requested.", policykey->algorithm);
             key = NULL;
@@ -472,6 +479,8 @@ hsm_key_factory_release_key_mockup(struct dbw_hsmkey *hsmkey, struct dbw_key *ke
 {
     int c = hsmkey->key_count;
     if (c == 1 && hsmkey->key[0] == key) c--;
+    /* keys of zones that were not fetched along */
+    c += hsmkey->foreign_key_count;
     if (c > 0) {
         ods_log_debug("[hsm_key_factory_release_key] unable to release hsm_key, in use");
     } else {
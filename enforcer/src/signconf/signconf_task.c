@@ -27,7 +27,18 @@
  *
  */
 
+#include "config.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
 #include "signconf/signconf_xml.h"
+#include "clientpipe.h"
 #include "duration.h"
 #include "log.h"
 #include "file.h"
@@ -38,12 +49,180 @@
 
 static const char *module_str = "signconf_cmd";
 
+/* Owner of the task notifying the signer of all exported zones at once */
+static const char *notify_owner = "[signer]";
+
+#define SIGNER_BATCH_CMD "update --batch"
+
+/* Zones whose signconf has been exported but not yet announced to the
+ * signer. Drained by the notify task. */
+static pthread_mutex_t notify_lock = PTHREAD_MUTEX_INITIALIZER;
+static char **notify_zones = NULL;
+static size_t notify_count = 0;
+static size_t notify_size = 0;
+
+static int
+notify_push(const char *zonename)
+{
+    char **zones;
+    char *name = strdup(zonename);
+    if (!name) return 1;
+    pthread_mutex_lock(&notify_lock);
+    if (notify_count == notify_size) {
+        size_t size = notify_size ? 2 * notify_size : 64;
+        zones = realloc(notify_zones, size * sizeof(char *));
+        if (!zones) {
+            pthread_mutex_unlock(&notify_lock);
+            free(name);
+            return 1;
+        }
+        notify_zones = zones;
+        notify_size = size;
+    }
+    notify_zones[notify_count++] = name;
+    pthread_mutex_unlock(&notify_lock);
+    return 0;
+}
+
+static int
+readall(int sockfd, char *buf, size_t n)
+{
+    ssize_t r;
+    while (n > 0) {
+        r = read(sockfd, buf, n);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return 1;
+        buf += r;
+        n -= r;
+    }
+    return 0;
+}
+
+/**
+ * Consume the signers response to one command. Returns its exit code,
+ * or -1 when the connection broke.
+ */
+static int
+signer_response(int sockfd)
+{
+    char hdr[3], data[ODS_SE_MAXLINE+1];
+    uint16_t datalen;
+
+    for (;;) {
+        if (readall(sockfd, hdr, 3)) return -1;
+        datalen = ntohs(*(uint16_t *)(hdr+1));
+        if (datalen > ODS_SE_MAXLINE || readall(sockfd, data, datalen))
+            return -1;
+        data[datalen] = '\0';
+        if (hdr[0] == CLIENT_OPC_EXIT) {
+            return datalen ? data[0] : 0;
+        } else if (hdr[0] == CLIENT_OPC_STDERR) {
+            ods_log_error("[%s] signer: %s", module_str, data);
+        } else {
+            ods_log_debug("[%s] signer: %s", module_str, data);
+        }
+    }
+}
+
+static int
+signer_connect(const char *socketfile)
+{
+    struct sockaddr_un addr;
+    int sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sockfd < 0) return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socketfile, sizeof(addr.sun_path) - 1);
+    if (connect(sockfd, (const struct sockaddr*) &addr, sizeof(addr)) == -1) {
+        int err = errno;
+        close(sockfd);
+        errno = err;
+        return -1;
+    }
+    return sockfd;
+}
+
+/**
+ * Announce all pending zones to the signer over a single connection to
+ * its command socket. Zones are packed into as few 'update --batch'
+ * commands as fit in a message.
+ */
+static time_t
+perform_notify(task_type* task, char const *owner, void *userdata,
+    void *context)
+{
+    (void)task; (void)owner; (void)context;
+    engine_type *engine = (engine_type *)userdata;
+    char cmd[ODS_SE_MAXLINE];
+    char **zones;
+    size_t count, z, len, n, msgs = 0;
+    int sockfd, ret = 0;
+    time_t start = time_now();
+
+    pthread_mutex_lock(&notify_lock);
+    zones = notify_zones;
+    count = notify_count;
+    notify_zones = NULL;
+    notify_count = notify_size = 0;
+    pthread_mutex_unlock(&notify_lock);
+    if (!count) return schedule_SUCCESS;
+
+    sockfd = signer_connect(engine->config->clisock_filename_signer);
+    if (sockfd == -1) {
+        ods_log_error("[%s] unable to notify signer of signconf changes "
+            "for %zu zones: %s", module_str, count, strerror(errno));
+    }
+    for (z = 0; z < count && sockfd != -1; msgs++) {
+        size_t first = z;
+        len = strlen(SIGNER_BATCH_CMD);
+        memcpy(cmd, SIGNER_BATCH_CMD, len);
+        for (; z < count; z++) {
+            n = strlen(zones[z]);
+            if (len + 1 + n >= sizeof(cmd)) break;
+            cmd[len++] = ' ';
+            memcpy(cmd + len, zones[z], n);
+            len += n;
+        }
+        if (z == first) {
+            ods_log_error("[%s] zone name %s too long to notify signer",
+                module_str, zones[z]);
+            z++;
+            continue;
+        }
+        if (!client_stdin(sockfd, cmd, len)
+            || (ret = signer_response(sockfd)) == -1)
+        {
+            ods_log_error("[%s] unable to notify signer of signconf changes "
+                "for %zu zones: connection lost", module_str, count - first);
+            break;
+        } else if (ret) {
+            ods_log_warning("[%s] signer did not accept all %zu zones, "
+                "it updated its zone list instead", module_str, z - first);
+        }
+    }
+    if (sockfd != -1) {
+        close(sockfd);
+        ods_log_info("[%s] notified signer of %zu zones in %zu messages "
+            "(%lds)", module_str, count, msgs, (long)(time_now() - start));
+    }
+    for (z = 0; z < count; z++) free(zones[z]);
+    free(zones);
+    return schedule_SUCCESS;
+}
+
+static task_type *
+notify_task(engine_type *engine)
+{
+    return task_create(strdup(notify_owner), TASK_CLASS_ENFORCER,
+        TASK_TYPE_SIGNCONF, perform_notify, engine, NULL, time_now());
+}
+
 static time_t
 perform(task_type* task, char const *zonename, void *userdata, void *context)
 {
-    (void)userdata;
+    (void)task;
     int ret;
-    char cmd[SYSTEM_MAXLEN];
+    engine_type *engine = (engine_type *)userdata;
     db_connection_t* dbconn = (db_connection_t*) context;
 
     ods_log_info("[%s] performing signconf for zone %s", module_str,
@@ -61,14 +240,15 @@ perform(task_type* task, char const *zonename, void *userdata, void *context)
 
     ods_log_info("[%s] signconf done for zone %s, notifying signer",
         module_str, zonename);
-        
-    /* TODO: do this better, connect directly or use execve() */
-    if (snprintf(cmd, sizeof(cmd), "%s %s", SIGNER_CLI_UPDATE, zonename) >= (int)sizeof(cmd)
-        || system(cmd))
-    {
-        ods_log_error("[%s] unable to notify signer of signconf changes for zone %s!",
-            module_str, zonename);
+
+    /* Queue the zone for the notify task. It is due now, so it sorts
+     * after signconf tasks already scheduled and picks them all up. */
+    if (notify_push(zonename)) {
+        ods_log_error("[%s] unable to notify signer of signconf changes "
+            "for zone %s!", module_str, zonename);
+        return schedule_SUCCESS;
     }
+    (void)schedule_task(engine->taskq, notify_task(engine), 1, 0);
     return schedule_SUCCESS;
 }
 
@@ -77,7 +257,7 @@ signconf_task_flush_zone(engine_type *engine, db_connection_t *dbconn,
     const char* zonename)
 {
     task_type* task = task_create(strdup(zonename), TASK_CLASS_ENFORCER,
-        TASK_TYPE_SIGNCONF, perform, NULL, NULL, time_now());
+        TASK_TYPE_SIGNCONF, perform, engine, NULL, time_now());
     (void) schedule_task(engine->taskq, task, 1, 0);
 }
 
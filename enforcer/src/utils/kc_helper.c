@@ -916,6 +916,18 @@ int check_policy(xmlNode *curNode, const char *policy_name, char **repo_list, in
 		}
 	}
 
+	/* EdDSA keys have a fixed size, 256 bits for Ed25519 (15) and 456 bits
+	 * for Ed448 (16). */
+	for (curkey = firstkey; curkey; curkey = curkey->next) {
+		if ((curkey->algo == 15 && curkey->length != 256) ||
+				(curkey->algo == 16 && curkey->length != 456)) {
+			dual_log("ERROR: Key length of %d used for algorithm %d in %s "
+					"policy in %s. Should be %d", curkey->length, curkey->algo,
+					policy_name, kasp, (curkey->algo == 15 ? 256 : 456));
+			status++;
+		}
+	}
+
 	/* Check that repositories listed in the KSK and ZSK sections are defined
 	 * in conf.xml. */
 	if (repo_list) {
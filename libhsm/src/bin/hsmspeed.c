@@ -42,6 +42,23 @@
 ldns_algorithm  algorithm = LDNS_RSASHA1;
 const char     *algoname  = "RSA/SHA1";
 
+/* Algorithms that can be measured, with the curve of the elliptic ones */
+static const struct {
+    const char     *option;
+    ldns_algorithm  algorithm;
+    const char     *name;
+    const char     *curve;
+} algorithms[] = {
+    { "rsasha1",         LDNS_RSASHA1,         "RSA/SHA1",         NULL },
+    { "rsasha256",       LDNS_RSASHA256,       "RSA/SHA256",       NULL },
+    { "rsasha512",       LDNS_RSASHA512,       "RSA/SHA512",       NULL },
+    { "ecdsap256sha256", LDNS_ECDSAP256SHA256, "ECDSA/P-256",      "P-256" },
+    { "ecdsap384sha384", LDNS_ECDSAP384SHA384, "ECDSA/P-384",      "P-384" },
+    { "ed25519",         LDNS_ED25519,         "Ed25519",          "edwards25519" },
+    { "ed448",           LDNS_ED448,           "Ed448",            "edwards448" },
+    { NULL,              0,                    NULL,               NULL }
+};
+
 extern char *optarg;
 char *progname = NULL;
 
@@ -57,7 +74,7 @@ usage ()
 {
     fprintf(stderr,
         "usage: %s "
-        "[-c config] -r repository [-i iterations] [-s keysize] [-t threads]\n",
+        "[-a algorithm] [-c config] -r repository [-i iterations] [-s keysize] [-t threads]\n",
         progname);
 }
 
@@ -146,12 +163,27 @@ main (int argc, char *argv[])
 
     int ch;
     unsigned int n;
+    const char *curve = NULL;
     double elapsed, speed;
 
     progname = argv[0];
 
-    while ((ch = getopt(argc, argv, "c:i:r:s:t:")) != -1) {
+    while ((ch = getopt(argc, argv, "a:c:i:r:s:t:")) != -1) {
         switch (ch) {
+        case 'a':
+            for (n=0; algorithms[n].option; n++) {
+                if (!strcasecmp(optarg, algorithms[n].option)) {
+                    break;
+                }
+            }
+            if (!algorithms[n].option) {
+                fprintf(stderr, "Unknown algorithm: %s\n", optarg);
+                exit(1);
+            }
+            algorithm = algorithms[n].algorithm;
+            algoname = algorithms[n].name;
+            curve = algorithms[n].curve;
+            break;
         case 'c':
             config = strdup(optarg);
             break;
@@ -211,7 +243,13 @@ main (int argc, char *argv[])
 
     /* Generate a temporary key */
     fprintf(stderr, "Generating temporary key...\n");
-    key = hsm_generate_rsa_key(ctx, repository, keysize);
+    if (algorithm == LDNS_ED25519 || algorithm == LDNS_ED448) {
+        key = hsm_generate_eddsa_key(ctx, repository, curve);
+    } else if (curve) {
+        key = hsm_generate_ecdsa_key(ctx, repository, curve);
+    } else {
+        key = hsm_generate_rsa_key(ctx, repository, keysize);
+    }
     if (key) {
         char *id = hsm_get_key_id(ctx, key);
         fprintf(stderr, "Temporary key created: %s\n", id);
@@ -267,9 +305,15 @@ main (int argc, char *argv[])
     end.tv_usec-= start.tv_usec;
     elapsed =(double)(end.tv_sec)+(double)(end.tv_usec)*.000001;
     speed = iterations / elapsed * threads;
-    printf("%d %s, %d signatures per thread, %.2f sig/s (RSA %d bits)\n",
-        threads, (threads > 1 ? "threads" : "thread"), iterations,
-        speed, keysize);
+    if (curve) {
+        printf("%d %s, %d signatures per thread, %.2f sig/s (%s)\n",
+            threads, (threads > 1 ? "threads" : "thread"), iterations,
+            speed, algoname);
+    } else {
+        printf("%d %s, %d signatures per thread, %.2f sig/s (RSA %d bits)\n",
+            threads, (threads > 1 ? "threads" : "thread"), iterations,
+            speed, keysize);
+    }
 
     /* Delete temporary key */
     fprintf(stderr, "Deleting temporary key...\n");
@@ -30,10 +30,28 @@
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <pthread.h>
 
 #include "libhsm.h"
 #include <libhsmdns.h>
 #include "hsmtest.h"
+#include <pkcs11.h>
+
+/* number of threads signing with contexts from the session pool */
+#define HSM_TEST_DRUDGERS 64
+/* number of signatures each of them makes */
+#define HSM_TEST_SIGNATURES 32
+/* number of rrsets signed in one go by hsm_test_sign_rrsets */
+#define HSM_TEST_RRSETS 4
+
+struct hsm_test_drudger {
+    pthread_t thread;
+    libhsm_key_t *key;
+    int failures;
+};
+
+static pthread_mutex_t hsm_test_lock = PTHREAD_MUTEX_INITIALIZER;
+static int hsm_test_signed;
 
 static int
 hsm_test_sign (hsm_ctx_t *ctx, libhsm_key_t *key, ldns_algorithm alg)
@@ -73,6 +91,58 @@ hsm_test_sign (hsm_ctx_t *ctx, libhsm_key_t *key, ldns_algorithm alg)
     return result;
 }
 
+/* Signs a number of rrsets through hsm_sign_rrsets and checks the
+ * signatures against those made for each rrset alone; only usable for
+ * algorithms with deterministic signatures such as EdDSA. */
+static int
+hsm_test_sign_rrsets (hsm_ctx_t *ctx, libhsm_key_t *key, ldns_algorithm alg)
+{
+    int result = 0;
+    size_t i;
+    char str[64];
+    ldns_rr_list *rrsets[HSM_TEST_RRSETS];
+    ldns_rr *signatures[HSM_TEST_RRSETS];
+    ldns_rr *rr, *sig, *dnskey_rr;
+    hsm_sign_params_t *sign_params;
+
+    for (i = 0; i < HSM_TEST_RRSETS; i++) {
+        rrsets[i] = ldns_rr_list_new();
+        snprintf(str, sizeof(str), "host%lu.example.com. IN A 192.168.0.%lu",
+                 (unsigned long)i, (unsigned long)i + 1);
+        if (ldns_rr_new_frm_str(&rr, str, 0, NULL, NULL) == LDNS_STATUS_OK)
+            ldns_rr_list_push_rr(rrsets[i], rr);
+    }
+
+    sign_params = hsm_sign_params_new();
+    sign_params->algorithm = alg;
+    sign_params->owner = ldns_rdf_new_frm_str(LDNS_RDF_TYPE_DNAME, "example.com.");
+    dnskey_rr = hsm_get_dnskey(ctx, key, sign_params);
+    sign_params->keytag = ldns_calc_keytag(dnskey_rr);
+
+    if (hsm_sign_rrsets(ctx, rrsets, HSM_TEST_RRSETS, key, sign_params,
+                        signatures)) {
+        result = 1;
+    } else {
+        for (i = 0; i < HSM_TEST_RRSETS; i++) {
+            sig = hsm_sign_rrset(ctx, rrsets[i], key, sign_params);
+            if (!sig || ldns_rdf_compare(ldns_rr_rrsig_sig(sig),
+                                         ldns_rr_rrsig_sig(signatures[i]))) {
+                result = 2;
+            }
+            ldns_rr_free(sig);
+            ldns_rr_free(signatures[i]);
+        }
+    }
+
+    for (i = 0; i < HSM_TEST_RRSETS; i++) {
+        ldns_rr_list_deep_free(rrsets[i]);
+    }
+    hsm_sign_params_free(sign_params);
+    ldns_rr_free(dnskey_rr);
+
+    return result;
+}
+
 static int
 hsm_test_random(hsm_ctx_t *ctx)
 {
@@ -103,6 +173,145 @@ hsm_test_random(hsm_ctx_t *ctx)
     return 0;
 }
 
+static void *
+hsm_test_drudge(void *arg)
+{
+    struct hsm_test_drudger *drudger = arg;
+    hsm_ctx_t *ctx;
+    int i;
+
+    for (i = 0; i < HSM_TEST_SIGNATURES; i++) {
+        ctx = hsm_pool_acquire();
+        if (!ctx || hsm_test_sign(ctx, drudger->key, LDNS_RSASHA256)) {
+            drudger->failures++;
+        }
+        hsm_pool_release(ctx);
+        pthread_mutex_lock(&hsm_test_lock);
+        hsm_test_signed++;
+        pthread_mutex_unlock(&hsm_test_lock);
+    }
+    return NULL;
+}
+
+/* sign with all drudgers, optionally resetting the token halfway */
+static int
+hsm_test_drudgers(hsm_ctx_t *ctx, const char *repository,
+                  libhsm_key_t *key, int reset)
+{
+    struct hsm_test_drudger drudgers[HSM_TEST_DRUDGERS];
+    CK_FUNCTION_LIST_PTR sym;
+    CK_SESSION_INFO info;
+    unsigned int i;
+    int done, tries, failures = 0;
+
+    hsm_test_signed = 0;
+    for (i = 0; i < HSM_TEST_DRUDGERS; i++) {
+        drudgers[i].key = key;
+        drudgers[i].failures = 0;
+        pthread_create(&drudgers[i].thread, NULL, hsm_test_drudge,
+                       &drudgers[i]);
+    }
+    if (reset) {
+        do {
+            usleep(1000);
+            pthread_mutex_lock(&hsm_test_lock);
+            done = hsm_test_signed;
+            pthread_mutex_unlock(&hsm_test_lock);
+        } while (done < HSM_TEST_DRUDGERS * HSM_TEST_SIGNATURES / 2);
+        /* simulate a token reset: close all sessions on the token,
+         * which also logs it out */
+        for (i = 0; i < ctx->session_count; i++) {
+            if (strcmp(ctx->session[i]->module->name, repository)) {
+                continue;
+            }
+            sym = (CK_FUNCTION_LIST_PTR) ctx->session[i]->module->sym;
+            if (sym->C_GetSessionInfo(ctx->session[i]->session, &info) == CKR_OK) {
+                (void) sym->C_CloseAllSessions(info.slotID);
+            }
+        }
+        for (tries = 0; hsm_pool_check() != HSM_OK && tries < 10; tries++) {
+            usleep(100000);
+        }
+        if (tries == 10) {
+            failures = -1;
+        }
+    }
+    for (i = 0; i < HSM_TEST_DRUDGERS; i++) {
+        pthread_join(drudgers[i].thread, NULL);
+        if (failures >= 0) {
+            failures += drudgers[i].failures;
+        }
+    }
+    return failures;
+}
+
+static int
+hsm_test_pool(const char *repository, hsm_ctx_t *ctx)
+{
+    libhsm_key_t *key;
+    hsm_ctx_t *poolctx;
+    int failures, errors = 0;
+
+    printf("Generating 1024-bit RSA key for the session pool... ");
+    key = hsm_generate_rsa_key(ctx, repository, 1024);
+    if (!key) {
+        printf("Failed\n");
+        hsm_print_error(ctx);
+        printf("\n");
+        return 1;
+    }
+    printf("OK\n");
+
+    hsm_pool_open(HSM_TEST_DRUDGERS / 2);
+
+    printf("Signing with %d drudgers from the session pool... ",
+           HSM_TEST_DRUDGERS);
+    failures = hsm_test_drudgers(ctx, repository, key, 0);
+    if (failures) {
+        errors++;
+        printf("Failed, %d signatures failed\n", failures);
+    } else {
+        printf("OK\n");
+    }
+
+    printf("Resetting the token while signing... ");
+    failures = hsm_test_drudgers(ctx, repository, key, 1);
+    if (failures < 0) {
+        errors++;
+        printf("Failed, sessions not recovered\n");
+        hsm_print_error(NULL);
+    } else {
+        printf("OK, %d signatures failed during the reset\n", failures);
+    }
+
+    printf("Signing with %d drudgers after the reset... ",
+           HSM_TEST_DRUDGERS);
+    failures = hsm_test_drudgers(ctx, repository, key, 0);
+    if (failures) {
+        errors++;
+        printf("Failed, %d signatures failed\n", failures);
+    } else {
+        printf("OK\n");
+    }
+
+    /* the sessions of ctx were lost in the reset */
+    printf("Deleting key... ");
+    poolctx = hsm_pool_acquire();
+    if (!poolctx || hsm_remove_key(poolctx, key)) {
+        errors++;
+        printf("Failed\n");
+        if (poolctx) hsm_print_error(poolctx);
+    } else {
+        printf("OK\n");
+    }
+    hsm_pool_release(poolctx);
+    hsm_pool_close();
+    libhsm_key_free(key);
+
+    printf("\n");
+    return errors;
+}
+
 int
 hsm_test (const char *repository, hsm_ctx_t* ctx)
 {
@@ -118,6 +327,10 @@ hsm_test (const char *repository, hsm_ctx_t* ctx)
     };
     ldns_algorithm curve;
 #endif
+    const ldns_algorithm ed_curves[] = {
+        LDNS_ED25519,
+        LDNS_ED448
+    };
 
     libhsm_key_t *key = NULL;
     char *id;
@@ -387,9 +600,82 @@ hsm_test (const char *repository, hsm_ctx_t* ctx)
     }
 #endif
 
+    /*
+     * Test key generation, signing and deletion for the Edwards curves
+     */
+    for (i=0; i<(sizeof(ed_curves)/sizeof(ldns_algorithm)); i++) {
+        if (ed_curves[i] == LDNS_ED25519) {
+            printf("Generating EdDSA Curve Ed25519 key... ");
+            key = hsm_generate_eddsa_key(ctx, repository, "edwards25519");
+        } else {
+            printf("Generating EdDSA Curve Ed448 key... ");
+            key = hsm_generate_eddsa_key(ctx, repository, "edwards448");
+        }
+        if (!key) {
+            errors++;
+            printf("Failed\n");
+            hsm_print_error(ctx);
+            printf("\n");
+            continue;
+        } else {
+            printf("OK\n");
+        }
+
+        printf("Extracting key identifier... ");
+        id = hsm_get_key_id(ctx, key);
+        if (!id) {
+            errors++;
+            printf("Failed\n");
+            hsm_print_error(ctx);
+            printf("\n");
+        } else {
+            printf("OK, %s\n", id);
+        }
+        free(id);
+
+        printf("Signing (EdDSA) with key... ");
+        result = hsm_test_sign(ctx, key, ed_curves[i]);
+        if (result) {
+            errors++;
+            printf("Failed, error: %d\n", result);
+            hsm_print_error(ctx);
+        } else {
+            printf("OK\n");
+        }
+
+        printf("Signing (EdDSA) a batch of RRsets with key... ");
+        result = hsm_test_sign_rrsets(ctx, key, ed_curves[i]);
+        if (result) {
+            errors++;
+            printf("Failed, error: %d\n", result);
+            hsm_print_error(ctx);
+        } else {
+            printf("OK\n");
+        }
+
+        printf("Deleting key... ");
+        result = hsm_remove_key(ctx, key);
+        if (result) {
+            errors++;
+            printf("Failed: error: %d\n", result);
+            hsm_print_error(ctx);
+        } else {
+            printf("OK\n");
+        }
+
+        libhsm_key_free(key);
+
+        printf("\n");
+    }
+
     if (hsm_test_random(ctx)) {
         errors++;
     }
 
+    /*
+     * Test the session pool, this resets the token
+     */
+    errors += hsm_test_pool(repository, ctx);
+
     return errors;
 }
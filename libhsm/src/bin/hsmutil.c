@@ -70,7 +70,7 @@ usage ()
     fprintf(stderr,"  login\n");
     fprintf(stderr,"  logout\n");
     fprintf(stderr,"  list [repository]\n");
-    fprintf(stderr,"  generate <repository> rsa|dsa|gost|ecdsa [keysize]\n");
+    fprintf(stderr,"  generate <repository> rsa|dsa|gost|ecdsa|eddsa [keysize]\n");
     fprintf(stderr,"  remove <id>\n");
     fprintf(stderr,"  purge <repository>\n");
     fprintf(stderr,"  dnskey <id> <name> <type> <algo>\n");
@@ -249,6 +249,22 @@ cmd_generate (int argc, char *argv[])
             printf("Expecting 256 or 384.\n");
             return -1;
         }
+    } else if (!strcasecmp(algorithm, "eddsa")) {
+        if (keysize == 256) {
+            printf("Generating an Ed25519 EdDSA key in repository: %s\n",
+                repository);
+
+            key = hsm_generate_eddsa_key(ctx, repository, "edwards25519");
+        } else if (keysize == 456) {
+            printf("Generating an Ed448 EdDSA key in repository: %s\n",
+                repository);
+
+            key = hsm_generate_eddsa_key(ctx, repository, "edwards448");
+        } else {
+            printf("Invalid EdDSA key size: %d\n", keysize);
+            printf("Expecting 256 or 456.\n");
+            return -1;
+        }
     } else {
         printf("Unknown algorithm: %s\n", algorithm);
         return -1;
@@ -502,6 +518,25 @@ cmd_dnskey (int argc, char *argv[])
             }
             break;
 #endif
+        case LDNS_ED25519:
+        case LDNS_ED448:
+            if (strcmp(key_info->algorithm_name, "EDDSA") != 0) {
+                printf("Not an EdDSA key, the key is of algorithm %s.\n", key_info->algorithm_name);
+                libhsm_key_info_free(key_info);
+                free(key);
+                free(name);
+                free(id);
+                return -1;
+            }
+            if (key_info->keysize != (algo == LDNS_ED25519 ? 256 : 456)) {
+                printf("The key is a EDDSA/%lu, expecting EDDSA/%d for this algorithm.\n", key_info->keysize, (algo == LDNS_ED25519 ? 256 : 456));
+                libhsm_key_info_free(key_info);
+                free(key);
+                free(name);
+                free(id);
+                return -1;
+            }
+            break;
         default:
             printf("Invalid algorithm: %i\n", algo);
             libhsm_key_info_free(key_info);
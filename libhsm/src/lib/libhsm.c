@@ -58,6 +58,22 @@
 hsm_ctx_t *_hsm_ctx;
 pthread_mutex_t _hsm_ctx_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+/*! Repositories and PIN callback of the global context, used to log in
+ *  again after the token lost its sessions */
+static struct engineconfig_repository *_hsm_rlist;
+static char *(*_hsm_pin_callback)(unsigned int, const char *, unsigned int);
+
+/*! Pool of contexts, shared by the signing threads. The idle contexts
+ *  and the contexts in use together never exceed the size of the pool. */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond; /*!< signalled when a place in the pool comes free */
+    hsm_ctx_t **idle;   /*!< idle contexts, used as a stack */
+    size_t count;       /*!< number of idle contexts */
+    size_t inuse;       /*!< number of contexts handed out or being checked */
+    size_t size;        /*!< maximum number of contexts */
+} _hsm_pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, 0, 0, 0 };
+
 /*! General PKCS11 helper functions */
 static char const *
 ldns_pkcs11_rv_str(CK_RV rv)
@@ -241,6 +257,9 @@ hsm_pkcs11_check_error(hsm_ctx_t *ctx, CK_RV rv, const char *action)
             ctx->error_action = action;
             strlcpy(ctx->error_message, ldns_pkcs11_rv_str(rv), sizeof(ctx->error_message));
         }
+        if (ctx) {
+            ctx->failed = 1;
+        }
         return 1;
     }
     return 0;
@@ -632,6 +651,8 @@ hsm_ctx_new()
     memset(ctx->session, 0, HSM_MAX_SESSIONS * sizeof(hsm_ctx_t*));
     ctx->session_count = 0;
     ctx->error = 0;
+    ctx->failed = 0;
+    ctx->sign_buf = NULL;
     return ctx;
 }
 
@@ -645,6 +666,9 @@ hsm_ctx_free(hsm_ctx_t *ctx)
         for (i = 0; i < ctx->session_count; i++) {
             hsm_session_free(ctx->session[i]);
         }
+        if (ctx->sign_buf) {
+            ldns_buffer_free(ctx->sign_buf);
+        }
         free(ctx);
     }
 }
@@ -1032,6 +1056,80 @@ hsm_get_key_ecdsa_value(hsm_ctx_t *ctx, const hsm_session_t *session,
     return data;
 }
 
+/* Returns the public key of an EdDSA key, the encoding of RFC 8032.
+ * PKCS#11 v3.0 wraps it in a DER octet string, but some tokens return
+ * the plain key.
+ */
+static unsigned char *
+hsm_get_key_eddsa_value(hsm_ctx_t *ctx, const hsm_session_t *session,
+                     const libhsm_key_t *key, CK_ULONG *data_len)
+{
+    CK_RV rv;
+    CK_BYTE_PTR value = NULL;
+    CK_BYTE_PTR data = NULL;
+    CK_ULONG value_len = 0;
+    CK_ULONG header_len = 0;
+
+    CK_ATTRIBUTE template[] = {
+        {CKA_EC_POINT, NULL, 0},
+    };
+
+    if (!session || !session->module || !key || !data_len) {
+        return NULL;
+    }
+
+    rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_GetAttributeValue(
+                                      session->session,
+                                      key->public_key,
+                                      template,
+                                      1);
+    if (hsm_pkcs11_check_error(ctx, rv, "C_GetAttributeValue")) {
+        return NULL;
+    }
+    value_len = template[0].ulValueLen;
+
+    CHECKALLOC(value = template[0].pValue = malloc(value_len));
+    memset(value, 0, value_len);
+
+    rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_GetAttributeValue(
+                                      session->session,
+                                      key->public_key,
+                                      template,
+                                      1);
+    if (hsm_pkcs11_check_error(ctx, rv, "get attribute value")) {
+        free(value);
+        return NULL;
+    }
+
+    if(value_len != template[0].ulValueLen) {
+        hsm_ctx_set_error(ctx, -1, "hsm_get_key_eddsa_value()",
+           "HSM returned two different length for a same CKA_EC_POINT. " \
+            "Abnormal behaviour detected.");
+        free(value);
+        return NULL;
+    }
+
+    /* Strip the octet string identifier and short form length */
+    if (value_len > 2 && value[0] == 0x04 && value[1] == value_len - 2) {
+        header_len = 2;
+    }
+
+    if (value_len - header_len != 32 && value_len - header_len != 57) {
+        hsm_ctx_set_error(ctx, -1, "hsm_get_key_eddsa_value()",
+            "The value has an invalid length");
+        free(value);
+        return NULL;
+    }
+
+    *data_len = value_len - header_len;
+    CHECKALLOC(data = malloc(*data_len));
+
+    memcpy(data, value + header_len, *data_len);
+    free(value);
+
+    return data;
+}
+
 /* returns a CK_ULONG with the key size of the given ECDSA key. The
  * key is not checked for type. For ECDSA, the number of bits in the
  * value X is the key size
@@ -1058,6 +1156,22 @@ hsm_get_key_size_ecdsa(hsm_ctx_t *ctx, const hsm_session_t *session,
     return bits;
 }
 
+/* returns a CK_ULONG with the key size of the given EdDSA key, the
+ * number of bits in the public key (256 for Ed25519, 456 for Ed448)
+ */
+static CK_ULONG
+hsm_get_key_size_eddsa(hsm_ctx_t *ctx, const hsm_session_t *session,
+                     const libhsm_key_t *key)
+{
+    CK_ULONG value_len;
+    unsigned char* value = hsm_get_key_eddsa_value(ctx, session, key, &value_len);
+
+    if (value == NULL) return 0;
+    free(value);
+
+    return value_len * 8;
+}
+
 /* Wrapper for specific key size functions */
 static CK_ULONG
 hsm_get_key_size(hsm_ctx_t *ctx, const hsm_session_t *session,
@@ -1075,6 +1189,8 @@ hsm_get_key_size(hsm_ctx_t *ctx, const hsm_session_t *session,
             return 512;
         case CKK_EC:
             return hsm_get_key_size_ecdsa(ctx, session, key);
+        case CKK_EC_EDWARDS:
+            return hsm_get_key_size_eddsa(ctx, session, key);
         default:
             return 0;
     }
@@ -1682,6 +1798,18 @@ hsm_get_key_rdata_ecdsa(hsm_ctx_t *ctx, hsm_session_t *session,
     return rdf;
 }
 
+static ldns_rdf *
+hsm_get_key_rdata_eddsa(hsm_ctx_t *ctx, hsm_session_t *session,
+                  const libhsm_key_t *key)
+{
+    CK_ULONG value_len;
+    unsigned char* value = hsm_get_key_eddsa_value(ctx, session, key, &value_len);
+
+    if (value == NULL) return NULL;
+
+    return ldns_rdf_new(LDNS_RDF_TYPE_B64, value_len, value);
+}
+
 static ldns_rdf *
 hsm_get_key_rdata(hsm_ctx_t *ctx, hsm_session_t *session,
                   const libhsm_key_t *key)
@@ -1698,21 +1826,24 @@ hsm_get_key_rdata(hsm_ctx_t *ctx, hsm_session_t *session,
             break;
         case CKK_EC:
             return hsm_get_key_rdata_ecdsa(ctx, session, key);
+        case CKK_EC_EDWARDS:
+            return hsm_get_key_rdata_eddsa(ctx, session, key);
         default:
             return 0;
     }
 }
 
-/* this function allocates memory for the mechanism ID and enough room
- * to leave the upcoming digest data. It fills in the mechanism id
- * use with care. The returned data must be free'd by the caller.
- * Only used by RSA PKCS. */
-static CK_BYTE *
+/* this function fills in the mechanism ID in front of the upcoming
+ * digest data and sets the size of the data to be signed. The data
+ * buffer must hold HSM_MAX_SIGN_DATA_LENGTH bytes.
+ * Only RSA PKCS needs an identifier, for the other algorithms the
+ * data is just the digest. */
+static int
 hsm_create_prefix(CK_ULONG digest_len,
                   ldns_algorithm algorithm,
+                  CK_BYTE *data,
                   CK_ULONG *data_size)
 {
-    CK_BYTE *data;
     const CK_BYTE RSA_MD5_ID[] = { 0x30, 0x20, 0x30, 0x0C, 0x06, 0x08, 0x2A, 0x86, 0x48, 0x86, 0xF7, 0x0D, 0x02, 0x05, 0x05, 0x00, 0x04, 0x10 };
     const CK_BYTE RSA_SHA1_ID[] = { 0x30, 0x21, 0x30, 0x09, 0x06, 0x05, 0x2B, 0x0E, 0x03, 0x02, 0x1A, 0x05, 0x00, 0x04, 0x14 };
     const CK_BYTE RSA_SHA256_ID[] = { 0x30, 0x31, 0x30, 0x0d, 0x06, 0x09, 0x60, 0x86, 0x48, 0x01, 0x65, 0x03, 0x04, 0x02, 0x01, 0x05, 0x00, 0x04, 0x20 };
@@ -1721,23 +1852,19 @@ hsm_create_prefix(CK_ULONG digest_len,
     switch((ldns_signing_algorithm)algorithm) {
         case LDNS_SIGN_RSAMD5:
             *data_size = sizeof(RSA_MD5_ID) + digest_len;
-            CHECKALLOC(data = malloc(*data_size));
             memcpy(data, RSA_MD5_ID, sizeof(RSA_MD5_ID));
             break;
         case LDNS_SIGN_RSASHA1:
         case LDNS_SIGN_RSASHA1_NSEC3:
             *data_size = sizeof(RSA_SHA1_ID) + digest_len;
-            CHECKALLOC(data = malloc(*data_size));
             memcpy(data, RSA_SHA1_ID, sizeof(RSA_SHA1_ID));
             break;
 	case LDNS_SIGN_RSASHA256:
             *data_size = sizeof(RSA_SHA256_ID) + digest_len;
-            CHECKALLOC(data = malloc(*data_size));
             memcpy(data, RSA_SHA256_ID, sizeof(RSA_SHA256_ID));
             break;
 	case LDNS_SIGN_RSASHA512:
             *data_size = sizeof(RSA_SHA512_ID) + digest_len;
-            CHECKALLOC(data = malloc(*data_size));
             memcpy(data, RSA_SHA512_ID, sizeof(RSA_SHA512_ID));
             break;
         case LDNS_SIGN_DSA:
@@ -1749,34 +1876,31 @@ hsm_create_prefix(CK_ULONG digest_len,
         case LDNS_SIGN_ECDSAP384SHA384:
 #endif
             *data_size = digest_len;
-            CHECKALLOC(data = malloc(*data_size));
             break;
         default:
-            return NULL;
+            return -1;
     }
-    return data;
+    return 0;
 }
 
-static CK_BYTE *
+static int
 hsm_digest_through_hsm(hsm_ctx_t *ctx,
                        hsm_session_t *session,
                        CK_MECHANISM_TYPE mechanism_type,
                        CK_ULONG digest_len,
-                       ldns_buffer *sign_buf)
+                       ldns_buffer *sign_buf,
+                       CK_BYTE *digest)
 {
     CK_MECHANISM digest_mechanism;
-    CK_BYTE *digest;
     CK_RV rv;
 
     digest_mechanism.pParameter = NULL;
     digest_mechanism.ulParameterLen = 0;
     digest_mechanism.mechanism = mechanism_type;
-    CHECKALLOC(digest = malloc(digest_len));
     rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_DigestInit(session->session,
                                                  &digest_mechanism);
     if (hsm_pkcs11_check_error(ctx, rv, "HSM digest init")) {
-        free(digest);
-        return NULL;
+        return -1;
     }
 
     rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_Digest(session->session,
@@ -1785,54 +1909,44 @@ hsm_digest_through_hsm(hsm_ctx_t *ctx,
                                         digest,
                                         &digest_len);
     if (hsm_pkcs11_check_error(ctx, rv, "HSM digest")) {
-        free(digest);
-        return NULL;
+        return -1;
     }
-    return digest;
+    return 0;
 }
 
-static ldns_rdf *
-hsm_sign_buffer(hsm_ctx_t *ctx,
-                ldns_buffer *sign_buf,
-                const libhsm_key_t *key,
-                ldns_algorithm algorithm)
+/* Computes the data handed to the HSM for signing the contents of
+ * sign_buf; the digest, preceded by the identifier for RSA. */
+static int
+hsm_digest_buffer(hsm_ctx_t *ctx,
+                  hsm_session_t *session,
+                  ldns_buffer *sign_buf,
+                  ldns_algorithm algorithm,
+                  CK_BYTE *data,
+                  CK_ULONG *data_len)
 {
-    CK_RV rv;
-    CK_ULONG signatureLen = HSM_MAX_SIGNATURE_LENGTH;
-    CK_BYTE signature[HSM_MAX_SIGNATURE_LENGTH];
-    CK_MECHANISM sign_mechanism;
-
-    ldns_rdf *sig_rdf;
-    CK_BYTE *digest = NULL;
+    CK_BYTE digest[LDNS_SHA512_DIGEST_LENGTH];
     CK_ULONG digest_len;
 
-    CK_BYTE *data = NULL;
-    CK_ULONG data_len = 0;
-
-    hsm_session_t *session;
-
-    session = hsm_find_key_session(ctx, key);
-    if (!session) return NULL;
-
     /* some HSMs don't really handle CKM_SHA1_RSA_PKCS well, so
      * we'll do the hashing manually */
-    /* When adding algorithms, remember there is another switch below */
+    /* When adding algorithms, remember there is another switch in
+     * hsm_sign_mechanism */
     switch ((ldns_signing_algorithm)algorithm) {
         case LDNS_SIGN_RSAMD5:
             digest_len = 16;
-            digest = hsm_digest_through_hsm(ctx, session,
-                                            CKM_MD5, digest_len,
-                                            sign_buf);
+            if (hsm_digest_through_hsm(ctx, session, CKM_MD5, digest_len,
+                                       sign_buf, digest)) {
+                return -1;
+            }
             break;
         case LDNS_SIGN_RSASHA1:
         case LDNS_SIGN_RSASHA1_NSEC3:
         case LDNS_SIGN_DSA:
         case LDNS_SIGN_DSA_NSEC3:
             digest_len = LDNS_SHA1_DIGEST_LENGTH;
-            CHECKALLOC(digest = malloc(digest_len));
-            digest = ldns_sha1(ldns_buffer_begin(sign_buf),
-                               ldns_buffer_position(sign_buf),
-                               digest);
+            ldns_sha1(ldns_buffer_begin(sign_buf),
+                      ldns_buffer_position(sign_buf),
+                      digest);
             break;
 
         case LDNS_SIGN_RSASHA256:
@@ -1841,89 +1955,111 @@ hsm_sign_buffer(hsm_ctx_t *ctx,
         case LDNS_SIGN_ECDSAP256SHA256:
 #endif
             digest_len = LDNS_SHA256_DIGEST_LENGTH;
-            CHECKALLOC(digest = malloc(digest_len));
-            digest = ldns_sha256(ldns_buffer_begin(sign_buf),
-                                 ldns_buffer_position(sign_buf),
-                                 digest);
+            ldns_sha256(ldns_buffer_begin(sign_buf),
+                        ldns_buffer_position(sign_buf),
+                        digest);
             break;
 /* TODO: We can remove the directive if we require LDNS >= 1.6.13 */
 #if !defined LDNS_BUILD_CONFIG_USE_ECDSA || LDNS_BUILD_CONFIG_USE_ECDSA
         case LDNS_SIGN_ECDSAP384SHA384:
             digest_len = LDNS_SHA384_DIGEST_LENGTH;
-            CHECKALLOC(digest = malloc(digest_len));
-            digest = ldns_sha384(ldns_buffer_begin(sign_buf),
-                                 ldns_buffer_position(sign_buf),
-                                 digest);
+            ldns_sha384(ldns_buffer_begin(sign_buf),
+                        ldns_buffer_position(sign_buf),
+                        digest);
             break;
 #endif
         case LDNS_SIGN_RSASHA512:
             digest_len = LDNS_SHA512_DIGEST_LENGTH;
-            CHECKALLOC(digest = malloc(digest_len));
-            digest = ldns_sha512(ldns_buffer_begin(sign_buf),
-                                 ldns_buffer_position(sign_buf),
-                                 digest);
+            ldns_sha512(ldns_buffer_begin(sign_buf),
+                        ldns_buffer_position(sign_buf),
+                        digest);
             break;
         case LDNS_SIGN_ECC_GOST:
             digest_len = 32;
-            digest = hsm_digest_through_hsm(ctx, session,
-                                            CKM_GOSTR3411, digest_len,
-                                            sign_buf);
+            if (hsm_digest_through_hsm(ctx, session, CKM_GOSTR3411,
+                                       digest_len, sign_buf, digest)) {
+                return -1;
+            }
             break;
         default:
             /* log error? or should we not even get here for
              * unsupported algorithms? */
-            return NULL;
-    }
-
-    if (!digest) {
-        return NULL;
+            return -1;
     }
 
     /* CKM_RSA_PKCS does the padding, but cannot know the identifier
      * prefix, so we need to add that ourselves.
-     * The other algorithms will just get the digest buffer returned. */
-    data = hsm_create_prefix(digest_len, algorithm, &data_len);
-    memcpy(data + data_len - digest_len, digest, digest_len);
+     * The other algorithms will just get the digest. */
+    if (hsm_create_prefix(digest_len, algorithm, data, data_len)) {
+        return -1;
+    }
+    memcpy(data + *data_len - digest_len, digest, digest_len);
+    return 0;
+}
 
-    sign_mechanism.pParameter = NULL;
-    sign_mechanism.ulParameterLen = 0;
+/* EdDSA (RFC 8080) signs the data itself, there is no digest up front */
+static int
+hsm_algorithm_is_eddsa(ldns_algorithm algorithm)
+{
+    return algorithm == LDNS_ED25519 || algorithm == LDNS_ED448;
+}
+
+static int
+hsm_sign_mechanism(ldns_algorithm algorithm, CK_MECHANISM *sign_mechanism)
+{
+    sign_mechanism->pParameter = NULL;
+    sign_mechanism->ulParameterLen = 0;
+    if (hsm_algorithm_is_eddsa(algorithm)) {
+        sign_mechanism->mechanism = CKM_EDDSA;
+        return 0;
+    }
     switch((ldns_signing_algorithm)algorithm) {
         case LDNS_SIGN_RSAMD5:
         case LDNS_SIGN_RSASHA1:
         case LDNS_SIGN_RSASHA1_NSEC3:
         case LDNS_SIGN_RSASHA256:
         case LDNS_SIGN_RSASHA512:
-            sign_mechanism.mechanism = CKM_RSA_PKCS;
+            sign_mechanism->mechanism = CKM_RSA_PKCS;
             break;
         case LDNS_SIGN_DSA:
         case LDNS_SIGN_DSA_NSEC3:
-            sign_mechanism.mechanism = CKM_DSA;
+            sign_mechanism->mechanism = CKM_DSA;
             break;
         case LDNS_SIGN_ECC_GOST:
-            sign_mechanism.mechanism = CKM_GOSTR3410;
+            sign_mechanism->mechanism = CKM_GOSTR3410;
             break;
 /* TODO: We can remove the directive if we require LDNS >= 1.6.13 */
 #if !defined LDNS_BUILD_CONFIG_USE_ECDSA || LDNS_BUILD_CONFIG_USE_ECDSA
         case LDNS_SIGN_ECDSAP256SHA256:
         case LDNS_SIGN_ECDSAP384SHA384:
-            sign_mechanism.mechanism = CKM_ECDSA;
+            sign_mechanism->mechanism = CKM_ECDSA;
             break;
 #endif
         default:
             /* log error? or should we not even get here for
              * unsupported algorithms? */
-            free(data);
-            free(digest);
-            return NULL;
+            return -1;
     }
+    return 0;
+}
+
+static ldns_rdf *
+hsm_sign_data(hsm_ctx_t *ctx,
+              hsm_session_t *session,
+              const libhsm_key_t *key,
+              CK_MECHANISM *sign_mechanism,
+              CK_BYTE *data,
+              CK_ULONG data_len)
+{
+    CK_RV rv;
+    CK_ULONG signatureLen = HSM_MAX_SIGNATURE_LENGTH;
+    CK_BYTE signature[HSM_MAX_SIGNATURE_LENGTH];
 
     rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_SignInit(
                                       session->session,
-                                      &sign_mechanism,
+                                      sign_mechanism,
                                       key->private_key);
     if (hsm_pkcs11_check_error(ctx, rv, "sign init")) {
-        free(data);
-        free(digest);
         return NULL;
     }
 
@@ -1931,20 +2067,42 @@ hsm_sign_buffer(hsm_ctx_t *ctx,
                                       signature,
                                       &signatureLen);
     if (hsm_pkcs11_check_error(ctx, rv, "sign final")) {
-        free(data);
-        free(digest);
         return NULL;
     }
 
-    sig_rdf = ldns_rdf_new_frm_data(LDNS_RDF_TYPE_B64,
-                                    signatureLen,
-                                    signature);
+    return ldns_rdf_new_frm_data(LDNS_RDF_TYPE_B64,
+                                 signatureLen,
+                                 signature);
+}
 
-    free(data);
-    free(digest);
+static ldns_rdf *
+hsm_sign_buffer(hsm_ctx_t *ctx,
+                ldns_buffer *sign_buf,
+                const libhsm_key_t *key,
+                ldns_algorithm algorithm)
+{
+    CK_MECHANISM sign_mechanism;
+    CK_BYTE data[HSM_MAX_SIGN_DATA_LENGTH];
+    CK_ULONG data_len = 0;
+    hsm_session_t *session;
 
-    return sig_rdf;
+    session = hsm_find_key_session(ctx, key);
+    if (!session) return NULL;
 
+    if (hsm_sign_mechanism(algorithm, &sign_mechanism)) {
+        return NULL;
+    }
+    if (hsm_algorithm_is_eddsa(algorithm)) {
+        return hsm_sign_data(ctx, session, key, &sign_mechanism,
+                             ldns_buffer_begin(sign_buf),
+                             ldns_buffer_position(sign_buf));
+    }
+    if (hsm_digest_buffer(ctx, session, sign_buf, algorithm,
+                          data, &data_len)) {
+        return NULL;
+    }
+    return hsm_sign_data(ctx, session, key, &sign_mechanism,
+                         data, data_len);
 }
 
 static int
@@ -2076,6 +2234,8 @@ hsm_open2(struct engineconfig_repository* rlist,
     int repositories = 0;
 
     pthread_mutex_lock(&_hsm_ctx_mutex);
+    _hsm_rlist = rlist;
+    _hsm_pin_callback = pin_callback;
     /* create an internal context with an attached session for each
      * configured HSM. */
     if ((_hsm_ctx = hsm_ctx_new())) {
@@ -2134,10 +2294,13 @@ hsm_open2(struct engineconfig_repository* rlist,
 void
 hsm_close()
 {
+    hsm_pool_close();
     pthread_mutex_lock(&_hsm_ctx_mutex);
     keycache_destroy(_hsm_ctx);
     hsm_ctx_close(_hsm_ctx, 1);
     _hsm_ctx = NULL;
+    _hsm_rlist = NULL;
+    _hsm_pin_callback = NULL;
     pthread_mutex_unlock(&_hsm_ctx_mutex);
 }
 
@@ -2151,65 +2314,309 @@ hsm_create_context()
     return newctx;
 }
 
-int
-hsm_check_context()
+void
+hsm_destroy_context(hsm_ctx_t *ctx)
+{
+    hsm_ctx_close(ctx, 0);
+}
+
+/* check that a session is still open and logged in, without opening
+ * new sessions */
+static int
+hsm_session_alive(hsm_ctx_t *ctx, hsm_session_t *session)
 {
-    unsigned int i;
-    hsm_session_t *session;
     CK_SESSION_INFO info;
     CK_RV rv;
-    CK_SESSION_HANDLE session_handle;
-    hsm_ctx_t *ctx;
 
-    pthread_mutex_lock(&_hsm_ctx_mutex);
-    ctx = _hsm_ctx;
+    rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_GetSessionInfo(
+                                    session->session,
+                                    &info);
+    if (hsm_pkcs11_check_error(ctx, rv, "get session info")) {
+        return 0;
+    }
+    if (info.state != CKS_RW_USER_FUNCTIONS) {
+        hsm_ctx_set_error(ctx, HSM_ERROR, "hsm_session_alive()",
+                          "Session not logged in");
+        return 0;
+    }
+    return 1;
+}
+
+static int
+hsm_ctx_alive(hsm_ctx_t *ctx)
+{
+    unsigned int i;
 
     for (i = 0; i < ctx->session_count; i++) {
-        session = ctx->session[i];
-        if (session == NULL) continue;
-
-        /* Get session info */
-        rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_GetSessionInfo(
-                                        session->session,
-                                        &info);
-        if (hsm_pkcs11_check_error(ctx, rv, "get session info")) {
-            pthread_mutex_unlock(&_hsm_ctx_mutex);
-            return HSM_ERROR;
+        if (ctx->session[i] && !hsm_session_alive(ctx, ctx->session[i])) {
+            return 0;
         }
+    }
+    return 1;
+}
 
-        /* Check session info */
-        if (info.state != CKS_RW_USER_FUNCTIONS) {
-            hsm_ctx_set_error(ctx, HSM_ERROR, "hsm_check_context()",
-                              "Session not logged in");
-            pthread_mutex_unlock(&_hsm_ctx_mutex);
-            return HSM_ERROR;
-        }
+/* replace a session of the global context that the token dropped by a
+ * new one, and log in again with the PIN of its repository */
+static int
+hsm_session_relogin(hsm_ctx_t *ctx, hsm_session_t *session, unsigned int id)
+{
+    CK_RV rv;
+    CK_SLOT_ID slot_id;
+    CK_SESSION_HANDLE session_handle;
+    CK_FUNCTION_LIST_PTR sym = (CK_FUNCTION_LIST_PTR) session->module->sym;
+    struct engineconfig_repository *repo;
+    char *pin = NULL;
+    int result;
 
-        /* Try open and close a session with the token */
-        rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_OpenSession(info.slotID,
-                                        CKF_SERIAL_SESSION | CKF_RW_SESSION,
-                                        NULL,
-                                        NULL,
-                                        &session_handle);
-        if (hsm_pkcs11_check_error(ctx, rv, "test open session")) {
-            pthread_mutex_unlock(&_hsm_ctx_mutex);
-            return HSM_ERROR;
-        }
-        rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_CloseSession(session_handle);
-        if (hsm_pkcs11_check_error(ctx, rv, "test close session")) {
-            pthread_mutex_unlock(&_hsm_ctx_mutex);
-            return HSM_ERROR;
+    repo = hsm_find_repository(_hsm_rlist, session->module->name);
+    if (!repo) {
+        hsm_ctx_set_error(ctx, HSM_REPOSITORY_NOT_FOUND,
+            "hsm_session_relogin()",
+            "Can't find repository: %s", session->module->name);
+        return HSM_REPOSITORY_NOT_FOUND;
+    }
+    result = hsm_get_slot_id(ctx, sym, session->module->token_label,
+                             &slot_id);
+    if (result != HSM_OK) return result;
+
+    /* the old handle is most likely gone already */
+    (void) sym->C_CloseSession(session->session);
+    rv = sym->C_OpenSession(slot_id, CKF_SERIAL_SESSION | CKF_RW_SESSION,
+                            NULL, NULL, &session_handle);
+    if (hsm_pkcs11_check_error(ctx, rv, "Reopen session")) {
+        return HSM_ERROR;
+    }
+    session->session = session_handle;
+
+    if (repo->pin) {
+        pin = repo->pin;
+    } else if (_hsm_pin_callback) {
+        pin = _hsm_pin_callback(id, repo->name, HSM_PIN_FIRST);
+    }
+    if (!pin) {
+        hsm_ctx_set_error(ctx, HSM_ERROR, "hsm_session_relogin()",
+            "No pin for repository %s", repo->name);
+        return HSM_ERROR;
+    }
+    rv = sym->C_Login(session_handle, CKU_USER, (unsigned char *) pin,
+                      strlen(pin));
+    if (pin != repo->pin) {
+        memset(pin, 0, strlen(pin));
+    }
+    if (rv != CKR_USER_ALREADY_LOGGED_IN &&
+        hsm_pkcs11_check_error(ctx, rv, "Login again")) {
+        return HSM_ERROR;
+    }
+    return HSM_OK;
+}
+
+int
+hsm_check_context()
+{
+    unsigned int i;
+    int result = HSM_OK;
+
+    /* the sessions of the global context hold the logins */
+    pthread_mutex_lock(&_hsm_ctx_mutex);
+    if (!_hsm_ctx) {
+        pthread_mutex_unlock(&_hsm_ctx_mutex);
+        return HSM_ERROR;
+    }
+    for (i = 0; i < _hsm_ctx->session_count; i++) {
+        if (_hsm_ctx->session[i] &&
+            !hsm_session_alive(_hsm_ctx, _hsm_ctx->session[i])) {
+            _hsm_ctx->error = 0;
+            if (hsm_session_relogin(_hsm_ctx, _hsm_ctx->session[i], i)
+                != HSM_OK) {
+                result = HSM_ERROR;
+            }
         }
     }
+    pthread_mutex_unlock(&_hsm_ctx_mutex);
+    return result;
+}
 
+int
+hsm_pool_open(size_t size)
+{
+    hsm_ctx_t **idle;
+    hsm_ctx_t *ctx;
+    size_t count = 0;
+
+    hsm_pool_close();
+    if (size == 0) return HSM_OK;
+    CHECKALLOC(idle = calloc(size, sizeof(hsm_ctx_t *)));
+    pthread_mutex_lock(&_hsm_ctx_mutex);
+    while (count < size && (ctx = hsm_ctx_clone(_hsm_ctx)) != NULL) {
+        idle[count++] = ctx;
+    }
     pthread_mutex_unlock(&_hsm_ctx_mutex);
-    return HSM_OK;
+    pthread_mutex_lock(&_hsm_pool.lock);
+    _hsm_pool.idle = idle;
+    _hsm_pool.count = count;
+    _hsm_pool.size = size;
+    pthread_mutex_unlock(&_hsm_pool.lock);
+    return (count == size ? HSM_OK : HSM_ERROR);
 }
 
 void
-hsm_destroy_context(hsm_ctx_t *ctx)
+hsm_pool_close()
+{
+    hsm_ctx_t **idle;
+    size_t i, count;
+
+    pthread_mutex_lock(&_hsm_pool.lock);
+    idle = _hsm_pool.idle;
+    count = _hsm_pool.count;
+    _hsm_pool.idle = NULL;
+    _hsm_pool.count = 0;
+    _hsm_pool.size = 0;
+    /* threads waiting for a context create their own from now on */
+    pthread_cond_broadcast(&_hsm_pool.cond);
+    pthread_mutex_unlock(&_hsm_pool.lock);
+    for (i = 0; i < count; i++) {
+        hsm_destroy_context(idle[i]);
+    }
+    free(idle);
+}
+
+hsm_ctx_t *
+hsm_pool_acquire()
+{
+    hsm_ctx_t *ctx = NULL;
+
+    pthread_mutex_lock(&_hsm_pool.lock);
+    /* wait for a context to be released rather than going beyond the
+     * size of the pool */
+    while (_hsm_pool.size > 0 && _hsm_pool.count == 0 &&
+        _hsm_pool.inuse >= _hsm_pool.size) {
+        pthread_cond_wait(&_hsm_pool.cond, &_hsm_pool.lock);
+    }
+    if (_hsm_pool.count > 0) {
+        ctx = _hsm_pool.idle[--_hsm_pool.count];
+    }
+    _hsm_pool.inuse++;
+    pthread_mutex_unlock(&_hsm_pool.lock);
+    if (!ctx) {
+        /* the pool is not open, or a context was lost and this one
+         * takes its place */
+        ctx = hsm_create_context();
+        if (!ctx) {
+            pthread_mutex_lock(&_hsm_pool.lock);
+            _hsm_pool.inuse--;
+            pthread_cond_signal(&_hsm_pool.cond);
+            pthread_mutex_unlock(&_hsm_pool.lock);
+        }
+    }
+    return ctx;
+}
+
+void
+hsm_pool_release(hsm_ctx_t *ctx)
 {
-    hsm_ctx_close(ctx, 0);
+    if (!ctx) return;
+    if (ctx->failed) {
+        /* only keep the context if its sessions survived the failure */
+        if (hsm_ctx_alive(ctx)) {
+            ctx->failed = 0;
+        }
+    }
+    /* an error left behind would keep the next user of the context from
+     * recording its own */
+    ctx->error = 0;
+    pthread_mutex_lock(&_hsm_pool.lock);
+    if (_hsm_pool.inuse > 0) {
+        _hsm_pool.inuse--;
+    }
+    if (!ctx->failed &&
+        _hsm_pool.count + _hsm_pool.inuse < _hsm_pool.size) {
+        _hsm_pool.idle[_hsm_pool.count++] = ctx;
+        ctx = NULL;
+    }
+    /* kept or destroyed, a place in the pool came free */
+    pthread_cond_signal(&_hsm_pool.cond);
+    pthread_mutex_unlock(&_hsm_pool.lock);
+    if (ctx) {
+        hsm_destroy_context(ctx);
+    }
+}
+
+int
+hsm_pool_check()
+{
+    hsm_ctx_t **idle;
+    hsm_ctx_t *ctx;
+    size_t i, count, size, room = 0, kept = 0;
+    int result;
+
+    result = hsm_check_context();
+
+    /* take the idle contexts out, so signing threads are not held up
+     * while they are checked */
+    pthread_mutex_lock(&_hsm_pool.lock);
+    size = _hsm_pool.size;
+    count = _hsm_pool.count;
+    idle = _hsm_pool.idle;
+    if (size) {
+        CHECKALLOC(_hsm_pool.idle = calloc(size, sizeof(hsm_ctx_t *)));
+    }
+    _hsm_pool.count = 0;
+    /* the contexts being checked keep their place in the pool */
+    _hsm_pool.inuse += count;
+    pthread_mutex_unlock(&_hsm_pool.lock);
+
+    for (i = 0; i < count; i++) {
+        if (hsm_ctx_alive(idle[i])) {
+            idle[kept++] = idle[i];
+        } else {
+            hsm_destroy_context(idle[i]);
+        }
+    }
+
+    /* put back the contexts that survived, and claim the places left by
+     * the contexts that did not and are not taken by contexts in use */
+    pthread_mutex_lock(&_hsm_pool.lock);
+    _hsm_pool.inuse -= count;
+    for (i = 0; i < kept &&
+        _hsm_pool.count + _hsm_pool.inuse < _hsm_pool.size; i++) {
+        _hsm_pool.idle[_hsm_pool.count++] = idle[i];
+    }
+    if (result == HSM_OK &&
+        _hsm_pool.count + _hsm_pool.inuse < _hsm_pool.size) {
+        room = _hsm_pool.size - _hsm_pool.count - _hsm_pool.inuse;
+        if (room > size) room = size;
+        _hsm_pool.inuse += room;
+    }
+    pthread_cond_broadcast(&_hsm_pool.cond);
+    pthread_mutex_unlock(&_hsm_pool.lock);
+    for (; i < kept; i++) {
+        hsm_destroy_context(idle[i]);
+    }
+
+    kept = 0;
+    if (room > 0) {
+        pthread_mutex_lock(&_hsm_ctx_mutex);
+        while (kept < room && (ctx = hsm_ctx_clone(_hsm_ctx)) != NULL) {
+            idle[kept++] = ctx;
+        }
+        pthread_mutex_unlock(&_hsm_ctx_mutex);
+        if (kept < room) result = HSM_ERROR;
+    }
+
+    /* release the claimed places and fill them */
+    pthread_mutex_lock(&_hsm_pool.lock);
+    _hsm_pool.inuse -= room;
+    while (kept > 0 &&
+        _hsm_pool.count + _hsm_pool.inuse < _hsm_pool.size) {
+        _hsm_pool.idle[_hsm_pool.count++] = idle[--kept];
+    }
+    pthread_cond_broadcast(&_hsm_pool.cond);
+    pthread_mutex_unlock(&_hsm_pool.lock);
+    for (i = 0; i < kept; i++) {
+        hsm_destroy_context(idle[i]);
+    }
+    free(idle);
+    return result;
 }
 
 /**
@@ -2695,6 +3102,103 @@ hsm_generate_ecdsa_key(hsm_ctx_t *ctx,
     return new_key;
 }
 
+libhsm_key_t *
+hsm_generate_eddsa_key(hsm_ctx_t *ctx,
+                       const char *repository,
+                       const char *curve)
+{
+    CK_RV rv;
+    libhsm_key_t *new_key;
+    hsm_session_t *session;
+    CK_OBJECT_HANDLE publicKey, privateKey;
+    CK_BBOOL ctrue = CK_TRUE;
+    CK_BBOOL cfalse = CK_FALSE;
+    CK_BBOOL cextractable = CK_FALSE;
+
+    /* ids we create are 16 bytes of data */
+    unsigned char id[16];
+    /* that's 33 bytes in string (16*2 + 1 for \0) */
+    char id_str[33];
+
+    session = hsm_find_repository_session(ctx, repository);
+    if (!session) return NULL;
+    cextractable = session->module->config->allow_extract ? CK_TRUE : CK_FALSE;
+
+    generate_unique_id(ctx, id, 16);
+
+    /* the CKA_LABEL will contain a hexadecimal string representation
+     * of the id */
+    hsm_hex_unparse(id_str, id, 16);
+
+    CK_KEY_TYPE keyType = CKK_EC_EDWARDS;
+    CK_MECHANISM mechanism = {
+        CKM_EC_EDWARDS_KEY_PAIR_GEN, NULL_PTR, 0
+    };
+
+    /* PKCS#11 v3.0 identifies the curves by a printable string */
+    CK_BYTE paramsEd25519[] = { 0x13, 0x0C, 'e', 'd', 'w', 'a', 'r', 'd', 's', '2', '5', '5', '1', '9' };
+    CK_BYTE paramsEd448[] = { 0x13, 0x0A, 'e', 'd', 'w', 'a', 'r', 'd', 's', '4', '4', '8' };
+
+    CK_ATTRIBUTE publicKeyTemplate[] = {
+        { CKA_EC_PARAMS,           NULL,     0               },
+        { CKA_LABEL,(CK_UTF8CHAR*) id_str,   strlen(id_str)  },
+        { CKA_ID,                  id,       16              },
+        { CKA_KEY_TYPE,            &keyType, sizeof(keyType) },
+        { CKA_VERIFY,              &ctrue,   sizeof(ctrue)   },
+        { CKA_ENCRYPT,             &cfalse,  sizeof(cfalse)  },
+        { CKA_WRAP,                &cfalse,  sizeof(cfalse)  },
+        { CKA_TOKEN,               &ctrue,   sizeof(ctrue)   }
+    };
+
+    CK_ATTRIBUTE privateKeyTemplate[] = {
+        { CKA_LABEL,(CK_UTF8CHAR*) id_str,   strlen (id_str) },
+        { CKA_ID,                  id,       16              },
+        { CKA_KEY_TYPE,            &keyType, sizeof(keyType) },
+        { CKA_SIGN,                &ctrue,   sizeof(ctrue)   },
+        { CKA_DECRYPT,             &cfalse,  sizeof(cfalse)  },
+        { CKA_UNWRAP,              &cfalse,  sizeof(cfalse)  },
+        { CKA_SENSITIVE,           &ctrue,   sizeof(ctrue)   },
+        { CKA_TOKEN,               &ctrue,   sizeof(ctrue)   },
+        { CKA_PRIVATE,             &ctrue,   sizeof(ctrue)   },
+        { CKA_EXTRACTABLE,         &cextractable,  sizeof (cextractable) }
+    };
+
+    /* Select the curve */
+    if (strcmp(curve, "edwards25519") == 0)
+    {
+        publicKeyTemplate[0].pValue = paramsEd25519;
+        publicKeyTemplate[0].ulValueLen = sizeof(paramsEd25519);
+    }
+    else if (strcmp(curve, "edwards448") == 0)
+    {
+        publicKeyTemplate[0].pValue = paramsEd448;
+        publicKeyTemplate[0].ulValueLen = sizeof(paramsEd448);
+    }
+    else
+    {
+        return NULL;
+    }
+
+    /* Generate key pair */
+
+    rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_GenerateKeyPair(session->session,
+                                                 &mechanism,
+                                                 publicKeyTemplate, 8,
+                                                 privateKeyTemplate, 10,
+                                                 &publicKey,
+                                                 &privateKey);
+    if (hsm_pkcs11_check_error(ctx, rv, "generate key pair")) {
+        return NULL;
+    }
+
+    new_key = libhsm_key_new();
+    new_key->modulename = strdup(session->module->name);
+    new_key->public_key = publicKey;
+    new_key->private_key = privateKey;
+
+    return new_key;
+}
+
 int
 hsm_remove_key(hsm_ctx_t *ctx, libhsm_key_t *key)
 {
@@ -2798,6 +3302,9 @@ hsm_get_key_info(hsm_ctx_t *ctx,
         case CKK_EC:
             key_info->algorithm_name = strdup("ECDSA");
             break;
+        case CKK_EC_EDWARDS:
+            key_info->algorithm_name = strdup("EDDSA");
+            break;
         default:
             CHECKALLOC(key_info->algorithm_name = malloc(HSM_MAX_ALGONAME));
             snprintf(key_info->algorithm_name, HSM_MAX_ALGONAME,
@@ -2822,6 +3329,42 @@ libhsm_key_info_free(libhsm_key_info_t *key_info)
     }
 }
 
+/* Puts the RRSIG RDATA without signature followed by the canonical
+ * RRset in the scratch buffer of the context. */
+static ldns_buffer *
+hsm_rrset2buffer(hsm_ctx_t *ctx,
+                 const ldns_rr_list* rrset,
+                 ldns_rr *signature)
+{
+    size_t i;
+
+    if (!ctx->sign_buf) {
+        ctx->sign_buf = ldns_buffer_new(LDNS_MAX_PACKETLEN);
+        if (!ctx->sign_buf) {
+            return NULL;
+        }
+    } else {
+        ldns_buffer_clear(ctx->sign_buf);
+    }
+
+    if (ldns_rrsig2buffer_wire(ctx->sign_buf, signature)
+        != LDNS_STATUS_OK) {
+        return NULL;
+    }
+
+    /* make it canonical */
+    for(i = 0; i < ldns_rr_list_rr_count(rrset); i++) {
+        ldns_rr2canonical(ldns_rr_list_rr(rrset, i));
+    }
+
+    /* add the rrset in sign_buf */
+    if (ldns_rr_list2buffer_wire(ctx->sign_buf, rrset)
+        != LDNS_STATUS_OK) {
+        return NULL;
+    }
+    return ctx->sign_buf;
+}
+
 ldns_rr*
 hsm_sign_rrset(hsm_ctx_t *ctx,
                const ldns_rr_list* rrset,
@@ -2831,7 +3374,6 @@ hsm_sign_rrset(hsm_ctx_t *ctx,
     ldns_rr *signature;
     ldns_buffer *sign_buf;
     ldns_rdf *b64_rdf;
-    size_t i;
 
     if (!key) return NULL;
     if (!sign_params) return NULL;
@@ -2842,32 +3384,15 @@ hsm_sign_rrset(hsm_ctx_t *ctx,
     /* right now, we have: a key, a semi-sig and an rrset. For
      * which we can create the sig and base64 encode that and
      * add that to the signature */
-    sign_buf = ldns_buffer_new(LDNS_MAX_PACKETLEN);
-
-    if (ldns_rrsig2buffer_wire(sign_buf, signature)
-        != LDNS_STATUS_OK) {
-        ldns_buffer_free(sign_buf);
+    sign_buf = hsm_rrset2buffer(ctx, rrset, signature);
+    if (!sign_buf) {
         /* ERROR */
         ldns_rr_free(signature);
         return NULL;
     }
 
-    /* make it canonical */
-    for(i = 0; i < ldns_rr_list_rr_count(rrset); i++) {
-        ldns_rr2canonical(ldns_rr_list_rr(rrset, i));
-    }
-
-    /* add the rrset in sign_buf */
-    if (ldns_rr_list2buffer_wire(sign_buf, rrset)
-        != LDNS_STATUS_OK) {
-        ldns_buffer_free(sign_buf);
-        ldns_rr_free(signature);
-        return NULL;
-    }
-
     b64_rdf = hsm_sign_buffer(ctx, sign_buf, key, sign_params->algorithm);
 
-    ldns_buffer_free(sign_buf);
     if (!b64_rdf) {
         /* signing went wrong */
         ldns_rr_free(signature);
@@ -2879,6 +3404,98 @@ hsm_sign_rrset(hsm_ctx_t *ctx,
     return signature;
 }
 
+int
+hsm_sign_rrsets(hsm_ctx_t *ctx,
+                ldns_rr_list** rrsets,
+                size_t nrrsets,
+                const libhsm_key_t *key,
+                const hsm_sign_params_t *sign_params,
+                ldns_rr** signatures)
+{
+    hsm_session_t *session;
+    CK_MECHANISM sign_mechanism;
+    CK_BYTE *data = NULL;
+    CK_ULONG *data_len = NULL;
+    ldns_buffer *sign_buf;
+    ldns_rdf *b64_rdf;
+    size_t i;
+
+    for (i = 0; i < nrrsets; i++) {
+        signatures[i] = NULL;
+    }
+    if (!key) return -1;
+    if (!sign_params) return -1;
+    if (nrrsets == 0) return 0;
+
+    /* the key, its session and the mechanism are the same for the
+     * whole batch, so only look them up once */
+    session = hsm_find_key_session(ctx, key);
+    if (!session) return -1;
+    if (hsm_sign_mechanism(sign_params->algorithm, &sign_mechanism)) {
+        return -1;
+    }
+
+    /* EdDSA signs the rrset data itself, which does not fit in the
+     * digest slots below, so sign each one straight from the buffer */
+    if (hsm_algorithm_is_eddsa(sign_params->algorithm)) {
+        for (i = 0; i < nrrsets; i++) {
+            signatures[i] = hsm_create_empty_rrsig(rrsets[i], sign_params);
+            sign_buf = hsm_rrset2buffer(ctx, rrsets[i], signatures[i]);
+            if (!sign_buf) {
+                goto error;
+            }
+            b64_rdf = hsm_sign_data(ctx, session, key, &sign_mechanism,
+                                    ldns_buffer_begin(sign_buf),
+                                    ldns_buffer_position(sign_buf));
+            if (!b64_rdf) {
+                goto error;
+            }
+            ldns_rr_rrsig_set_sig(signatures[i], b64_rdf);
+        }
+        return 0;
+    }
+
+    CHECKALLOC(data = malloc(nrrsets * HSM_MAX_SIGN_DATA_LENGTH));
+    CHECKALLOC(data_len = malloc(nrrsets * sizeof(CK_ULONG)));
+
+    /* first compute all digests in the reused scratch buffer, then
+     * issue the signing calls back to back on the session */
+    for (i = 0; i < nrrsets; i++) {
+        signatures[i] = hsm_create_empty_rrsig(rrsets[i], sign_params);
+        sign_buf = hsm_rrset2buffer(ctx, rrsets[i], signatures[i]);
+        if (!sign_buf ||
+            hsm_digest_buffer(ctx, session, sign_buf, sign_params->algorithm,
+                              &data[i * HSM_MAX_SIGN_DATA_LENGTH],
+                              &data_len[i])) {
+            goto error;
+        }
+    }
+    for (i = 0; i < nrrsets; i++) {
+        b64_rdf = hsm_sign_data(ctx, session, key, &sign_mechanism,
+                                &data[i * HSM_MAX_SIGN_DATA_LENGTH],
+                                data_len[i]);
+        if (!b64_rdf) {
+            goto error;
+        }
+        ldns_rr_rrsig_set_sig(signatures[i], b64_rdf);
+    }
+
+    free(data_len);
+    free(data);
+    return 0;
+
+error:
+    for (i = 0; i < nrrsets; i++) {
+        if (signatures[i]) {
+            ldns_rr_free(signatures[i]);
+            signatures[i] = NULL;
+        }
+    }
+    free(data_len);
+    free(data);
+    return -1;
+}
+
 int
 hsm_keytag(const char* loc, int alg, int ksk, uint16_t* keytag)
 {
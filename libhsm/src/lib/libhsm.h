@@ -30,6 +30,7 @@
 
 #include <stdint.h>
 #include <ldns/rbtree.h>
+#include <ldns/buffer.h>
 #include <pthread.h>
 #include "cfg.h"
 
@@ -52,6 +53,8 @@
 /* TODO: depends on type and key, or just leave it at current
  * maximum? */
 #define HSM_MAX_SIGNATURE_LENGTH 512
+/*! Maximum length of the digest, with identifier, that is signed */
+#define HSM_MAX_SIGN_DATA_LENGTH 128
 
 /* Note that this constant also determines the size of the shared PIN memory.
  * Increasing this size requires any existing memory to be removed and should
@@ -123,6 +126,10 @@ typedef struct {
     /*!< non-zero if the last operation failed (only the first error will be set) */
     int error;
 
+    /*!< non-zero if a PKCS#11 call failed since the context was handed
+         out by the pool (not cleared by hsm_get_error) */
+    int failed;
+
    /*!< static string describing the action we were trying to do
         when the first error happened */
     const char *error_action;
@@ -132,6 +139,9 @@ typedef struct {
     
     ldns_rbtree_t* keycache;
     pthread_mutex_t *keycache_lock;
+
+    /*!< scratch buffer reused for the data to be signed */
+    ldns_buffer *sign_buf;
 } hsm_ctx_t;
 
 
@@ -233,8 +243,9 @@ hsm_create_context(void);
 
 /*! Check HSM context
 
-Check if the associated sessions are still alive.
-If they are not alive, then try re-open libhsm.
+Check if the sessions of the global context are still alive, using
+C_GetSessionInfo() only. Sessions that were lost, for instance after a
+token reset, are reopened and logged in again.
 
 \param context HSM context
 \return 0 if successful, !0 if failed
@@ -252,6 +263,71 @@ Also destroys any associated sessions.
 void
 hsm_destroy_context(hsm_ctx_t *context);
 
+
+/*! Open the session pool
+
+Fills a pool with size contexts, each with a session for every attached
+HSM. Contexts are handed out with hsm_pool_acquire() and returned with
+hsm_pool_release(); the idle contexts and those in use together never
+exceed size. An existing pool is closed first. The pool is closed
+by hsm_close().
+
+\param size number of contexts the pool holds
+\return 0 if all contexts were created, !0 otherwise
+*/
+int
+hsm_pool_open(size_t size);
+
+
+/*! Close the session pool
+
+Destroys the idle contexts. Contexts that are in use are destroyed when
+they are released. Threads waiting in hsm_pool_acquire() create a context
+of their own.
+*/
+void
+hsm_pool_close(void);
+
+
+/*! Take a context from the session pool
+
+If no idle context is available, waits until one is released, unless
+contexts were lost and the pool has room left, in which case a new one is
+created. Without an open pool a new context is always created.
+
+\return HSM context, NULL if no context could be created
+*/
+hsm_ctx_t *
+hsm_pool_acquire(void);
+
+
+/*! Return a context to the session pool
+
+If a PKCS#11 call failed on the context, its sessions are checked and the
+context is destroyed if they are no longer usable. Contexts that do not
+fit in the pool are destroyed as well. Either way a thread waiting in
+hsm_pool_acquire() is woken up.
+
+\param context HSM context
+*/
+void
+hsm_pool_release(hsm_ctx_t *context);
+
+
+/*! Check the session pool
+
+Logs in again on HSMs that dropped the sessions of the global context,
+for instance after a token reset, drops idle contexts whose sessions were
+lost and tops the pool up again, leaving room for the contexts that are in
+use. Sessions are checked with C_GetSessionInfo() only. Signing threads
+keep releasing contexts while the pool is checked; a thread that finds no
+idle context waits until the check is done.
+
+\return 0 if successful, !0 if the sessions could not be recovered
+*/
+int
+hsm_pool_check(void);
+
 void
 libhsm_key_free(libhsm_key_t *key);
 
@@ -371,6 +447,23 @@ hsm_generate_ecdsa_key(hsm_ctx_t *context,
                        const char *repository,
                        const char *curve);
 
+/*! Generate new EdDSA key pair in HSM
+
+Keys generated by libhsm will have a 16-byte identifier set as CKA_ID
+and the hexadecimal representation of it set as CKA_LABEL.
+
+The returned key structure can be freed with libhsm_key_free()
+
+\param context HSM context
+\param repository repository in where to create the key
+\param curve which curve to use, "edwards25519" or "edwards448"
+\return return key identifier or NULL if key generation failed
+*/
+libhsm_key_t *
+hsm_generate_eddsa_key(hsm_ctx_t *context,
+                       const char *repository,
+                       const char *curve);
+
 /*! Remove a key pair from HSM
 
 When a key is removed, the module pointer is set to NULL, and
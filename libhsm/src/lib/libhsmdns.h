@@ -30,6 +30,12 @@
 
 #include <ldns/ldns.h>
 
+/* TODO: We can remove these if we require LDNS >= 1.7.0 */
+#if LDNS_REVISION < ((1<<16)|(7<<8)|(0))
+#define LDNS_ED25519 15
+#define LDNS_ED448 16
+#endif
+
 /*! Extra information for signing rrsets (algorithm, expiration, etc) */
 typedef struct {
     /** The DNS signing algorithm identifier */
@@ -81,6 +87,32 @@ hsm_sign_rrset(hsm_ctx_t *ctx,
                const hsm_sign_params_t *sign_params);
 
 
+/*! Sign a number of RRsets using the same key
+
+All signatures are produced with the same signing parameters. The
+digests of the RRsets are computed first, after which the signing
+operations are issued back to back on the session of the key. EdDSA
+signs the RRset data itself, so those RRsets are signed one by one.
+Each returned ldns_rr structure can be freed with ldns_rr_free()
+
+\param context HSM context
+\param rrsets RRsets to sign
+\param nrrsets Number of RRsets to sign
+\param key Key pair used to sign
+\param sign_params the signing parameters
+\param signatures Array of nrrsets entries receiving the signatures
+\return 0 if successful, -1 if any signature failed (no signatures
+are returned in that case)
+*/
+int
+hsm_sign_rrsets(hsm_ctx_t *ctx,
+                ldns_rr_list** rrsets,
+                size_t nrrsets,
+                const libhsm_key_t *key,
+                const hsm_sign_params_t *sign_params,
+                ldns_rr** signatures);
+
+
 /*! Get DNSKEY RR
 
 The returned ldns_rr structure can be freed with ldns_rr_free()
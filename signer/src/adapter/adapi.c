@@ -92,13 +92,12 @@ adapi_process_dnskey(zone_type* zone, ldns_rr* rr)
 
 
 /**
- * Process RR.
+ * Filter RR.
  *
  */
-static ods_status
-adapi_process_rr(zone_type* zone, names_view_type view, ldns_rr* rr, int add, int backup)
+ods_status
+adapi_filter_rr(zone_type* zone, ldns_rr* rr, int add, int backup)
 {
-    ods_status status = ODS_STATUS_OK;
     uint32_t tmp = 0;
     ods_log_assert(rr);
     ods_log_assert(zone);
@@ -143,7 +142,22 @@ adapi_process_rr(zone_type* zone, names_view_type view, ldns_rr* rr, int add, in
 
     /* TODO: DNAME and CNAME checks */
     /* TODO: NS and DS checks */
+    return ODS_STATUS_OK;
+}
+
 
+/**
+ * Process RR.
+ *
+ */
+static ods_status
+adapi_process_rr(zone_type* zone, names_view_type view, ldns_rr* rr, int add, int backup)
+{
+    ods_status status;
+    status = adapi_filter_rr(zone, rr, add, backup);
+    if (status != ODS_STATUS_OK) {
+        return status;
+    }
     if (add) {
         return zone_add_rr(zone, view, rr);
     } else {
@@ -72,6 +72,20 @@ void adapi_trans_full(zone_type* zone, names_view_type view, unsigned more_comin
  */
 void adapi_trans_diff(zone_type* zone, names_view_type view, unsigned more_coming);
 
+/**
+ * Filter RR before it is added to or deleted from the zone. Forces the
+ * class to IN, applies the DNSKEY TTL and MaxZoneTTL and skips
+ * out-of-zone and DNSSEC data.
+ * \param[in] zone zone
+ * \param[in] rr RR, may be modified
+ * \param[in] add whether the RR is to be added
+ * \param[in] backup from backup
+ * \return ods_status ODS_STATUS_OK if the RR is to be processed,
+ *         ODS_STATUS_UNCHANGED if it is skipped, error otherwise
+ *
+ */
+ods_status adapi_filter_rr(zone_type* zone, ldns_rr* rr, int add, int backup);
+
 /**
  * Add RR.
  * \param[in] zone zone
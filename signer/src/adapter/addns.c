@@ -42,16 +42,81 @@
 #include "status.h"
 #include "util.h"
 #include "signer/zone.h"
+#include "wire/apexcache.h"
+#include "wire/axfrimage.h"
+#include "wire/ixfrjournal.h"
 #include "wire/notify.h"
 #include "wire/xfrd.h"
+#include "signer/zonelist.h"
+#include "daemon/metastorage.h"
 
 #include <ldns/ldns.h>
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
 
 static const char* adapter_str = "adapter";
-static ods_status addns_read_pkt(FILE* fd, zone_type* zone, names_view_type view);
-static ods_status addns_read_file(FILE* fd, zone_type* zone, names_view_type view);
+
+/**
+ * Position in a mapped transfer spool.
+ *
+ */
+typedef struct addns_spool_struct addns_spool_type;
+struct addns_spool_struct {
+    const uint8_t* data;
+    size_t size;
+    size_t pos; /* next spool record */
+    const uint8_t* pkt; /* packet being read */
+    size_t pktlen;
+    size_t pktpos;
+    unsigned ancount; /* answer RRs left in packet */
+    int end; /* end of transfer reached */
+};
+
+/**
+ * Progress of applying a transfer to a view.
+ *
+ */
+typedef struct addns_xfr_struct addns_xfr_type;
+struct addns_xfr_struct {
+    size_t rr_count;
+    uint32_t new_serial;
+    uint32_t old_serial;
+    uint32_t tmp_serial;
+    unsigned is_axfr;
+    unsigned del_mode;
+    unsigned soa_seen;
+};
+
+/**
+ * A transfer applied to an input view while it is being received.
+ *
+ */
+typedef struct addns_stream_packet_struct addns_stream_packet_type;
+struct addns_stream_packet_struct {
+    addns_stream_packet_type* next;
+    size_t len;
+    uint8_t data[1];
+};
+
+struct addns_stream_struct {
+    zone_type* zone;
+    names_view_type view;
+    addns_xfr_type xfr;
+    ods_status status;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    addns_stream_packet_type* first;
+    addns_stream_packet_type* last;
+    int finished; /* no more packets will be queued */
+};
+
+static ods_status addns_read_pkt(addns_spool_type* spool, zone_type* zone, names_view_type view, uint32_t* serial);
+static ods_status addns_read_file(addns_spool_type* spool, zone_type* zone, names_view_type view);
 
 
 /**
@@ -131,254 +196,309 @@ addns_read_line:
 
 
 /**
- * Read pkt from file.
+ * Start reading the answer section of a packet.
  *
  */
-static ods_status
-addns_read_pkt(FILE* fd, zone_type* zone, names_view_type view)
+static ldns_status
+addns_spool_packet(addns_spool_type* spool, const uint8_t* pkt, size_t len)
 {
     ldns_rr* rr = NULL;
-    long startpos = 0;
-    long fpos = 0;
-    int len = 0;
-    uint32_t new_serial = 0;
-    uint32_t old_serial = 0;
-    uint32_t tmp_serial = 0;
-    ldns_rdf* prev = NULL;
-    ldns_rdf* orig = NULL;
-    ldns_rdf* dname = NULL;
-    uint32_t ttl = 0;
-    size_t rr_count = 0;
-    ods_status result = ODS_STATUS_OK;
-    ldns_status status = LDNS_STATUS_OK;
-    char line[SE_ADFILE_MAXLINE];
-    unsigned is_axfr = 0;
-    unsigned del_mode = 0;
-    unsigned soa_seen = 0;
-    unsigned line_update_interval = 100000;
-    unsigned line_update = line_update_interval;
-    unsigned l = 0;
-    char* xfrd;
-    char* fin;
-    char* fout;
+    ldns_status status;
+    unsigned qdcount;
 
-    ods_log_assert(fd);
-    ods_log_assert(zone);
-    ods_log_assert(zone->name);
-
-
-    fpos = ftell(fd);
-    len = adutil_readline_frm_file(fd, line, &l, 1);
-    if (len < 0) {
-        /* -1 EOF */
-        return ODS_STATUS_EOF;
+    spool->pkt = pkt;
+    spool->pktlen = len;
+    spool->ancount = 0;
+    if (len < LDNS_HEADER_SIZE) {
+        return LDNS_STATUS_PACKET_OVERFLOW;
     }
-    adutil_rtrim_line(line, &len);
-    if (ods_strcmp(";;BEGINPACKET", line) != 0) {
-        ods_log_error("[%s] bogus xfrd file zone %s, missing ;;BEGINPACKET (was %s)",
-            adapter_str, zone->name, line);
-        return ODS_STATUS_ERR;
+    qdcount = read_uint16(pkt + 4);
+    spool->ancount = read_uint16(pkt + 6);
+    spool->pktpos = LDNS_HEADER_SIZE;
+    /* skip question section */
+    while (qdcount--) {
+        status = ldns_wire2rr(&rr, pkt, len, &spool->pktpos,
+            LDNS_SECTION_QUESTION);
+        if (status != LDNS_STATUS_OK) {
+            spool->ancount = 0;
+            return status;
+        }
+        ldns_rr_free(rr);
+        rr = NULL;
     }
-    startpos = fpos;
-    fpos = ftell(fd);
-
-    rr_count = 0;
-    is_axfr = 0;
-    del_mode = 0;
-    soa_seen = 0;
-    /* $ORIGIN <zone name> */
-    dname = adapi_get_origin(zone);
-    if (!dname) {
-        ods_log_error("[%s] error getting default value for $ORIGIN",
-            adapter_str);
-        return ODS_STATUS_ERR;
+    return LDNS_STATUS_OK;
+}
+
+
+/**
+ * Read the next answer RR from the transfer spool. Returns NULL at the
+ * end of the transfer, at the end of the spool or on error (status set).
+ *
+ */
+static ldns_rr*
+addns_spool_rr(addns_spool_type* spool, ldns_status* status)
+{
+    ldns_rr* rr = NULL;
+    uint8_t type;
+    size_t len;
+
+    *status = LDNS_STATUS_OK;
+    while (!spool->pkt || spool->ancount == 0) {
+        spool->pkt = NULL;
+        if (spool->pos + XFRD_SPOOL_HDRLEN > spool->size) {
+            /* EOF */
+            return NULL;
+        }
+        type = spool->data[spool->pos];
+        len = read_uint32(&spool->data[spool->pos + 1]);
+        if (spool->pos + XFRD_SPOOL_HDRLEN + len > spool->size) {
+            /* partly written record, treat as EOF */
+            return NULL;
+        }
+        switch (type) {
+            case XFRD_SPOOL_PACKET:
+                spool->pos += XFRD_SPOOL_HDRLEN + len;
+                *status = addns_spool_packet(spool,
+                    &spool->data[spool->pos - len], len);
+                if (*status != LDNS_STATUS_OK) {
+                    return NULL;
+                }
+                break;
+            case XFRD_SPOOL_END:
+                spool->pos += XFRD_SPOOL_HDRLEN + len;
+                spool->end = 1;
+                return NULL;
+            case XFRD_SPOOL_BEGIN:
+                /* begin transfer but previous not ended, rollback */
+                return NULL;
+            default:
+                *status = LDNS_STATUS_ERR;
+                return NULL;
+        }
     }
-    orig = ldns_rdf_clone(dname);
-    if (!orig) {
-        ods_log_error("[%s] error setting default value for $ORIGIN",
-            adapter_str);
-        return ODS_STATUS_ERR;
+    spool->ancount--;
+    *status = ldns_wire2rr(&rr, spool->pkt, spool->pktlen, &spool->pktpos,
+        LDNS_SECTION_ANSWER);
+    if (*status != LDNS_STATUS_OK) {
+        if (rr) {
+            ldns_rr_free(rr);
+        }
+        return NULL;
     }
-    /* $TTL <default ttl> */
-    ttl = adapi_get_ttl(zone);
+    return rr;
+}
 
-    /* read RRs */
-    while ((rr = addns_read_rr(fd, line, &orig, &prev, &ttl, &status, &l))
-        != NULL) {
-        /* update file position */
-        fpos = ftell(fd);
-        /* check status */
-        if (status != LDNS_STATUS_OK) {
-            ods_log_error("[%s] error reading RR at line %i (%s): %s",
-                adapter_str, l, ldns_get_errorstr_by_id(status), line);
-            result = ODS_STATUS_ERR;
-            break;
+
+/**
+ * Apply the next RR of a transfer to the view, this takes over the RR.
+ * Returns other than ODS_STATUS_OK if the transfer can not be applied.
+ *
+ */
+static ods_status
+addns_xfr_rr(addns_xfr_type* xfr, zone_type* zone, names_view_type view,
+    ldns_rr* rr)
+{
+    ods_status result = ODS_STATUS_OK;
+
+    /* first RR: check if SOA and correct zone & serialno */
+    if (xfr->rr_count == 0) {
+        xfr->rr_count++;
+        if (ldns_rr_get_type(rr) != LDNS_RR_TYPE_SOA) {
+            ods_log_error("[%s] bad xfr, first rr is not soa",
+                adapter_str);
+            ldns_rr_free(rr);
+            return ODS_STATUS_ERR;
         }
-        /* debug update */
-        if (l > line_update) {
-            ods_log_debug("[%s] ...at line %i: %s", adapter_str, l, line);
-            line_update += line_update_interval;
+        xfr->soa_seen++;
+        if (ldns_dname_compare(ldns_rr_owner(rr), zone->apex)) {
+            ods_log_error("[%s] bad xfr, soa dname not equal to zone "
+                "dname %s", adapter_str, zone->name);
+            ldns_rr_free(rr);
+            return ODS_STATUS_ERR;
         }
-        /* first RR: check if SOA and correct zone & serialno */
-        if (rr_count == 0) {
-            rr_count++;
-            if (ldns_rr_get_type(rr) != LDNS_RR_TYPE_SOA) {
-                ods_log_error("[%s] bad xfr, first rr is not soa",
-                    adapter_str);
-                ldns_rr_free(rr);
-                rr = NULL;
-                result = ODS_STATUS_ERR;
-                break;
-            }
-            soa_seen++;
-            if (ldns_dname_compare(ldns_rr_owner(rr), zone->apex)) {
-                ods_log_error("[%s] bad xfr, soa dname not equal to zone "
-                    "dname %s", adapter_str, zone->name);
-                ldns_rr_free(rr);
-                rr = NULL;
-                result = ODS_STATUS_ERR;
-                break;
-            }
 
-            tmp_serial =
-                ldns_rdf2native_int32(ldns_rr_rdf(rr, SE_SOA_RDATA_SERIAL));
-            old_serial = *(zone->inboundserial);
+        xfr->tmp_serial =
+            ldns_rdf2native_int32(ldns_rr_rdf(rr, SE_SOA_RDATA_SERIAL));
 
 /**
  * Do we need to make this check? It is already done by xfrd.
  * By not doing this check, retransfers will be taken into account.
  *
 
-            if (!util_serial_gt(tmp_serial, old_serial) &&
-                zone->db->is_initialized) {
-                ods_log_info("[%s] zone %s is already up to date, have "
-                    "serial %u, got serial %u", adapter_str, zone->name,
-                    old_serial, tmp_serial);
-                new_serial = tmp_serial;
-                ldns_rr_free(rr);
-                rr = NULL;
-                result = ODS_STATUS_UPTODATE;
-                while (len >= 0) {
-                    len = adutil_readline_frm_file(fd, line, &l, 1);
-                    if (len && ods_strcmp(";;ENDPACKET", line) == 0) {
-                        startpos = 0;
-                        break;
-                    }
-                }
-                break;
-            }
+        if (!util_serial_gt(xfr->tmp_serial, xfr->old_serial) &&
+            zone->db->is_initialized) {
+            ods_log_info("[%s] zone %s is already up to date, have "
+                "serial %u, got serial %u", adapter_str, zone->name,
+                xfr->old_serial, xfr->tmp_serial);
+            xfr->new_serial = xfr->tmp_serial;
+            ldns_rr_free(rr);
+            return ODS_STATUS_UPTODATE;
+        }
 
  *
  **/
 
-            ldns_rr_free(rr);
-            rr = NULL;
-            result = ODS_STATUS_OK;
-            continue;
-        }
-        /* second RR: if not soa, this is an AXFR */
-        if (rr_count == 1) {
-            if (ldns_rr_get_type(rr) != LDNS_RR_TYPE_SOA) {
-                ods_log_verbose("[%s] detected axfr serial=%u for zone %s",
-                    adapter_str, tmp_serial, zone->name);
-                new_serial = tmp_serial;
-                is_axfr = 1;
-                del_mode = 0;
-            } else {
-                ods_log_verbose("[%s] detected ixfr serial=%u for zone %s",
-                    adapter_str, tmp_serial, zone->name);
+        ldns_rr_free(rr);
+        return ODS_STATUS_OK;
+    }
+    /* second RR: if not soa, this is an AXFR */
+    if (xfr->rr_count == 1) {
+        if (ldns_rr_get_type(rr) != LDNS_RR_TYPE_SOA) {
+            ods_log_verbose("[%s] detected axfr serial=%u for zone %s",
+                adapter_str, xfr->tmp_serial, zone->name);
+            xfr->new_serial = xfr->tmp_serial;
+            xfr->is_axfr = 1;
+            xfr->del_mode = 0;
+        } else {
+            ods_log_verbose("[%s] detected ixfr serial=%u for zone %s",
+                adapter_str, xfr->tmp_serial, zone->name);
 
-                if (!util_serial_gt(tmp_serial, old_serial)) {
-                    ods_log_error("[%s] bad ixfr for zone %s, bad start serial %lu",
-                        adapter_str, zone->name, (unsigned long)tmp_serial);
-                    result = ODS_STATUS_ERR;
-                }
+            if (!util_serial_gt(xfr->tmp_serial, xfr->old_serial)) {
+                ods_log_error("[%s] bad ixfr for zone %s, bad start serial %lu",
+                    adapter_str, zone->name, (unsigned long)xfr->tmp_serial);
+                result = ODS_STATUS_ERR;
+            }
 
-                new_serial = tmp_serial;
-                tmp_serial =
-                  ldns_rdf2native_int32(ldns_rr_rdf(rr, SE_SOA_RDATA_SERIAL));
-                ldns_rr_free(rr);
-                rr = NULL;
-                rr_count++;
-                if (tmp_serial < new_serial) {
-                    del_mode = 1;
-                    result = ODS_STATUS_OK;
-                    continue;
-                } else {
-                    ods_log_error("[%s] bad ixfr for zone %s, bad soa serial %lu",
-                        adapter_str, zone->name, (unsigned long) tmp_serial);
-                    result = ODS_STATUS_ERR;
-                    break;
-                }
+            xfr->new_serial = xfr->tmp_serial;
+            xfr->tmp_serial =
+              ldns_rdf2native_int32(ldns_rr_rdf(rr, SE_SOA_RDATA_SERIAL));
+            ldns_rr_free(rr);
+            xfr->rr_count++;
+            if (xfr->tmp_serial < xfr->new_serial) {
+                xfr->del_mode = 1;
+                return ODS_STATUS_OK;
+            } else {
+                ods_log_error("[%s] bad ixfr for zone %s, bad soa serial %lu",
+                    adapter_str, zone->name, (unsigned long) xfr->tmp_serial);
+                return ODS_STATUS_ERR;
             }
         }
-        /* soa means swap */
-        rr_count++;
-        if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_SOA) {
-            if (!is_axfr) {
-                tmp_serial =
-                  ldns_rdf2native_int32(ldns_rr_rdf(rr, SE_SOA_RDATA_SERIAL));
-                if (tmp_serial <= new_serial) {
-                    if (tmp_serial == new_serial) {
-                        soa_seen++;
-                    }
-                    del_mode = !del_mode;
-                    ldns_rr_free(rr);
-                    rr = NULL;
-                    result = ODS_STATUS_OK;
-                    continue;
-                } else {
-                    ods_log_assert(tmp_serial > new_serial);
-                    ods_log_error("[%s] bad xfr for zone %s, bad soa serial",
-                        adapter_str, zone->name);
-                    ldns_rr_free(rr);
-                    rr = NULL;
-                    result = ODS_STATUS_ERR;
-                    break;
+    }
+    /* soa means swap */
+    xfr->rr_count++;
+    if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_SOA) {
+        if (!xfr->is_axfr) {
+            xfr->tmp_serial =
+              ldns_rdf2native_int32(ldns_rr_rdf(rr, SE_SOA_RDATA_SERIAL));
+            if (xfr->tmp_serial <= xfr->new_serial) {
+                if (xfr->tmp_serial == xfr->new_serial) {
+                    xfr->soa_seen++;
                 }
+                xfr->del_mode = !xfr->del_mode;
+                ldns_rr_free(rr);
+                return ODS_STATUS_OK;
             } else {
-               /* for axfr */
-               soa_seen++;
+                ods_log_assert(xfr->tmp_serial > xfr->new_serial);
+                ods_log_error("[%s] bad xfr for zone %s, bad soa serial",
+                    adapter_str, zone->name);
+                ldns_rr_free(rr);
+                return ODS_STATUS_ERR;
             }
-        }
-        /* [add to/remove from] the zone */
-        if (!is_axfr && del_mode) {
-            ods_log_deeebug("[%s] delete RR #%lu at line %i: %s",
-                adapter_str, (unsigned long)rr_count, l, line);
-            result = adapi_del_rr(zone, view, rr, 0);
-            ldns_rr_free(rr);
-            rr = NULL;
         } else {
-            ods_log_deeebug("[%s] add RR #%lu at line %i: %s",
-                adapter_str, (unsigned long)rr_count, l, line);
-            result = adapi_add_rr(zone, view, rr, 0);
-        }
-        if (result == ODS_STATUS_UNCHANGED) {
-            ods_log_debug("[%s] skipping RR at line %i (%s): %s",
-                adapter_str, l, del_mode?"not found":"duplicate", line);
-            ldns_rr_free(rr);
-            rr = NULL;
-            result = ODS_STATUS_OK;
-            continue;
-        } else if (result != ODS_STATUS_OK) {
-            ods_log_error("[%s] error %s RR at line %i: %s",
-                adapter_str, del_mode?"deleting":"adding", l, line);
-            ldns_rr_free(rr);
-            rr = NULL;
-            break;
+           /* for axfr */
+           xfr->soa_seen++;
         }
     }
-    /* and done */
-    if (orig) {
-        ldns_rdf_deep_free(orig);
-        orig = NULL;
+    /* [add to/remove from] the zone */
+    if (!xfr->is_axfr && xfr->del_mode) {
+        ods_log_deeebug("[%s] delete RR #%lu", adapter_str,
+            (unsigned long)xfr->rr_count);
+        result = adapi_del_rr(zone, view, rr, 0);
+        ldns_rr_free(rr);
+    } else {
+        ods_log_deeebug("[%s] add RR #%lu", adapter_str,
+            (unsigned long)xfr->rr_count);
+        result = adapi_add_rr(zone, view, rr, 0);
     }
-    if (prev) {
-        ldns_rdf_deep_free(prev);
-        prev = NULL;
+    if (result == ODS_STATUS_UNCHANGED) {
+        ods_log_debug("[%s] skipping RR #%lu (%s)", adapter_str,
+            (unsigned long)xfr->rr_count, xfr->del_mode?"not found":"duplicate");
+        ldns_rr_free(rr);
+        return ODS_STATUS_OK;
+    } else if (result != ODS_STATUS_OK) {
+        ods_log_error("[%s] error %s RR #%lu", adapter_str,
+            xfr->del_mode?"deleting":"adding", (unsigned long)xfr->rr_count);
+        ldns_rr_free(rr);
+        return result;
+    }
+    return ODS_STATUS_OK;
+}
+
+
+/**
+ * Check a fully applied transfer. The inbound serial is set by the caller
+ * once the changes are committed.
+ *
+ */
+static ods_status
+addns_xfr_done(addns_xfr_type* xfr, zone_type* zone)
+{
+    /* check the number of SOAs seen */
+    if ((xfr->is_axfr && xfr->soa_seen != 2) ||
+        (!xfr->is_axfr && xfr->soa_seen != 3)) {
+        ods_log_error("[%s] bad %s, wrong number of SOAs (%u)",
+            adapter_str, xfr->is_axfr?"axfr":"ixfr", xfr->soa_seen);
+        return ODS_STATUS_ERR;
+    }
+    return ODS_STATUS_OK;
+}
+
+
+/**
+ * Read transfer from spool.
+ *
+ */
+static ods_status
+addns_read_pkt(addns_spool_type* spool, zone_type* zone, names_view_type view,
+    uint32_t* serial)
+{
+    ldns_rr* rr = NULL;
+    size_t startpos = 0;
+    addns_xfr_type xfr;
+    ods_status result = ODS_STATUS_OK;
+    ldns_status status = LDNS_STATUS_OK;
+    size_t rr_update_interval = 100000;
+    size_t rr_update = rr_update_interval;
+    char* xfrd;
+    char* fin;
+    char* fout;
+
+    ods_log_assert(spool);
+    ods_log_assert(zone);
+    ods_log_assert(zone->name);
+
+    if (spool->pos + XFRD_SPOOL_HDRLEN > spool->size) {
+        /* EOF */
+        return ODS_STATUS_EOF;
+    }
+    if (spool->data[spool->pos] != XFRD_SPOOL_BEGIN) {
+        ods_log_error("[%s] bogus xfrd file zone %s, missing begin of "
+            "transfer at offset %lu", adapter_str, zone->name,
+            (unsigned long) spool->pos);
+        return ODS_STATUS_ERR;
+    }
+    startpos = spool->pos;
+    spool->pos += XFRD_SPOOL_HDRLEN;
+    spool->pkt = NULL;
+    spool->end = 0;
+    memset(&xfr, 0, sizeof(xfr));
+    xfr.old_serial = *serial;
+
+    /* read RRs */
+    while ((rr = addns_spool_rr(spool, &status)) != NULL) {
+        /* debug update */
+        if (xfr.rr_count > rr_update) {
+            ods_log_debug("[%s] ...at RR #%lu", adapter_str,
+                (unsigned long) xfr.rr_count);
+            rr_update += rr_update_interval;
+        }
+        result = addns_xfr_rr(&xfr, zone, view, rr);
+        if (result != ODS_STATUS_OK) {
+            break;
+        }
     }
     /* check again */
-    if (ods_strcmp(";;ENDPACKET", line) == 0) {
+    if (spool->end) {
         ods_log_verbose("[%s] xfr zone %s on disk complete, commit to db",
             adapter_str, zone->name);
             startpos = 0;
@@ -389,23 +509,15 @@ addns_read_pkt(FILE* fd, zone_type* zone, names_view_type view)
     }
     /* otherwise EOF */
     if (result == ODS_STATUS_OK && status != LDNS_STATUS_OK) {
-        ods_log_error("[%s] error reading RR at line %i (%s): %s",
-            adapter_str, l, ldns_get_errorstr_by_id(status), line);
+        ods_log_error("[%s] error reading RR #%lu (%s)", adapter_str,
+            (unsigned long) xfr.rr_count, ldns_get_errorstr_by_id(status));
         result = ODS_STATUS_ERR;
     }
-    /* check the number of SOAs seen */
     if (result == ODS_STATUS_OK) {
-        if ((is_axfr && soa_seen != 2) || (!is_axfr && soa_seen != 3)) {
-            ods_log_error("[%s] bad %s, wrong number of SOAs (%u)",
-                adapter_str, is_axfr?"axfr":"ixfr", soa_seen);
-            result = ODS_STATUS_ERR;
-        }
+        result = addns_xfr_done(&xfr, zone);
     }
-    /* input zone ok, set inbound serial and apply differences */
     if (result == ODS_STATUS_OK) {
-        free(zone->inboundserial); /* FIXME handle if inboundserial is same mem location as nextserial */
-        zone->inboundserial = malloc(sizeof(uint32_t));
-        *(zone->inboundserial) = new_serial;
+        *serial = xfr.new_serial;
     }
     if (result == ODS_STATUS_UPTODATE) {
         /* do a transaction for DNSKEY and NSEC3PARAM */
@@ -429,6 +541,8 @@ addns_read_pkt(FILE* fd, zone_type* zone, names_view_type view)
                 adapter_str, zone->name, ods_status2str(result));
         } else {
             pthread_mutex_lock(&zone->xfrd->rw_lock);
+            /* a transfer being received is appended and moved as well */
+            xfrd_spool_close(zone->xfrd);
             if (ods_file_lastmodified(xfrd)) {
                 result = ods_file_copy(xfrd, fout, 0, 1);
                 if (result != ODS_STATUS_OK) {
@@ -457,19 +571,23 @@ addns_read_pkt(FILE* fd, zone_type* zone, names_view_type view)
 
 
 /**
- * Read pkt from file.
+ * Read transfers from spool.
  *
  */
 static ods_status
-addns_read_file(FILE* fd, zone_type* zone, names_view_type view)
+addns_read_file(addns_spool_type* spool, zone_type* zone, names_view_type view)
 {
     ods_status status = ODS_STATUS_OK;
+    uint32_t serial;
 
+    serial = (zone->inboundserial ? *zone->inboundserial : 0);
     while (status == ODS_STATUS_OK) {
-        status = addns_read_pkt(fd, zone, view);
+        status = addns_read_pkt(spool, zone, view, &serial);
         if (status == ODS_STATUS_OK) {
+            /* input zone ok, set inbound serial and apply differences */
+            zone_set_inboundserial(zone, serial);
             pthread_mutex_lock(&zone->xfrd->serial_lock);
-            zone->xfrd->serial_xfr = *(zone->inboundserial);
+            zone->xfrd->serial_xfr = serial;
             zone->xfrd->serial_xfr_acquired = zone->xfrd->serial_disk_acquired;
             pthread_mutex_unlock(&zone->xfrd->serial_lock);
         }
@@ -492,6 +610,7 @@ dnsin_create(void)
     CHECKALLOC(addns = (dnsin_type*) malloc(sizeof(dnsin_type)));
     addns->request_xfr = NULL;
     addns->allow_notify = NULL;
+    addns->allow_update = NULL;
     addns->tsig = NULL;
     return addns;
 }
@@ -538,6 +657,7 @@ dnsin_read(dnsin_type* addns, const char* filename)
         addns->tsig = parse_addns_tsig(filename);
         addns->request_xfr = parse_addns_request_xfr(filename, addns->tsig);
         addns->allow_notify = parse_addns_allow_notify(filename, addns->tsig);
+        addns->allow_update = parse_addns_allow_update(filename, addns->tsig);
         ods_fclose(fd);
         return ODS_STATUS_OK;
     }
@@ -654,7 +774,6 @@ dnsout_send_notify(zone_type* z, names_view_type view)
     ods_log_assert(z->name);
     names_viewlookupone(view, NULL, LDNS_RR_TYPE_SOA, NULL, &soa);
     ods_log_assert(soa);
-    soa = ldns_rr_clone(soa);
     notify_enable(z->notify, soa);
 }
 
@@ -670,6 +789,8 @@ addns_read(zone_type* z, names_view_type v)
     char* xfrfile = NULL;
     char* file = NULL;
     FILE* fd = NULL;
+    long size = -1;
+    addns_spool_type spool;
     ods_log_assert(z);
     ods_log_assert(z->name);
     ods_log_assert(z->xfrd);
@@ -704,6 +825,8 @@ addns_read(zone_type* z, names_view_type v)
         ods_log_error("[%s] unable to build paths to xfrd files", adapter_str);
         return ODS_STATUS_MALLOC_ERR;
     }
+    /* the receiving side reopens the spool for the next transfer */
+    xfrd_spool_close(z->xfrd);
     if (rename(xfrfile, file) != 0) {
         pthread_mutex_unlock(&z->xfrd->serial_lock);
         pthread_mutex_unlock(&z->xfrd->rw_lock);
@@ -717,14 +840,37 @@ addns_read(zone_type* z, names_view_type v)
     /* open copy of zone transfers to read */
     fd = ods_fopen(file, NULL, "r");
     free((void*) xfrfile);
-    if (!fd) {
+    if (fd && fseek(fd, 0, SEEK_END) == 0) {
+        size = ftell(fd);
+    }
+    if (size < 0) {
+        if (fd) {
+            ods_fclose(fd);
+        }
         pthread_mutex_unlock(&z->xfrd->rw_lock);
         free((void*) file);
         return ODS_STATUS_FOPEN_ERR;
     }
     pthread_mutex_unlock(&z->xfrd->rw_lock);
 
-    status = addns_read_file(fd, z, v);
+    /* the transfers are decoded straight from the mapped spool */
+    memset(&spool, 0, sizeof(spool));
+    spool.size = (size_t) size;
+    if (spool.size > 0) {
+        spool.data = mmap(NULL, spool.size, PROT_READ, MAP_PRIVATE,
+            fileno(fd), 0);
+        if (spool.data == MAP_FAILED) {
+            ods_log_error("[%s] unable to map file %s: %s", adapter_str, file,
+                strerror(errno));
+            ods_fclose(fd);
+            free((void*) file);
+            return ODS_STATUS_FREAD_ERR;
+        }
+    }
+    status = addns_read_file(&spool, z, v);
+    if (spool.size > 0) {
+        munmap((void*) spool.data, spool.size);
+    }
     if (status == ODS_STATUS_OK) {
         /* clean up copy of zone transfer */
         if (unlink((const char*) file) != 0) {
@@ -739,6 +885,186 @@ addns_read(zone_type* z, names_view_type v)
 }
 
 
+/**
+ * Apply queued packets of a transfer until it is finished.
+ *
+ */
+static void*
+addns_stream_apply(void* arg)
+{
+    addns_stream_type* stream = (addns_stream_type*) arg;
+    addns_stream_packet_type* packet;
+    addns_spool_type spool;
+    ldns_status status;
+    ldns_rr* rr;
+
+    for (;;) {
+        pthread_mutex_lock(&stream->lock);
+        while (!stream->first && !stream->finished) {
+            pthread_cond_wait(&stream->cond, &stream->lock);
+        }
+        packet = stream->first;
+        if (packet) {
+            stream->first = packet->next;
+            if (!stream->first) {
+                stream->last = NULL;
+            }
+        }
+        pthread_mutex_unlock(&stream->lock);
+        if (!packet) {
+            break;
+        }
+        if (stream->status == ODS_STATUS_OK) {
+            memset(&spool, 0, sizeof(spool));
+            status = addns_spool_packet(&spool, packet->data, packet->len);
+            while (status == LDNS_STATUS_OK &&
+                (rr = addns_spool_rr(&spool, &status)) != NULL) {
+                stream->status = addns_xfr_rr(&stream->xfr, stream->zone,
+                    stream->view, rr);
+                if (stream->status != ODS_STATUS_OK) {
+                    break;
+                }
+            }
+            if (stream->status == ODS_STATUS_OK && status != LDNS_STATUS_OK) {
+                ods_log_error("[%s] error reading RR #%lu (%s)", adapter_str,
+                    (unsigned long) stream->xfr.rr_count,
+                    ldns_get_errorstr_by_id(status));
+                stream->status = ODS_STATUS_ERR;
+            }
+        }
+        free(packet);
+    }
+    return NULL;
+}
+
+
+/**
+ * Start applying a transfer while it is being received.
+ *
+ */
+addns_stream_type*
+addns_stream_start(zone_type* zone)
+{
+    addns_stream_type* stream;
+    uint32_t serial;
+    ods_log_assert(zone);
+    /* the transfer is checked against the serial of the zone as it is
+     * now, a zone that is busy is not waited for but read from disk */
+    if (pthread_mutex_trylock(&zone->zone_lock)) {
+        return NULL;
+    }
+    if (!zone->signconf || !zone->signconf->last_modified ||
+        !zone->inboundserial) {
+        /* RRs can not be checked against the signconf yet */
+        pthread_mutex_unlock(&zone->zone_lock);
+        return NULL;
+    }
+    serial = *zone->inboundserial;
+    pthread_mutex_unlock(&zone->zone_lock);
+    CHECKALLOC(stream = (addns_stream_type*) calloc(1, sizeof(addns_stream_type)));
+    stream->zone = zone;
+    stream->xfr.old_serial = serial;
+    stream->status = ODS_STATUS_OK;
+    pthread_mutex_init(&stream->lock, NULL);
+    pthread_cond_init(&stream->cond, NULL);
+    stream->view = zonelist_obtainresource(NULL, zone, NULL,
+        offsetof(zone_type, inputview));
+    if (pthread_create(&stream->thread, NULL, addns_stream_apply, stream)) {
+        ods_log_warning("[%s] unable to apply xfr zone %s while receiving: "
+            "pthread_create() failed", adapter_str, zone->name);
+        zonelist_releaseresource(NULL, zone, NULL,
+            offsetof(zone_type, inputview), stream->view);
+        pthread_cond_destroy(&stream->cond);
+        pthread_mutex_destroy(&stream->lock);
+        free(stream);
+        return NULL;
+    }
+    ods_log_verbose("[%s] apply xfr zone %s while receiving", adapter_str,
+        zone->name);
+    return stream;
+}
+
+
+/**
+ * Queue a received packet.
+ *
+ */
+void
+addns_stream_packet(addns_stream_type* stream, const uint8_t* data,
+    size_t len)
+{
+    addns_stream_packet_type* packet;
+    CHECKALLOC(packet = (addns_stream_packet_type*)
+        malloc(sizeof(addns_stream_packet_type) + len));
+    packet->next = NULL;
+    packet->len = len;
+    memcpy(packet->data, data, len);
+    pthread_mutex_lock(&stream->lock);
+    if (stream->last) {
+        stream->last->next = packet;
+    } else {
+        stream->first = packet;
+    }
+    stream->last = packet;
+    pthread_cond_signal(&stream->cond);
+    pthread_mutex_unlock(&stream->lock);
+}
+
+
+/**
+ * Finish applying a transfer, commit or discard the changes.
+ *
+ */
+ods_status
+addns_stream_finish(addns_stream_type* stream, int complete)
+{
+    zone_type* zone = stream->zone;
+    ods_status status;
+
+    pthread_mutex_lock(&stream->lock);
+    stream->finished = 1;
+    pthread_cond_signal(&stream->cond);
+    pthread_mutex_unlock(&stream->lock);
+    pthread_join(stream->thread, NULL);
+
+    status = stream->status;
+    if (!complete) {
+        status = ODS_STATUS_XFRINCOMPLETE;
+    } else if (status == ODS_STATUS_OK) {
+        status = addns_xfr_done(&stream->xfr, zone);
+    }
+    if (status == ODS_STATUS_OK) {
+        /* the view was taken when the transfer started, a read or update
+         * committed meanwhile makes the commit conflict and throws away
+         * the changes, the transfer is then read from the spool */
+        if (names_viewcommit(stream->view)) {
+            ods_log_warning("[%s] unable to apply xfr zone %s while "
+                "receiving: input view changed, read from disk",
+                adapter_str, zone->name);
+            status = ODS_STATUS_CONFLICT_ERR;
+        } else {
+            ods_log_verbose("[%s] xfr zone %s applied while receiving, "
+                "commit to db", adapter_str, zone->name);
+            zone_set_inboundserial(zone, stream->xfr.new_serial);
+            metastorageput(zone);
+        }
+    } else {
+        if (complete) {
+            ods_log_warning("[%s] unable to apply xfr zone %s while "
+                "receiving (%s), read from disk", adapter_str, zone->name,
+                ods_status2str(status));
+        }
+        names_viewreset(stream->view);
+    }
+    zonelist_releaseresource(NULL, zone, NULL, offsetof(zone_type, inputview),
+        stream->view);
+    pthread_cond_destroy(&stream->cond);
+    pthread_mutex_destroy(&stream->lock);
+    free(stream);
+    return status;
+}
+
+
 /**
  * Write to DNS Output Adapter.
  *
@@ -751,6 +1077,12 @@ addns_write(zone_type* z, names_view_type view)
     ods_log_assert(z->adoutbound);
     ods_log_assert(z->adoutbound->type == ADAPTER_DNS);
 
+    /* serve transfers from a precompiled image and journal and apex
+     * queries from precomputed answers, they fall back to the views if
+     * these can not be written */
+    (void) axfr_image_write(z, view);
+    (void) ixfr_journal_append(z);
+    (void) apex_cache_update(z, view);
     dnsout_send_notify(z, view);
     return ODS_STATUS_OK;
 }
@@ -768,6 +1100,7 @@ dnsin_cleanup(dnsin_type* addns)
     }
     acl_cleanup(addns->request_xfr);
     acl_cleanup(addns->allow_notify);
+    acl_cleanup(addns->allow_update);
     tsig_cleanup(addns->tsig);
     free(addns);
 }
@@ -50,6 +50,7 @@ typedef struct dnsin_struct dnsin_type;
 struct dnsin_struct {
     acl_type* request_xfr;
     acl_type* allow_notify;
+    acl_type* allow_update;
     tsig_type* tsig;
     time_t last_modified;
 };
@@ -118,6 +119,43 @@ ldns_rr* addns_read_rr(FILE* fd, char* line, ldns_rdf** orig, ldns_rdf** prev,
     uint32_t* ttl, ldns_status* status, unsigned int* l);
 
 
+/**
+ * Transfer that is applied to an input view while it is received.
+ *
+ */
+typedef struct addns_stream_struct addns_stream_type;
+
+/**
+ * Start applying a transfer to an input view while it is received.
+ * \param[in] zone zone reference
+ * \return addns_stream_type* stream, NULL if the transfer can not be
+ *         applied while it is received
+ *
+ */
+addns_stream_type* addns_stream_start(zone_type* zone);
+
+/**
+ * Queue a received packet to be applied.
+ * \param[in] stream stream
+ * \param[in] data packet in wire format
+ * \param[in] len packet length
+ *
+ */
+void addns_stream_packet(addns_stream_type* stream, const uint8_t* data,
+    size_t len);
+
+/**
+ * Wait until all queued packets are applied, and commit the input view if
+ * the transfer is complete and correct. Otherwise the changes are thrown
+ * away. The stream is freed. When complete, to be called with the zone
+ * lock held.
+ * \param[in] stream stream
+ * \param[in] complete whether the transfer was received completely
+ * \return ods_status ODS_STATUS_OK if the transfer was committed
+ *
+ */
+ods_status addns_stream_finish(addns_stream_type* stream, int complete);
+
 /**
  * Read zone from DNS input adapter.
  * \param[in] zone zone reference
@@ -45,25 +45,46 @@ static const char* dnsh_str = "dnshandler";
  *
  */
 dnshandler_type*
-dnshandler_create(listener_type* interfaces)
+dnshandler_create(listener_type* interfaces, int threads)
 {
     dnshandler_type* dnsh = NULL;
+    size_t i = 0;
     if (!interfaces || interfaces->count <= 0) {
         return NULL;
     }
+#ifndef SO_REUSEPORT
+    if (threads > 1) {
+        ods_log_warning("[%s] SO_REUSEPORT not supported, using one thread "
+            "instead of %d", dnsh_str, threads);
+        threads = 1;
+    }
+#endif
+    if (threads < 1) {
+        threads = 1;
+    }
     CHECKALLOC(dnsh = (dnshandler_type*) malloc(sizeof(dnshandler_type)));
     dnsh->need_to_exit = 0;
     dnsh->engine = NULL;
     dnsh->interfaces = interfaces;
-    dnsh->socklist = NULL;
-    dnsh->netio = NULL;
-    dnsh->query = NULL;
     dnsh->started = 0;
-    dnsh->tcp_accept_handlers = NULL;
+    dnsh->worker_count = (size_t) threads;
     /* setup */
-    CHECKALLOC(dnsh->socklist = (socklist_type*) malloc(sizeof(socklist_type)));
-    dnsh->netio = netio_create();
-    dnsh->query = query_create();
+    CHECKALLOC(dnsh->workers = (dnshandler_worker_type*) calloc(
+        dnsh->worker_count, sizeof(dnshandler_worker_type)));
+    for (i = 0; i < dnsh->worker_count; i++) {
+        dnshandler_worker_type* worker = &dnsh->workers[i];
+        size_t j = 0;
+        worker->thread_id = NULL;
+        worker->dnshandler = dnsh;
+        worker->tcp_accept_handlers = NULL;
+        CHECKALLOC(worker->socklist = (socklist_type*) malloc(sizeof(socklist_type)));
+        for (j = 0; j < MAX_INTERFACES; j++) {
+            worker->socklist->udp[j].s = -1;
+            worker->socklist->tcp[j].s = -1;
+        }
+        worker->netio = netio_create();
+        CHECKALLOC(worker->batch = sock_udp_batch_create());
+    }
     dnsh->xfrhandler.fd = -1;
     dnsh->xfrhandler.user_data = (void*) dnsh;
     dnsh->xfrhandler.timeout = 0;
@@ -79,39 +100,42 @@ ods_status
 dnshandler_listen(dnshandler_type* dnshandler)
 {
     ods_status status = ODS_STATUS_OK;
+    size_t i = 0;
     ods_log_assert(dnshandler);
-    status = sock_listen(dnshandler->socklist, dnshandler->interfaces);
-    if (status != ODS_STATUS_OK) {
-        ods_log_error("[%s] unable to start: sock_listen() "
-            "failed (%s)", dnsh_str, ods_status2str(status));
-        dnshandler->thread_id = 0;
+    for (i = 0; i < dnshandler->worker_count; i++) {
+        status = sock_listen(dnshandler->workers[i].socklist,
+            dnshandler->interfaces, dnshandler->worker_count > 1);
+        if (status != ODS_STATUS_OK) {
+            ods_log_error("[%s] unable to start: sock_listen() "
+                "failed (%s)", dnsh_str, ods_status2str(status));
+            dnshandler->thread_id = 0;
+            return status;
+        }
     }
     return status;
 }
 
 
 /**
- * Start dns handler.
+ * Serve queries on the sockets of one worker.
  *
  */
-void
-dnshandler_start(dnshandler_type* dnshandler)
+static void
+dnshandler_serve(dnshandler_worker_type* worker)
 {
+    dnshandler_type* dnshandler = worker->dnshandler;
     size_t i = 0;
 
-    ods_log_assert(dnshandler);
-    ods_log_debug("[%s] start", dnsh_str);
-
     /* udp */
     for (i=0; i < dnshandler->interfaces->count; i++) {
         struct udp_data* data = NULL;
         netio_handler_type* handler = NULL;
         CHECKALLOC(data = (struct udp_data*) malloc(sizeof(struct udp_data)));
-        data->query = dnshandler->query;
+        data->batch = worker->batch;
         data->engine = dnshandler->engine;
-        data->socket = &dnshandler->socklist->udp[i];
+        data->socket = &worker->socklist->udp[i];
         CHECKALLOC(handler = (netio_handler_type*) malloc(sizeof(netio_handler_type)));
-        handler->fd = dnshandler->socklist->udp[i].s;
+        handler->fd = worker->socklist->udp[i].s;
         handler->timeout = NULL;
         handler->user_data = data;
         handler->event_types = NETIO_EVENT_READ;
@@ -119,20 +143,20 @@ dnshandler_start(dnshandler_type* dnshandler)
         handler->free_handler = 1;
         ods_log_debug("[%s] add udp network handler fd %u", dnsh_str,
             (unsigned) handler->fd);
-        netio_add_handler(dnshandler->netio, handler);
+        netio_add_handler(worker->netio, handler);
     }
     /* tcp */
-    CHECKALLOC(dnshandler->tcp_accept_handlers = (netio_handler_type*) malloc(dnshandler->interfaces->count * sizeof(netio_handler_type)));
+    CHECKALLOC(worker->tcp_accept_handlers = (netio_handler_type*) malloc(dnshandler->interfaces->count * sizeof(netio_handler_type)));
     for (i=0; i < dnshandler->interfaces->count; i++) {
         struct tcp_accept_data* data = NULL;
         netio_handler_type* handler = NULL;
         CHECKALLOC(data = (struct tcp_accept_data*) malloc(sizeof(struct tcp_accept_data)));
         data->engine = dnshandler->engine;
-        data->socket = &dnshandler->socklist->udp[i];
+        data->socket = &worker->socklist->udp[i];
         data->tcp_accept_handler_count = dnshandler->interfaces->count;
-        data->tcp_accept_handlers = dnshandler->tcp_accept_handlers;
-        handler = &dnshandler->tcp_accept_handlers[i];
-        handler->fd = dnshandler->socklist->tcp[i].s;
+        data->tcp_accept_handlers = worker->tcp_accept_handlers;
+        handler = &worker->tcp_accept_handlers[i];
+        handler->fd = worker->socklist->tcp[i].s;
         handler->timeout = NULL;
         handler->user_data = data;
         handler->event_types = NETIO_EVENT_READ;
@@ -140,12 +164,12 @@ dnshandler_start(dnshandler_type* dnshandler)
         handler->free_handler = 0;
         ods_log_debug("[%s] add tcp network handler fd %u", dnsh_str,
             (unsigned) handler->fd);
-        netio_add_handler(dnshandler->netio, handler);
+        netio_add_handler(worker->netio, handler);
     }
     /* service */
     while (dnshandler->need_to_exit == 0) {
         ods_log_deeebug("[%s] netio dispatch", dnsh_str);
-        if (netio_dispatch(dnshandler->netio, NULL, NULL) == -1) {
+        if (netio_dispatch(worker->netio, NULL, NULL) == -1) {
             if (errno != EINTR) {
                 ods_log_error("[%s] unable to dispatch netio: %s", dnsh_str,
                     strerror(errno));
@@ -153,6 +177,35 @@ dnshandler_start(dnshandler_type* dnshandler)
             }
         }
     }
+}
+
+
+/**
+ * Start dns handler.
+ *
+ */
+void
+dnshandler_start(dnshandler_type* dnshandler)
+{
+    size_t i = 0;
+
+    ods_log_assert(dnshandler);
+    ods_log_debug("[%s] start %lu thread(s)", dnsh_str,
+        (unsigned long) dnshandler->worker_count);
+
+    /* the first worker runs in this thread */
+    for (i=1; i < dnshandler->worker_count; i++) {
+        janitor_thread_create(&dnshandler->workers[i].thread_id,
+            handlerthreadclass, (janitor_runfn_t)dnshandler_serve,
+            &dnshandler->workers[i]);
+    }
+    dnshandler_serve(&dnshandler->workers[0]);
+    for (i=1; i < dnshandler->worker_count; i++) {
+        if (dnshandler->workers[i].thread_id) {
+            janitor_thread_join(dnshandler->workers[i].thread_id);
+            dnshandler->workers[i].thread_id = NULL;
+        }
+    }
     /* shutdown */
     ods_log_debug("[%s] shutdown", dnsh_str);
 }
@@ -165,8 +218,14 @@ dnshandler_start(dnshandler_type* dnshandler)
 void
 dnshandler_signal(dnshandler_type* dnshandler)
 {
+    size_t i = 0;
     if (dnshandler && dnshandler->thread_id && dnshandler->started) {
         janitor_thread_signal(dnshandler->thread_id);
+        for (i=1; i < dnshandler->worker_count; i++) {
+            if (dnshandler->workers[i].thread_id) {
+                janitor_thread_signal(dnshandler->workers[i].thread_id);
+            }
+        }
     }
 }
 
@@ -199,27 +258,30 @@ void
 dnshandler_cleanup(dnshandler_type* dnshandler)
 {
     size_t i = 0;
+    size_t w = 0;
     if (!dnshandler) {
         return;
     }
-    netio_cleanup(dnshandler->netio);
-    query_cleanup(dnshandler->query);
-
-
-    for (i = 0; i < dnshandler->interfaces->count; i++) {
-        if (dnshandler->tcp_accept_handlers)
-            free(dnshandler->tcp_accept_handlers[i].user_data);
-        if (dnshandler->socklist->udp[i].s != -1) {
-            close(dnshandler->socklist->udp[i].s);
-            freeaddrinfo((void*)dnshandler->socklist->udp[i].addr);
+    for (w = 0; w < dnshandler->worker_count; w++) {
+        dnshandler_worker_type* worker = &dnshandler->workers[w];
+        netio_cleanup(worker->netio);
+        sock_udp_batch_cleanup(worker->batch);
+        for (i = 0; i < dnshandler->interfaces->count; i++) {
+            if (worker->tcp_accept_handlers)
+                free(worker->tcp_accept_handlers[i].user_data);
+            if (worker->socklist->udp[i].s != -1) {
+                close(worker->socklist->udp[i].s);
+                freeaddrinfo((void*)worker->socklist->udp[i].addr);
+            }
+            if (worker->socklist->tcp[i].s != -1) {
+                close(worker->socklist->tcp[i].s);
+                freeaddrinfo((void*)worker->socklist->tcp[i].addr);
+            }
         }
-        if (dnshandler->socklist->tcp[i].s != -1) {
-            close(dnshandler->socklist->tcp[i].s);
-            freeaddrinfo((void*)dnshandler->socklist->tcp[i].addr);
-        }  
+        free(worker->tcp_accept_handlers);
+        free(worker->socklist);
     }
-    free(dnshandler->tcp_accept_handlers);
-    free(dnshandler->socklist);
+    free(dnshandler->workers);
     listener_cleanup(dnshandler->interfaces);
     free(dnshandler);
 }
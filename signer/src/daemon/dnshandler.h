@@ -36,6 +36,7 @@
 #include <stdint.h>
 
 typedef struct dnshandler_struct dnshandler_type;
+typedef struct dnshandler_worker_struct dnshandler_worker_type;
 
 #include "status.h"
 #include "locks.h"
@@ -48,27 +49,40 @@ typedef struct dnshandler_struct dnshandler_type;
 #define ODS_SE_NOTIFY_CMD "NOTIFY"
 #define ODS_SE_MAX_HANDLERS 5
 
+/**
+ * A thread answering queries. Each worker has its own sockets on all
+ * interfaces (bound with SO_REUSEPORT if there is more than one worker),
+ * its own netio and its own query buffers.
+ *
+ */
+struct dnshandler_worker_struct {
+    janitor_thread_t thread_id;
+    dnshandler_type* dnshandler;
+    socklist_type* socklist;
+    netio_type* netio;
+    struct udp_batch* batch;
+    netio_handler_type *tcp_accept_handlers;
+};
+
 struct dnshandler_struct {
     janitor_thread_t thread_id;
     engine_type* engine;
     listener_type* interfaces;
-    socklist_type* socklist;
-    netio_type* netio;
-    query_type* query;
+    dnshandler_worker_type* workers;
+    size_t worker_count;
     netio_handler_type xfrhandler;
     unsigned need_to_exit;
     unsigned started;
-    netio_handler_type *tcp_accept_handlers;
 };
 
 /**
  * Create dns handler.
- * \param[in] allocator memory allocator
  * \param[in] interfaces list of interfaces
+ * \param[in] threads number of threads answering queries
  * \return dnshandler_type* created dns handler
  *
  */
-dnshandler_type* dnshandler_create(listener_type* interfaces);
+dnshandler_type* dnshandler_create(listener_type* interfaces, int threads);
 
 /**
  * Start dns handler listener.
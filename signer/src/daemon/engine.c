@@ -64,6 +64,9 @@
 
 static const char* engine_str = "engine";
 
+/* seconds between background checks of the hsm sessions */
+#define ENGINE_HSM_CHECK_INTERVAL 10
+
 /**
  * Create engine.
  *
@@ -96,12 +99,13 @@ engine_create(void)
         engine_cleanup(engine);
         return NULL;
     }
-    schedule_registertask(engine->taskq, TASK_CLASS_SIGNER, TASK_SIGNCONF, do_readsignconf);
-    schedule_registertask(engine->taskq, TASK_CLASS_SIGNER, TASK_FORCESIGNCONF, do_forcereadsignconf);
-    schedule_registertask(engine->taskq, TASK_CLASS_SIGNER, TASK_READ, do_readzone);
-    schedule_registertask(engine->taskq, TASK_CLASS_SIGNER, TASK_FORCEREAD, do_forcereadzone);
-    schedule_registertask(engine->taskq, TASK_CLASS_SIGNER, TASK_SIGN, do_signzone);
-    schedule_registertask(engine->taskq, TASK_CLASS_SIGNER, TASK_WRITE, do_writezone);
+    schedule_registertask(engine->taskq, TASK_CLASS_SIGNER, TASK_SIGNCONF, TASK_PRIORITY_BULK, do_readsignconf);
+    schedule_registertask(engine->taskq, TASK_CLASS_SIGNER, TASK_FORCESIGNCONF, TASK_PRIORITY_INTERACTIVE, do_forcereadsignconf);
+    schedule_registertask(engine->taskq, TASK_CLASS_SIGNER, TASK_READ, TASK_PRIORITY_BULK, do_readzone);
+    schedule_registertask(engine->taskq, TASK_CLASS_SIGNER, TASK_FORCEREAD, TASK_PRIORITY_INTERACTIVE, do_forcereadzone);
+    schedule_registertask(engine->taskq, TASK_CLASS_SIGNER, TASK_SIGN, TASK_PRIORITY_RESIGN, do_signzone);
+    schedule_registertask(engine->taskq, TASK_CLASS_SIGNER, TASK_FORCESIGN, TASK_PRIORITY_INTERACTIVE, do_signzone);
+    schedule_registertask(engine->taskq, TASK_CLASS_SIGNER, TASK_WRITE, TASK_PRIORITY_RESIGN, do_writezone);
     return engine;
 }
 
@@ -118,7 +122,7 @@ engine_start_cmdhandler(engine_type* engine)
     /* IPv4 addesses needs be placed first */
     http_listener_push(&listenerconfig, "0.0.0.0", AF_INET, "8000", NULL, NULL);
     //http_listener_push(&listenerconfig, "::0", AF_INET6, "8000", NULL, NULL);
-    httpd = httpd_create(&listenerconfig, engine->zonelist);
+    httpd = httpd_create(&listenerconfig, engine->zonelist, engine->taskq);
     httpd_start(httpd);
 }
 
@@ -336,8 +340,11 @@ engine_setup_initialize(engine_type* engine, int* fdptr)
         ods_log_error("Failed to setup command handler");
         return ODS_STATUS_CMDHANDLER_ERR;
     }
-    engine->dnshandler = dnshandler_create(create_listener(engine->config->interfaces));
-    engine->xfrhandler = xfrhandler_create();
+    engine->dnshandler = dnshandler_create(create_listener(engine->config->interfaces),
+        engine->config->num_listener_threads);
+    engine->xfrhandler = xfrhandler_create(
+        engine->config->num_transfer_connections,
+        engine->config->num_transfer_connections_master);
     if (!engine->xfrhandler) {
         ods_log_error("Failed to setup transfer handler");
         return ODS_STATUS_XFRHANDLER_ERR;
@@ -499,12 +506,13 @@ engine_run(engine_type* engine)
     if (!engine) {
         return;
     }
+    struct timespec deadline;
     engine_start_workers(engine);
 
     while (!engine->need_to_exit && !engine->need_to_reload) {
         /* We must use locking here to avoid race conditions. We want
-         * to sleep indefinitely and want to wake up on signal. This
-         * is to make sure we never mis the signal. */
+         * to sleep until the next hsm check and want to wake up on
+         * signal. This is to make sure we never mis the signal. */
         pthread_mutex_lock(&engine->signal_lock);
         if (!engine->need_to_exit && !engine->need_to_reload) {
             /* TODO: this silly. We should be handling the commandhandler
@@ -512,9 +520,23 @@ engine_run(engine_type* engine)
              * Also it would be easier to wake up the command hander
              * as signals will reach it if it is the main thread! */
             ods_log_debug("[%s] taking a break", engine_str);
-            pthread_cond_wait(&engine->signal_cond, &engine->signal_lock);
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += ENGINE_HSM_CHECK_INTERVAL;
+            pthread_cond_timedwait(&engine->signal_cond, &engine->signal_lock,
+                &deadline);
         }
         pthread_mutex_unlock(&engine->signal_lock);
+        /* check the hsm sessions while the signer threads keep working */
+        if (!engine->need_to_exit && !engine->need_to_reload &&
+            hsm_pool_check() != HSM_OK) {
+            char* error = hsm_get_error(NULL);
+            if (error != NULL) {
+                ods_log_error("[%s] %s", "hsm", error);
+                free(error);
+            }
+            ods_log_error("signer instructed to reload due to hsm reset");
+            engine->need_to_reload = 1;
+        }
     }
     ods_log_debug("[%s] signer halted", engine_str);
     engine_stop_threads(engine);
@@ -754,6 +776,8 @@ engine_start(engine_type* engine)
     ods_status status = ODS_STATUS_OK;
     int linkfd;
 
+    /* restore zones on as many threads as there are workers */
+    engine->zonelist->startthreads = engine->config->num_worker_threads_signer;
     /* run */
     while (engine->need_to_exit == 0) {
         /* update zone list */
@@ -792,6 +816,9 @@ engine_start(engine_type* engine)
                 free(error);
             }
             ods_log_error("[%s] opening hsm failed (for engine run)", engine_str);
+        } else if (hsm_pool_open(engine->config->num_hsm_sessions) != HSM_OK) {
+            ods_log_warning("[%s] unable to open all %d hsm sessions",
+                engine_str, engine->config->num_hsm_sessions);
         }
         engine_run(engine);
         hsm_close();
@@ -29,6 +29,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <pthread.h>
 #include "utilities.h"
 #include "views/marshalling.h"
 #include "views/proto.h"
@@ -152,7 +153,7 @@ metastorage(const char* filename, int ndefs, struct definition_struct* defs, con
         rdhandle = marshallcreate(marshall_INPUT, rdfd);
         ptr = malloc(wrdef->membersize);
         do {
-            offset = lseek(rdfd,0,SEEK_CUR);
+            offset = marshallposition(rdhandle);
             if(offset < size) {
                 marshalling(rdhandle, "", &ptr, NULL, rddef->membersize, rddef->memberfunction);
                 if(wrfd>=0) {
@@ -205,16 +206,28 @@ setup(void)
     defs[0].membername = zonename;
 }
 
+/* zones are restored and stored from several threads, they all share the
+ * one storage file */
+static pthread_mutex_t metastoragelock = PTHREAD_MUTEX_INITIALIZER;
+
 int
 metastorageget(const char* name, void* item)
 {
+    int status;
+    pthread_mutex_lock(&metastoragelock);
     setup();
-    return metastorage("signer.db", ndefs, defs, name, (void**)item);
+    status = metastorage("signer.db", ndefs, defs, name, (void**)item);
+    pthread_mutex_unlock(&metastoragelock);
+    return status;
 }
 
 int
 metastorageput(void* item)
 {
+    int status;
+    pthread_mutex_lock(&metastoragelock);
     setup();
-    return metastorage("signer.db", ndefs, defs, NULL, item);
+    status = metastorage("signer.db", ndefs, defs, NULL, item);
+    pthread_mutex_unlock(&metastoragelock);
+    return status;
 }
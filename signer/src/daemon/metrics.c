@@ -0,0 +1,366 @@
+/*
+ * Copyright (c) 2011-2018 NLNet Labs.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Runtime metrics.
+ *
+ * Each thread that records a metric gets its own block of counters and
+ * histogram buckets, so the signing paths never contend on a lock or a
+ * shared cache line. Collecting the metrics sums the blocks of all
+ * threads, plus the totals of threads that have since exited.
+ *
+ */
+
+#include "config.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "status.h"
+#include "scheduler/schedule.h"
+#include "signer/zonelist.h"
+#include "daemon/metrics.h"
+
+static const char* metrics_str = "metrics";
+
+/* Upper bounds of the histogram buckets, in seconds */
+static const double metrics_bounds[] = {
+    0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05,
+    0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0, 30.0, 60.0
+};
+#define METRICS_NBUCKETS (sizeof(metrics_bounds) / sizeof(double) + 1)
+
+struct metrics_desc {
+    const char* name;
+    const char* labels;
+    const char* help;
+};
+
+static const struct metrics_desc metrics_counters[METRICS_NCOUNTERS] = {
+    { "ods_signer_signatures_total", "",
+      "Signatures created by the HSM." },
+    { "ods_signer_view_commits_total", "",
+      "Changes committed to zone views." },
+    { "ods_signer_view_conflicts_total", "",
+      "View commits that conflicted with a concurrent commit." },
+    { "ods_signer_transfers_out_total", "type=\"axfr\"",
+      "Zone transfer requests served." },
+    { "ods_signer_transfers_out_total", "type=\"ixfr\"",
+      "Zone transfer requests served." }
+};
+
+static const struct metrics_desc metrics_histograms[METRICS_NHISTOGRAMS] = {
+    { "ods_signer_stage_duration_seconds", "stage=\"read\"",
+      "Time spent per zone in each stage of signing." },
+    { "ods_signer_stage_duration_seconds", "stage=\"sign\"",
+      "Time spent per zone in each stage of signing." },
+    { "ods_signer_stage_duration_seconds", "stage=\"write\"",
+      "Time spent per zone in each stage of signing." },
+    { "ods_signer_hsm_sign_duration_seconds", "",
+      "Time spent in the HSM per signing call." },
+    { "ods_signer_view_commit_duration_seconds", "",
+      "Time spent committing changes to a zone view." }
+};
+
+struct metrics_block {
+    uint64_t counters[METRICS_NCOUNTERS];
+    uint64_t buckets[METRICS_NHISTOGRAMS][METRICS_NBUCKETS];
+    double sums[METRICS_NHISTOGRAMS];
+    struct metrics_block* next;
+};
+
+static pthread_once_t metrics_once = PTHREAD_ONCE_INIT;
+static pthread_key_t metrics_key;
+static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct metrics_block* metrics_blocks = NULL;
+static struct metrics_block metrics_retired;
+static volatile int metrics_enabled = 1;
+
+static void
+metrics_add(struct metrics_block* total, struct metrics_block* block)
+{
+    size_t i, j;
+    for (i = 0; i < METRICS_NCOUNTERS; i++) {
+        total->counters[i] += block->counters[i];
+    }
+    for (i = 0; i < METRICS_NHISTOGRAMS; i++) {
+        for (j = 0; j < METRICS_NBUCKETS; j++) {
+            total->buckets[i][j] += block->buckets[i][j];
+        }
+        total->sums[i] += block->sums[i];
+    }
+}
+
+/**
+ * Fold the block of an exiting thread into the retired totals.
+ *
+ */
+static void
+metrics_retire(void* arg)
+{
+    struct metrics_block* block = (struct metrics_block*) arg;
+    struct metrics_block** iter;
+    pthread_mutex_lock(&metrics_lock);
+    for (iter = &metrics_blocks; *iter; iter = &(*iter)->next) {
+        if (*iter == block) {
+            *iter = block->next;
+            break;
+        }
+    }
+    metrics_add(&metrics_retired, block);
+    pthread_mutex_unlock(&metrics_lock);
+    free(block);
+}
+
+static void
+metrics_init(void)
+{
+    if (pthread_key_create(&metrics_key, metrics_retire)) {
+        ods_fatal_exit("[%s] unable to create thread key", metrics_str);
+    }
+}
+
+static struct metrics_block*
+metrics_block(void)
+{
+    struct metrics_block* block;
+    pthread_once(&metrics_once, metrics_init);
+    block = (struct metrics_block*) pthread_getspecific(metrics_key);
+    if (!block) {
+        CHECKALLOC(block = (struct metrics_block*) calloc(1, sizeof(struct metrics_block)));
+        pthread_setspecific(metrics_key, block);
+        pthread_mutex_lock(&metrics_lock);
+        block->next = metrics_blocks;
+        metrics_blocks = block;
+        pthread_mutex_unlock(&metrics_lock);
+    }
+    return block;
+}
+
+void
+metrics_enable(int enabled)
+{
+    metrics_enabled = enabled;
+}
+
+void
+metrics_count(enum metrics_counter counter, uint64_t n)
+{
+    if (!metrics_enabled)
+        return;
+    metrics_block()->counters[counter] += n;
+}
+
+void
+metrics_observe(enum metrics_histogram histogram, double seconds)
+{
+    struct metrics_block* block;
+    size_t i;
+    if (!metrics_enabled)
+        return;
+    block = metrics_block();
+    for (i = 0; i < METRICS_NBUCKETS - 1; i++) {
+        if (seconds <= metrics_bounds[i])
+            break;
+    }
+    block->buckets[histogram][i] += 1;
+    block->sums[histogram] += seconds;
+}
+
+void
+metrics_clock(struct timespec* start)
+{
+    if (!metrics_enabled) {
+        start->tv_sec = 0;
+        start->tv_nsec = 0;
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, start);
+}
+
+void
+metrics_since(enum metrics_histogram histogram, struct timespec* start)
+{
+    struct timespec now;
+    /* not timed when started while recording was disabled */
+    if (!metrics_enabled || (start->tv_sec == 0 && start->tv_nsec == 0))
+        return;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    metrics_observe(histogram, (now.tv_sec - start->tv_sec) +
+        (now.tv_nsec - start->tv_nsec) / 1e9);
+}
+
+struct metrics_text {
+    char* buf;
+    size_t len;
+    size_t size;
+};
+
+static void
+metrics_printf(struct metrics_text* text, const char* format, ...)
+{
+    va_list ap;
+    int n;
+    char* buf;
+    if (!text->buf) return;
+    for (;;) {
+        va_start(ap, format);
+        n = vsnprintf(text->buf + text->len, text->size - text->len, format, ap);
+        va_end(ap);
+        if (n < 0) return;
+        if (text->len + n < text->size) {
+            text->len += n;
+            return;
+        }
+        buf = realloc(text->buf, text->size * 2 + n);
+        if (!buf) {
+            free(text->buf);
+            text->buf = NULL;
+            return;
+        }
+        text->buf = buf;
+        text->size = text->size * 2 + n;
+    }
+}
+
+static void
+metrics_header(struct metrics_text* text, const struct metrics_desc* desc,
+    const struct metrics_desc* prev, const char* type)
+{
+    if (prev && !strcmp(prev->name, desc->name))
+        return;
+    metrics_printf(text, "# HELP %s %s\n# TYPE %s %s\n", desc->name,
+        desc->help, desc->name, type);
+}
+
+static void
+metrics_gauge(struct metrics_text* text, const char* name, const char* help,
+    double value)
+{
+    metrics_printf(text, "# HELP %s %s\n# TYPE %s gauge\n%s %.0f\n", name,
+        help, name, name, value);
+}
+
+char*
+metrics_expose(struct zonelist_struct* zonelist, struct schedule_struct* taskq,
+    size_t* len)
+{
+    struct metrics_block total;
+    struct metrics_block* block;
+    struct metrics_text text;
+    const struct metrics_desc* desc;
+    const char* sep;
+    uint64_t cumulative;
+    size_t i, j;
+    long pages;
+    FILE* fd;
+
+    /* The blocks are read while their threads keep updating them, an
+     * update in flight is picked up by the next collection. */
+    pthread_once(&metrics_once, metrics_init);
+    pthread_mutex_lock(&metrics_lock);
+    total = metrics_retired;
+    for (block = metrics_blocks; block; block = block->next) {
+        metrics_add(&total, block);
+    }
+    pthread_mutex_unlock(&metrics_lock);
+
+    text.size = 8192;
+    text.len = 0;
+    text.buf = malloc(text.size);
+    for (i = 0; i < METRICS_NCOUNTERS; i++) {
+        desc = &metrics_counters[i];
+        metrics_header(&text, desc, (i ? &metrics_counters[i-1] : NULL), "counter");
+        metrics_printf(&text, "%s%s%s%s %llu\n", desc->name,
+            (*desc->labels ? "{" : ""), desc->labels,
+            (*desc->labels ? "}" : ""),
+            (unsigned long long) total.counters[i]);
+    }
+    for (i = 0; i < METRICS_NHISTOGRAMS; i++) {
+        desc = &metrics_histograms[i];
+        metrics_header(&text, desc, (i ? &metrics_histograms[i-1] : NULL), "histogram");
+        sep = (*desc->labels ? "," : "");
+        cumulative = 0;
+        for (j = 0; j < METRICS_NBUCKETS; j++) {
+            cumulative += total.buckets[i][j];
+            if (j < METRICS_NBUCKETS - 1) {
+                metrics_printf(&text, "%s_bucket{%s%sle=\"%g\"} %llu\n",
+                    desc->name, desc->labels, sep, metrics_bounds[j],
+                    (unsigned long long) cumulative);
+            } else {
+                metrics_printf(&text, "%s_bucket{%s%sle=\"+Inf\"} %llu\n",
+                    desc->name, desc->labels, sep,
+                    (unsigned long long) cumulative);
+            }
+        }
+        metrics_printf(&text, "%s_sum%s%s%s %g\n", desc->name,
+            (*desc->labels ? "{" : ""), desc->labels,
+            (*desc->labels ? "}" : ""), total.sums[i]);
+        metrics_printf(&text, "%s_count%s%s%s %llu\n", desc->name,
+            (*desc->labels ? "{" : ""), desc->labels,
+            (*desc->labels ? "}" : ""), (unsigned long long) cumulative);
+    }
+
+    if (zonelist) {
+        pthread_mutex_lock(&zonelist->zl_lock);
+        metrics_gauge(&text, "ods_signer_zones", "Zones configured.",
+            (double) zonelist->zones->count);
+        pthread_mutex_unlock(&zonelist->zl_lock);
+    }
+    if (taskq) {
+        pthread_mutex_lock(&taskq->schedule_lock);
+        metrics_gauge(&text, "ods_signer_tasks_queued",
+            "Tasks in the schedule.", (double) taskq->tasks->count);
+        metrics_gauge(&text, "ods_signer_workers_idle",
+            "Workers waiting for a task.", (double) taskq->num_waiting);
+        pthread_mutex_unlock(&taskq->schedule_lock);
+        pthread_mutex_lock(&taskq->signq->q_lock);
+        metrics_gauge(&text, "ods_signer_signq_depth",
+            "RRset chunks waiting for a drudger.", (double) taskq->signq->count);
+        pthread_mutex_unlock(&taskq->signq->q_lock);
+    }
+    /* statm reports sizes in pages, the second field is resident */
+    if ((fd = fopen("/proc/self/statm", "r")) != NULL) {
+        if (fscanf(fd, "%*s %ld", &pages) == 1) {
+            metrics_gauge(&text, "process_resident_memory_bytes",
+                "Resident memory size in bytes.",
+                (double) pages * sysconf(_SC_PAGESIZE));
+        }
+        fclose(fd);
+    }
+
+    if (!text.buf) {
+        ods_log_error("[%s] unable to collect metrics: malloc failed",
+            metrics_str);
+        return NULL;
+    }
+    *len = text.len;
+    return text.buf;
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2011-2018 NLNet Labs.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Runtime metrics.
+ *
+ */
+
+#ifndef DAEMON_METRICS_H
+#define DAEMON_METRICS_H
+
+#include "config.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+struct zonelist_struct;
+struct schedule_struct;
+
+/**
+ * Counters. Several entries can share a metric name and differ in
+ * their labels.
+ */
+enum metrics_counter {
+    METRICS_SIGNATURES,
+    METRICS_VIEW_COMMITS,
+    METRICS_VIEW_CONFLICTS,
+    METRICS_XFR_OUT_AXFR,
+    METRICS_XFR_OUT_IXFR,
+    METRICS_NCOUNTERS
+};
+
+/**
+ * Latency histograms, observed in seconds.
+ */
+enum metrics_histogram {
+    METRICS_STAGE_READ,
+    METRICS_STAGE_SIGN,
+    METRICS_STAGE_WRITE,
+    METRICS_HSM_SIGN,
+    METRICS_VIEW_COMMIT,
+    METRICS_NHISTOGRAMS
+};
+
+/**
+ * Switch the recording of metrics on or off, it is on by default.
+ * \param[in] enabled whether to record
+ *
+ */
+void metrics_enable(int enabled);
+
+/**
+ * Add to a counter. Every thread updates its own copy, the copies are
+ * only merged when the metrics are collected, so no lock is taken.
+ * \param[in] counter counter
+ * \param[in] n amount to add
+ *
+ */
+void metrics_count(enum metrics_counter counter, uint64_t n);
+
+/**
+ * Record an observation in a histogram of the calling thread.
+ * \param[in] histogram histogram
+ * \param[in] seconds observed duration
+ *
+ */
+void metrics_observe(enum metrics_histogram histogram, double seconds);
+
+/**
+ * Start timing an operation.
+ * \param[out] start start of the operation
+ *
+ */
+void metrics_clock(struct timespec* start);
+
+/**
+ * Record the time passed since metrics_clock() in a histogram.
+ * \param[in] histogram histogram
+ * \param[in] start start of the operation
+ *
+ */
+void metrics_since(enum metrics_histogram histogram, struct timespec* start);
+
+/**
+ * Collect all metrics in the Prometheus text exposition format.
+ * \param[in] zonelist zone list, may be NULL
+ * \param[in] taskq task queue, may be NULL
+ * \param[out] len length of the returned text
+ * \return char* allocated text, NULL on malloc failure
+ *
+ */
+char* metrics_expose(struct zonelist_struct* zonelist,
+    struct schedule_struct* taskq, size_t* len);
+
+#endif /* DAEMON_METRICS_H */
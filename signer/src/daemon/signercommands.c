@@ -98,6 +98,9 @@ cmdhandler_handle_cmd_help(int sockfd, cmdhandler_ctx_type* context, char *cmd)
                                     "configurations.\n"
         "update [--all]              Update zone list and all signer "
                                     "configurations.\n"
+        "update --batch <zone> ...   Update the signer configurations "
+                                    "of the given\n"
+        "                            zones.\n"
         "retransfer <zone>           Retransfer the zone from the master.\n"
         "start                       Start the engine.\n"
         "running                     Check if the engine is running.\n"
@@ -187,6 +190,63 @@ command_update(engine_type* engine, ods_status* zonelistchangestatus, int* added
     }
 }
 
+/**
+ * Update the signer configurations of a batch of zones. The enforcer
+ * uses this to deliver many zones per message. Each zone reads its
+ * signconf in a task of its own, as with the single zone update. If one
+ * of them is unknown, the whole zone list is updated instead.
+ *
+ */
+static int
+cmdhandler_handle_cmd_update_batch(int sockfd, engine_type* engine,
+    const char* zones)
+{
+    char buf[ODS_SE_MAXLINE];
+    char* name;
+    char* last = NULL;
+    /* names are separated by at least one character */
+    zone_type* batch[ODS_SE_MAXLINE / 2];
+    zone_type* zone;
+    int i, count = 0;
+
+    if (strlen(zones) >= sizeof(buf)) {
+        client_printf_err(sockfd, "Error: zone batch too long.\n");
+        return 1;
+    }
+    (void)strcpy(buf, zones);
+    /* only look the zones up under the zone list lock, waiting for each
+     * zone lock while holding it would stall everything using the list */
+    pthread_mutex_lock(&engine->zonelist->zl_lock);
+    for (name = strtok_r(buf, " \t\n", &last); name;
+         name = strtok_r(NULL, " \t\n", &last)) {
+        zone = zonelist_lookup_zone_by_name(engine->zonelist, name,
+            LDNS_RR_CLASS_IN);
+        /* If this zone is just added, don't update (it might not have a
+         * task yet) */
+        if (!zone || zone->zl_status == ZONE_ZL_ADDED) {
+            pthread_mutex_unlock(&engine->zonelist->zl_lock);
+            client_printf(sockfd, "Error: Zone %s not found, updating "
+                "zone list and all signer configurations.\n", name);
+            command_update(engine, NULL, NULL, NULL, NULL);
+            return 1;
+        }
+        batch[count++] = zone;
+    }
+    pthread_mutex_unlock(&engine->zonelist->zl_lock);
+    for (i = 0; i < count; i++) {
+        zone = batch[i];
+        pthread_mutex_lock(&zone->zone_lock);
+        schedule_scheduletask(engine->taskq, TASK_FORCESIGNCONF, zone->name, zone, &zone->zone_lock, schedule_PROMPTLY);
+        pthread_mutex_unlock(&zone->zone_lock);
+    }
+
+    client_printf(sockfd, "%d zone configs being updated.\n", count);
+    ods_log_verbose("[%s] %d zones scheduled for immediate update signconf",
+        cmdh_str, count);
+    engine_wakeup_workers(engine);
+    return 0;
+}
+
 /**
  * Handle the 'update' command.
  *
@@ -200,9 +260,14 @@ cmdhandler_handle_cmd_update(int sockfd, cmdhandler_ctx_type* context, const cha
     zone_type* zone = NULL;
     ods_status zl_changed = ODS_STATUS_OK;
     int numadded, numremoved, numupdated;
+    const char* arg;
     engine = getglobalcontext(context);
     ods_log_assert(engine->taskq);
-    if (cmdargument(cmd, "--all", NULL)) {
+    arg = cmdargument(cmd, NULL, "");
+    if (!strncmp(arg, "--batch", 7) &&
+        (arg[7] == '\0' || isspace((unsigned char)arg[7]))) {
+        return cmdhandler_handle_cmd_update_batch(sockfd, engine, arg + 7);
+    } else if (cmdargument(cmd, "--all", NULL)) {
         command_update(engine, &zl_changed, &numadded, &numremoved, &numupdated);
         switch (zl_changed) {
             case ODS_STATUS_UNCHANGED:
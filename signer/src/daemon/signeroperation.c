@@ -184,15 +184,150 @@ rrsigkeymatching(signconf_type* signconf, struct signature_struct** rrsigs, stru
 }
 
 /**
- * Sign RRset.
+ * Signatures still to be made, collected such that all RRsets that are
+ * to be signed with the same key and validity are handed to the HSM at once.
+ *
+ */
+struct rrset_signjob {
+    ldns_rr_list* rrset;
+    ldns_rr_type rrtype;
+    key_type* key;
+    time_t inception;
+    time_t expiration;
+};
+
+struct rrset_signbatch {
+    struct rrset_signjob* jobs;
+    int njobs;
+    int maxjobs;
+    ldns_rr_list** rrsets; /* RRsets owned by the batch */
+    int nrrsets;
+    int maxrrsets;
+};
+
+struct rrset_signbatch*
+rrset_signbatchcreate(void)
+{
+    struct rrset_signbatch* batch;
+    batch = malloc(sizeof(struct rrset_signbatch));
+    batch->jobs = NULL;
+    batch->njobs = batch->maxjobs = 0;
+    batch->rrsets = NULL;
+    batch->nrrsets = batch->maxrrsets = 0;
+    return batch;
+}
+
+static void
+rrset_signbatchadd(struct rrset_signbatch* batch, ldns_rr_list* rrset, ldns_rr_type rrtype, key_type* key, time_t inception, time_t expiration)
+{
+    if (batch->njobs == batch->maxjobs) {
+        batch->maxjobs = (batch->maxjobs ? batch->maxjobs * 2 : 8);
+        batch->jobs = realloc(batch->jobs, sizeof(struct rrset_signjob) * batch->maxjobs);
+    }
+    batch->jobs[batch->njobs].rrset = rrset;
+    batch->jobs[batch->njobs].rrtype = rrtype;
+    batch->jobs[batch->njobs].key = key;
+    batch->jobs[batch->njobs].inception = inception;
+    batch->jobs[batch->njobs].expiration = expiration;
+    batch->njobs++;
+}
+
+static void
+rrset_signbatchkeep(struct rrset_signbatch* batch, ldns_rr_list* rrset)
+{
+    if (batch->nrrsets == batch->maxrrsets) {
+        batch->maxrrsets = (batch->maxrrsets ? batch->maxrrsets * 2 : 8);
+        batch->rrsets = realloc(batch->rrsets, sizeof(ldns_rr_list*) * batch->maxrrsets);
+    }
+    batch->rrsets[batch->nrrsets++] = rrset;
+}
+
+void
+rrset_signbatchclear(struct rrset_signbatch* batch)
+{
+    for (int i=0; i<batch->nrrsets; i++)
+        ldns_rr_list_deep_free(batch->rrsets[i]);
+    batch->nrrsets = 0;
+    batch->njobs = 0;
+}
+
+void
+rrset_signbatchdestroy(struct rrset_signbatch* batch)
+{
+    if (!batch)
+        return;
+    rrset_signbatchclear(batch);
+    free(batch->rrsets);
+    free(batch->jobs);
+    free(batch);
+}
+
+/**
+ * Produce all signatures collected in the batch and add them to the record.
+ *
+ */
+ods_status
+rrset_signbatchflush(struct rrset_signbatch* batch, recordset_type record, hsm_ctx_t* ctx)
+{
+    ods_status status = ODS_STATUS_OK;
+    ldns_rr_list** rrsets;
+    ldns_rr** rrsigs;
+    int* members;
+    int nmembers;
+    char* done;
+
+    if (batch->njobs == 0) {
+        rrset_signbatchclear(batch);
+        return ODS_STATUS_OK;
+    }
+    rrsets = malloc(sizeof(ldns_rr_list*) * batch->njobs);
+    rrsigs = malloc(sizeof(ldns_rr*) * batch->njobs);
+    members = malloc(sizeof(int) * batch->njobs);
+    done = calloc(batch->njobs, sizeof(char));
+    for (int i=0; i<batch->njobs && status == ODS_STATUS_OK; i++) {
+        if (done[i])
+            continue;
+        nmembers = 0;
+        for (int j=i; j<batch->njobs; j++) {
+            if (!done[j] && batch->jobs[j].key == batch->jobs[i].key &&
+                batch->jobs[j].inception == batch->jobs[i].inception &&
+                batch->jobs[j].expiration == batch->jobs[i].expiration) {
+                rrsets[nmembers] = batch->jobs[j].rrset;
+                members[nmembers++] = j;
+                done[j] = 1;
+            }
+        }
+        status = lhsm_signbatch(ctx, rrsets, nmembers, batch->jobs[i].key, batch->jobs[i].inception, batch->jobs[i].expiration, rrsigs);
+        if (status != ODS_STATUS_OK) {
+            ods_log_crit("unable to sign %d RRsets of %s: lhsm_signbatch() failed", nmembers, names_recordgetname(record));
+            break;
+        }
+        for (int j=0; j<nmembers; j++) {
+            /* Add signature */
+            names_recordaddsignature(record, batch->jobs[members[j]].rrtype, rrsigs[j], strdup(batch->jobs[i].key->locator), batch->jobs[i].key->flags);
+        }
+    }
+    free(done);
+    free(members);
+    free(rrsigs);
+    free(rrsets);
+    rrset_signbatchclear(batch);
+    return status;
+}
+
+/**
+ * Sign RRset.  The signatures to be made are added to the batch, or when
+ * no batch is given, made immediately.
  *
  */
 ods_status
-rrset_sign(signconf_type* signconf, names_view_type view, recordset_type record, ldns_rr_type rrtype, hsm_ctx_t* ctx, time_t signtime)
+rrset_sign(signconf_type* signconf, names_view_type view, recordset_type record, ldns_rr_type rrtype, hsm_ctx_t* ctx, time_t signtime, struct rrset_signbatch* batch)
 {
     ods_status status;
     uint32_t newsigs;
     ldns_rr* rrsig;
+    struct rrset_signbatch* ownbatch = NULL;
+    int queued = 0;
     time_t inception;
     time_t expiration;
     ldns_rr_type dstatus = LDNS_RR_TYPE_FIRST;
@@ -215,7 +350,7 @@ rrset_sign(signconf_type* signconf, names_view_type view, recordset_type record,
     /* Transmogrify rrset */
     if (ldns_rr_list_rr_count(rrset) <= 0) {
         /* Empty RRset, no signatures needed */
-        if(rrset) ldns_rr_list_free(rrset);
+        if(rrset) ldns_rr_list_deep_free(rrset);
         free(matchedsignatures);
         return 0;
     }
@@ -234,12 +369,12 @@ rrset_sign(signconf_type* signconf, names_view_type view, recordset_type record,
 
     /* Skip delegation, glue and occluded RRsets */
     if (dstatus != LDNS_RR_TYPE_SOA) {
-        if(rrset) ldns_rr_list_free(rrset);
+        if(rrset) ldns_rr_list_deep_free(rrset);
         free(matchedsignatures);
         return 0;
     }
     if (delegpt != LDNS_RR_TYPE_SOA && rrtype != LDNS_RR_TYPE_DS) {
-        if(rrset) ldns_rr_list_free(rrset);
+        if(rrset) ldns_rr_list_deep_free(rrset);
         free(matchedsignatures);
         return 0;
     }
@@ -249,8 +384,8 @@ rrset_sign(signconf_type* signconf, names_view_type view, recordset_type record,
      */
     for (int i=0; i<nmatchedsignatures; i++) {
         if(matchedsignatures[i].signature) {
-            expiration = ldns_rdf2native_int32(ldns_rr_rrsig_expiration(matchedsignatures[i].signature->rr));
-            inception = ldns_rdf2native_int32(ldns_rr_rrsig_inception(matchedsignatures[i].signature->rr));
+            expiration = matchedsignatures[i].signature->expiration;
+            inception = matchedsignatures[i].signature->inception;
         }
         if (matchedsignatures[i].key && matchedsignatures[i].key->ksk && !matchedsignatures[i].key->zsk && rrtype != LDNS_RR_TYPE_DNSKEY) {
             /* If KSK don't sign other RRsets */
@@ -314,21 +449,16 @@ rrset_sign(signconf_type* signconf, names_view_type view, recordset_type record,
     }
     /* Calculate signature validity for new signatures */
     rrset_sigvalid_period(signconf, rrtype, signtime, &inception, &expiration);
+    if (!batch) {
+        batch = ownbatch = rrset_signbatchcreate();
+    }
     /* for each missing signature (no signature, but with key in the tuplie list) produce a signature */
     for (int i = 0; i < nmatchedsignatures; i++) {
         if (!matchedsignatures[i].signature && matchedsignatures[i].key) {
             /* Sign the RRset with this key */
             logger_message(&cls,logger_noctx,logger_TRACE, "sign %s with key %s inception=%ld expiration=%ld delegation=%s occluded=%s\n",names_recordgetname(record),matchedsignatures[i].key->locator,(long)inception,(long)expiration,(delegpt!=LDNS_RR_TYPE_SOA?"yes":"no"),(dstatus!=LDNS_RR_TYPE_SOA?"yes":"no"));
-            rrsig = lhsm_sign(ctx, rrset, matchedsignatures[i].key, inception, expiration);
-            if (rrsig == NULL) {
-                ods_log_crit("unable to sign RRset[%i]: lhsm_sign() failed", rrtype);
-                if(rrset) ldns_rr_list_free(rrset);
-                free(matchedsignatures);
-                return ODS_STATUS_HSM_ERR;
-            }
-            /* Add signature */
-            names_recordaddsignature(record, rrtype, rrsig, strdup(matchedsignatures[i].key->locator), matchedsignatures[i].key->flags);
-            newsigs++;
+            rrset_signbatchadd(batch, rrset, rrtype, matchedsignatures[i].key, inception, expiration);
+            queued = 1;
         }
         /* Add signatures for DNSKEY if have been configured to be added explicitjy */
         if(rrtype == LDNS_RR_TYPE_DNSKEY && signconf->dnskey_signature) {
@@ -340,7 +470,12 @@ rrset_sign(signconf_type* signconf, names_view_type view, recordset_type record,
                     ods_log_error("unable to publish dnskeys for zone %s: error decoding literal dnskey", signconf->name);
                     if(apex)
                         ldns_rdf_free(apex);
-                    if(rrset) ldns_rr_list_free(rrset);
+                    if (queued) {
+                        rrset_signbatchkeep(batch, rrset);
+                    } else if(rrset) {
+                        ldns_rr_list_deep_free(rrset);
+                    }
+                    rrset_signbatchdestroy(ownbatch);
                     free(matchedsignatures);
                     return status;
                 }
@@ -353,9 +488,18 @@ rrset_sign(signconf_type* signconf, names_view_type view, recordset_type record,
         }
     }
 
-    /* RRset signing completed */
-    if(rrset) ldns_rr_list_free(rrset);
+    /* The RRset is freed with the batch once its signatures are made */
+    if (queued) {
+        rrset_signbatchkeep(batch, rrset);
+    } else if(rrset) {
+        ldns_rr_list_deep_free(rrset);
+    }
     free(matchedsignatures);
+    if (ownbatch) {
+        status = rrset_signbatchflush(ownbatch, record, ctx);
+        rrset_signbatchdestroy(ownbatch);
+        return status;
+    }
     return 0;
 }
 
@@ -635,8 +779,8 @@ zone_update_serial(zone_type* zone, names_view_type view)
         names_recordlookupone(d, LDNS_RR_TYPE_SOA, NULL, &rr);
         assert(rr);
         serial = ldns_rdf2native_int32(ldns_rr_rdf(rr, 2));
-        zone->inboundserial = malloc(sizeof(uint16_t));
-        *(zone->inboundserial) = serial;
+        zone_set_inboundserial(zone, serial);
+        ldns_rr_free(rr);
         rr = NULL;
     }
     /* FIXME set min TTL from signconf */
@@ -656,7 +800,6 @@ zone_update_serial(zone_type* zone, names_view_type view)
         names_recordsetvalidfrom(d, serial);
     }
     names_recordlookupone(d, LDNS_RR_TYPE_SOA, NULL, &rr);
-    rr = ldns_rr_clone(rr);;
     names_recorddelall(d, LDNS_RR_TYPE_SOA);
     if(zone->outboundserial)
         free(zone->outboundserial);
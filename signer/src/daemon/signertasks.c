@@ -31,6 +31,7 @@
 #include <unistd.h>
 
 #include "daemon/engine.h"
+#include "daemon/metrics.h"
 #include "scheduler/worker.h"
 #include "scheduler/schedule.h"
 #include "signertasks.h"
@@ -50,53 +51,93 @@
 static logger_cls_type names_logsigning = LOGGER_INITIALIZE("signing");
 
 /**
- * Queue RRset for signing.
+ * Contiguous range of RRsets that a drudger signs in one go.
+ *
+ */
+struct sign_chunk {
+    size_t count;
+    recordset_type records[1];
+};
+
+
+/**
+ * Queue a batch of chunks for signing.
  *
  */
 static void
-worker_queue_domain(struct worker_context* context, fifoq_type* q, void* item, long* nsubtasks)
+worker_queue_chunks(struct worker_context* context, fifoq_type* q, void** items, size_t nitems, long* nsubtasks)
 {
-    ods_status status = ODS_STATUS_UNCHANGED;
+    size_t pushed;
     int tries = 0;
     ods_log_assert(q);
 
-        pthread_mutex_lock(&q->q_lock);
-        status = fifoq_push(q, item, context, &tries);
-        while (status == ODS_STATUS_UNCHANGED) {
+    pthread_mutex_lock(&q->q_lock);
+    pushed = fifoq_pushbatch(q, items, nitems, context, &tries);
+    while (pushed < nitems) {
+        if (pushed == 0) {
             tries++;
-            if (context->worker->need_to_exit) {
-                pthread_mutex_unlock(&q->q_lock);
-                return; /* FIXME should indicate some fundamental problem */
-            }
-            /**
-             * Apparently the queue is full. Lets take a small break to not hog CPU.
-             * The worker will release the signq lock while sleeping and will
-             * automatically grab the lock when the queue is nonfull.
-             * Queue is nonfull at 10% of the queue size.
-             */
-            ods_thread_wait(&q->q_nonfull, &q->q_lock, 5);
-            status = fifoq_push(q, item, context, &tries);
         }
-        pthread_mutex_unlock(&q->q_lock);
+        if (context->worker->need_to_exit) {
+            pthread_mutex_unlock(&q->q_lock);
+            *nsubtasks += pushed;
+            return; /* FIXME should indicate some fundamental problem */
+        }
+        /**
+         * Apparently the queue is full. Lets take a small break to not hog CPU.
+         * The worker will release the signq lock while sleeping and will
+         * automatically grab the lock when the queue is nonfull.
+         * Queue is nonfull at 10% of the queue size.
+         */
+        ods_thread_wait(&q->q_nonfull, &q->q_lock, 5);
+        pushed += fifoq_pushbatch(q, items + pushed, nitems - pushed, context, &tries);
+    }
+    pthread_mutex_unlock(&q->q_lock);
 
-        ods_log_assert(status == ODS_STATUS_OK);
-        *nsubtasks += 1;
+    *nsubtasks += pushed;
 }
 
 
 /**
- * Queue zone for signing.
+ * Queue zone for signing, in chunks of SignChunkSize RRsets so that the
+ * queue lock is taken once per chunk on both sides.  The chunks are taken
+ * from the region of the signing pass and released together with it, and
+ * are pushed FIFOQ_BATCH_COUNT at a time.
  *
  */
 static void
-worker_queue_zone(struct worker_context* context, fifoq_type* q, names_view_type view, long* nsubtasks)
+worker_queue_zone(struct worker_context* context, fifoq_type* q, names_view_type view, names_region_type region, long* nsubtasks)
 {
     names_iterator iter;
     recordset_type record;
+    struct sign_chunk* chunk = NULL;
+    void* batch[FIFOQ_BATCH_COUNT];
+    size_t nbatch = 0;
+    size_t chunksize = 1;
     time_t refreshtime = context->clock_in + duration2time(context->zone->signconf->sig_refresh_interval);
+    if (context->engine->config->sign_chunk_size > 1) {
+        chunksize = context->engine->config->sign_chunk_size;
+    }
     for(iter=names_viewiterator(view,names_iteratorexpiring,refreshtime); names_iterate(&iter,&record); names_advance(&iter,NULL)) {
         names_amend(view, record);
-        worker_queue_domain(context, q, record, nsubtasks);
+        if (!chunk) {
+            chunk = names_regionalloc(region, sizeof(struct sign_chunk) + (chunksize - 1) * sizeof(recordset_type));
+            chunk->count = 0;
+        }
+        chunk->records[chunk->count++] = record;
+        if (chunk->count == chunksize) {
+            batch[nbatch++] = chunk;
+            chunk = NULL;
+            if (nbatch == FIFOQ_BATCH_COUNT) {
+                worker_queue_chunks(context, q, batch, nbatch, nsubtasks);
+                nbatch = 0;
+            }
+        }
+    }
+    if (chunk) {
+        batch[nbatch++] = chunk;
+    }
+    if (nbatch) {
+        worker_queue_chunks(context, q, batch, nbatch, nsubtasks);
     }
 }
 
@@ -111,7 +152,7 @@ worker_check_jobs(worker_type* worker, task_type* task, int ntasks, long ntasksf
     ods_log_assert(worker);
     ods_log_assert(task);
     if (ntasksfailed) {
-        ods_log_error("[%s] sign zone %s failed: %ld RRsets failed",
+        ods_log_error("[%s] sign zone %s failed: %ld chunks of RRsets failed",
             worker->name, task->owner, ntasksfailed);
         return ODS_STATUS_ERR;
     } else if (worker->need_to_exit) {
@@ -123,31 +164,34 @@ worker_check_jobs(worker_type* worker, task_type* task, int ntasks, long ntasksf
 }
 
 static ods_status
-signdomain(struct worker_context* superior, hsm_ctx_t* ctx, recordset_type record)
+signdomain(struct worker_context* superior, hsm_ctx_t* ctx, struct rrset_signbatch* batch, recordset_type record)
 {
     ods_status status;
     names_iterator iter;
     ldns_rr_type rrtype;
     time_t expiration = INT_MAX;
     time_t rrsigexpirationtime;
-    ldns_rr* rrsig;
     struct signature_struct** rrsigs;
-    ldns_rdf* rrsigexpiration;
 
     for (iter=names_recordalltypes(record); names_iterate(&iter,&rrtype); names_advance(&iter,NULL)) {
-        if ((status = rrset_sign(superior->zone->signconf, superior->view, record, rrtype, ctx, superior->clock_in)) != ODS_STATUS_OK)
+        if ((status = rrset_sign(superior->zone->signconf, superior->view, record, rrtype, ctx, superior->clock_in, batch)) != ODS_STATUS_OK) {
+            rrset_signbatchclear(batch);
             return status;
+        }
     }
     if(names_recordgetdenial(record)) {
-        if((status = rrset_sign(superior->zone->signconf, superior->view, record, LDNS_RR_TYPE_NSEC, ctx, superior->clock_in)) != ODS_STATUS_OK)
+        if((status = rrset_sign(superior->zone->signconf, superior->view, record, LDNS_RR_TYPE_NSEC, ctx, superior->clock_in, batch)) != ODS_STATUS_OK) {
+            rrset_signbatchclear(batch);
             return status;
+        }
     }
+    /* all RRsets of the record are signed in one go per key */
+    if ((status = rrset_signbatchflush(batch, record, ctx)) != ODS_STATUS_OK)
+        return status;
 
     names_recordlookupall(record, LDNS_RR_TYPE_RRSIG, NULL, NULL, &rrsigs);
     for(int i=0; rrsigs[i]; i++) {
-        rrsig = rrsigs[i]->rr;
-        rrsigexpiration = ldns_rr_rrsig_expiration(rrsig);
-        rrsigexpirationtime = ldns_rdf2native_time_t(rrsigexpiration);
+        rrsigexpirationtime = (time_t) rrsigs[i]->expiration;
         if(rrsigexpirationtime < expiration)
             expiration = rrsigexpirationtime;
     }
@@ -160,12 +204,17 @@ signdomain(struct worker_context* superior, hsm_ctx_t* ctx, recordset_type recor
 void
 drudge(worker_type* worker)
 {
-    recordset_type record;
+    struct sign_chunk* chunk;
     ods_status status;
+    ods_status chunkstatus;
     struct worker_context* superior;
     hsm_ctx_t* ctx = NULL;
+    struct rrset_signbatch* batch;
     engine_type* engine;
     fifoq_type* signq = worker->taskq->signq;
+    size_t i;
+
+    batch = rrset_signbatchcreate();
 
     while (worker->need_to_exit == 0) {
         ods_log_deeebug("[%s] report for duty", worker->name);
@@ -175,8 +224,8 @@ drudge(worker_type* worker)
             break;
         }
         superior = NULL;
-        record = (recordset_type) fifoq_pop(signq, (void**)&superior);
-        if (!record) {
+        chunk = (struct sign_chunk*) fifoq_pop(signq, (void**)&superior);
+        if (!chunk) {
             ods_log_deeebug("[%s] nothing to do, wait", worker->name);
             /**
              * Apparently the queue is empty. Wait until new work is queued.
@@ -186,16 +235,13 @@ drudge(worker_type* worker)
              */
             pthread_cond_wait(&signq->q_threshold, &signq->q_lock);
             if(worker->need_to_exit == 0)
-                record = (recordset_type) fifoq_pop(signq, (void**)&superior);
+                chunk = (struct sign_chunk*) fifoq_pop(signq, (void**)&superior);
         }
         pthread_mutex_unlock(&signq->q_lock);
         /* do some work */
-        if (record) {
+        if (chunk) {
             ods_log_assert(superior);
-            if (!ctx) {
-                ods_log_debug("[%s] create hsm context", worker->name);
-                ctx = hsm_create_context();
-            }
+            ctx = hsm_pool_acquire();
             if (!ctx) {
                 engine = superior->engine;
                 ods_log_crit("[%s] error creating libhsm context", worker->name);
@@ -206,16 +252,21 @@ drudge(worker_type* worker)
                 ods_log_error("signer instructed to reload due to hsm reset while signing");
                 status = ODS_STATUS_HSM_ERR;
             } else {
-                status = signdomain(superior, ctx, record);
+                status = ODS_STATUS_OK;
+                for (i = 0; i < chunk->count; i++) {
+                    chunkstatus = signdomain(superior, ctx, batch, chunk->records[i]);
+                    if (chunkstatus != ODS_STATUS_OK) {
+                        status = chunkstatus;
+                    }
+                }
+                hsm_pool_release(ctx);
+                ctx = NULL;
             }
             fifoq_report(signq, superior->worker, status);
         }
         /* done work */
     }
-    /* cleanup open HSM sessions */
-    if (ctx) {
-        hsm_destroy_context(ctx);
-    }
+    rrset_signbatchdestroy(batch);
 }
 
 time_t
@@ -269,6 +320,7 @@ do_forcereadsignconf(task_type* task, const char* zonename, void* zonearg, void
         schedule_unscheduletask(engine->taskq, TASK_SIGNCONF, zone->name);
         schedule_unscheduletask(engine->taskq, TASK_READ, zone->name);
         schedule_unscheduletask(engine->taskq, TASK_SIGN, zone->name);
+        schedule_unscheduletask(engine->taskq, TASK_FORCESIGN, zone->name);
         schedule_unscheduletask(engine->taskq, TASK_WRITE, zone->name);
         schedule_scheduletask(engine->taskq, TASK_READ, zone->name, zone, &zone->zone_lock, schedule_PROMPTLY);
         return schedule_SUCCESS;
@@ -379,7 +431,9 @@ do_signzone(task_type* task, const char* zonename, void* zonearg, void *contexta
     struct dual change;
     names_iterator iter;
     time_t returnscheduletime = schedule_SUCCESS;
+    struct timespec started;
 
+    metrics_clock(&started);
     context->clock_in = time_now();
     context->zone = zone;
     if (!zone->nextserial) {
@@ -436,7 +490,8 @@ do_signzone(task_type* task, const char* zonename, void* zonearg, void *contexta
         zone->stats->sig_time = 0;
         pthread_mutex_unlock(&zone->stats->stats_lock);
     }
-    /* check the HSM connection before queuing sign operations */
+    /* check the HSM logins before queuing sign operations, this logs in
+     * again after a token reset */
     if (hsm_check_context()) {
         ods_log_error("signer instructed to reload due to hsm reset in sign task");
         engine->need_to_reload = 1;
@@ -453,22 +508,30 @@ do_signzone(task_type* task, const char* zonename, void* zonearg, void *contexta
         names_viewreset(signview);
         /* queue menial, hard signing work */
         if(context->signq) {
-            worker_queue_zone(context, worker->taskq->signq, signview, &nsubtasks);
+            names_region_type region = names_regioncreate();
+            worker_queue_zone(context, worker->taskq->signq, signview, region, &nsubtasks);
             ods_log_deeebug("[%s] wait until drudgers are finished "
                     "signing zone %s", worker->name, task->owner);
             /* sleep until work is done */
             fifoq_waitfor(context->signq, worker, nsubtasks, &nsubtasksfailed);
+            /* when told to exit drudgers may still hold on to chunks */
+            if (!worker->need_to_exit) {
+                names_regiondestroy(region);
+            }
         } else {
             names_iterator iter;
             hsm_ctx_t* ctx;
+            struct rrset_signbatch* batch;
             recordset_type record;
             time_t refreshtime = context->clock_in + duration2time(zone->signconf->sig_refresh_interval);
-            ctx = hsm_create_context();
+            ctx = hsm_pool_acquire();
+            batch = rrset_signbatchcreate();
             for(iter=names_viewiterator(signview,names_iteratorexpiring,refreshtime); names_iterate(&iter,&record); names_advance(&iter,NULL)) {
                 names_amend(signview, record);
-                signdomain(context, ctx, record);
+                signdomain(context, ctx, batch, record);
             }
-            hsm_destroy_context(ctx);
+            rrset_signbatchdestroy(batch);
+            hsm_pool_release(ctx);
         }
     }
     /* stop timer */
@@ -505,6 +568,7 @@ do_signzone(task_type* task, const char* zonename, void* zonearg, void *contexta
     zonelist_releaseresource(NULL, zone, NULL, offsetof(zone_type, signview), signview);
 
     if(returnscheduletime == schedule_SUCCESS) {
+        metrics_since(METRICS_STAGE_SIGN, &started);
         schedule_scheduletask(engine->taskq, TASK_WRITE, zone->name, zone, &zone->zone_lock, schedule_PROMPTLY);
     }
     return returnscheduletime;
@@ -517,6 +581,8 @@ do_readzone(task_type* task, const char* zonename, void* zonearg, void *contexta
     struct worker_context* context = contextarg;
     engine_type* engine = context->engine;
     zone_type* zone = zonearg;
+    struct timespec started;
+    metrics_clock(&started);
     /* perform 'read input adapter' task */
     if (!zone->signconf->last_modified) {
         ods_log_debug("no signconf.xml for zone %s yet", task->owner);
@@ -549,6 +615,7 @@ do_readzone(task_type* task, const char* zonename, void* zonearg, void *contexta
          * task cannot remove the read task (it is no longer queued), but will schedule a sign task.
          * The read task can then continue, finding the just created sign task in its path.
          */
+        metrics_since(METRICS_STAGE_READ, &started);
         schedule_unscheduletask(engine->taskq, TASK_SIGN, zone->name);
         schedule_scheduletask(engine->taskq, TASK_SIGN, zone->name, zone, &zone->zone_lock, schedule_PROMPTLY);
         return schedule_SUCCESS;
@@ -562,6 +629,8 @@ do_forcereadzone(task_type* task, const char* zonename, void* zonearg, void *con
     struct worker_context* context = contextarg;
     engine_type* engine = context->engine;
     zone_type* zone = zonearg;
+    struct timespec started;
+    metrics_clock(&started);
     /* perform 'read input adapter' task */
     if (!zone->signconf->last_modified) {
         ods_log_debug("no signconf.xml for zone %s yet", task->owner);
@@ -583,10 +652,12 @@ do_forcereadzone(task_type* task, const char* zonename, void* zonearg, void *con
         }
         return schedule_SUCCESS;
     } else {
+        metrics_since(METRICS_STAGE_READ, &started);
         schedule_unscheduletask(engine->taskq, TASK_SIGNCONF, zone->name);
         schedule_unscheduletask(engine->taskq, TASK_FORCEREAD, zone->name);
         schedule_unscheduletask(engine->taskq, TASK_READ, zone->name);
         schedule_unscheduletask(engine->taskq, TASK_SIGN, zone->name);
+        schedule_unscheduletask(engine->taskq, TASK_FORCESIGN, zone->name);
         schedule_unscheduletask(engine->taskq, TASK_WRITE, zone->name);
         schedule_scheduletask(engine->taskq, TASK_SIGN, zone->name, zone, &zone->zone_lock, schedule_PROMPTLY);
         return schedule_SUCCESS;
@@ -678,6 +749,8 @@ do_writezone(task_type* task, const char* zonename, void* zonearg, void *context
     worker_type* worker = context->worker;
     zone_type* zone = zonearg;
     time_t resign;
+    struct timespec started;
+    metrics_clock(&started);
     context->clock_in = time_now(); /* TODO this means something different */
     /* perform write to output adapter task */
 
@@ -713,6 +786,7 @@ do_writezone(task_type* task, const char* zonename, void* zonearg, void *context
             do_outputzonefile(zone);
         }
     }
+    metrics_since(METRICS_STAGE_WRITE, &started);
 
     if (zone->signconf &&
             duration2time(zone->signconf->sig_resign_interval)) {
@@ -49,7 +49,7 @@ static void xfrhandler_handle_dns(netio_type* netio,
  *
  */
 xfrhandler_type*
-xfrhandler_create()
+xfrhandler_create(int tcp_max, int tcp_max_master)
 {
     xfrhandler_type* xfrh = NULL;
     CHECKALLOC(xfrh = (xfrhandler_type*) malloc(sizeof(xfrhandler_type)));
@@ -57,7 +57,6 @@ xfrhandler_create()
     xfrh->packet = NULL;
     xfrh->netio = NULL;
     xfrh->tcp_set = NULL;
-    xfrh->tcp_waiting_first = NULL;
     xfrh->udp_waiting_first = NULL;
     xfrh->udp_waiting_last = NULL;
     xfrh->udp_use_num = 0;
@@ -73,7 +72,8 @@ xfrhandler_create()
     /* setup */
     xfrh->netio = netio_create();
     xfrh->packet = buffer_create(PACKET_BUFFER_SIZE);
-    xfrh->tcp_set = tcp_set_create();
+    xfrh->tcp_set = tcp_set_create(tcp_max > 0 ? (size_t) tcp_max : 1,
+        tcp_max_master > 0 ? (size_t) tcp_max_master : 0);
     xfrh->dnshandler.fd = -1;
     xfrh->dnshandler.user_data = (void*) xfrh;
     xfrh->dnshandler.timeout = 0;
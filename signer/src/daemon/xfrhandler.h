@@ -60,7 +60,6 @@ struct xfrhandler_struct {
     netio_type* netio;
     tcp_set_type* tcp_set;
     buffer_type* packet;
-    xfrd_type* tcp_waiting_first;
     xfrd_type* udp_waiting_first;
     xfrd_type* udp_waiting_last;
     size_t udp_use_num;
@@ -75,11 +74,12 @@ struct xfrhandler_struct {
 
 /**
  * Create zone transfer handler.
- * \param[in] allocator memory allocator
+ * \param[in] tcp_max number of concurrent tcp transfers
+ * \param[in] tcp_max_master number of concurrent tcp transfers per master
  * \return xfrhandler_type* created zoned transfer handler
  *
  */
-xfrhandler_type* xfrhandler_create(void);
+xfrhandler_type* xfrhandler_create(int tcp_max, int tcp_max_master);
 
 /**
  * Start zone transfer handler.
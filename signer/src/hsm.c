@@ -30,6 +30,7 @@
  */
 
 #include "daemon/engine.h"
+#include "daemon/metrics.h"
 #include "hsm.h"
 #include "log.h"
 #include "cryptoki_compat/pkcs11.h"
@@ -130,6 +131,27 @@ llibhsm_key_start:
 }
 
 
+/**
+ * Create the signing parameters for a key.
+ *
+ */
+static hsm_sign_params_t*
+lhsm_signparams(key_type* key_id, time_t inception, time_t expiration)
+{
+    hsm_sign_params_t* params;
+    ods_log_assert(key_id->dnskey);
+    ods_log_assert(key_id->params);
+    params = hsm_sign_params_new();
+    params->owner = ldns_rdf_clone(key_id->params->owner);
+    params->algorithm = key_id->algorithm;
+    params->flags = key_id->flags;
+    params->inception = inception;
+    params->expiration = expiration;
+    params->keytag = key_id->params->keytag;
+    return params;
+}
+
+
 /**
  * Get RRSIG from one of the HSMs, given a RRset and a key.
  *
@@ -141,23 +163,18 @@ lhsm_sign(hsm_ctx_t* ctx, ldns_rr_list* rrset, key_type* key_id,
     char* error = NULL;
     ldns_rr* result = NULL;
     hsm_sign_params_t* params = NULL;
+    struct timespec started;
 
     if (!key_id || !rrset || !inception || !expiration) {
         ods_log_error("[%s] unable to sign: missing required elements",
             hsm_str);
         return NULL;
     }
-    ods_log_assert(key_id->dnskey);
-    ods_log_assert(key_id->params);
     /* adjust parameters */
-    params = hsm_sign_params_new();
-    params->owner = ldns_rdf_clone(key_id->params->owner);
-    params->algorithm = key_id->algorithm;
-    params->flags = key_id->flags;
-    params->inception = inception;
-    params->expiration = expiration;
-    params->keytag = key_id->params->keytag;
+    params = lhsm_signparams(key_id, inception, expiration);
+    metrics_clock(&started);
     result = hsm_sign_rrset(ctx, rrset, keylookup(ctx, key_id->locator), params);
+    metrics_since(METRICS_HSM_SIGN, &started);
     hsm_sign_params_free(params);
     if (!result) {
         error = hsm_get_error(ctx);
@@ -166,6 +183,47 @@ lhsm_sign(hsm_ctx_t* ctx, ldns_rr_list* rrset, key_type* key_id,
             free((void*)error);
         }
         ods_log_crit("[%s] error signing rrset with libhsm", hsm_str);
+    } else {
+        metrics_count(METRICS_SIGNATURES, 1);
     }
     return result;
 }
+
+
+/**
+ * Get RRSIGs from one of the HSMs, given a number of RRsets and a key.
+ *
+ */
+ods_status
+lhsm_signbatch(hsm_ctx_t* ctx, ldns_rr_list** rrsets, size_t nrrsets,
+    key_type* key_id, time_t inception, time_t expiration, ldns_rr** rrsigs)
+{
+    char* error = NULL;
+    hsm_sign_params_t* params = NULL;
+    struct timespec started;
+    int result;
+
+    if (!key_id || !rrsets || !inception || !expiration) {
+        ods_log_error("[%s] unable to sign: missing required elements",
+            hsm_str);
+        return ODS_STATUS_ASSERT_ERR;
+    }
+    params = lhsm_signparams(key_id, inception, expiration);
+    metrics_clock(&started);
+    result = hsm_sign_rrsets(ctx, rrsets, nrrsets,
+        keylookup(ctx, key_id->locator), params, rrsigs);
+    metrics_since(METRICS_HSM_SIGN, &started);
+    hsm_sign_params_free(params);
+    if (result) {
+        error = hsm_get_error(ctx);
+        if (error) {
+            ods_log_error("[%s] %s", hsm_str, error);
+            free((void*)error);
+        }
+        ods_log_crit("[%s] error signing %lu rrsets with libhsm", hsm_str,
+            (unsigned long) nrrsets);
+        return ODS_STATUS_HSM_ERR;
+    }
+    metrics_count(METRICS_SIGNATURES, nrrsets);
+    return ODS_STATUS_OK;
+}
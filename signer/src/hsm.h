@@ -67,4 +67,20 @@ ods_status lhsm_get_key(hsm_ctx_t* ctx, ldns_rdf* owner, key_type* key_id, int s
 ldns_rr* lhsm_sign(hsm_ctx_t* ctx, ldns_rr_list* rrset, key_type* key_id,
     time_t inception, time_t expiration);
 
+/**
+ * Get RRSIGs from one of the HSMs, given a number of RRsets and a key.
+ * \param[in] ctx HSM context
+ * \param[in] rrsets RRsets to be signed
+ * \param[in] nrrsets number of RRsets
+ * \param[in] key_id key credentials
+ * \param[in] inception signature inception
+ * \param[in] expiration signature expiration
+ * \param[out] rrsigs receives a RRSIG record for each RRset
+ * \return ods_status status
+ *
+ */
+ods_status lhsm_signbatch(hsm_ctx_t* ctx, ldns_rr_list** rrsets,
+    size_t nrrsets, key_type* key_id, time_t inception, time_t expiration,
+    ldns_rr** rrsigs);
+
 #endif /* SHARED_HSM_H */
@@ -345,6 +345,19 @@ parse_addns_allow_notify(const char* filename,
 }
 
 
+/**
+ * Parse <AllowUpdate/>.
+ *
+ */
+acl_type*
+parse_addns_allow_update(const char* filename,
+    tsig_type* tsig)
+{
+    return parse_addns_acl(filename, tsig,
+        (char *)"//Adapter/DNS/Inbound/AllowUpdate/Peer");
+}
+
+
 /**
  * Parse <ProvideTransfer/>.
  *
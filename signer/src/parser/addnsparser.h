@@ -58,6 +58,15 @@ acl_type* parse_addns_request_xfr(const char* filename, tsig_type* tsig);
  */
 acl_type* parse_addns_allow_notify(const char* filename, tsig_type* tsig);
 
+/**
+ * Parse <AllowUpdate/>.
+ * \param[in] filename filename
+ * \param[in] tsig list of TSIGs
+ * \return acl_type* ACL
+ *
+ */
+acl_type* parse_addns_allow_update(const char* filename, tsig_type* tsig);
+
 /**
  * Parse <ProvideTransfer/>.
  * \param[in] allocator memory allocator
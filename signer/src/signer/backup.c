@@ -382,7 +382,12 @@ backup_read_namedb(FILE* in, zone_type* zone, names_view_type view)
         goto backup_namedb_done;
     }
 
-    names_viewcommit(view);
+    if (names_viewcommit(view)) {
+        ods_log_error("[%s] unable to commit RRs of zone %s: view "
+            "changed while recovering", backup_str, z->name);
+        result = ODS_STATUS_CONFLICT_ERR;
+        goto backup_namedb_done;
+    }
     
     /* read NSEC(3)s */
     ods_log_debug("[%s] read NSEC(3)s %s", backup_str, z->name);
@@ -475,7 +480,13 @@ backup_read_namedb(FILE* in, zone_type* zone, names_view_type view)
             backup_str, l, ldns_get_errorstr_by_id(status), line);
         result = ODS_STATUS_ERR;
     }
-    names_viewcommit(view);
+    if (names_viewcommit(view)) {
+        ods_log_error("[%s] unable to commit RRSIGs of zone %s: view "
+            "changed while recovering", backup_str, z->name);
+        if (result == ODS_STATUS_OK) {
+            result = ODS_STATUS_CONFLICT_ERR;
+        }
+    }
 
 backup_namedb_done:
     if (orig) {
@@ -556,8 +567,6 @@ upgraderecords(zone_type* zone, names_view_type view)
     recordset_type record;
     time_t expiration = LONG_MAX;
     struct signature_struct** rrsigs;
-    ldns_rr* rrsig;
-    ldns_rdf* rrsigexpiration;
     time_t rrsigexpirationtime;
     uint32_t serial;
     serial = *zone->outboundserial;
@@ -566,16 +575,17 @@ upgraderecords(zone_type* zone, names_view_type view)
         names_recordsetvalidfrom(record, serial);
         names_recordlookupall(record, LDNS_RR_TYPE_RRSIG, NULL, NULL, &rrsigs);
         for(int i=0; rrsigs[i]; i++) {
-            rrsig = rrsigs[i]->rr;
-            rrsigexpiration = ldns_rr_rrsig_expiration(rrsig);
-            rrsigexpirationtime = ldns_rdf2native_time_t(rrsigexpiration);
+            rrsigexpirationtime = (time_t) rrsigs[i]->expiration;
             if(rrsigexpirationtime < expiration)
                 expiration = rrsigexpirationtime;
         }
         free(rrsigs);
         names_recordsetexpiry(record, expiration);
     }
-    names_viewcommit(view);
+    if (names_viewcommit(view)) {
+        ods_log_warning("[%s] unable to upgrade records of zone %s: view "
+            "changed", backup_str, zone->name);
+    }
 }
 
 /**
@@ -646,10 +656,9 @@ zone_recover(zone_type* zone)
             goto recover_error2;
         }
         zone->klass = (ldns_rr_class) klass;
-        zone->inboundserial   = malloc(sizeof(uint32_t));
+        zone_set_inboundserial(zone, inbound);
         zone->nextserial      = malloc(sizeof(uint32_t));
         zone->outboundserial  = malloc(sizeof(uint32_t));
-        *zone->inboundserial  = inbound;
         *zone->nextserial     = internal;
         *zone->outboundserial = outbound;
         /* signconf part */
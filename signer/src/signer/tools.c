@@ -148,7 +148,12 @@ tools_input(zone_type* zone)
     }
     switch(status) {
         case ODS_STATUS_OK:
-            names_viewcommit(view);
+            if (names_viewcommit(view)) {
+                ods_log_error("[%s] unable to read zone %s: input view "
+                    "changed meanwhile", tools_str, zone->name);
+                status = ODS_STATUS_CONFLICT_ERR;
+                break;
+            }
             metastorageput(zone);
             break;
         case ODS_STATUS_UNCHANGED:
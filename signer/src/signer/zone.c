@@ -37,6 +37,7 @@
 #include "status.h"
 #include "util.h"
 #include "signer/zone.h"
+#include "wire/apexcache.h"
 #include "wire/netio.h"
 #include "compat.h"
 #include "daemon/signertasks.h"
@@ -76,6 +77,12 @@ zone_create(char* name, ldns_rr_class klass)
         free(zone);
         return NULL;
     }
+    if (pthread_mutex_init(&zone->apex_lock, NULL)) {
+        (void)pthread_mutex_destroy(&zone->xfr_lock);
+        (void)pthread_mutex_destroy(&zone->zone_lock);
+        free(zone);
+        return NULL;
+    }
 
     zone->name = strdup(name);
     if (!zone->name) {
@@ -184,7 +191,7 @@ zone_publish_dnskeys(zone_type* zone, names_view_type view, int skip_hsm_access)
 
     /* hsm access */
     if (!skip_hsm_access) {
-        ctx = hsm_create_context();
+        ctx = hsm_pool_acquire();
         if (ctx == NULL) {
             ods_log_error("[%s] unable to publish keys for zone %s: "
                 "error creating libhsm context", zone_str, zone->name);
@@ -208,7 +215,7 @@ zone_publish_dnskeys(zone_type* zone, names_view_type view, int skip_hsm_access)
                     ods_log_error("[%s] unable to publish dnskeys for zone %s: "
                             "error decoding literal dnskey", zone_str, zone->name);
                     if (!skip_hsm_access) {
-                        hsm_destroy_context(ctx);
+                        hsm_pool_release(ctx);
                     }
                     return status;
                 }
@@ -247,7 +254,7 @@ zone_publish_dnskeys(zone_type* zone, names_view_type view, int skip_hsm_access)
     }
     /* done */
     if (!skip_hsm_access) {
-        hsm_destroy_context(ctx);
+        hsm_pool_release(ctx);
     }
     return status;
 }
@@ -330,7 +337,7 @@ zone_prepare_keys(zone_type* zone)
     }
     ods_log_assert(zone->name);
     /* hsm access */
-    ctx = hsm_create_context();
+    ctx = hsm_pool_acquire();
     if (ctx == NULL) {
         ods_log_error("[%s] unable to prepare signing keys for zone %s: "
             "error creating libhsm context", zone_str, zone->name);
@@ -351,7 +358,7 @@ zone_prepare_keys(zone_type* zone)
         ods_log_assert(zone->signconf->keys->keys[i].params);
     }
     /* done */
-    hsm_destroy_context(ctx);
+    hsm_pool_release(ctx);
     return status;
 }
 
@@ -480,6 +487,7 @@ zone_cleanup(zone_type* zone)
     signconf_cleanup(zone->signconf);
     pthread_mutex_unlock(&zone->zone_lock);
     stats_cleanup(zone->stats);
+    apex_cache_cleanup(zone->apexcache);
     free(zone->notify_command);
     free(zone->notify_args);
     free((void*)zone->policy_name);
@@ -492,11 +500,21 @@ zone_cleanup(zone_type* zone)
     zone->nextserial = NULL;
     zone->inboundserial = NULL;
     zone->outboundserial = NULL;
+    pthread_mutex_destroy(&zone->apex_lock);
     pthread_mutex_destroy(&zone->xfr_lock);
     pthread_mutex_destroy(&zone->zone_lock);
     free(zone);
 }
 
+void
+zone_set_inboundserial(zone_type* zone, uint32_t serial)
+{
+    if (!zone->inboundserial) {
+        CHECKALLOC(zone->inboundserial = malloc(sizeof(uint32_t)));
+    }
+    *zone->inboundserial = serial;
+}
+
 void
 zone_start(zone_type* zone)
 {
@@ -531,9 +549,7 @@ zone_start(zone_type* zone)
     names_viewlookupone(zone->baseview, zone->apex, LDNS_RR_TYPE_SOA, NULL, &rr);
     if(rr) {
         serial = ldns_rdf2native_int32(ldns_rr_rdf(rr, SE_SOA_RDATA_SERIAL));
-        if(zone->inboundserial)
-            free(zone->inboundserial);
-        zone->inboundserial = malloc(sizeof(uint32_t));
-        *zone->inboundserial = serial;
+        zone_set_inboundserial(zone, serial);
+        ldns_rr_free(rr);
     }
 }
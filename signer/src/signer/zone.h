@@ -103,10 +103,13 @@ struct zone_struct {
     /* zone transfers */
     xfrd_type* xfrd;
     notify_type* notify;
+    /* precomputed apex answers */
+    struct apex_cache_struct* apexcache;
     /* statistics */
     stats_type* stats;
     pthread_mutex_t zone_lock;
     pthread_mutex_t xfr_lock;
+    pthread_mutex_t apex_lock;
     /* backing store for rrsigs (both domain as denial) */
     int zoneconfigvalid; /* flag indicating whether the signconf has at least once been read */
 };
@@ -230,6 +233,15 @@ ods_status zone_del_nsec3params(zone_type* zone, names_view_type view);
  */
 void zone_merge(zone_type* z1, zone_type* z2);
 
+/**
+ * Set the inbound serial of a zone. Once allocated the serial is updated
+ * in place, so a reader never holds on to freed memory.
+ * \param[in] zone zone
+ * \param[in] serial serial of the unsigned zone
+ *
+ */
+void zone_set_inboundserial(zone_type* zone, uint32_t serial);
+
 /**
  * Clean up zone.
  * \param[in] zone zone
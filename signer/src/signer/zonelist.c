@@ -83,6 +83,7 @@ zonelist_create()
         return NULL;
     }
     zlist->last_modified = 0;
+    zlist->startthreads = 1;
     pthread_mutex_init(&zlist->zl_lock, NULL);
     return zlist;
 }
@@ -411,11 +412,103 @@ zone_not_present:
 
 
 /**
- * Merge zone lists.
+ * Zones to be started, shared by the threads that start them.
+ *
+ */
+struct zonelist_startup_struct {
+    zone_type** zones;
+    int count;
+    int next;
+    int done;
+    time_t reported;
+    pthread_mutex_t lock;
+};
+
+#define ZONELIST_PROGRESS_INTERVAL 10
+
+
+/**
+ * Start zones until none are left, reporting progress.
+ *
+ */
+static void*
+zonelist_startzones(void* arg)
+{
+    struct zonelist_startup_struct* startup = arg;
+    zone_type* zone;
+    time_t now;
+    for (;;) {
+        pthread_mutex_lock(&startup->lock);
+        zone = NULL;
+        if (startup->next < startup->count) {
+            zone = startup->zones[startup->next++];
+        }
+        pthread_mutex_unlock(&startup->lock);
+        if (!zone) {
+            break;
+        }
+        zone_start(zone);
+        pthread_mutex_lock(&startup->lock);
+        startup->done++;
+        now = time_now();
+        if (startup->done == startup->count ||
+            now >= startup->reported + ZONELIST_PROGRESS_INTERVAL) {
+            ods_log_info("[%s] restored %d of %d zones", zl_str,
+                startup->done, startup->count);
+            startup->reported = now;
+        }
+        pthread_mutex_unlock(&startup->lock);
+    }
+    return NULL;
+}
+
+
+/**
+ * Start added zones, concurrently on startthreads threads.
+ *
+ */
+static void
+zonelist_start(zonelist_type* zl, zone_type** zones, int count)
+{
+    struct zonelist_startup_struct startup;
+    pthread_t* threads;
+    int nthreads, i;
+    if (count == 0) {
+        return;
+    }
+    startup.zones = zones;
+    startup.count = count;
+    startup.next = 0;
+    startup.done = 0;
+    startup.reported = time_now();
+    pthread_mutex_init(&startup.lock, NULL);
+    nthreads = (zl->startthreads < count ? zl->startthreads : count);
+    if (nthreads > 1) {
+        ods_log_info("[%s] restoring %d zones using %d threads", zl_str,
+            count, nthreads);
+    }
+    CHECKALLOC(threads = (pthread_t*) calloc(nthreads > 1 ? nthreads : 1, sizeof(pthread_t)));
+    for (i = 1; i < nthreads; i++) {
+        if (pthread_create(&threads[i], NULL, zonelist_startzones, &startup)) {
+            break;
+        }
+    }
+    nthreads = i;
+    zonelist_startzones(&startup);
+    for (i = 1; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    pthread_mutex_destroy(&startup.lock);
+}
+
+
+/**
+ * Merge zone lists. Zones that need to be started are added to started.
  *
  */
 static void
-zonelist_merge(zonelist_type* zl1, zonelist_type* zl2)
+zonelist_merge(zonelist_type* zl1, zonelist_type* zl2, zone_type** started, int* nstarted)
 {
     zone_type* z1 = NULL;
     zone_type* z2 = NULL;
@@ -448,7 +541,7 @@ zonelist_merge(zonelist_type* zl1, zonelist_type* zl2)
                 ods_log_crit("[%s] merge failed: z2 not added", zl_str);
                 return;
             }
-            zone_start(z2);
+            started[(*nstarted)++] = z2;
             n2 = ldns_rbtree_next(n2);
         } else {
             /* compare the zones z1 and z2 */
@@ -465,7 +558,7 @@ zonelist_merge(zonelist_type* zl1, zonelist_type* zl2)
                     ods_log_crit("[%s] merge failed: z2 not added", zl_str);
                     return;
                 }
-                zone_start(z2);
+                started[(*nstarted)++] = z2;
                 n2 = ldns_rbtree_next(n2);
             } else {
                 /* just update zone z1 */
@@ -499,6 +592,8 @@ ods_status
 zonelist_update(zonelist_type* zl, const char* zlfile)
 {
     zonelist_type* new_zlist = NULL;
+    zone_type** started = NULL;
+    int nstarted = 0;
     time_t st_mtime = 0;
     ods_status status = ODS_STATUS_OK;
     char* datestamp = NULL;
@@ -528,7 +623,10 @@ zonelist_update(zonelist_type* zl, const char* zlfile)
         zl->just_added = 0;
         zl->just_updated = 0;
         new_zlist->last_modified = st_mtime;
-        zonelist_merge(zl, new_zlist);
+        CHECKALLOC(started = (zone_type**) malloc((new_zlist->zones->count + 1) * sizeof(zone_type*)));
+        zonelist_merge(zl, new_zlist, started, &nstarted);
+        zonelist_start(zl, started, nstarted);
+        free(started);
         (void)time_datestamp(zl->last_modified, "%Y-%m-%d %T", &datestamp);
         ods_log_error("[%s] file %s is modified since %s", zl_str, zlfile,
             datestamp?datestamp:"Unknown");
@@ -49,6 +49,7 @@ struct zonelist_struct {
     int just_added;
     int just_updated;
     int just_removed;
+    int startthreads; /* threads used to restore added zones */
     pthread_mutex_t zl_lock;
 };
 
@@ -52,7 +52,11 @@
 #include "utilities.h"
 #include "daemon/signertasks.h"
 #include "daemon/metastorage.h"
+#include "daemon/metrics.h"
 #include "views/httpd.h"
+#include "wire/axfrimage.h"
+#include "wire/netio.h"
+#include "wire/update.h"
 #include "adapter/adutil.h"
 #include "settings.h"
 #include "cfg.h"
@@ -415,6 +419,52 @@ makecall(const char* zone, const char* delegation, ...)
 }
 
 
+static ldns_pkt*
+makeupdate(const char* zone, const char* prereq, const char* update)
+{
+    ldns_rr* rr = NULL;
+    ldns_rdf* origin;
+    ldns_rr_list* prereqs = ldns_rr_list_new();
+    ldns_rr_list* updates = ldns_rr_list_new();
+    ldns_pkt* pkt;
+    origin = ldns_dname_new_frm_str(zone);
+    if (prereq) {
+        CU_ASSERT_EQUAL(ldns_rr_new_frm_str(&rr, prereq, 0, origin, NULL), LDNS_STATUS_OK);
+        ldns_rr_list_push_rr(prereqs, rr);
+    }
+    if (update) {
+        CU_ASSERT_EQUAL(ldns_rr_new_frm_str(&rr, update, 0, origin, NULL), LDNS_STATUS_OK);
+        ldns_rr_list_push_rr(updates, rr);
+    }
+    pkt = ldns_update_pkt_new(origin, LDNS_RR_CLASS_IN, prereqs, updates, NULL);
+    ldns_rr_list_free(prereqs);
+    ldns_rr_list_free(updates);
+    return pkt;
+}
+
+static ldns_pkt_rcode
+applyupdate(zone_type* zone, ldns_pkt* pkt, int* changed)
+{
+    names_view_type view;
+    ldns_pkt_rcode rcode;
+    pthread_mutex_lock(&zone->zone_lock);
+    view = zonelist_obtainresource(NULL, zone, NULL, offsetof(zone_type, inputview));
+    rcode = update_apply(zone, view, pkt, changed);
+    zonelist_releaseresource(NULL, zone, NULL, offsetof(zone_type, inputview), view);
+    pthread_mutex_unlock(&zone->zone_lock);
+    ldns_pkt_free(pkt);
+    return rcode;
+}
+
+static double
+elapsed(struct timespec* start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+
 void
 testNothing(void)
 {
@@ -512,6 +562,129 @@ testAnnotate(void)
     testAnnotateItem("com", "com");
 }
 
+static char*
+testNSEC3HashExpected(const char* name, const char* apex, nsec3params_type* n3p)
+{
+    ldns_rdf* dname;
+    ldns_rdf* origin;
+    ldns_rdf* hashed_label;
+    ldns_rdf* hashed_ownername;
+    char* expected;
+    dname = ldns_rdf_new_frm_str(LDNS_RDF_TYPE_DNAME, name);
+    origin = ldns_rdf_new_frm_str(LDNS_RDF_TYPE_DNAME, apex);
+    hashed_label = ldns_nsec3_hash_name(dname, n3p->algorithm, n3p->iterations, n3p->salt_len, n3p->salt_data);
+    hashed_ownername = ldns_dname_cat_clone(hashed_label, origin);
+    expected = ldns_rdf2str(hashed_ownername);
+    ldns_rdf_deep_free(hashed_ownername);
+    ldns_rdf_deep_free(hashed_label);
+    ldns_rdf_deep_free(origin);
+    ldns_rdf_deep_free(dname);
+    return expected;
+}
+
+static void
+testNSEC3HashItem(const char* name, struct names_view_zone* zonedata)
+{
+    recordset_type record;
+    char* expected;
+    record = names_recordcreatetemp(name);
+    names_recordannotate(record, zonedata);
+    expected = testNSEC3HashExpected(name, zonedata->apex, (*zonedata->signconf)->nsec3params);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(names_recordgetdenial(record));
+    CU_ASSERT_STRING_EQUAL(names_recordgetdenial(record), expected);
+    free(expected);
+    names_recorddispose(record);
+}
+
+void
+testNSEC3Hash(void)
+{
+    static const char* names[] = { "example.com.", "www.example.com.", "www.example.com",
+        "WwW.ExAmPlE.cOm.", "\\087ww.example.com.", "a\\.b.example.com.", "\\000\\255.example.com.",
+        "\\*.example.com.", "*.example.com.", NULL };
+    static const int iterations[] = { 0, 1, 5, 150 };
+    static const int saltlengths[] = { 0, 4, 255 };
+    uint8_t salt[255];
+    signconf_type signconf;
+    signconf_type* signconfptr = &signconf;
+    nsec3params_type n3p = { NULL, LDNS_SHA1, 0, 0, 0, NULL, NULL };
+    struct names_view_zone zonedata = { NULL, "example.com.", &signconfptr };
+    names_view_type baseview;
+    names_view_type view;
+    names_iterator iter;
+    recordset_type record;
+    ldns_rr* rr;
+    char name[64];
+    char line[128];
+    char* expected;
+    int i, j, k, count = 12000, mismatches;
+
+    for(i=0; i<(int)sizeof(salt); i++)
+        salt[i] = (uint8_t)(i * 7 + 1);
+    memset(&signconf, 0, sizeof(signconf));
+    signconf.nsec3params = &n3p;
+    for(i=0; i<(int)(sizeof(iterations)/sizeof(iterations[0])); i++) {
+        for(j=0; j<(int)(sizeof(saltlengths)/sizeof(saltlengths[0])); j++) {
+            n3p.iterations = iterations[i];
+            n3p.salt_len = saltlengths[j];
+            n3p.salt_data = (saltlengths[j] ? salt : NULL);
+            for(k=0; names[k]; k++)
+                testNSEC3HashItem(names[k], &zonedata);
+        }
+    }
+
+    /* enough new records in one commit for the hashes to be computed on
+     * multiple threads */
+    n3p.iterations = 5;
+    n3p.salt_len = 8;
+    n3p.salt_data = salt;
+    baseview = names_viewcreate(NULL, names_view_BASE[0], &names_view_BASE[1]);
+    names_viewrestore(baseview, "example.com.", -1, NULL);
+    names_viewconfig(baseview, &signconfptr);
+    view = names_viewcreate(baseview, names_view_INPUT[0], &names_view_INPUT[1]);
+    for(i=0; i<count; i++) {
+        snprintf(name, sizeof(name), "Host%d.\\%03d.example.com.", i, i % 256);
+        record = names_place(view, name);
+        snprintf(line, sizeof(line), "%s 3600 IN A 192.0.2.1", name);
+        ldns_rr_new_frm_str(&rr, line, 0, NULL, NULL);
+        names_recordadddata(record, rr);
+    }
+    CU_ASSERT_EQUAL(names_viewcommit(view), 0);
+    i = mismatches = 0;
+    for(iter=names_viewiterator(view, NULL); names_iterate(&iter, &record); names_advance(&iter, NULL)) {
+        expected = testNSEC3HashExpected(names_recordgetname(record), "example.com.", &n3p);
+        if(names_recordgetdenial(record) == NULL || strcmp(names_recordgetdenial(record), expected))
+            ++mismatches;
+        free(expected);
+        ++i;
+    }
+    CU_ASSERT_EQUAL(i, count);
+    CU_ASSERT_EQUAL(mismatches, 0);
+    names_viewdestroy(view);
+    names_viewreset(baseview);
+    names_viewdestroy(baseview);
+}
+
+
+void
+testAxfrImageRecord(void)
+{
+    static const uint8_t rr[] = { 3, 'w', 'w', 'w', 0, 0, 1, 0, 1, 0, 0, 14, 16, 0, 4, 192, 0, 2, 1 };
+    uint8_t zeroes[sizeof(rr)];
+    uint8_t wire[sizeof(rr)];
+    memset(zeroes, 0, sizeof(zeroes));
+    CU_ASSERT_EQUAL(axfr_image_rrlen(rr, sizeof(rr)), sizeof(rr));
+    CU_ASSERT_EQUAL(axfr_image_rrlen(rr, sizeof(rr) - 1), 0);
+    /* a run of zeroes from a torn image is not a record at the root */
+    CU_ASSERT_EQUAL(axfr_image_rrlen(zeroes, sizeof(zeroes)), 0);
+    memcpy(wire, rr, sizeof(rr));
+    wire[6] = 0;
+    CU_ASSERT_EQUAL(axfr_image_rrlen(wire, sizeof(wire)), 0);
+    memcpy(wire, rr, sizeof(rr));
+    wire[8] = 0;
+    CU_ASSERT_EQUAL(axfr_image_rrlen(wire, sizeof(wire)), 0);
+}
+
 
 void
 testMarshalling(void)
@@ -524,7 +697,9 @@ testMarshalling(void)
     ldns_rr* rr3;
     ldns_rr* rrsig;
     ldns_rdf* rrprev = NULL;
+    ldns_buffer* buffer;
     recordset_type record;
+    struct signature_struct** rrsigs;
     signconf_type* signconf = NULL;
     struct names_view_zone zone = { NULL, "example.com.", &signconf };
 
@@ -543,7 +718,7 @@ testMarshalling(void)
     names_recordadddata(record, rr2);
     names_recordadddata(record, rr3);
     ldns_rr_new_frm_str(&rrsig, "domain.example.com. RRSIG A 7 3 86400 20180525135557 20180525125459 55490 example.com. FV0gZ8FAaqlFnJ6jFuBj4DSImeftLaRdOXhjGxUZuZe29PkkuZP9u2cb9n4SSXRSn88rEHoSff8nPKwYKCOzOxlgHx7q4FZwmGrLrmV7Sfjp41O7DI4P8F/APVwfuc4d63uQq3C2opXgFv76L0CQ/+9mIOxthjL7hVy00UDPzWM=", 60, origin, &rrprev);
-    names_recordaddsignature(record,LDNS_RR_TYPE_A, rrsig, "locateme", 0);
+    names_recordaddsignature(record,LDNS_RR_TYPE_A, rrsig, strdup("locateme"), 0);
     names_recordsetexpiry(record, 111);
     names_recordsetvalidfrom(record, 222);
     names_recordsetvalidupto(record, 333);
@@ -561,6 +736,31 @@ testMarshalling(void)
     // names_dumprecord(stderr,record); In case this test fails enable this to investigate
     marshallclose(h);
     close(fd);
+
+    CU_ASSERT(names_recordhasdata(record, LDNS_RR_TYPE_A, rr1, 1));
+    CU_ASSERT(names_recordhasdata(record, LDNS_RR_TYPE_A, rr2, 1));
+    CU_ASSERT(names_recordhasdata(record, LDNS_RR_TYPE_NS, rr3, 1));
+    names_recordlookupall(record, LDNS_RR_TYPE_RRSIG, NULL, NULL, &rrsigs);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(rrsigs[0]);
+    CU_ASSERT_STRING_EQUAL(rrsigs[0]->keylocator, "locateme");
+    rrsig = names_recordsignature(record, rrsigs[0]);
+    CU_ASSERT_EQUAL(ldns_rr_get_type(rrsig), LDNS_RR_TYPE_RRSIG);
+    ldns_rr_free(rrsig);
+    CU_ASSERT_PTR_NULL(rrsigs[1]);
+    free(rrsigs);
+    /* two A records and their signature, each with the 12 byte owner */
+    buffer = ldns_buffer_new(LDNS_MIN_BUFLEN);
+    CU_ASSERT_EQUAL(names_recordwire(record, LDNS_RR_TYPE_A, 0, buffer), 1);
+    CU_ASSERT_EQUAL(ldns_buffer_position(buffer), 12 + 10 + 4);
+    CU_ASSERT_EQUAL(names_recordwire(record, LDNS_RR_TYPE_A, 1, buffer), 1);
+    CU_ASSERT_EQUAL(names_recordwire(record, LDNS_RR_TYPE_A, 2, buffer), 1);
+    CU_ASSERT_EQUAL(names_recordwire(record, LDNS_RR_TYPE_A, 3, buffer), 0);
+    CU_ASSERT_EQUAL(names_recordwire(record, LDNS_RR_TYPE_MX, 0, buffer), 0);
+    ldns_buffer_free(buffer);
+    names_recorddeldata(record, LDNS_RR_TYPE_A, rr1);
+    CU_ASSERT(!names_recordhasdata(record, LDNS_RR_TYPE_A, rr1, 0));
+    CU_ASSERT(names_recordhasdata(record, LDNS_RR_TYPE_A, rr2, 0));
+    names_recorddispose(record);
     
     unlink("test.dmp");
 }
@@ -898,6 +1098,365 @@ testSignFastChange(void)
     CU_ASSERT_EQUAL((system("ldns-verify-zone -t 20180926013741 signed.zone")), 0);
 }
 
+void
+testUpdate(void)
+{
+    int changed;
+    zone_type* zone;
+    set_time_now(1537918509);
+    usefile("example.com.state", NULL);
+    usefile("signer.db", NULL);
+    usefile("zones.xml", "zones.xml.example");
+    usefile("unsigned.zone", "unsigned.zone.testing");
+    usefile("signconf.xml", "signconf.xml.nsec");
+    zonelist_update(engine->zonelist, engine->config->zonelist_filename_signer);
+    zone = zonelist_lookup_zone_by_name(engine->zonelist, "example.com", LDNS_RR_CLASS_IN);
+    signzone(zone);
+
+    /* prerequisites that do not hold leave the zone alone */
+    CU_ASSERT_EQUAL(applyupdate(zone, makeupdate("example.com.", "ns.example.com. 0 IN A 192.0.2.2",
+        "new.example.com. 3600 IN A 192.0.2.10"), &changed), LDNS_RCODE_NXRRSET);
+    CU_ASSERT_EQUAL(changed, 0);
+    CU_ASSERT_EQUAL(applyupdate(zone, makeupdate("example.com.", "other.example.com. 0 ANY ANY",
+        "new.example.com. 3600 IN A 192.0.2.10"), &changed), LDNS_RCODE_NXDOMAIN);
+    CU_ASSERT_EQUAL(applyupdate(zone, makeupdate("example.com.", NULL,
+        "www.example.org. 3600 IN A 192.0.2.10"), &changed), LDNS_RCODE_NOTZONE);
+
+    /* add a name, then delete an address and the apex soa, which is kept;
+     * the serial of the unsigned zone is left to the primary */
+    CU_ASSERT_EQUAL(applyupdate(zone, makeupdate("example.com.", "ns.example.com. 0 IN A 192.0.2.1",
+        "new.example.com. 3600 IN A 192.0.2.10"), &changed), LDNS_RCODE_NOERROR);
+    CU_ASSERT_EQUAL(changed, 1);
+    CU_ASSERT_EQUAL(*zone->inboundserial, 1);
+    CU_ASSERT_EQUAL(applyupdate(zone, makeupdate("example.com.", NULL,
+        "new.example.com. 3600 IN A 192.0.2.10"), &changed), LDNS_RCODE_NOERROR);
+    CU_ASSERT_EQUAL(changed, 0);
+    CU_ASSERT_EQUAL(applyupdate(zone, makeupdate("example.com.", NULL,
+        "example.com. 0 ANY SOA"), &changed), LDNS_RCODE_NOERROR);
+    CU_ASSERT_EQUAL(changed, 0);
+    CU_ASSERT_EQUAL(applyupdate(zone, makeupdate("example.com.", NULL,
+        "example.com. 86400 IN SOA ns1.example.com. postmaster.example.com. 5 10800 3600 604800 86400"), &changed), LDNS_RCODE_NOERROR);
+    CU_ASSERT_EQUAL(changed, 0);
+    CU_ASSERT_EQUAL(applyupdate(zone, makeupdate("example.com.", "new.example.com. 0 ANY A",
+        "ns.example.com. 0 NONE A 192.0.2.1"), &changed), LDNS_RCODE_NOERROR);
+    CU_ASSERT_EQUAL(changed, 1);
+    CU_ASSERT_EQUAL(*zone->inboundserial, 1);
+
+    reresignzone(zone);
+    outputzone(zone);
+    disposezone(zone);
+    CU_ASSERT_EQUAL((system("ldns-verify-zone -t 20180926013741 signed.zone")), 0);
+}
+
+
+/* set up example.com as an unsigned zone with count generated hosts */
+static void
+usegeneratedzone(int count)
+{
+    int i;
+    FILE* fp;
+    usefile("example.com.state", NULL);
+    usefile("signer.db", NULL);
+    usefile("zones.xml", "zones.xml.example");
+    usefile("unsigned.zone", NULL);
+    usefile("signconf.xml", "signconf.xml.nsec");
+    fp = fopen("unsigned.zone", "w");
+    fprintf(fp, "$ORIGIN example.com.\n$TTL 86400\n");
+    fprintf(fp, "@ IN SOA ns1.example.com. postmaster.example.com. 1 10800 3600 604800 86400\n");
+    fprintf(fp, "@ IN NS ns1.example.com.\nns1 IN A 192.0.2.1\n");
+    for (i=0; i<count; i++) {
+        fprintf(fp, "host%d IN A 10.%d.%d.%d\n", i, (i>>16)&0xff, (i>>8)&0xff, i&0xff);
+    }
+    fclose(fp);
+}
+
+void
+testUpdateSpeed(void)
+{
+    int i, changed, count = 1000000, updates = 10000, resigns = 100;
+    double duration, latency = 0.0, worst = 0.0;
+    struct timespec start;
+    char update[128];
+    zone_type* zone;
+    logger_configurecls("performance", logger_INFO, logger_log_stdout);
+    set_time_now(1537918509);
+    usegeneratedzone(count);
+    logger_mark_performance("done setup files");
+    zonelist_update(engine->zonelist, engine->config->zonelist_filename_signer);
+    zone = zonelist_lookup_zone_by_name(engine->zonelist, "example.com", LDNS_RR_CLASS_IN);
+    signzone(zone);
+
+    /* updates applied to the input view */
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i=0; i<updates; i++) {
+        snprintf(update, sizeof(update), "host%d.example.com. 86400 IN A 192.168.%d.%d", i, (i>>8)&0xff, i&0xff);
+        CU_ASSERT_EQUAL(applyupdate(zone, makeupdate("example.com.", NULL, update), &changed), LDNS_RCODE_NOERROR);
+    }
+    duration = elapsed(&start);
+    printf("%d updates in %.3fs, %.0f updates/s\n", updates, duration, updates / duration);
+    reresignzone(zone);
+
+    /* delay from update to signed output */
+    for (i=0; i<resigns; i++) {
+        snprintf(update, sizeof(update), "new%d.example.com. 86400 IN A 192.0.2.%d", i, i&0xff);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        CU_ASSERT_EQUAL(applyupdate(zone, makeupdate("example.com.", NULL, update), &changed), LDNS_RCODE_NOERROR);
+        reresignzone(zone);
+        outputzone(zone);
+        duration = elapsed(&start);
+        latency += duration;
+        if (duration > worst)
+            worst = duration;
+    }
+    printf("update to signed output: average %.1fms, worst %.1fms\n", latency * 1000.0 / resigns, worst * 1000.0);
+    disposezone(zone);
+}
+
+static volatile int scraping;
+
+static void*
+scraper(void* arg)
+{
+    size_t len;
+    (void)arg;
+    while (scraping) {
+        free(metrics_expose(engine->zonelist, engine->taskq, &len));
+        usleep(1000);
+    }
+    return NULL;
+}
+
+void
+testMetricsOverhead(void)
+{
+    int round, count = 100000, rounds = 3;
+    time_t now = 1537918509;
+    double duration, best[3] = { 0.0, 0.0, 0.0 };
+    struct timespec start;
+    pthread_t thread;
+    zone_type* zone;
+    set_time_now(now);
+    usegeneratedzone(count);
+    zonelist_update(engine->zonelist, engine->config->zonelist_filename_signer);
+    zone = zonelist_lookup_zone_by_name(engine->zonelist, "example.com", LDNS_RR_CLASS_IN);
+    signzone(zone);
+
+    /* rotate between rounds without recording, recording only and
+     * recording with a scraper, every round moves past the signature
+     * validity so the whole zone is re-signed */
+    for (round=0; round<rounds*3; round++) {
+        now += 2 * 86400;
+        set_time_now(now);
+        metrics_enable(round % 3 != 0);
+        scraping = (round % 3 == 2);
+        if (scraping)
+            pthread_create(&thread, NULL, scraper, NULL);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        reresignzone(zone);
+        duration = elapsed(&start);
+        if (scraping) {
+            scraping = 0;
+            pthread_join(thread, NULL);
+        }
+        if (best[round % 3] == 0.0 || duration < best[round % 3])
+            best[round % 3] = duration;
+    }
+    metrics_enable(1);
+    printf("full resign without recording %.0f names/s, recording %.0f names/s, with scraping %.0f names/s\n",
+        count / best[0], count / best[1], count / best[2]);
+    printf("overhead of recording %+.1f%%, with scraping %+.1f%%\n",
+        (best[1] / best[0] - 1.0) * 100.0, (best[2] / best[0] - 1.0) * 100.0);
+    /* wall clock timings are noisy, only catch gross regressions */
+    CU_ASSERT(best[1] <= best[0] * 1.5);
+    CU_ASSERT(best[2] <= best[0] * 1.5);
+    disposezone(zone);
+}
+
+static pthread_mutex_t schedcountlock = PTHREAD_MUTEX_INITIALIZER;
+static int schedbusycount;
+static int schedothercount;
+
+static time_t
+schedbusy(task_type* task, char const *owner, void *userdata, void *context)
+{
+    pthread_mutex_lock(&schedcountlock);
+    schedbusycount++;
+    pthread_mutex_unlock(&schedcountlock);
+    return schedule_SUCCESS;
+}
+
+static time_t
+schedother(task_type* task, char const *owner, void *userdata, void *context)
+{
+    usleep(1000);
+    pthread_mutex_lock(&schedcountlock);
+    schedothercount++;
+    pthread_mutex_unlock(&schedcountlock);
+    return schedule_SUCCESS;
+}
+
+static int
+schedwait(int* counter, int expected, double timeout)
+{
+    struct timespec start;
+    int count;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        pthread_mutex_lock(&schedcountlock);
+        count = *counter;
+        pthread_mutex_unlock(&schedcountlock);
+        if (count >= expected)
+            break;
+        usleep(10000);
+    } while (elapsed(&start) < timeout);
+    return count;
+}
+
+void
+testScheduler(void)
+{
+    int i, nworkers = 4, nbusy = 64, nother = 1000;
+    schedule_type* sched;
+    worker_type* workers[4];
+    pthread_mutex_t busylock;
+    pthread_mutex_t* locks;
+    task_type* task;
+    char* owner;
+    struct timespec start;
+
+    sched = schedule_create();
+    schedbusycount = schedothercount = 0;
+
+    /* Of two due tasks the one in the more urgent class goes first */
+    task = task_create(strdup("bulk.example"), TASK_CLASS_SIGNER, TASK_READ, schedother, NULL, NULL, schedule_IMMEDIATELY);
+    task->priority = TASK_PRIORITY_BULK;
+    schedule_task(sched, task, 0, 0);
+    task = task_create(strdup("update.example"), TASK_CLASS_SIGNER, TASK_SIGN, schedother, NULL, NULL, schedule_IMMEDIATELY);
+    task->priority = TASK_PRIORITY_INTERACTIVE;
+    schedule_task(sched, task, 0, 0);
+    task = schedule_pop_task(sched);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(task);
+    CU_ASSERT_STRING_EQUAL(task->owner, "update.example");
+    task_perform(sched, task, NULL);
+    task = schedule_pop_task(sched);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(task);
+    CU_ASSERT_STRING_EQUAL(task->owner, "bulk.example");
+    task_perform(sched, task, NULL);
+    schedothercount = 0;
+
+    /* A task without callback still releases the lock taken on popping */
+    pthread_mutex_init(&busylock, NULL);
+    task = task_create(strdup("none.example"), TASK_CLASS_SIGNER, TASK_NONE, NULL, NULL, NULL, schedule_IMMEDIATELY);
+    task->lock = &busylock;
+    schedule_task(sched, task, 0, 0);
+    task = schedule_pop_task(sched);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(task);
+    task_perform(sched, task, NULL);
+    CU_ASSERT_EQUAL(pthread_mutex_trylock(&busylock), 0);
+
+    /* A burst of tasks for one zone whose lock is held, queued ahead of
+     * work for other zones, must not park the workers */
+    for (i = 0; i < nbusy; i++) {
+        asprintf(&owner, "busy%03d.example", i);
+        task = task_create(owner, TASK_CLASS_SIGNER, TASK_SIGN, schedbusy, NULL, NULL, schedule_IMMEDIATELY);
+        task->lock = &busylock;
+        schedule_task(sched, task, 0, 0);
+    }
+    CHECKALLOC(locks = calloc(nother, sizeof(pthread_mutex_t)));
+    for (i = 0; i < nother; i++) {
+        pthread_mutex_init(&locks[i], NULL);
+        asprintf(&owner, "zone%04d.example", i);
+        task = task_create(owner, TASK_CLASS_SIGNER, TASK_SIGN, schedother, NULL, NULL, schedule_IMMEDIATELY);
+        task->lock = &locks[i];
+        schedule_task(sched, task, 0, 0);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < nworkers; i++) {
+        asprintf(&owner, "worker[%d]", i+1);
+        workers[i] = worker_create(owner, sched);
+        janitor_thread_create(&workers[i]->thread_id, workerthreadclass, (janitor_runfn_t)worker_start, workers[i]);
+    }
+    CU_ASSERT_EQUAL(schedwait(&schedothercount, nother, 30.0), nother);
+    CU_ASSERT_EQUAL(schedbusycount, 0);
+    printf("\n%d tasks for other zones done in %.3fs while one zone was busy\n", nother, elapsed(&start));
+    pthread_mutex_unlock(&busylock);
+    CU_ASSERT_EQUAL(schedwait(&schedbusycount, nbusy, 30.0), nbusy);
+
+    for (i = 0; i < nworkers; i++) {
+        workers[i]->need_to_exit = 1;
+    }
+    schedule_release_all(sched);
+    for (i = 0; i < nworkers; i++) {
+        janitor_thread_join(workers[i]->thread_id);
+        worker_cleanup(workers[i]);
+    }
+    schedule_cleanup(sched);
+    for (i = 0; i < nother; i++) {
+        pthread_mutex_destroy(&locks[i]);
+    }
+    free(locks);
+    pthread_mutex_destroy(&busylock);
+}
+
+static volatile int netiocalled;
+static volatile int netiodone;
+static volatile int netiostop;
+
+static void
+netiohandler(netio_type* netio, netio_handler_type* handler, netio_events_type event_types)
+{
+    char c;
+    netiocalled = 1;
+    usleep(100000);
+    CU_ASSERT_EQUAL(read(handler->fd, &c, 1), 1);
+    netiodone = 1;
+}
+
+static void*
+netiodispatcher(void* arg)
+{
+    netio_type* netio = arg;
+    struct timespec timeout = { 0, 10000000 };
+    while (!netiostop) {
+        if (netio_dispatch(netio, &timeout, NULL) == 0)
+            usleep(1000);
+    }
+    return NULL;
+}
+
+void
+testNetioRemove(void)
+{
+    int fds[2];
+    pthread_t thread;
+    netio_type* netio;
+    netio_handler_type* handler;
+    CU_ASSERT_EQUAL_FATAL(pipe(fds), 0);
+    netio = netio_create();
+    handler = calloc(1, sizeof(netio_handler_type));
+    handler->fd = fds[0];
+    handler->event_types = NETIO_EVENT_READ;
+    handler->event_handler = netiohandler;
+    netio_add_handler(netio, handler);
+    netiocalled = netiodone = netiostop = 0;
+    pthread_create(&thread, NULL, netiodispatcher, netio);
+    CU_ASSERT_EQUAL(write(fds[1], "x", 1), 1);
+    while (!netiocalled)
+        usleep(1000);
+    /* removing from another thread waits for the running callback */
+    netio_remove_handler(netio, handler);
+    CU_ASSERT(netiodone);
+    memset(handler, 0xff, sizeof(netio_handler_type));
+    free(handler);
+    CU_ASSERT_EQUAL(write(fds[1], "x", 1), 1);
+    usleep(50000);
+    netiostop = 1;
+    pthread_join(thread, NULL);
+    netio_cleanup(netio);
+    close(fds[0]);
+    close(fds[1]);
+}
+
 void
 testDisposing(void)
 {
@@ -1000,6 +1559,8 @@ extern void testNothing(void);
 extern void testIterator(void);
 extern void testConfig(void);
 extern void testAnnotate(void);
+extern void testNSEC3Hash(void);
+extern void testAxfrImageRecord(void);
 extern void testStatefile(void);
 extern void testTransferfile(void);
 extern void testBasic(void);
@@ -1009,6 +1570,11 @@ extern void testSignNL(void);
 extern void testSignFastRemove(void);
 extern void testSignFastInsert(void);
 extern void testSignFastChange(void);
+extern void testUpdate(void);
+extern void testUpdateSpeed(void);
+extern void testScheduler(void);
+extern void testMetricsOverhead(void);
+extern void testNetioRemove(void);
 extern void testDisposing(void);
 
 struct test_struct {
@@ -1023,6 +1589,8 @@ struct test_struct {
     { "signer", "testIterator",        "test of iterator" },
     { "signer", "testConfig",          "test config" },
     { "signer", "testAnnotate",        "test of denial annotation" },
+    { "signer", "testNSEC3Hash",       "test of hashed denial annotation" },
+    { "signer", "testAxfrImageRecord", "test axfr image record parsing" },
     { "signer", "testMarshalling",     "test marshalling" },
     { "signer", "testStatefile",       "test statefile usage" },
     { "signer", "testTransferfile",    "test transferfile usage" },
@@ -1033,9 +1601,14 @@ struct test_struct {
     { "signer", "testSignFastRemove",  "test fast updates deletes" },
     { "signer", "testSignFastInsert",  "test fast updates inserts" },
     { "signer", "testSignFastChange",  "test fast updates changes" },
+    { "signer", "testUpdate",          "test dynamic update" },
+    { "signer", "testScheduler",       "test scheduler with busy zones" },
+    { "signer", "testNetioRemove",     "test removing a netio handler during dispatch" },
     { "signer", "testDisposing",       "test dispose" },
     { "signer", "testBackup",          "test migration backup files" },
     { "signer", "-testSignNL",          "test NL signing" },
+    { "signer", "-testUpdateSpeed",     "test dynamic update speed" },
+    { "signer", "-testMetricsOverhead", "test metrics collection overhead" },
     { NULL, NULL, NULL }
 };
 
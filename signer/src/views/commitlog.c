@@ -62,27 +62,19 @@ struct names_commitlog_struct {
     void (*storefn)(names_table_type, marshall_handle);
 };
 
-static void
-destroynode(void* arg, void* key, void* val)
-{
-    (void)arg;
-    (void)key;
-    free(val);
-}
-
 static void
 destroynodeandrecord(void* arg, void* key, void* val)
 {
     (void)arg;
-    (void)key;
-    free(val);
+    (void)val;
     names_recorddisposal(key, 1);
 }
 
+/* The changes themselves are allocated from the region of the table. */
 void
 names_commitlogdestroy(names_table_type table)
 {
-    names_tabledispose(table, destroynode, NULL);
+    names_tabledispose(table, NULL, NULL);
 }
 
 void
@@ -54,6 +54,7 @@
 #include "utilities.h"
 #include "proto.h"
 #include "httpd.h"
+#include "daemon/metrics.h"
 
 #define HTTPD_POOL_SIZE 1
 
@@ -140,12 +141,18 @@ httpd_dispatch(names_view_type view, struct rpc *rpc)
             case RPC_CHANGE_DELEGATION:
                 deletedelegation(view, rpc);
                 insertrecords(view, rpc);
-                names_viewcommit(view);
+                if (names_viewcommit(view)) {
+                    /* zone changed concurrently, change not applied */
+                    rpc->status = RPC_ERR;
+                }
                 return 0;
             case RPC_CHANGE_NAME:
                 deleterecordsets(view, rpc);
                 insertrecords(view, rpc);
-                names_viewcommit(view);
+                if (names_viewcommit(view)) {
+                    /* zone changed concurrently, change not applied */
+                    rpc->status = RPC_ERR;
+                }
                 return 0;
             default:
                 rpc->status = RPC_ERR;
@@ -242,6 +249,20 @@ handle_connection(void *cls, struct MHD_Connection *connection,
             response = MHD_create_response_from_buffer(strlen(body),
                 (void*) body, MHD_RESPMEM_PERSISTENT);
         }
+    } else if (!strcmp(method, "GET") && !strcmp(url, "/metrics")) {
+        size_t len;
+        char *body = metrics_expose(httpd->zonelist, httpd->taskq, &len);
+        if (body) {
+            response = MHD_create_response_from_buffer(len,
+                (void*) body, MHD_RESPMEM_MUST_FREE);
+            MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE,
+                "text/plain; version=0.0.4");
+        } else {
+            const char *error = "out of memory\n";
+            response = MHD_create_response_from_buffer(strlen(error),
+                (void*) error, MHD_RESPMEM_PERSISTENT);
+            http_status_code = MHD_HTTP_INTERNAL_SERVER_ERROR;
+        }
     } else if (!strcmp(method, "GET")) {
         char *body  = strdup("I don't GET it\n");
         response = MHD_create_response_from_buffer(strlen(body),
@@ -273,11 +294,12 @@ handle_connection_done(void *cls, struct MHD_Connection *connection,
 }
 
 struct httpd *
-httpd_create(struct http_listener_struct* config, zonelist_type* zonelist)
+httpd_create(struct http_listener_struct* config, zonelist_type* zonelist, schedule_type* taskq)
 {
     struct httpd *httpd;
     CHECKALLOC(httpd = (struct httpd *) malloc(sizeof(struct httpd)));
     httpd->zonelist = zonelist;
+    httpd->taskq = taskq;
     httpd->if_count = config->count;
     httpd->ifs = NULL;
     CHECKALLOC(httpd->ifs = (struct sockaddr_storage *) malloc(httpd->if_count * sizeof(struct sockaddr_storage)));
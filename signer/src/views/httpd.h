@@ -31,6 +31,7 @@
 
 #include <microhttpd.h>
 #include "proto.h"
+#include "scheduler/schedule.h"
 #include "wire/acl.h"
 
 typedef struct http_interface_struct http_interface_type;
@@ -80,11 +81,12 @@ struct httpd {
     int if_count;
     struct sockaddr_storage *ifs;
     zonelist_type* zonelist;
+    schedule_type* taskq;
 };
 
 int rpcproc_apply(struct httpd*, struct rpc *rpc);
 
-struct httpd* httpd_create(struct http_listener_struct* config, zonelist_type* zonelist);
+struct httpd* httpd_create(struct http_listener_struct* config, zonelist_type* zonelist, schedule_type* taskq);
 void httpd_destroy(struct httpd *httpd);
 void httpd_start(struct httpd *httpd);
 void httpd_stop(struct httpd *httpd);
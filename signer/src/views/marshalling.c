@@ -32,6 +32,9 @@
 #include <string.h>
 #include <unistd.h>
 #include <assert.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <ldns/ldns.h>
 #include "proto.h"
 
@@ -41,6 +44,9 @@ enum marshall_func { BASIC, OBJECT, SELF };
 int optionaldummy;
 int* marshall_OPTIONAL = &optionaldummy;
 
+/* size of the read and write buffer of a file backed handle */
+#define MARSHALL_BUFSIZE 65536
+
 struct marshall_struct {
     enum marshall_mode mode;
     int fd;
@@ -48,8 +54,124 @@ struct marshall_struct {
     int indentincr;
     int indentlvl;
     int indentcount;
+    /* input is read from a mapping of the whole file when possible,
+     * otherwise through the buffer, output always goes through the buffer */
+    char* map;
+    size_t mapsize;
+    char* buffer;
+    size_t bufpos;
+    size_t buflen;
+    off_t offset; /* file offset of buffer[0] or map[0] */
 };
 
+static void
+marshallmap(marshall_handle h)
+{
+    struct stat st;
+    void* map;
+    h->offset = lseek(h->fd, 0, SEEK_CUR);
+    if(h->offset < 0 || fstat(h->fd, &st) != 0 || st.st_size <= h->offset) {
+        h->offset = (h->offset < 0 ? 0 : h->offset);
+        return;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, h->fd, 0);
+    if(map == MAP_FAILED)
+        return;
+    (void)madvise(map, st.st_size, MADV_SEQUENTIAL);
+    h->map = map;
+    h->mapsize = st.st_size;
+    h->bufpos = h->offset;
+    h->offset = 0;
+}
+
+static int
+marshallread(marshall_handle h, void* data, size_t len)
+{
+    size_t count = 0;
+    size_t avail;
+    ssize_t size;
+    if(h->map) {
+        avail = h->mapsize - h->bufpos;
+        count = (len < avail ? len : avail);
+        memcpy(data, &h->map[h->bufpos], count);
+        h->bufpos += count;
+        return count;
+    }
+    while(count < len) {
+        if(h->bufpos == h->buflen) {
+            h->offset += h->buflen;
+            h->bufpos = h->buflen = 0;
+            if(len - count >= MARSHALL_BUFSIZE) {
+                size = read(h->fd, &((char*)data)[count], len - count);
+                if(size <= 0)
+                    break;
+                h->offset += size;
+                count += size;
+                continue;
+            }
+            size = read(h->fd, h->buffer, MARSHALL_BUFSIZE);
+            if(size <= 0)
+                break;
+            h->buflen = size;
+        }
+        avail = h->buflen - h->bufpos;
+        if(avail > len - count)
+            avail = len - count;
+        memcpy(&((char*)data)[count], &h->buffer[h->bufpos], avail);
+        h->bufpos += avail;
+        count += avail;
+    }
+    return count;
+}
+
+static int
+marshallwrite(marshall_handle h, const void* data, size_t len)
+{
+    size_t count = 0;
+    size_t avail;
+    while(count < len) {
+        if(h->bufpos == MARSHALL_BUFSIZE) {
+            if(marshallflush(h))
+                break;
+        }
+        avail = MARSHALL_BUFSIZE - h->bufpos;
+        if(avail > len - count)
+            avail = len - count;
+        memcpy(&h->buffer[h->bufpos], &((const char*)data)[count], avail);
+        h->bufpos += avail;
+        count += avail;
+    }
+    return count;
+}
+
+int
+marshallflush(marshall_handle h)
+{
+    size_t count = 0;
+    ssize_t size;
+    if(!h || h->mode != WRITE || h->fd < 0)
+        return 0;
+    while(count < h->bufpos) {
+        size = write(h->fd, &h->buffer[count], h->bufpos - count);
+        if(size <= 0) {
+            memmove(h->buffer, &h->buffer[count], h->bufpos - count);
+            h->bufpos -= count;
+            h->offset += count;
+            return -1;
+        }
+        count += size;
+    }
+    h->offset += count;
+    h->bufpos = 0;
+    return 0;
+}
+
+off_t
+marshallposition(marshall_handle h)
+{
+    return h->offset + h->bufpos;
+}
+
 marshall_handle
 marshallcreate(enum marshall_method method, ...)
 {
@@ -58,15 +180,26 @@ marshallcreate(enum marshall_method method, ...)
     h = malloc(sizeof(struct marshall_struct));
     h->fd = -1;
     h->fp = NULL;
+    h->map = NULL;
+    h->mapsize = 0;
+    h->buffer = NULL;
+    h->bufpos = 0;
+    h->buflen = 0;
+    h->offset = 0;
     va_start(ap, method);
     switch(method) {
         case marshall_INPUT:
             h->mode = READ;
             h->fd = va_arg(ap, int);
+            marshallmap(h);
+            if(!h->map)
+                h->buffer = malloc(MARSHALL_BUFSIZE);
             break;
         case marshall_OUTPUT:
             h->mode = WRITE;
             h->fd = va_arg(ap, int);
+            h->buffer = malloc(MARSHALL_BUFSIZE);
+            h->offset = lseek(h->fd, 0, SEEK_CUR);
             break;
         case marshall_PRINT:
             h->mode = PRINT;
@@ -77,6 +210,12 @@ marshallcreate(enum marshall_method method, ...)
             old = va_arg(ap, marshall_handle);
             h->fd = old->fd;
             h->fp = old->fp;
+            h->buffer = malloc(MARSHALL_BUFSIZE);
+            /* continue where reading stopped, not where read-ahead left
+             * the file offset */
+            h->offset = marshallposition(old);
+            if(h->fd >= 0)
+                lseek(h->fd, h->offset, SEEK_SET);
             old->fd = -1;
             old->fp = NULL;
             break;
@@ -99,12 +238,23 @@ marshallclose(marshall_handle h)
     if (h->fp && h->fp != stdout && h->fp != stderr) {
         fclose(h->fp);
     }
+    marshallflush(h);
+    if (h->map) {
+        munmap(h->map, h->mapsize);
+    }
     if (h->fd >= 0) {
         close(h->fd);
     }
+    free(h->buffer);
     free(h);
 }
 
+int
+marshallreading(marshall_handle h)
+{
+    return h->mode == READ;
+}
+
 int
 marshallself(marshall_handle h, void* member)
 {
@@ -123,11 +273,11 @@ marshallinteger(marshall_handle h, void* member)
         case FREE:
             break;
         case READ:
-            size = read(h->fd, member, sizeof(int));
+            size = marshallread(h, member, sizeof(int));
             assert(size==sizeof(int));
             break;
         case WRITE:
-            size = write(h->fd, member, sizeof(int));
+            size = marshallwrite(h, member, sizeof(int));
             assert(size==sizeof(int));
             break;
         case COUNT:
@@ -152,11 +302,11 @@ marshallint64(marshall_handle h, void* member)
         case FREE:
             break;
         case READ:
-            size = read(h->fd, member, sizeof(int64_t));
+            size = marshallread(h, member, sizeof(int64_t));
             assert(size==sizeof(int64_t));
             break;
         case WRITE:
-            size = write(h->fd, member, sizeof(int64_t));
+            size = marshallwrite(h, member, sizeof(int64_t));
             assert(size==sizeof(int64_t));
             break;
         case COUNT:
@@ -181,10 +331,10 @@ marshallbyte(marshall_handle h, void* member)
         case FREE:
             break;
         case READ:
-            size = read(h->fd, member, 1);
+            size = marshallread(h, member, 1);
             break;
         case WRITE:
-            size = write(h->fd, member, 1);
+            size = marshallwrite(h, member, 1);
             break;
         case COUNT:
             break;
@@ -213,7 +363,7 @@ marshallstring(marshall_handle h, void* member)
             size = marshallinteger(h, &len);
             if(len >= 0) {
                 *str = malloc(len + 1);
-                read(h->fd, *str, sizeof(char)*len);
+                marshallread(h, *str, sizeof(char)*len);
                 (*str)[len] = '\0';
                 size += len;
             } else {
@@ -224,7 +374,7 @@ marshallstring(marshall_handle h, void* member)
             if(*str) {
                 len = strlen(*str);
                 size = marshallinteger(h, &len);
-                write(h->fd, *str, sizeof(char)*len);
+                marshallwrite(h, *str, sizeof(char)*len);
                 size += len;
             } else {
                 len = -1;
@@ -277,7 +427,7 @@ marshallldnsrr(marshall_handle h, void* member)
             size = marshallinteger(h, &len);
             if(len >= 0) {
                 str = malloc(len + 1);
-                read(h->fd, str, sizeof(char)*len);
+                marshallread(h, str, sizeof(char)*len);
                 str[len] = '\0';
                 size += len;
                 ldns_rr_new_frm_str(rr, str, 0, NULL, NULL);
@@ -290,7 +440,7 @@ marshallldnsrr(marshall_handle h, void* member)
                 str = ldns_rr2str(*rr);
                 len = strlen(str);
                 size = marshallinteger(h, &len);
-                write(h->fd, str, sizeof(char)*len);
+                marshallwrite(h, str, sizeof(char)*len);
                 size += len;
                 free(str);
             } else {
@@ -332,7 +482,7 @@ marshallsigs(marshall_handle h, void* member)
 {
     struct signatures_struct* signatures = (struct signatures_struct*)member;
     int i, size;
-    size = marshalling(h, "sigs", &(signatures->sigs), &(signatures->nsigs), sizeof(struct signatures_struct), marshallself);
+    size = marshalling(h, "sigs", &(signatures->sigs), &(signatures->nsigs), sizeof(struct signature_struct), marshallself);
     for(i=0; i<signatures->nsigs; i++) {
         size += marshalling(h, "rr", &(signatures->sigs[i].rr), NULL, 0, marshallldnsrr);
         size += marshalling(h, "keylocator", &(signatures->sigs[i].keylocator), NULL, 0, marshallstring);
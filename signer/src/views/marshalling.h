@@ -38,6 +38,9 @@ typedef struct marshall_struct* marshall_handle;
 
 marshall_handle marshallcreate(enum marshall_method method, ...);
 void marshallclose(marshall_handle h);
+int marshallflush(marshall_handle h);
+off_t marshallposition(marshall_handle h);
+int marshallreading(marshall_handle h);
 int marshallself(marshall_handle h, void* member);
 int marshallbyte(marshall_handle h, void* member);
 int marshallinteger(marshall_handle h, void* member);
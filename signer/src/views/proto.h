@@ -31,6 +31,7 @@ typedef struct names_iterator_struct* names_iterator;
 typedef struct recordset_struct* recordset_type;
 typedef struct names_index_struct* names_index_type;
 typedef struct names_table_struct* names_table_type;
+typedef struct names_region_struct* names_region_type;
 typedef struct names_view_struct* names_view_type;
 
 #include "signer/signconf.h"
@@ -49,14 +50,24 @@ extern const char* names_view_BACKUP[];
 
 extern logger_cls_type names_logcommitlog;
 
+/* The signature itself is kept in wire format in the set, rr is only used
+ * to pass the ldns form while (un)marshalling.
+ */
 struct signature_struct {
     ldns_rr* rr;
     const char* keylocator;
     int keyflags;
+    uint32_t inception;
+    uint32_t expiration;
+    uint32_t offset;
 };
 struct signatures_struct {
     int nsigs;
     struct signature_struct* sigs;
+    ldns_rdf* owner;
+    ldns_rr_class klass;
+    size_t wirelen;
+    uint8_t* wire;
 };
 void signaturedispose(struct signatures_struct* sigs);
 
@@ -142,6 +153,7 @@ struct names_view_zone {
 recordset_type names_recordcreate(char**name);
 recordset_type names_recordcreatetemp(const char*name);
 void names_recordannotate(recordset_type d, struct names_view_zone* zone);
+void names_recordannotatehashed(recordset_type* records, int nrecords, struct names_view_zone* zone);
 recordset_type names_recordcopy(recordset_type, int clear);
 void names_recorddispose(recordset_type);
 void names_recorddisposal(recordset_type record, int doit);
@@ -171,8 +183,13 @@ void names_recordaddsignature(recordset_type record, ldns_rr_type rrtype, ldns_r
 int names_recordmarshall(recordset_type*, marshall_handle);
 size_t names_recordextend(recordset_type);
 
+/* The ldns records returned by the lookups are built on each call and are
+ * owned by the caller, the lists are to be freed with ldns_rr_list_deep_free.
+ */
 void names_recordlookupone(recordset_type record, ldns_rr_type type, ldns_rr* template, ldns_rr** rr);
 void names_recordlookupall(recordset_type record, ldns_rr_type type, ldns_rr* template, ldns_rr_list** rrs, struct signature_struct*** rrsigs);
+ldns_rr* names_recordsignature(recordset_type record, struct signature_struct* signature);
+int names_recordwire(recordset_type record, ldns_rr_type type, int index, ldns_buffer* buffer);
 
 struct dual {
     recordset_type src;
@@ -189,6 +206,14 @@ int names_indexinsert(names_index_type index, recordset_type d, recordset_type*
 void names_indexdestroy(names_index_type, void (*userfunc)(void* arg, void* key, void* val), void* userarg);
 names_iterator names_indexiterator(names_index_type);
 
+/* A region hands out memory that is only released all at once, when the
+ * region is destroyed.  Regions are not thread safe.
+ */
+
+names_region_type names_regioncreate(void);
+void* names_regionalloc(names_region_type region, size_t size);
+void names_regiondestroy(names_region_type region);
+
 /* Table structures are used internally by views to record changes made in
  * the view.  A table is a set of changes, also dubbed a changelog.
  * The table* functions are not to be used outside of the scope of the
@@ -201,6 +226,7 @@ void names_tabledispose(names_table_type table, void (*userfunc)(void* arg, void
 void* names_tableget(names_table_type table, void* name);
 int names_tabledel(names_table_type table, char* name);
 void** names_tableput(names_table_type table, void* name);
+void* names_tablealloc(names_table_type table, size_t size);
 void names_tableconcat(names_table_type* list, names_table_type item);
 names_iterator names_tableitems(names_table_type table);
 
@@ -278,7 +304,12 @@ ldns_rr_type domain_is_occluded(names_view_type view, recordset_type record);
 ldns_rr_type domain_is_delegpt(names_view_type view, recordset_type record);
 ldns_rr* denial_nsecify(signconf_type* signconf, names_view_type view, recordset_type domain, ldns_rdf* nxt); // FIXME rename
 ods_status namedb_update_serial(zone_type* globalzone);
-ods_status rrset_sign(signconf_type* signconf, names_view_type view, recordset_type domain, ldns_rr_type rrtype, hsm_ctx_t* ctx, time_t signtime);
+struct rrset_signbatch;
+struct rrset_signbatch* rrset_signbatchcreate(void);
+ods_status rrset_signbatchflush(struct rrset_signbatch* batch, recordset_type domain, hsm_ctx_t* ctx);
+void rrset_signbatchclear(struct rrset_signbatch* batch);
+void rrset_signbatchdestroy(struct rrset_signbatch* batch);
+ods_status rrset_sign(signconf_type* signconf, names_view_type view, recordset_type domain, ldns_rr_type rrtype, hsm_ctx_t* ctx, time_t signtime, struct rrset_signbatch* batch);
 ods_status rrset_getliteralrr(ldns_rr** dnskey, const char *resourcerecord, uint32_t ttl, ldns_rdf* apex);
 ods_status namedb_domain_entize(names_view_type view, recordset_type domain, ldns_rdf* dname, ldns_rdf* apex);
 
@@ -30,23 +30,42 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <ctype.h>
+#include <pthread.h>
 #include <ldns/ldns.h>
+#ifdef HAVE_SSL
+#include <openssl/sha.h>
+#else
+#define SHA_DIGEST_LENGTH LDNS_SHA1_DIGEST_LENGTH
+#define SHA1(D,N,MD) ldns_sha1((D),(N),(MD))
+#endif
 #include "uthash.h"
 #include "utilities.h"
 #include "logging.h"
 #include "proto.h"
 
-struct item {
-    ldns_rr* rr;
-};
-
+/* The items of an itemset are not kept as separate ldns_rr structures, but
+ * as one block of canonical wire format data.  Every item in the block
+ * consists of the ttl, rdlength and rdata of the record, the owner name,
+ * type and class being common to the itemset.  The offsets table has
+ * nitems+1 entries, the last one being the size of the block.  The ldns
+ * form of the items is only build when a caller asks for it, and is handed
+ * over to that caller.
+ */
 struct itemset {
     ldns_rr_type rrtype;
+    ldns_rr_class klass;
     int nitems;
-    struct item* items;
+    uint32_t* offsets;
+    uint8_t* wire;
     struct signatures_struct* signatures;
 };
 
+/* only used to (un)marshall the items in their textual form */
+struct item {
+    ldns_rr* rr;
+};
+
 struct recordset_struct {
     char* name;
     int revision;
@@ -61,16 +80,197 @@ struct recordset_struct {
     struct itemset* itemsets;
 };
 
+/* Key locators are shared by a great many signatures, keep a single copy
+ * of each of them.  Entries are never removed.
+ */
+struct keylocator {
+    UT_hash_handle hh;
+    char locator[1];
+};
+
+static struct keylocator* keylocators = NULL;
+static pthread_mutex_t keylocatorslock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char*
+internkeylocator(const char* locator)
+{
+    struct keylocator* entry;
+    size_t len;
+    if(locator == NULL)
+        return NULL;
+    len = strlen(locator);
+    pthread_mutex_lock(&keylocatorslock);
+    HASH_FIND(hh, keylocators, locator, (unsigned)len, entry);
+    if(entry == NULL) {
+        CHECKALLOC(entry = malloc(sizeof(struct keylocator) + len));
+        memcpy(entry->locator, locator, len + 1);
+        HASH_ADD(hh, keylocators, locator[0], (unsigned)len, entry);
+    }
+    pthread_mutex_unlock(&keylocatorslock);
+    return entry->locator;
+}
+
+/* Records are encoded for every lookup and change, each thread keeps one
+ * buffer to encode them in.
+ */
+static pthread_key_t scratchkey;
+static pthread_once_t scratchonce = PTHREAD_ONCE_INIT;
+
+static void
+scratchdispose(void* buffer)
+{
+    ldns_buffer_free((ldns_buffer*)buffer);
+}
+
+static void
+scratchinit(void)
+{
+    if(pthread_key_create(&scratchkey, scratchdispose))
+        ods_fatal_exit("unable to create thread key");
+}
+
+static ldns_buffer*
+scratchbuffer(void)
+{
+    ldns_buffer* buffer;
+    pthread_once(&scratchonce, scratchinit);
+    buffer = (ldns_buffer*) pthread_getspecific(scratchkey);
+    if(buffer == NULL) {
+        CHECKALLOC(buffer = ldns_buffer_new(LDNS_MIN_BUFLEN));
+        pthread_setspecific(scratchkey, buffer);
+    }
+    return buffer;
+}
+
+/* Encode the ttl, rdlength and canonical rdata of rr into buffer, returns
+ * a pointer into the buffer.
+ */
+static const uint8_t*
+rr2wire(ldns_buffer* buffer, ldns_rr* rr, size_t* len)
+{
+    size_t ownerlen;
+    ldns_buffer_clear(buffer);
+    if(ldns_rr2buffer_wire_canonical(buffer, rr, LDNS_SECTION_ANSWER) != LDNS_STATUS_OK) {
+        *len = 0;
+        return NULL;
+    }
+    ownerlen = (ldns_rr_owner(rr) ? ldns_rdf_size(ldns_rr_owner(rr)) : 0);
+    *len = ldns_buffer_position(buffer) - ownerlen - 4;
+    return ldns_buffer_at(buffer, ownerlen + 4);
+}
+
+static size_t
+wirelength(const uint8_t* wire)
+{
+    return 6 + ldns_read_uint16(&wire[4]);
+}
+
+/* compare the rdata of two items, disregarding the ttl */
+static int
+wirecompare(const uint8_t* a, const uint8_t* b)
+{
+    if(ldns_read_uint16(&a[4]) != ldns_read_uint16(&b[4]))
+        return 1;
+    return memcmp(&a[6], &b[6], ldns_read_uint16(&a[4]));
+}
+
+static ldns_rr*
+materialise(const ldns_rdf* owner, ldns_rr_type rrtype, ldns_rr_class klass, const uint8_t* wire)
+{
+    ldns_rr* rr = NULL;
+    uint8_t* buffer;
+    size_t ownerlen, len, pos;
+    ownerlen = ldns_rdf_size(owner);
+    len = ownerlen + 4 + wirelength(wire);
+    CHECKALLOC(buffer = malloc(len));
+    memcpy(buffer, ldns_rdf_data(owner), ownerlen);
+    ldns_write_uint16(&buffer[ownerlen], rrtype);
+    ldns_write_uint16(&buffer[ownerlen + 2], klass);
+    memcpy(&buffer[ownerlen + 4], wire, wirelength(wire));
+    pos = 0;
+    if(ldns_wire2rr(&rr, buffer, len, &pos, LDNS_SECTION_ANSWER) != LDNS_STATUS_OK) {
+        rr = NULL;
+    }
+    free(buffer);
+    return rr;
+}
+
+static size_t
+itemsetsize(struct itemset* itemset)
+{
+    return (itemset->offsets ? itemset->offsets[itemset->nitems] : 0);
+}
+
+static int
+itemsetfind(struct itemset* itemset, const uint8_t* wire)
+{
+    int j;
+    for(j=0; j<itemset->nitems; j++)
+        if(!wirecompare(wire, &itemset->wire[itemset->offsets[j]]))
+            break;
+    return j;
+}
+
+static void
+itemsetinit(struct itemset* itemset, ldns_rr_type rrtype, ldns_rr_class klass)
+{
+    itemset->rrtype = rrtype;
+    itemset->klass = klass;
+    itemset->nitems = 0;
+    itemset->offsets = NULL;
+    itemset->wire = NULL;
+    itemset->signatures = NULL;
+}
+
+static void
+itemsetadd(struct itemset* itemset, ldns_rr* rr)
+{
+    const uint8_t* wire;
+    size_t len, size;
+    wire = rr2wire(scratchbuffer(), rr, &len);
+    if(wire == NULL || itemsetfind(itemset, wire) < itemset->nitems)
+        return;
+    size = itemsetsize(itemset);
+    CHECKALLOC(itemset->wire = realloc(itemset->wire, size + len));
+    memcpy(&itemset->wire[size], wire, len);
+    CHECKALLOC(itemset->offsets = realloc(itemset->offsets, sizeof(uint32_t) * (itemset->nitems + 2)));
+    itemset->offsets[itemset->nitems] = size;
+    itemset->offsets[itemset->nitems + 1] = size + len;
+    itemset->nitems += 1;
+}
+
+static void
+itemsetremove(struct itemset* itemset, int j)
+{
+    int k;
+    uint32_t len;
+    len = itemset->offsets[j+1] - itemset->offsets[j];
+    memmove(&itemset->wire[itemset->offsets[j]], &itemset->wire[itemset->offsets[j+1]], itemset->offsets[itemset->nitems] - itemset->offsets[j+1]);
+    for(k=j; k<itemset->nitems; k++)
+        itemset->offsets[k] = itemset->offsets[k+1] - len;
+    itemset->nitems -= 1;
+}
+
+/* Builds item j of an itemset in ldns form, the caller owns the result. */
+static ldns_rr*
+itemsetrr(recordset_type d, struct itemset* itemset, int j)
+{
+    ldns_rdf* owner;
+    ldns_rr* rr;
+    CHECKALLOC(owner = ldns_dname_new_frm_str(d->name));
+    rr = materialise(owner, itemset->rrtype, itemset->klass, &itemset->wire[itemset->offsets[j]]);
+    ldns_rdf_deep_free(owner);
+    return rr;
+}
+
 static void
 disposesignature(struct signatures_struct** signatures)
 {
-    int i;
     if(*signatures) {
-        for (i=0; i<(*signatures)->nsigs; i++) {
-            free((void*)(*signatures)->sigs[i].keylocator);
-            ldns_rr_free((*signatures)->sigs[i].rr);
-        }
         free((*signatures)->sigs);
+        free((*signatures)->wire);
+        if((*signatures)->owner)
+            ldns_rdf_deep_free((*signatures)->owner);
         free((*signatures));
         *signatures = NULL;
     }
@@ -79,44 +279,116 @@ disposesignature(struct signatures_struct** signatures)
 void
 disposeitemset(struct itemset* itemset)
 {
-    int j;
-    for(j=0; j<itemset->nitems; j++) {
-        ldns_rr_free(itemset->items[j].rr);
-    }
-    free(itemset->items);
+    free(itemset->offsets);
+    free(itemset->wire);
     disposesignature(&(itemset->signatures));
 }
 
+static void
+removeitemset(recordset_type d, int i)
+{
+    disposeitemset(&(d->itemsets[i]));
+    d->nitemsets -= 1;
+    for(; i<d->nitemsets; i++)
+        d->itemsets[i] = d->itemsets[i+1];
+    if(d->nitemsets > 0) {
+        CHECKALLOC(d->itemsets = realloc(d->itemsets, sizeof(struct itemset) * d->nitemsets));
+    } else {
+        free(d->itemsets);
+        d->itemsets = NULL;
+    }
+}
+
+/* Takes over both the rrsig and the key locator. */
+static void
+addsignature(struct signatures_struct** signatures, ldns_rr* rrsig, const char* keylocator, int keyflags)
+{
+    struct signatures_struct* s;
+    struct signature_struct* sig;
+    const uint8_t* wire;
+    size_t len;
+    wire = rr2wire(scratchbuffer(), rrsig, &len);
+    if(wire != NULL) {
+        if(!*signatures) {
+            CHECKALLOC(s = malloc(sizeof(struct signatures_struct)));
+            s->nsigs = 0;
+            s->sigs = NULL;
+            s->owner = (ldns_rr_owner(rrsig) ? ldns_rdf_clone(ldns_rr_owner(rrsig)) : NULL);
+            s->klass = ldns_rr_get_class(rrsig);
+            s->wirelen = 0;
+            s->wire = NULL;
+            *signatures = s;
+        }
+        s = *signatures;
+        CHECKALLOC(s->sigs = realloc(s->sigs, sizeof(struct signature_struct) * (s->nsigs + 1)));
+        CHECKALLOC(s->wire = realloc(s->wire, s->wirelen + len));
+        memcpy(&s->wire[s->wirelen], wire, len);
+        sig = &s->sigs[s->nsigs];
+        sig->rr = NULL;
+        sig->offset = s->wirelen;
+        sig->keylocator = internkeylocator(keylocator);
+        sig->keyflags = keyflags;
+        sig->expiration = (ldns_rr_rrsig_expiration(rrsig) ? ldns_rdf2native_int32(ldns_rr_rrsig_expiration(rrsig)) : 0);
+        sig->inception = (ldns_rr_rrsig_inception(rrsig) ? ldns_rdf2native_int32(ldns_rr_rrsig_inception(rrsig)) : 0);
+        s->wirelen += len;
+        s->nsigs += 1;
+    }
+    ldns_rr_free(rrsig);
+    free((void*)keylocator);
+}
+
 void
 names_recordaddsignature(recordset_type d, ldns_rr_type rrtype, ldns_rr* rrsig, const char* keylocator, int keyflags)
 {
-    int i, j;
+    int i;
     for(i=0; i<d->nitemsets; i++)
         if(rrtype == d->itemsets[i].rrtype)
             break;
     if (i<d->nitemsets) {
-        if(!d->itemsets[i].signatures) {
-            d->itemsets[i].signatures = malloc(sizeof(struct signatures_struct));
-            d->itemsets[i].signatures->nsigs = 0;
-            d->itemsets[i].signatures->sigs = NULL;
-        }
-        d->itemsets[i].signatures->nsigs += 1;
-        d->itemsets[i].signatures->sigs = realloc(d->itemsets[i].signatures->sigs, sizeof(struct signature_struct) * d->itemsets[i].signatures->nsigs);
-        d->itemsets[i].signatures->sigs[d->itemsets[i].signatures->nsigs-1].rr = rrsig;
-        d->itemsets[i].signatures->sigs[d->itemsets[i].signatures->nsigs-1].keylocator = keylocator;
-        d->itemsets[i].signatures->sigs[d->itemsets[i].signatures->nsigs-1].keyflags = keyflags;
+        addsignature(&(d->itemsets[i].signatures), rrsig, keylocator, keyflags);
     } else if(rrtype == LDNS_RR_TYPE_NSEC || rrtype == LDNS_RR_TYPE_NSEC3) {
-        if(!d->spansignatures) {
-            d->spansignatures = malloc(sizeof(struct signatures_struct));
-            d->spansignatures->nsigs = 0;
-            d->spansignatures->sigs = NULL;            
-        }
-        d->spansignatures->nsigs += 1;
-        d->spansignatures->sigs = realloc(d->spansignatures->sigs, sizeof(struct signature_struct) * d->spansignatures->nsigs);
-        d->spansignatures->sigs[d->spansignatures->nsigs-1].rr = rrsig;
-        d->spansignatures->sigs[d->spansignatures->nsigs-1].keylocator = keylocator;
-        d->spansignatures->sigs[d->spansignatures->nsigs-1].keyflags = keyflags;
+        addsignature(&(d->spansignatures), rrsig, keylocator, keyflags);
+    } else {
+        ldns_rr_free(rrsig);
+        free((void*)keylocator);
+    }
+}
+
+static struct signatures_struct*
+signatureset(recordset_type d, struct signature_struct* signature)
+{
+    int i;
+    struct signatures_struct* s;
+    for(i=0; i<=d->nitemsets; i++) {
+        s = (i < d->nitemsets ? d->itemsets[i].signatures : d->spansignatures);
+        if(s && signature >= s->sigs && signature < &s->sigs[s->nsigs])
+            return s;
     }
+    return NULL;
+}
+
+static ldns_rr*
+signaturematerialise(recordset_type d, struct signatures_struct* s, struct signature_struct* signature)
+{
+    ldns_rdf* owner;
+    ldns_rr* rr;
+    if(s->owner) {
+        rr = materialise(s->owner, LDNS_RR_TYPE_RRSIG, s->klass, &s->wire[signature->offset]);
+    } else {
+        CHECKALLOC(owner = ldns_dname_new_frm_str(d->name));
+        rr = materialise(owner, LDNS_RR_TYPE_RRSIG, s->klass, &s->wire[signature->offset]);
+        ldns_rdf_deep_free(owner);
+    }
+    return rr;
+}
+
+ldns_rr*
+names_recordsignature(recordset_type d, struct signature_struct* signature)
+{
+    struct signatures_struct* s;
+    s = signatureset(d, signature);
+    assert(s);
+    return signaturematerialise(d, s, signature);
 }
 
 int
@@ -173,29 +445,118 @@ names_recordcreatetemp(const char* name)
     return dict;
 }
 
+/* Convert a presentation format name into canonical (lower case) wire
+ * format, without allocating.  Returns the length, or 0 on a malformed name.
+ */
+static size_t
+name2wire(const char* name, uint8_t* wire)
+{
+    size_t pos, label;
+    const char* s;
+    int c;
+    label = 0;
+    pos = 1;
+    if(!strcmp(name, "."))
+        name = "";
+    for(s=name; *s; s++) {
+        if(*s == '.') {
+            if(pos == label + 1)
+                return 0;
+            wire[label] = pos - label - 1;
+            label = pos++;
+            continue;
+        } else if(*s == '\\') {
+            if(isdigit((unsigned char)s[1]) && isdigit((unsigned char)s[2]) && isdigit((unsigned char)s[3])) {
+                c = (s[1] - '0') * 100 + (s[2] - '0') * 10 + (s[3] - '0');
+                if(c > 255)
+                    return 0;
+                s += 3;
+            } else if(s[1]) {
+                c = (unsigned char) *++s;
+            } else
+                return 0;
+        } else {
+            c = (unsigned char) *s;
+        }
+        if(pos - label > LDNS_MAX_LABELLEN || pos + 1 >= LDNS_MAX_DOMAINLEN)
+            return 0;
+        wire[pos++] = tolower(c);
+    }
+    wire[label] = pos - label - 1;
+    if(pos != label + 1)
+        wire[pos++] = 0;
+    return pos;
+}
+
+/* The iterated hash of RFC 5155 section 5, computed in a fixed buffer. */
+static void
+nsec3hash(const uint8_t* wire, size_t len, nsec3params_type* n3p, uint8_t* digest)
+{
+    uint8_t buffer[LDNS_MAX_DOMAINLEN + 256];
+    int i;
+    memcpy(buffer, wire, len);
+    memcpy(&buffer[len], n3p->salt_data, n3p->salt_len);
+    SHA1(buffer, len + n3p->salt_len, digest);
+    memcpy(&buffer[SHA_DIGEST_LENGTH], n3p->salt_data, n3p->salt_len);
+    for(i=0; i<n3p->iterations; i++) {
+        memcpy(buffer, digest, SHA_DIGEST_LENGTH);
+        SHA1(buffer, SHA_DIGEST_LENGTH + n3p->salt_len, digest);
+    }
+}
+
+/* Annotates a number of records with their hashed owner names in one go,
+ * the zone suffix is only converted once.
+ */
 void
-names_recordannotate(recordset_type d, struct names_view_zone* zone)
+names_recordannotatehashed(recordset_type* records, int nrecords, struct names_view_zone* zone)
 {
-    if(zone) {
-        if(zone->signconf && *(zone->signconf) && (*(zone->signconf))->nsec3params) {
-            nsec3params_type* n3p = (*zone->signconf)->nsec3params;
-            ldns_rdf* dname;
-            ldns_rdf* apex;
-            ldns_rdf* hashed_label;
-            ldns_rdf* hashed_ownername;
-            dname = ldns_rdf_new_frm_str(LDNS_RDF_TYPE_DNAME, d->name);
-            apex = ldns_rdf_new_frm_str(LDNS_RDF_TYPE_DNAME, zone->apex);
+    nsec3params_type* n3p = (*zone->signconf)->nsec3params;
+    uint8_t wire[LDNS_MAX_DOMAINLEN + 1];
+    uint8_t digest[SHA_DIGEST_LENGTH];
+    char hash[LDNS_MAX_LABELLEN + 1];
+    ldns_rdf* apex;
+    ldns_rdf* dname;
+    ldns_rdf* hashed_label;
+    ldns_rdf* hashed_ownername;
+    char* suffix;
+    size_t suffixlen, hashlen, len;
+    int i;
+    apex = ldns_rdf_new_frm_str(LDNS_RDF_TYPE_DNAME, zone->apex);
+    suffix = ldns_rdf2str(apex);
+    suffixlen = strlen(suffix);
+    for(i=0; i<nrecords; i++) {
+        len = (n3p->algorithm == LDNS_SHA1 ? name2wire(records[i]->name, wire) : 0);
+        if(len > 0) {
+            nsec3hash(wire, len, n3p, digest);
+            hashlen = ldns_b32_ntop_extended_hex(digest, SHA_DIGEST_LENGTH, hash, sizeof(hash));
+            CHECKALLOC(records[i]->spanhash = malloc(hashlen + 1 + suffixlen + 1));
+            memcpy(records[i]->spanhash, hash, hashlen);
+            records[i]->spanhash[hashlen] = '.';
+            memcpy(&records[i]->spanhash[hashlen + 1], suffix, suffixlen + 1);
+        } else {
             /*
              * The owner name of the NSEC3 RR is the hash of the original owner
              * name, prepended as a single label to the zone name.
              */
+            dname = ldns_rdf_new_frm_str(LDNS_RDF_TYPE_DNAME, records[i]->name);
             hashed_label = ldns_nsec3_hash_name(dname, n3p->algorithm, n3p->iterations, n3p->salt_len, n3p->salt_data);
             hashed_ownername = ldns_dname_cat_clone(hashed_label, apex);
-            d->spanhash = ldns_rdf2str(hashed_ownername);
+            records[i]->spanhash = ldns_rdf2str(hashed_ownername);
             ldns_rdf_deep_free(hashed_ownername);
             ldns_rdf_deep_free(hashed_label);
-            ldns_rdf_deep_free(apex);
             ldns_rdf_deep_free(dname);
+        }
+    }
+    free(suffix);
+    ldns_rdf_deep_free(apex);
+}
+
+void
+names_recordannotate(recordset_type d, struct names_view_zone* zone)
+{
+    if(zone) {
+        if(zone->signconf && *(zone->signconf) && (*(zone->signconf))->nsec3params) {
+            names_recordannotatehashed(&d, 1, zone);
         } else {
             /* ldns_rdf* rdf;
              * ldns_rdf* revrdf;
@@ -239,7 +600,8 @@ names_recordannotate(recordset_type d, struct names_view_zone* zone)
 recordset_type
 names_recordcopy(recordset_type dict, int clear)
 {
-    int i, j;
+    int i;
+    size_t size;
     struct recordset_struct* target;
     char* name = dict->name;
     target = (struct recordset_struct*) names_recordcreate(&name);
@@ -247,12 +609,15 @@ names_recordcopy(recordset_type dict, int clear)
     target->nitemsets = dict->nitemsets;
     CHECKALLOC(target->itemsets = malloc(sizeof(struct itemset) * target->nitemsets));
     for(i=0; i<target->nitemsets; i++) {
-        target->itemsets[i].rrtype = dict->itemsets[i].rrtype;
+        itemsetinit(&target->itemsets[i], dict->itemsets[i].rrtype, dict->itemsets[i].klass);
         target->itemsets[i].nitems = dict->itemsets[i].nitems;
-        target->itemsets[i].items = malloc(sizeof(struct item) * dict->itemsets[i].nitems);
-        target->itemsets[i].signatures = NULL;
-        for(j=0; j<dict->itemsets[i].nitems; j++) {
-            target->itemsets[i].items[j].rr = ldns_rr_clone(dict->itemsets[i].items[j].rr);
+        if(dict->itemsets[i].offsets) {
+            size = sizeof(uint32_t) * (dict->itemsets[i].nitems + 1);
+            CHECKALLOC(target->itemsets[i].offsets = malloc(size));
+            memcpy(target->itemsets[i].offsets, dict->itemsets[i].offsets, size);
+            size = itemsetsize(&dict->itemsets[i]);
+            CHECKALLOC(target->itemsets[i].wire = malloc(size > 0 ? size : 1));
+            memcpy(target->itemsets[i].wire, dict->itemsets[i].wire, size);
         }
     }
     target->spanhash = (dict->spanhash ? strdup(dict->spanhash) : NULL);
@@ -282,6 +647,9 @@ int
 names_recordhasdata(recordset_type record, ldns_rr_type recordtype, ldns_rr* rr, int exact)
 {
     int i, j;
+    int rc = 0;
+    const uint8_t* wire;
+    size_t len;
     if(!record)
         return 0;
     if(recordtype == 0) { /* note there is no rrtype of 0 in DNS */
@@ -294,27 +662,26 @@ names_recordhasdata(recordset_type record, ldns_rr_type recordtype, ldns_rr* rr,
             if(rr == NULL) {
                 return record->itemsets[i].nitems > 0;
             } else {
-                for(j=0; j<record->itemsets[i].nitems; j++)
-                    if(!ldns_rr_compare(rr, record->itemsets[i].items[j].rr))
-                        break;
-                if (j<record->itemsets[i].nitems) {
-                    if(exact) {
-                        if(ldns_rr_ttl(record->itemsets[i].items[j].rr) != ldns_rr_ttl(rr))
-                            return 0;
-                        return  1;
-                    } else
-                        return 1;
+                wire = rr2wire(scratchbuffer(), rr, &len);
+                if(wire) {
+                    j = itemsetfind(&record->itemsets[i], wire);
+                    if (j<record->itemsets[i].nitems) {
+                        if(exact) {
+                            rc = !memcmp(wire, &record->itemsets[i].wire[record->itemsets[i].offsets[j]], 4);
+                        } else
+                            rc = 1;
+                    }
                 }
             }
         }
     }
-    return 0;
+    return rc;
 }
 
 void
 names_recordadddata(recordset_type d, ldns_rr* rr)
 {
-    int i, j;
+    int i;
     ldns_rr_type rrtype;
     rrtype = ldns_rr_get_type(rr);
     for(i=0; i<d->nitemsets; i++)
@@ -323,70 +690,32 @@ names_recordadddata(recordset_type d, ldns_rr* rr)
     if (i==d->nitemsets) {
         d->nitemsets += 1;
         CHECKALLOC(d->itemsets = realloc(d->itemsets, sizeof(struct itemset) * d->nitemsets));
-        d->itemsets[i].rrtype = rrtype;
-        d->itemsets[i].items = NULL;
-        d->itemsets[i].nitems = 0;
-        d->itemsets[i].signatures = NULL;
-    }
-    for(j=0; j<d->itemsets[i].nitems; j++)
-        if(!ldns_rr_compare(rr, d->itemsets[i].items[j].rr))
-            break;
-    if (j==d->itemsets[i].nitems) {
-        d->itemsets[i].nitems += 1;
-        d->itemsets[i].items = realloc(d->itemsets[i].items, sizeof(struct item) * d->itemsets[i].nitems);
-        d->itemsets[i].items[j].rr = ldns_rr_clone(rr);
+        itemsetinit(&d->itemsets[i], rrtype, ldns_rr_get_class(rr));
     }
+    itemsetadd(&d->itemsets[i], rr);
 }
 
 void
 names_recorddeldata(recordset_type d, ldns_rr_type rrtype, ldns_rr* rr)
 {
     int i, j;
+    const uint8_t* wire;
+    size_t len;
     for(i=0; i<d->nitemsets; i++)
         if(rrtype == d->itemsets[i].rrtype)
             break;
     if (i<d->nitemsets) {
         if(rr) {
-            for(j=0; j<d->itemsets[i].nitems; j++)
-                if(ldns_rr_compare(rr, d->itemsets[i].items[j].rr))
-                    break;
+            wire = rr2wire(scratchbuffer(), rr, &len);
+            j = (wire ? itemsetfind(&d->itemsets[i], wire) : d->itemsets[i].nitems);
             if (j<d->itemsets[i].nitems) {
-                ldns_rr_free(d->itemsets[i].items[j].rr);
-                d->itemsets[i].nitems -= 1;
-                for(; j<d->itemsets[i].nitems; j++) {
-                    d->itemsets[i].items[j] = d->itemsets[i].items[j+1];
-                }
-                if(d->itemsets[i].nitems > 0) {
-                    d->itemsets[i].items = realloc(d->itemsets[i].items, sizeof(struct item) * d->itemsets[i].nitems);
-                } else {
-                    free(d->itemsets[i].items);
-                    d->itemsets[i].items = NULL;
-                    d->nitemsets -= 1;
-                    for(; i<d->nitemsets; i++)
-                        d->itemsets[i] = d->itemsets[i+1];
-                    if(d->nitemsets > 0) {
-                        CHECKALLOC(d->itemsets = realloc(d->itemsets, sizeof(struct itemset) * d->nitemsets));
-                    } else {
-                        free(d->itemsets);
-                        d->itemsets = NULL;
-                    }
+                itemsetremove(&d->itemsets[i], j);
+                if(d->itemsets[i].nitems == 0) {
+                    removeitemset(d, i);
                 }
             }
         } else {
-            for(j=0; j<d->itemsets[i].nitems; j++) {
-                ldns_rr_free(d->itemsets[i].items[j].rr);
-            }
-            free(d->itemsets[i].items);
-            d->itemsets[i].items = NULL;
-            d->nitemsets -= 1;
-            for(; i<d->nitemsets; i++)
-                d->itemsets[i] = d->itemsets[i+1];
-            if(d->nitemsets > 0) {
-                CHECKALLOC(d->itemsets = realloc(d->itemsets, sizeof(struct itemset) * d->nitemsets));
-            } else {
-                free(d->itemsets);
-                d->itemsets = NULL;
-            }
+            removeitemset(d, i);
         }
     }
 }
@@ -394,31 +723,19 @@ names_recorddeldata(recordset_type d, ldns_rr_type rrtype, ldns_rr* rr)
 void
 names_recorddelall(recordset_type d, ldns_rr_type rrtype)
 {
-    int i, j;
-    for(i=0; i<d->nitemsets; i++) {
-        if(rrtype==0 || d->itemsets[i].rrtype == rrtype) {
-            disposeitemset(&(d->itemsets[i]));
-            if(rrtype != 0)
-                break;
-        }
-    }
+    int i;
     if(rrtype == 0) {
+        for(i=0; i<d->nitemsets; i++)
+            disposeitemset(&(d->itemsets[i]));
         free(d->itemsets);
         d->itemsets = NULL;
         d->nitemsets = 0;
-    } else if(i<d->nitemsets) {
-        d->itemsets[i].items = NULL;
-        d->nitemsets -= 1;
-        for (; i < d->nitemsets; i++)
-            d->itemsets[i] = d->itemsets[i + 1];
-        if (d->nitemsets > 0) {
-            CHECKALLOC(d->itemsets = realloc(d->itemsets, sizeof (struct itemset) * d->nitemsets));
-        } else {
-            for(i=0; i<d->nitemsets; i++)
-                disposeitemset(&(d->itemsets[i]));
-            free(d->itemsets);
-            d->itemsets = NULL;
-        }        
+    } else {
+        for(i=0; i<d->nitemsets; i++)
+            if(d->itemsets[i].rrtype == rrtype)
+                break;
+        if(i<d->nitemsets)
+            removeitemset(d, i);
     }
 }
 
@@ -437,20 +754,34 @@ names_recordalltypes(recordset_type d)
     return iter;
 }
 
-static void names_recordallvaluestrings_func(names_iterator iter, void* base, int index, void* dst)
+static char*
+wire2str(const ldns_rdf* owner, ldns_rr_type rrtype, ldns_rr_class klass, const uint8_t* wire)
+{
+    char* str;
+    ldns_rr* rr;
+    rr = materialise(owner, rrtype, klass, wire);
+    str = ldns_rr2str(rr);
+    ldns_rr_free(rr);
+    return str;
+}
+
+static char*
+signature2str(recordset_type d, struct signatures_struct* s, struct signature_struct* signature)
 {
-    struct item* items = (struct item*) base;
-    char** ptr = (char**)dst;
-    free(*ptr);
-    if (index >= 0)
-        *ptr = ldns_rr2str(items[index].rr);
-    else
-        *ptr = NULL;
+    char* str;
+    ldns_rr* rr;
+    rr = signaturematerialise(d, s, signature);
+    str = ldns_rr2str(rr);
+    ldns_rr_free(rr);
+    return str;
 }
+
 names_iterator
 names_recordallvaluestrings(recordset_type d, ldns_rr_type rrtype)
 {
     int i;
+    ldns_rdf* owner;
+    struct signatures_struct* s;
     for(i=0; i<d->nitemsets; i++) {
         if(rrtype == d->itemsets[i].rrtype)
             break;
@@ -458,14 +789,16 @@ names_recordallvaluestrings(recordset_type d, ldns_rr_type rrtype)
     if(i<d->nitemsets) {
         int j;
         names_iterator iter = names_iterator_createrefs(free);
+        CHECKALLOC(owner = ldns_dname_new_frm_str(d->name));
         for(j=0; j<d->itemsets[i].nitems; j++) {
-            names_iterator_addptr(iter, ldns_rr2str(d->itemsets[i].items[j].rr));
+            names_iterator_addptr(iter, wire2str(owner, rrtype, d->itemsets[i].klass, &d->itemsets[i].wire[d->itemsets[i].offsets[j]]));
         }
-        if(d->itemsets[i].signatures) {
-            for(j=0; j<d->itemsets[i].signatures->nsigs; j++) {
-                names_iterator_addptr(iter, ldns_rr2str(d->itemsets[i].signatures->sigs[j].rr));
+        if((s = d->itemsets[i].signatures)) {
+            for(j=0; j<s->nsigs; j++) {
+                names_iterator_addptr(iter, signature2str(d, s, &s->sigs[j]));
             }
         }
+        ldns_rdf_deep_free(owner);
         return iter;
     } else {
         if(rrtype == LDNS_RR_TYPE_NSEC || rrtype == LDNS_RR_TYPE_NSEC3) {
@@ -474,7 +807,7 @@ names_recordallvaluestrings(recordset_type d, ldns_rr_type rrtype)
             names_iterator_addptr(iter, ldns_rr2str(d->spanhashrr));
             if(d->spansignatures) {
                 for(j=0; j<d->spansignatures->nsigs; j++) {
-                    names_iterator_addptr(iter, ldns_rr2str(d->spansignatures->sigs[j].rr));
+                    names_iterator_addptr(iter, signature2str(d, d->spansignatures, &d->spansignatures->sigs[j]));
                 }
             }
             return iter;            
@@ -483,16 +816,60 @@ names_recordallvaluestrings(recordset_type d, ldns_rr_type rrtype)
     }
 }
 
+/* The values are build for the iteration only, they are freed together
+ * once the iterator ends.
+ */
+static void
+allvaluesindexfunc(names_iterator iter, void* data, int index, void* ptr)
+{
+    int j;
+    ldns_rr** rrs = data;
+    if(index >= 0) {
+        *(ldns_rr**)ptr = rrs[index];
+    } else {
+        for(j=0; rrs[j]; j++)
+            ldns_rr_free(rrs[j]);
+        free(rrs);
+    }
+}
+
+names_iterator
+names_recordallvalues(recordset_type d, ldns_rr_type rrtype)
+{
+    int i, j, count;
+    ldns_rr** rrs;
+    struct signatures_struct* s;
+    for(i=0; i<d->nitemsets; i++) {
+        if(rrtype == d->itemsets[i].rrtype)
+            break;
+    }
+    if(i<d->nitemsets) {
+        s = d->itemsets[i].signatures;
+        CHECKALLOC(rrs = malloc(sizeof(ldns_rr*) * (d->itemsets[i].nitems + (s ? s->nsigs : 0) + 1)));
+        for(j=0, count=0; j<d->itemsets[i].nitems; j++)
+            if((rrs[count] = itemsetrr(d, &d->itemsets[i], j)))
+                count++;
+    } else if((rrtype == LDNS_RR_TYPE_NSEC || rrtype == LDNS_RR_TYPE_NSEC3) && d->spanhashrr) {
+        s = d->spansignatures;
+        CHECKALLOC(rrs = malloc(sizeof(ldns_rr*) * (1 + (s ? s->nsigs : 0) + 1)));
+        rrs[0] = ldns_rr_clone(d->spanhashrr);
+        count = 1;
+    } else {
+        return NULL;
+    }
+    for(j=0; s && j<s->nsigs; j++)
+        if((rrs[count] = signaturematerialise(d, s, &s->sigs[j])))
+            count++;
+    rrs[count] = NULL;
+    return names_iterator_createarray(count, rrs, allvaluesindexfunc);
+}
+
 void
 names_recorddispose(recordset_type dict)
 {
-    int i, j;
+    int i;
     for(i=0; i<dict->nitemsets; i++) {
-        for(j=0; j<dict->itemsets[i].nitems; j++) {
-            ldns_rr_free(dict->itemsets[i].items[j].rr);
-        }
-        disposesignature(&dict->itemsets[i].signatures);
-        free(dict->itemsets[i].items);
+        disposeitemset(&dict->itemsets[i]);
     }
     free(dict->itemsets);
     free(dict->name);
@@ -622,30 +999,146 @@ names_recordsetexpiry(recordset_type record, int64_t value)
     *(record->expiry) = value;
 }
 
+/* The persisted form of a record keeps the items and signatures in their
+ * textual form, the wire format blocks are converted on the fly.
+ */
+static struct item*
+exportitems(recordset_type d, struct itemset* itemset)
+{
+    int j;
+    struct item* items;
+    ldns_rdf* owner;
+    CHECKALLOC(items = malloc(sizeof(struct item) * (itemset->nitems > 0 ? itemset->nitems : 1)));
+    CHECKALLOC(owner = ldns_dname_new_frm_str(d->name));
+    for(j=0; j<itemset->nitems; j++)
+        items[j].rr = materialise(owner, itemset->rrtype, itemset->klass, &itemset->wire[itemset->offsets[j]]);
+    ldns_rdf_deep_free(owner);
+    return items;
+}
+
+static void
+importitems(struct itemset* itemset, struct item* items, int nitems)
+{
+    int j;
+    itemsetinit(itemset, itemset->rrtype, (items && nitems > 0 && items[0].rr ? ldns_rr_get_class(items[0].rr) : LDNS_RR_CLASS_IN));
+    for(j=0; j<nitems; j++) {
+        if(items[j].rr) {
+            itemsetadd(itemset, items[j].rr);
+            ldns_rr_free(items[j].rr);
+        }
+    }
+    free(items);
+}
+
+static void
+releaseitems(struct item* items, int nitems)
+{
+    int j;
+    for(j=0; j<nitems; j++)
+        if(items[j].rr)
+            ldns_rr_free(items[j].rr);
+    free(items);
+}
+
+static struct signatures_struct*
+exportsignatures(recordset_type d, struct signatures_struct* s)
+{
+    int i;
+    struct signatures_struct* signatures;
+    if(s == NULL)
+        return NULL;
+    CHECKALLOC(signatures = malloc(sizeof(struct signatures_struct)));
+    signatures->nsigs = s->nsigs;
+    CHECKALLOC(signatures->sigs = malloc(sizeof(struct signature_struct) * (s->nsigs > 0 ? s->nsigs : 1)));
+    signatures->owner = NULL;
+    signatures->wire = NULL;
+    signatures->wirelen = 0;
+    for(i=0; i<s->nsigs; i++) {
+        signatures->sigs[i] = s->sigs[i];
+        signatures->sigs[i].rr = signaturematerialise(d, s, &s->sigs[i]);
+    }
+    return signatures;
+}
+
+static struct signatures_struct*
+importsignatures(struct signatures_struct* signatures)
+{
+    int i;
+    struct signatures_struct* s = NULL;
+    if(signatures == NULL)
+        return NULL;
+    for(i=0; i<signatures->nsigs; i++) {
+        if(signatures->sigs[i].rr) {
+            addsignature(&s, signatures->sigs[i].rr, signatures->sigs[i].keylocator, signatures->sigs[i].keyflags);
+        } else {
+            free((void*)signatures->sigs[i].keylocator);
+        }
+    }
+    free(signatures->sigs);
+    free(signatures);
+    return s;
+}
+
+static void
+releasesignatures(struct signatures_struct* signatures)
+{
+    int i;
+    if(signatures) {
+        for(i=0; i<signatures->nsigs; i++)
+            if(signatures->sigs[i].rr)
+                ldns_rr_free(signatures->sigs[i].rr);
+        free(signatures->sigs);
+        free(signatures);
+    }
+}
+
 int
 marshall(marshall_handle h, void* ptr)
 {
     recordset_type d = ptr;
     int size = 0;
     int i, j;
+    int reading;
+    int nitems;
+    struct item* items;
+    struct signatures_struct* signatures;
+    reading = marshallreading(h);
     size += marshalling(h, "name", &(d->name), NULL, 0, marshallstring);
     size += marshalling(h, "marker", &(d->marker), NULL, 0, marshallinteger);
     size += marshalling(h, "revision", &(d->revision), NULL, 0, marshallinteger);
     size += marshalling(h, "spanhash", &(d->spanhash), NULL, 0, marshallstring);
-    size += marshalling(h, "spansignatures", &(d->spansignatures), marshall_OPTIONAL, sizeof(struct signatures_struct), marshallsigs);
+    signatures = (reading ? NULL : exportsignatures(d, d->spansignatures));
+    size += marshalling(h, "spansignatures", &signatures, marshall_OPTIONAL, sizeof(struct signatures_struct), marshallsigs);
+    if(reading) {
+        d->spansignatures = importsignatures(signatures);
+    } else {
+        releasesignatures(signatures);
+    }
     size += marshalling(h, "spanhashrr", &(d->spanhashrr), NULL, 0, marshallldnsrr);
     size += marshalling(h, "validupto", &(d->validupto), marshall_OPTIONAL, sizeof(int), marshallinteger);
     size += marshalling(h, "validfrom", &(d->validfrom), marshall_OPTIONAL, sizeof(int), marshallinteger);
     size += marshalling(h, "expiry", &(d->expiry), marshall_OPTIONAL, sizeof(int64_t), marshallint64);
     size += marshalling(h, "itemsets", &(d->itemsets), &(d->nitemsets), sizeof(struct itemset), marshallself);
+    if(reading && d->nitemsets < 0)
+        d->nitemsets = 0;
     for(i=0; i<d->nitemsets; i++) {
         size += marshalling(h, "itemname", &(d->itemsets[i].rrtype), NULL, 0, marshallinteger);
-        size += marshalling(h, "items", &(d->itemsets[i].items), &(d->itemsets[i].nitems), sizeof(struct item), marshallself);
-        for(j=0; j<d->itemsets[i].nitems; j++) {
-            size += marshalling(h, "rr", &(d->itemsets[i].items[j].rr), NULL, 0, marshallldnsrr);
-            size += marshalling(h, NULL, NULL, &(d->itemsets[i].nitems), j, marshallself);
+        nitems = (reading ? 0 : d->itemsets[i].nitems);
+        items = (reading ? NULL : exportitems(d, &d->itemsets[i]));
+        size += marshalling(h, "items", &items, &nitems, sizeof(struct item), marshallself);
+        for(j=0; j<nitems; j++) {
+            size += marshalling(h, "rr", &(items[j].rr), NULL, 0, marshallldnsrr);
+            size += marshalling(h, NULL, NULL, &nitems, j, marshallself);
+        }
+        signatures = (reading ? NULL : exportsignatures(d, d->itemsets[i].signatures));
+        size += marshalling(h, "signatures", &signatures, marshall_OPTIONAL, sizeof(struct signatures_struct), marshallsigs);
+        if(reading) {
+            importitems(&d->itemsets[i], items, nitems);
+            d->itemsets[i].signatures = importsignatures(signatures);
+        } else {
+            releaseitems(items, nitems);
+            releasesignatures(signatures);
         }
-        size += marshalling(h, "signatures", &(d->itemsets[i].signatures), marshall_OPTIONAL, sizeof(struct signatures_struct), marshallsigs);
         size += marshalling(h, NULL, NULL, &(d->nitemsets), i, marshallself);
     }
     return size;
@@ -665,22 +1158,17 @@ names_recordmarshall(recordset_type* record, marshall_handle h)
 size_t
 names_recordextend(recordset_type record)
 {
-    int i, j;
+    int i;
     size_t size;
     size = sizeof(struct recordset_struct);
     size += record->nitemsets * sizeof(struct itemset);
     for(i=0; i<record->nitemsets; i++) {
-        size += record->itemsets[i].nitems * sizeof(struct item);
-        for(j=0; j<record->itemsets[i].nitems; j++) {
-            size += ldns_rr_uncompressed_size(record->itemsets[i].items[j].rr);
-        }
+        size += (record->itemsets[i].offsets ? (record->itemsets[i].nitems + 1) * sizeof(uint32_t) : 0);
+        size += itemsetsize(&record->itemsets[i]);
         if(record->itemsets[i].signatures) {
             size += sizeof(struct signatures_struct);
             size += record->itemsets[i].signatures->nsigs * sizeof(struct signature_struct);
-            for(j=0; j<record->itemsets[i].signatures->nsigs; j++) {
-                size += (record->itemsets[i].signatures->sigs[j].keylocator ? strlen(record->itemsets[i].signatures->sigs[j].keylocator) : 0);
-                size += ldns_rr_uncompressed_size(record->itemsets[i].signatures->sigs[j].rr);
-            }
+            size += record->itemsets[i].signatures->wirelen;
         }
     }
     size += (record->name ? strlen(record->name) : 0);
@@ -691,10 +1179,7 @@ names_recordextend(recordset_type record)
     if(record->spansignatures) {
         size += sizeof(struct signatures_struct);
         size += record->spansignatures->nsigs * sizeof(struct signature_struct);
-        for(j=0; j<record->spansignatures->nsigs; j++) {
-            size += (record->spansignatures->sigs[j].keylocator ? strlen(record->spansignatures->sigs[j].keylocator) : 0);
-            size += ldns_rr_uncompressed_size(record->spansignatures->sigs[j].rr);
-        }
+        size += record->spansignatures->wirelen;
     }
     size += (record->validupto ? sizeof(int) : 0);
     size += (record->validfrom ? sizeof(int) : 0);
@@ -702,6 +1187,7 @@ names_recordextend(recordset_type record)
     return size;
 }
 
+
 #define DEFINECOMPARISON(N) \
     int N(recordset_type, recordset_type, int*); \
     int N ## _ldns(const void* a, const void* b) { \
@@ -1083,24 +1569,23 @@ void
 names_recordlookupone(recordset_type record, ldns_rr_type recordtype, ldns_rr* template, ldns_rr** rr)
 {
     int i, j;
+    const uint8_t* wire;
+    size_t len;
     assert(record);
     assert(recordtype != 0);
     *rr = NULL;
     for(i=0; i<record->nitemsets; i++)
         if(record->itemsets[i].rrtype == recordtype)
             break;
-    if (i<record->nitemsets) {
-        if(rr == NULL) {
-            if(record->itemsets[i].nitems > 0) {
-                *rr = record->itemsets[i].items[0].rr;
-            }
+    if (i<record->nitemsets && record->itemsets[i].nitems > 0) {
+        if(template == NULL) {
+            j = 0;
         } else {
-            for(j=0; j<record->itemsets[i].nitems; j++)
-                if(!template || !ldns_rr_compare(template, record->itemsets[i].items[j].rr))
-                    break;
-            if (j<record->itemsets[i].nitems) {
-                *rr = record->itemsets[i].items[j].rr;
-            }
+            wire = rr2wire(scratchbuffer(), template, &len);
+            j = (wire ? itemsetfind(&record->itemsets[i], wire) : record->itemsets[i].nitems);
+        }
+        if (j<record->itemsets[i].nitems) {
+            *rr = itemsetrr(record, &record->itemsets[i], j);
         }
     }
 }
@@ -1110,6 +1595,9 @@ names_recordlookupall(recordset_type record, ldns_rr_type rrtype, ldns_rr* templ
 {
     int i, j;
     int nrrsigs = 0;
+    ldns_rdf* owner;
+    const uint8_t* wire;
+    size_t len;
     assert(record);
     if(rrs)
         *rrs = NULL;
@@ -1138,14 +1626,16 @@ names_recordlookupall(recordset_type record, ldns_rr_type rrtype, ldns_rr* templ
         }
     }
     if (i<record->nitemsets) {
-        *rrs = ldns_rr_list_new();
+        if(rrs)
+            *rrs = ldns_rr_list_new();
         if(template == NULL) {
             if(record->itemsets[i].nitems > 0) {
                 if(rrs) {
+                    CHECKALLOC(owner = ldns_dname_new_frm_str(record->name));
                     for(j=0; j<record->itemsets[i].nitems; j++) {
-                        assert(record->itemsets[i].items[j].rr);
-                        ldns_rr_list_push_rr(*rrs, record->itemsets[i].items[j].rr);
+                        ldns_rr_list_push_rr(*rrs, materialise(owner, record->itemsets[i].rrtype, record->itemsets[i].klass, &record->itemsets[i].wire[record->itemsets[i].offsets[j]]));
                     }
+                    ldns_rdf_deep_free(owner);
                 }
                 if(rrsigs && record->itemsets[i].signatures) {
                     for(j=0; j<record->itemsets[i].signatures->nsigs; j++) {
@@ -1156,13 +1646,11 @@ names_recordlookupall(recordset_type record, ldns_rr_type rrtype, ldns_rr* templ
                 }
             }
         } else {
-            for(j=0; j<record->itemsets[i].nitems; j++)
-                if(!ldns_rr_compare(template, record->itemsets[i].items[j].rr))
-                    break;
+            wire = rr2wire(scratchbuffer(), template, &len);
+            j = (wire ? itemsetfind(&record->itemsets[i], wire) : record->itemsets[i].nitems);
             if (j<record->itemsets[i].nitems) {
                 if(rrs) {
-                    assert(record->itemsets[i].items[j].rr);
-                    ldns_rr_list_push_rr(*rrs, record->itemsets[i].items[j].rr);
+                    ldns_rr_list_push_rr(*rrs, itemsetrr(record, &record->itemsets[i], j));
                 }
             }
         }
@@ -1172,7 +1660,7 @@ names_recordlookupall(recordset_type record, ldns_rr_type rrtype, ldns_rr* templ
                 *rrs = ldns_rr_list_new();
             if(rrs) {
                 assert(record->spanhashrr);
-                ldns_rr_list_push_rr(*rrs, record->spanhashrr);
+                ldns_rr_list_push_rr(*rrs, ldns_rr_clone(record->spanhashrr));
             }
             if(record->spansignatures)
                 for(j=0; j<record->spansignatures->nsigs; j++) {
@@ -1189,3 +1677,61 @@ names_recordlookupall(recordset_type record, ldns_rr_type rrtype, ldns_rr* templ
         (*rrsigs)[nrrsigs-1] = NULL;
     }
 }
+
+/* Append record index of a type in uncompressed wire format to buffer,
+ * copied from the stored block without building the ldns form.  The items
+ * are numbered first, followed by their signatures, for NSEC(3) the denial
+ * record comes first.  Returns 1 if the record was appended, 0 if there are
+ * no more records and -1 on an error.
+ */
+int
+names_recordwire(recordset_type record, ldns_rr_type rrtype, int index, ldns_buffer* buffer)
+{
+    int i;
+    uint8_t name[LDNS_MAX_DOMAINLEN + 1];
+    const uint8_t* owner = name;
+    size_t ownerlen;
+    const uint8_t* wire = NULL;
+    ldns_rr_class klass;
+    struct signatures_struct* s = NULL;
+    for(i=0; i<record->nitemsets; i++)
+        if(record->itemsets[i].rrtype == rrtype)
+            break;
+    if(i<record->nitemsets) {
+        if(index < record->itemsets[i].nitems) {
+            klass = record->itemsets[i].klass;
+            wire = &record->itemsets[i].wire[record->itemsets[i].offsets[index]];
+        } else {
+            index -= record->itemsets[i].nitems;
+            s = record->itemsets[i].signatures;
+        }
+    } else if((rrtype == LDNS_RR_TYPE_NSEC || rrtype == LDNS_RR_TYPE_NSEC3) && record->spanhashrr) {
+        if(index == 0)
+            return (ldns_rr2buffer_wire(buffer, record->spanhashrr, LDNS_SECTION_ANSWER) == LDNS_STATUS_OK ? 1 : -1);
+        index -= 1;
+        s = record->spansignatures;
+    } else {
+        return 0;
+    }
+    if(wire == NULL) {
+        if(s == NULL || index >= s->nsigs)
+            return 0;
+        rrtype = LDNS_RR_TYPE_RRSIG;
+        klass = s->klass;
+        wire = &s->wire[s->sigs[index].offset];
+        if(s->owner)
+            owner = ldns_rdf_data(s->owner);
+    }
+    if(owner == name) {
+        ownerlen = name2wire(record->name, name);
+    } else {
+        ownerlen = ldns_rdf_size(s->owner);
+    }
+    if(ownerlen == 0 || !ldns_buffer_reserve(buffer, ownerlen + 4 + wirelength(wire)))
+        return -1;
+    ldns_buffer_write(buffer, owner, ownerlen);
+    ldns_buffer_write_u16(buffer, rrtype);
+    ldns_buffer_write_u16(buffer, klass);
+    ldns_buffer_write(buffer, wire, wirelength(wire));
+    return 1;
+}
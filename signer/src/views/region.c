@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2018 NLNet Labs.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <ldns/ldns.h>
+#include "utilities.h"
+#include "proto.h"
+
+/* size of a regular chunk, larger allocations get a chunk of their own */
+#define NAMES_REGION_CHUNKSIZE 65536
+#define NAMES_REGION_LARGE (NAMES_REGION_CHUNKSIZE / 8)
+#define NAMES_REGION_ALIGN(N) (((N) + sizeof(long double) - 1) & ~(sizeof(long double) - 1))
+
+struct names_regionchunk {
+    struct names_regionchunk* next;
+    long double data[1];
+};
+
+struct names_region_struct {
+    struct names_regionchunk* chunks;
+    size_t used;
+};
+
+names_region_type
+names_regioncreate(void)
+{
+    struct names_region_struct* region;
+    CHECKALLOC(region = malloc(sizeof(struct names_region_struct)));
+    region->chunks = NULL;
+    region->used = NAMES_REGION_CHUNKSIZE;
+    return region;
+}
+
+void*
+names_regionalloc(names_region_type region, size_t size)
+{
+    struct names_regionchunk* chunk;
+    void* ptr;
+    size = NAMES_REGION_ALIGN(size);
+    if(size > NAMES_REGION_LARGE) {
+        /* keep filling the current chunk, put the large one after it */
+        CHECKALLOC(chunk = malloc(offsetof(struct names_regionchunk, data) + size));
+        if(region->chunks) {
+            chunk->next = region->chunks->next;
+            region->chunks->next = chunk;
+        } else {
+            chunk->next = NULL;
+            region->chunks = chunk;
+            region->used = NAMES_REGION_CHUNKSIZE;
+        }
+        return chunk->data;
+    }
+    if(region->used + size > NAMES_REGION_CHUNKSIZE) {
+        CHECKALLOC(chunk = malloc(offsetof(struct names_regionchunk, data) + NAMES_REGION_CHUNKSIZE));
+        chunk->next = region->chunks;
+        region->chunks = chunk;
+        region->used = 0;
+    }
+    ptr = &((char*)region->chunks->data)[region->used];
+    region->used += size;
+    return ptr;
+}
+
+void
+names_regiondestroy(names_region_type region)
+{
+    struct names_regionchunk* chunk;
+    if(region == NULL)
+        return;
+    while(region->chunks) {
+        chunk = region->chunks;
+        region->chunks = chunk->next;
+        free(chunk);
+    }
+    free(region);
+}
@@ -47,6 +47,7 @@ struct names_table_struct {
     ldns_rbtree_t* tree;
     names_table_type next;
     int (*cmp)(const void *, const void *);
+    names_region_type region;
 };
 
 struct names_iterator_struct {
@@ -112,6 +113,7 @@ names_tablecreate(int (*cmpf)(const void *, const void *))
     table->tree = ldns_rbtree_create(cmpf);
     table->next = NULL;
     table->cmp = cmpf;
+    table->region = names_regioncreate();
     return table;
 }
 
@@ -130,23 +132,31 @@ static void
 disposenode(ldns_rbnode_t* node, void* cargo)
 {
     struct destroyinfo* user = cargo;
-    if(user && user->free) {
-        user->free(user->arg, (void*)node->key, (void*)node->data);
-    }
-    free(node);
+    user->free(user->arg, (void*)node->key, (void*)node->data);
 }
 
+/* The nodes of the table live in the region of the table, only when the
+ * user needs to visit the entries the tree is traversed.
+ */
 void
 names_tabledispose(names_table_type table, void (*userfunc)(void* arg, void* key, void* val), void* userarg)
 {
     struct destroyinfo cargo;
     cargo.free = userfunc;
     cargo.arg = userarg;
-    ldns_traverse_postorder(table->tree, disposenode, (userfunc?&cargo:NULL));
+    if(userfunc)
+        ldns_traverse_postorder(table->tree, disposenode, &cargo);
     ldns_rbtree_free(table->tree);
+    names_regiondestroy(table->region);
     free(table);
 }
 
+void*
+names_tablealloc(names_table_type table, size_t size)
+{
+    return names_regionalloc(table->region, size);
+}
+
 void*
 names_tableget(names_table_type table, void* key)
 {
@@ -166,7 +176,7 @@ names_tableput(names_table_type table, void* key)
 
     node = ldns_rbtree_search(table->tree, key);
     if (node == NULL || node == LDNS_RBTREE_NULL) {
-        node = malloc(sizeof (struct ldns_rbnode_t));
+        node = names_regionalloc(table->region, sizeof (struct ldns_rbnode_t));
         node->key = key;
         node->data = NULL;
         ldns_rbtree_insert(table->tree, node);
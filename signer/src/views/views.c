@@ -36,6 +36,7 @@
 #include <time.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <ldns/ldns.h>
@@ -43,6 +44,7 @@
 #include "utilities.h"
 #include "logging.h"
 #include "proto.h"
+#include "daemon/metrics.h"
 
 const char* names_view_BASE[]    = { "base",    "namerevision", "outdated", NULL };
 const char* names_view_INPUT[]   = { "input",   "nameupcoming", "namehierarchy", NULL };
@@ -91,7 +93,7 @@ changed(names_view_type view, recordset_type record, enum changetype type, recor
     if(target)
         *target = NULL;
     if(*changeptr == NULL) {
-        change = malloc(sizeof(struct names_change_struct));
+        change = names_tablealloc(view->changelog, sizeof(struct names_change_struct));
         *changeptr = change;
         switch(type) {
             case ADD:
@@ -194,6 +196,12 @@ names_amend(names_view_type view, recordset_type record)
     changed(view, record, UPD, NULL);
 }
 
+static int
+names_viewhashed(names_view_type view)
+{
+    return view->zonedata.signconf && *(view->zonedata.signconf) && (*(view->zonedata.signconf))->nsec3params;
+}
+
 void*
 names_place(names_view_type view, const char* name)
 {
@@ -203,7 +211,9 @@ names_place(names_view_type view, const char* name)
     if(content == NULL) {
         newname = (char*)name;
         content = names_recordcreate(&newname);
-        names_recordannotate(content, &view->zonedata);
+        /* hashed denial names are computed in bulk on commit */
+        if(!names_viewhashed(view))
+            names_recordannotate(content, &view->zonedata);
         names_indexinsert(view->indices[0], content, NULL);
         changed(view, content, ADD, NULL);
     }
@@ -229,11 +239,64 @@ names_remove(names_view_type view, recordset_type record)
     changed(view, record, DEL, NULL);
 }
 
+/* from this number of records the secondary indices of a view are filled
+ * concurrently */
+#define NAMES_VIEW_PARALLEL_MIN 10000
+
+struct names_viewfill_struct {
+    names_view_type view;
+    int index;
+};
+
+static void*
+names_viewfillindex(void* arg)
+{
+    struct names_viewfill_struct* fill = arg;
+    names_iterator iter;
+    recordset_type content;
+    for(iter=names_indexiterator(fill->view->indices[0]); names_iterate(&iter, &content); names_advance(&iter, NULL)) {
+        names_indexinsert(fill->view->indices[fill->index], content, NULL);
+    }
+    return NULL;
+}
+
+/* Each secondary index is its own tree and the records are only read, so
+ * the indices can be filled on separate threads. */
+static void
+names_viewfillindices(names_view_type view)
+{
+    int i;
+    struct names_viewfill_struct* fills;
+    pthread_t* threads;
+    int* started;
+    fills = malloc(sizeof(struct names_viewfill_struct) * view->nindices);
+    threads = malloc(sizeof(pthread_t) * view->nindices);
+    started = calloc(view->nindices, sizeof(int));
+    for(i=1; i<view->nindices; i++) {
+        fills[i].view = view;
+        fills[i].index = i;
+        if(i > 1 && !pthread_create(&threads[i], NULL, names_viewfillindex, &fills[i]))
+            started[i] = 1;
+    }
+    for(i=1; i<view->nindices; i++) {
+        if(!started[i])
+            names_viewfillindex(&fills[i]);
+    }
+    for(i=1; i<view->nindices; i++) {
+        if(started[i])
+            pthread_join(threads[i], NULL);
+    }
+    free(started);
+    free(threads);
+    free(fills);
+}
+
 names_view_type
 names_viewcreate(names_view_type base, const char* viewname, const char** keynames)
 {
     names_view_type view;
     int i, nindices;
+    long count;
     names_iterator iter;
     recordset_type content;
     if(base && base->base) {
@@ -266,12 +329,18 @@ names_viewcreate(names_view_type base, const char* viewname, const char** keynam
         names_viewaddsearchfunction2(view, view->indices[0], view->indices[2], names_iteratordenialchainupdates);
     }
     if(base != NULL) {
+        count = 0;
         for(iter=names_indexiterator(base->indices[0]); names_iterate(&iter, &content); names_advance(&iter, NULL)) {
             names_indexinsert(view->indices[0], content, NULL);
+            ++count;
         }
-        for(iter=names_indexiterator(view->indices[0]); names_iterate(&iter, &content); names_advance(&iter, NULL)) {
-            for(i=1; i<nindices; i++) {
-                names_indexinsert(view->indices[i], content, NULL);
+        if(nindices > 2 && count >= NAMES_VIEW_PARALLEL_MIN) {
+            names_viewfillindices(view);
+        } else {
+            for(iter=names_indexiterator(view->indices[0]); names_iterate(&iter, &content); names_advance(&iter, NULL)) {
+                for(i=1; i<nindices; i++) {
+                    names_indexinsert(view->indices[i], content, NULL);
+                }
             }
         }
         view->commitlog = base->commitlog;
@@ -481,6 +550,76 @@ names_iteratordenialchainupdates(names_index_type primary, names_index_type seco
     return result;
 }
 
+/* at most this number of threads compute the NSEC3 hashes of new records */
+#define NAMES_VIEW_HASHTHREADS 16
+
+struct names_viewhash_struct {
+    names_view_type view;
+    recordset_type* records;
+    int nrecords;
+};
+
+static void*
+names_viewhashrecords(void* arg)
+{
+    struct names_viewhash_struct* hash = arg;
+    names_recordannotatehashed(hash->records, hash->nrecords, &hash->view->zonedata);
+    return NULL;
+}
+
+/* Records placed in a view of an NSEC3 signed zone are annotated with
+ * their hashed owner name just before the commit, spread over a number of
+ * threads for large changes such as a zone being read in.
+ */
+static void
+hashchangelog(names_view_type view)
+{
+    names_iterator iter;
+    names_change_type change;
+    recordset_type* records = NULL;
+    int nrecords = 0, maxrecords = 0;
+    struct names_viewhash_struct hashes[NAMES_VIEW_HASHTHREADS];
+    pthread_t threads[NAMES_VIEW_HASHTHREADS];
+    int started[NAMES_VIEW_HASHTHREADS];
+    long nthreads;
+    int i, offset;
+    if(!names_viewhashed(view))
+        return;
+    for(iter=names_tableitems(view->changelog); names_iterate(&iter, &change); names_advance(&iter, NULL)) {
+        if(change->oldrecord == NULL && change->record && names_recordgetdenial(change->record) == NULL) {
+            if(nrecords == maxrecords) {
+                maxrecords = (maxrecords ? maxrecords * 2 : 1024);
+                CHECKALLOC(records = realloc(records, sizeof(recordset_type) * maxrecords));
+            }
+            records[nrecords++] = change->record;
+        }
+    }
+    nthreads = 1;
+    if(nrecords >= NAMES_VIEW_PARALLEL_MIN) {
+        nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+        if(nthreads < 1)
+            nthreads = 1;
+        if(nthreads > NAMES_VIEW_HASHTHREADS)
+            nthreads = NAMES_VIEW_HASHTHREADS;
+    }
+    for(i=0, offset=0; i<nthreads; i++) {
+        hashes[i].view = view;
+        hashes[i].records = &records[offset];
+        hashes[i].nrecords = (nrecords - offset) / (nthreads - i);
+        offset += hashes[i].nrecords;
+        started[i] = (i > 0 && !pthread_create(&threads[i], NULL, names_viewhashrecords, &hashes[i]));
+    }
+    for(i=0; i<nthreads; i++) {
+        if(!started[i])
+            names_viewhashrecords(&hashes[i]);
+    }
+    for(i=0; i<nthreads; i++) {
+        if(started[i])
+            pthread_join(threads[i], NULL);
+    }
+    free(records);
+}
+
 static void
 resetchangelog(names_view_type view)
 {
@@ -562,8 +701,15 @@ int
 names_viewcommit(names_view_type view)
 {
     int conflict;
+    struct timespec started;
+    metrics_clock(&started);
+    hashchangelog(view);
     conflict = updateview(view, &(view->changelog));
-    assert(!conflict);
+    metrics_since(METRICS_VIEW_COMMIT, &started);
+    if (conflict)
+        metrics_count(METRICS_VIEW_CONFLICTS, 1);
+    else
+        metrics_count(METRICS_VIEW_COMMITS, 1);
     return conflict;
 }
 
@@ -584,6 +730,7 @@ persistfn(names_table_type table, marshall_handle store)
             names_recordmarshall(&(change->record), store);
     }
     names_recordmarshall(NULL, store);
+    marshallflush(store);
 }
 
 int
@@ -666,6 +813,7 @@ names_viewpersist(names_view_type view, int basefd, char* filename)
     }
     names_end(&iter);
     names_commitlogpersistfull(view->commitlog, persistfn, view->viewid, marsh, &oldmarsh);
+    marshallflush(marsh);
 
     marshallclose(oldmarsh);
     CHECK(renameat(basefd, tmpfilename, basefd, filename));
@@ -731,6 +879,7 @@ names_dumpviewinfo(FILE* fp, names_view_type view)
             while((rr = ldns_rr_list_pop_rr(rrs))) {
                 serial = ldns_rdf2native_int32(ldns_rr_rdf(rr, 2));
                 fprintf(stderr," %d",(int)serial);
+                ldns_rr_free(rr);
             }
             ldns_rr_list_free(rrs);
         }
@@ -783,13 +932,14 @@ names_viewlookupall(names_view_type view, ldns_rdf* dname, ldns_rr_type type, ld
         *signatures = ldns_rr_list_new();
         names_recordlookupall(record, type, NULL, rrs, &rrsigs);
         for(int i=0; rrsigs[i]; i++) {
-            rrsig = rrsigs[i]->rr;
+            rrsig = names_recordsignature(record, rrsigs[i]);
             ldns_rr_list_push_rr(*signatures, rrsig);
         }
         free(rrsigs);
     } else {
-        *rrs = NULL;
-        *rrsigs = NULL;
+        if(rrs)
+            *rrs = NULL;
+        *signatures = NULL;
     }
     if(name)
         free(name);
@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2011-2018 NLNet Labs.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Precomputed answers for queries at the zone apex.
+ *
+ */
+
+#include "config.h"
+#include <sys/types.h>
+#include <string.h>
+#include "log.h"
+#include "util.h"
+#include "wire/apexcache.h"
+
+static const char* apexcache_str = "apexcache";
+
+
+/**
+ * Encode records in uncompressed wire format.
+ * \return int number of records added, -1 on error
+ *
+ */
+static int
+apex_cache_encode_rrs(ldns_buffer* wire, ldns_rr_list* rrs)
+{
+    size_t i;
+    if (!rrs) {
+        return 0;
+    }
+    for (i = 0; i < ldns_rr_list_rr_count(rrs); i++) {
+        if (ldns_rr2buffer_wire(wire, ldns_rr_list_rr(rrs, i),
+            LDNS_SECTION_ANSWER) != LDNS_STATUS_OK) {
+            return -1;
+        }
+    }
+    return (int) i;
+}
+
+
+/**
+ * Encode signatures in uncompressed wire format.
+ * \return int number of records added, -1 on error
+ *
+ */
+static int
+apex_cache_encode_sigs(ldns_buffer* wire, recordset_type record,
+    struct signature_struct** rrsigs)
+{
+    int i;
+    ldns_rr* rrsig;
+    ldns_status status;
+    if (!rrsigs) {
+        return 0;
+    }
+    for (i = 0; rrsigs[i]; i++) {
+        rrsig = names_recordsignature(record, rrsigs[i]);
+        status = ldns_rr2buffer_wire(wire, rrsig, LDNS_SECTION_ANSWER);
+        ldns_rr_free(rrsig);
+        if (status != LDNS_STATUS_OK) {
+            return -1;
+        }
+    }
+    return i;
+}
+
+
+/**
+ * Encode an rrset with or without its signatures, followed by the
+ * authority rrset if there is one.
+ * \return int 1 on success, 0 if the rrset is not there, -1 on error
+ *
+ */
+static int
+apex_cache_encode(apex_answer_type* answer, ldns_buffer* wire,
+    recordset_type record, ldns_rr_list* rrs, struct signature_struct** rrsigs,
+    ldns_rr_list* nsrrs, struct signature_struct** nsrrsigs, int dnssec_ok)
+{
+    int an, ansigs = 0, ns = 0, nssigs = 0;
+    if (!rrs || ldns_rr_list_rr_count(rrs) == 0) {
+        return 0;
+    }
+    ldns_buffer_clear(wire);
+    an = apex_cache_encode_rrs(wire, rrs);
+    if (dnssec_ok) {
+        ansigs = apex_cache_encode_sigs(wire, record, rrsigs);
+    }
+    ns = apex_cache_encode_rrs(wire, nsrrs);
+    if (dnssec_ok) {
+        nssigs = apex_cache_encode_sigs(wire, record, nsrrsigs);
+    }
+    if (an < 0 || ansigs < 0 || ns < 0 || nssigs < 0 ||
+        an + ansigs > UINT16_MAX || ns + nssigs > UINT16_MAX) {
+        return -1;
+    }
+    answer->len = ldns_buffer_position(wire);
+    CHECKALLOC(answer->wire = (uint8_t*) malloc(answer->len));
+    memcpy(answer->wire, ldns_buffer_begin(wire), answer->len);
+    answer->ancount = (uint16_t) (an + ansigs);
+    answer->nscount = (uint16_t) (ns + nssigs);
+    return 1;
+}
+
+
+/**
+ * Index of the answers for a query type.
+ *
+ */
+int
+apex_cache_index(ldns_rr_type qtype)
+{
+    switch (qtype) {
+        case LDNS_RR_TYPE_SOA:
+            return APEX_CACHE_SOA;
+        case LDNS_RR_TYPE_NS:
+            return APEX_CACHE_NS;
+        case LDNS_RR_TYPE_DNSKEY:
+            return APEX_CACHE_DNSKEY;
+        default:
+            break;
+    }
+    return -1;
+}
+
+
+/**
+ * Build the apex answers and replace the ones of the zone.
+ *
+ */
+ods_status
+apex_cache_update(zone_type* zone, names_view_type view)
+{
+    static const ldns_rr_type types[APEX_CACHE_TYPES] = {
+        LDNS_RR_TYPE_SOA, LDNS_RR_TYPE_NS, LDNS_RR_TYPE_DNSKEY };
+    apex_cache_type* cache = NULL;
+    apex_cache_type* old = NULL;
+    recordset_type record;
+    ldns_buffer* wire = NULL;
+    ldns_rr_list* rrs[APEX_CACHE_TYPES];
+    struct signature_struct** rrsigs[APEX_CACHE_TYPES];
+    ldns_rr* soa = NULL;
+    int i, dnssec_ok, ret = 1;
+    ods_log_assert(zone);
+    ods_log_assert(zone->name);
+
+    record = names_take(view, 0, NULL);
+    if (!record) {
+        return ODS_STATUS_ERR;
+    }
+    CHECKALLOC(cache = (apex_cache_type*) calloc(1, sizeof(apex_cache_type)));
+    CHECKALLOC(wire = ldns_buffer_new(LDNS_MAX_PACKETLEN));
+    for (i = 0; i < APEX_CACHE_TYPES; i++) {
+        names_recordlookupall(record, types[i], NULL, &rrs[i], &rrsigs[i]);
+    }
+    if (rrs[APEX_CACHE_SOA] && ldns_rr_list_rr_count(rrs[APEX_CACHE_SOA])) {
+        soa = ldns_rr_list_rr(rrs[APEX_CACHE_SOA], 0);
+        cache->serial = ldns_rdf2native_int32(ldns_rr_rdf(soa,
+            SE_SOA_RDATA_SERIAL));
+        cache->expire = ldns_rdf2native_int32(ldns_rr_rdf(soa,
+            SE_SOA_RDATA_EXPIRE));
+    }
+    for (dnssec_ok = 0; dnssec_ok < 2 && ret >= 0; dnssec_ok++) {
+        /* the soa is answered on its own, like soa_request() does */
+        ret = apex_cache_encode(&cache->answer[APEX_CACHE_SOA][dnssec_ok],
+            wire, record, rrs[APEX_CACHE_SOA], rrsigs[APEX_CACHE_SOA], NULL, NULL,
+            dnssec_ok);
+        if (ret >= 0) {
+            ret = apex_cache_encode(&cache->answer[APEX_CACHE_NS][dnssec_ok],
+                wire, record, rrs[APEX_CACHE_NS], rrsigs[APEX_CACHE_NS], NULL, NULL,
+                dnssec_ok);
+        }
+        if (ret >= 0) {
+            ret = apex_cache_encode(
+                &cache->answer[APEX_CACHE_DNSKEY][dnssec_ok], wire, record,
+                rrs[APEX_CACHE_DNSKEY], rrsigs[APEX_CACHE_DNSKEY],
+                rrs[APEX_CACHE_NS], rrsigs[APEX_CACHE_NS], dnssec_ok);
+        }
+    }
+    if (ret < 0 || !soa) {
+        ods_log_error("[%s] unable to precompute apex answers for zone %s",
+            apexcache_str, zone->name);
+        apex_cache_cleanup(cache);
+        cache = NULL;
+    }
+    for (i = 0; i < APEX_CACHE_TYPES; i++) {
+        ldns_rr_list_deep_free(rrs[i]);
+        free(rrsigs[i]);
+    }
+    ldns_buffer_free(wire);
+    pthread_mutex_lock(&zone->apex_lock);
+    old = zone->apexcache;
+    zone->apexcache = cache;
+    pthread_mutex_unlock(&zone->apex_lock);
+    apex_cache_cleanup(old);
+    if (!cache) {
+        return ODS_STATUS_ERR;
+    }
+    ods_log_debug("[%s] zone %s apex answers for serial %u", apexcache_str,
+        zone->name, cache->serial);
+    return ODS_STATUS_OK;
+}
+
+
+/**
+ * Clean up apex answers.
+ *
+ */
+void
+apex_cache_cleanup(apex_cache_type* cache)
+{
+    int i;
+    if (!cache) {
+        return;
+    }
+    for (i = 0; i < APEX_CACHE_TYPES; i++) {
+        free(cache->answer[i][0].wire);
+        free(cache->answer[i][1].wire);
+    }
+    free(cache);
+}
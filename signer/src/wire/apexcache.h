@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2011-2018 NLNet Labs.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Precomputed answers for queries at the zone apex.
+ *
+ */
+
+#ifndef WIRE_APEXCACHE_H
+#define WIRE_APEXCACHE_H
+
+#include "config.h"
+#include "signer/zone.h"
+#include "views/proto.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * SOA, NS and DNSKEY queries for the apex are answered from records that
+ * are encoded in uncompressed wire format when the output view of the
+ * zone is written. A response only needs the bytes copied behind the
+ * question section and the section counts set.
+ *
+ */
+#define APEX_CACHE_SOA 0
+#define APEX_CACHE_NS 1
+#define APEX_CACHE_DNSKEY 2
+#define APEX_CACHE_TYPES 3
+
+typedef struct apex_answer_struct apex_answer_type;
+struct apex_answer_struct {
+    /* answer and authority records, NULL if the rrset is not there */
+    uint8_t* wire;
+    size_t len;
+    uint16_t ancount;
+    uint16_t nscount;
+};
+
+typedef struct apex_cache_struct apex_cache_type;
+struct apex_cache_struct {
+    uint32_t serial;
+    uint32_t expire;
+    /* per type, without and with signatures */
+    apex_answer_type answer[APEX_CACHE_TYPES][2];
+};
+
+/**
+ * Build the apex answers from the output view and replace the ones of
+ * the zone.
+ * \param[in] zone zone
+ * \param[in] view output view of the zone
+ * \return ods_status status
+ *
+ */
+ods_status apex_cache_update(zone_type* zone, names_view_type view);
+
+/**
+ * Index of the answers for a query type.
+ * \param[in] qtype query type
+ * \return int index, -1 if the type is not cached
+ *
+ */
+int apex_cache_index(ldns_rr_type qtype);
+
+/**
+ * Clean up apex answers.
+ * \param[in] cache apex answers
+ *
+ */
+void apex_cache_cleanup(apex_cache_type* cache);
+
+#endif /* WIRE_APEXCACHE_H */
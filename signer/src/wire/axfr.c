@@ -33,6 +33,8 @@
 #include "file.h"
 #include "util.h"
 #include "wire/axfr.h"
+#include "wire/axfrimage.h"
+#include "wire/ixfrjournal.h"
 #include "wire/buffer.h"
 #include "wire/edns.h"
 #include "wire/query.h"
@@ -42,6 +44,161 @@
 
 const char* axfr_str = "axfr";
 
+
+/**
+ * Check if data of given length fits in the response.
+ *
+ */
+static int
+axfr_fits(query_type* q, size_t len)
+{
+    return buffer_available(q->buffer, len) &&
+        buffer_position(q->buffer) + len <= q->maxlen - q->reserved_space;
+}
+
+
+/**
+ * Check if zone served from the AXFR image has expired.
+ *
+ */
+static int
+axfr_image_expired(query_type* q)
+{
+    time_t expire;
+    if (!q->zone->xfrd) {
+        return 0;
+    }
+    expire = q->zone->xfrd->serial_xfr_acquired;
+    expire += q->axfr_image->expire;
+    return expire < time_now();
+}
+
+
+/**
+ * Copy records from the AXFR image into the response. Runs are copied as a
+ * whole when they fit, otherwise record by record.
+ * \return 1 if the closing SOA was added, 0 if the response is full,
+ *         -1 if the image is corrupt
+ *
+ */
+static int
+axfr_image_fill(query_type* q, uint16_t* total_added)
+{
+    axfr_image_type* image = q->axfr_image;
+    size_t end, len;
+    uint32_t count;
+    while (q->axfr_run < image->runcount) {
+        end = axfr_image_run_offset(image, q->axfr_run + 1);
+        if (q->axfr_pos == axfr_image_run_offset(image, q->axfr_run) &&
+            end >= q->axfr_pos && axfr_fits(q, end - q->axfr_pos)) {
+            count = axfr_image_run_count(image, q->axfr_run);
+            buffer_write(q->buffer, image->data + q->axfr_pos,
+                end - q->axfr_pos);
+            buffer_pkt_set_ancount(q->buffer,
+                buffer_pkt_ancount(q->buffer) + count);
+            *total_added += count;
+            q->axfr_pos = end;
+            q->axfr_run++;
+            continue;
+        }
+        while (q->axfr_pos < end) {
+            len = axfr_image_rrlen(image->data + q->axfr_pos,
+                end - q->axfr_pos);
+            if (!len) {
+                return -1;
+            }
+            if (!axfr_fits(q, len)) {
+                return 0;
+            }
+            buffer_write(q->buffer, image->data + q->axfr_pos, len);
+            buffer_pkt_set_ancount(q->buffer, buffer_pkt_ancount(q->buffer)+1);
+            (*total_added)++;
+            q->axfr_pos += len;
+        }
+        q->axfr_run++;
+    }
+    if (!axfr_fits(q, image->soalen)) {
+        return 0;
+    }
+    buffer_write(q->buffer, image->soa, image->soalen);
+    buffer_pkt_set_ancount(q->buffer, buffer_pkt_ancount(q->buffer)+1);
+    (*total_added)++;
+    return 1;
+}
+
+
+/**
+ * Copy the differences from the IXFR journal into the response, followed
+ * by the closing SOA.
+ * \return 1 if the closing SOA was added, 0 if the response is full,
+ *         -1 if the journal is corrupt
+ *
+ */
+static int
+ixfr_journal_fill(query_type* q, uint16_t* total_added)
+{
+    ixfr_journal_type* journal = q->ixfr_journal;
+    const uint8_t* data = journal->map;
+    size_t len;
+    while (q->axfr_pos < journal->end) {
+        len = axfr_image_rrlen(data + q->axfr_pos,
+            journal->end - q->axfr_pos);
+        if (!len) {
+            return -1;
+        }
+        if (!axfr_fits(q, len)) {
+            return 0;
+        }
+        buffer_write(q->buffer, data + q->axfr_pos, len);
+        buffer_pkt_set_ancount(q->buffer, buffer_pkt_ancount(q->buffer)+1);
+        (*total_added)++;
+        q->axfr_pos += len;
+    }
+    if (journal->start == journal->end) {
+        /* requestor is up to date, the SOA is the whole answer */
+        return 1;
+    }
+    if (!axfr_fits(q, journal->soalen)) {
+        return 0;
+    }
+    buffer_write(q->buffer, journal->soa, journal->soalen);
+    buffer_pkt_set_ancount(q->buffer, buffer_pkt_ancount(q->buffer)+1);
+    (*total_added)++;
+    return 1;
+}
+
+
+/**
+ * Handle SOA request from the AXFR image.
+ *
+ */
+static query_state
+soa_request_image(query_type* q)
+{
+    if (axfr_image_expired(q)) {
+        ods_log_warning("[%s] zone %s expired, not serving soa", axfr_str,
+            q->zone->name);
+        buffer_pkt_set_rcode(q->buffer, LDNS_RCODE_SERVFAIL);
+        return QUERY_PROCESSED;
+    }
+    if (!axfr_fits(q, q->axfr_image->soalen)) {
+        ods_log_error("[%s] soa does not fit in response %s",
+            axfr_str, q->zone->name);
+        buffer_pkt_set_rcode(q->buffer, LDNS_RCODE_SERVFAIL);
+        return QUERY_PROCESSED;
+    }
+    buffer_write(q->buffer, q->axfr_image->soa, q->axfr_image->soalen);
+    buffer_pkt_set_ancount(q->buffer, 1);
+    buffer_pkt_set_nscount(q->buffer, 0);
+    buffer_pkt_set_arcount(q->buffer, 0);
+    buffer_pkt_set_aa(q->buffer);
+    /* check if it needs TSIG signatures */
+    if (q->tsig_rr->status == TSIG_OK) {
+        q->tsig_sign_it = 1;
+    }
+    return QUERY_PROCESSED;
+}
+
 /**
  * Handle SOA request.
  *
@@ -64,6 +221,13 @@ soa_request(query_type* q, engine_type* engine)
     ods_log_assert(q->zone);
     ods_log_assert(q->zone->name);
     ods_log_assert(engine);
+    q->axfr_image = axfr_image_open(q->zone->name);
+    if (q->axfr_image) {
+        query_state state = soa_request_image(q);
+        axfr_image_close(q->axfr_image);
+        q->axfr_image = NULL;
+        return state;
+    }
     xfrfile = ods_build_path(q->zone->name, ".axfr", 0, 1);
     if (xfrfile) {
         fd = ods_fopen(xfrfile, NULL, "r");
@@ -159,6 +323,7 @@ axfr(query_type* q, engine_type* engine, int fallback)
     unsigned l = 0;
     long fpos = 0;
     size_t bufpos = 0;
+    int filled;
     ods_log_assert(q);
     ods_log_assert(q->buffer);
     ods_log_assert(q->zone);
@@ -183,7 +348,35 @@ axfr(query_type* q, engine_type* engine, int fallback)
         }
     }
     ods_log_assert(q->tsig_rr);
-    if (q->axfr_fd == NULL) {
+    if (q->axfr_fd == NULL && q->axfr_image == NULL &&
+        (q->axfr_image = axfr_image_open(q->zone->name)) != NULL) {
+        /* start AXFR from image */
+        if (q->tsig_rr->status == TSIG_OK) {
+            q->tsig_sign_it = 1; /* sign first packet in stream */
+        }
+        if (axfr_image_expired(q)) {
+            ods_log_warning("[%s] zone %s expired, not transferring zone",
+                axfr_str, q->zone->name);
+            buffer_pkt_set_rcode(q->buffer, LDNS_RCODE_SERVFAIL);
+            axfr_image_close(q->axfr_image);
+            q->axfr_image = NULL;
+            return QUERY_PROCESSED;
+        }
+        if (!axfr_fits(q, q->axfr_image->soalen)) {
+            ods_log_error("[%s] soa does not fit in axfr zone %s",
+                axfr_str, q->zone->name);
+            buffer_pkt_set_rcode(q->buffer, LDNS_RCODE_SERVFAIL);
+            axfr_image_close(q->axfr_image);
+            q->axfr_image = NULL;
+            return QUERY_PROCESSED;
+        }
+        buffer_write(q->buffer, q->axfr_image->soa, q->axfr_image->soalen);
+        buffer_pkt_set_ancount(q->buffer, buffer_pkt_ancount(q->buffer)+1);
+        total_added++;
+        bufpos = buffer_position(q->buffer);
+        q->axfr_run = 0;
+        q->axfr_pos = 0;
+    } else if (q->axfr_fd == NULL && q->axfr_image == NULL) {
         /* start AXFR */
         q->axfr_fd = getxfr(q->zone, ".axfr", NULL);
         if (!q->axfr_fd) {
@@ -269,6 +462,26 @@ axfr(query_type* q, engine_type* engine, int fallback)
         buffer_pkt_set_qdcount(q->buffer, 0);
         query_prepare(q);
     }
+    if (q->axfr_image) {
+        /* add as many records as fit */
+        filled = axfr_image_fill(q, &total_added);
+        if (filled < 0) {
+            ods_log_error("[%s] bad axfr image zone %s, corrupted file",
+                axfr_str, q->zone->name);
+            buffer_pkt_set_rcode(q->buffer, LDNS_RCODE_SERVFAIL);
+            axfr_image_close(q->axfr_image);
+            q->axfr_image = NULL;
+            return QUERY_PROCESSED;
+        } else if (!filled) {
+            if (q->tcp) {
+                goto return_axfr;
+            }
+            goto udp_overflow;
+        }
+        axfr_image_close(q->axfr_image);
+        q->axfr_image = NULL;
+        goto axfr_done;
+    }
     /* add as many records as fit */
     fpos = ftell(q->axfr_fd);
     if (fpos < 0) {
@@ -328,6 +541,7 @@ axfr(query_type* q, engine_type* engine, int fallback)
             }
         }
     }
+axfr_done:
     ods_log_debug("[%s] axfr zone %s is done", axfr_str, q->zone->name);
     q->tsig_sign_it = 1; /* sign last packet */
     q->axfr_is_done = 1;
@@ -393,6 +607,7 @@ ixfr(query_type* q, engine_type* engine)
     uint32_t new_serial = 0;
     unsigned del_mode = 0;
     unsigned soa_found = 0;
+    int filled;
     ods_log_assert(engine);
     ods_log_assert(q);
     ods_log_assert(q->buffer);
@@ -412,7 +627,42 @@ ixfr(query_type* q, engine_type* engine)
         q->tsig_sign_it = 0;
     }
     ods_log_assert(q->tsig_rr);
-    if (q->axfr_fd == NULL) {
+    if (q->axfr_fd == NULL && q->ixfr_journal == NULL &&
+        (q->ixfr_journal = ixfr_journal_open(q->zone->name, q->serial))
+        != NULL) {
+        /* start IXFR from journal */
+        if (q->tsig_rr->status == TSIG_OK) {
+            q->tsig_sign_it = 1; /* sign first packet in stream */
+        }
+        /* zone not expired? */
+        if (q->zone->xfrd) {
+            expire = q->zone->xfrd->serial_xfr_acquired;
+            expire += q->ixfr_journal->expire;
+            if (expire < time_now()) {
+                ods_log_warning("[%s] zone %s expired, not transferring zone",
+                    axfr_str, q->zone->name);
+                buffer_pkt_set_rcode(q->buffer, LDNS_RCODE_SERVFAIL);
+                ixfr_journal_close(q->ixfr_journal);
+                q->ixfr_journal = NULL;
+                return QUERY_PROCESSED;
+            }
+        }
+        buffer_set_position(q->buffer, q->startpos);
+        if (!axfr_fits(q, q->ixfr_journal->soalen)) {
+            ods_log_error("[%s] soa does not fit in ixfr zone %s",
+                axfr_str, q->zone->name);
+            buffer_pkt_set_rcode(q->buffer, LDNS_RCODE_SERVFAIL);
+            ixfr_journal_close(q->ixfr_journal);
+            q->ixfr_journal = NULL;
+            return QUERY_PROCESSED;
+        }
+        buffer_write(q->buffer, q->ixfr_journal->soa,
+            q->ixfr_journal->soalen);
+        buffer_pkt_set_ancount(q->buffer, buffer_pkt_ancount(q->buffer)+1);
+        total_added++;
+        bufpos = buffer_position(q->buffer);
+        q->axfr_pos = q->ixfr_journal->start;
+    } else if (q->axfr_fd == NULL && q->ixfr_journal == NULL) {
         /* start IXFR */
         q->axfr_fd = getxfr(q->zone, ".ixfr", &q->zone->xfrd->serial_xfr_acquired);
         if (!q->axfr_fd) {
@@ -504,6 +754,23 @@ ixfr(query_type* q, engine_type* engine)
         query_prepare(q);
         soa_found = 1;
     }
+    if (q->ixfr_journal) {
+        /* add as many records as fit */
+        filled = ixfr_journal_fill(q, &total_added);
+        if (filled < 0) {
+            ods_log_error("[%s] bad ixfr journal zone %s, corrupted file",
+                axfr_str, q->zone->name);
+            goto axfr_fallback;
+        } else if (!filled) {
+            if (q->tcp) {
+                goto return_ixfr;
+            }
+            goto axfr_fallback;
+        }
+        ixfr_journal_close(q->ixfr_journal);
+        q->ixfr_journal = NULL;
+        goto ixfr_done;
+    }
 
     /* add as many records as fit */
     fpos = ftell(q->axfr_fd);
@@ -582,6 +849,7 @@ ixfr(query_type* q, engine_type* engine)
             axfr_str, q->zone->name, q->serial);
         goto axfr_fallback;
     }
+ixfr_done:
     ods_log_debug("[%s] ixfr zone %s is done", axfr_str, q->zone->name);
     q->tsig_sign_it = 1; /* sign last packet */
     q->axfr_is_done = 1;
@@ -609,6 +877,8 @@ axfr_fallback:
             ods_fclose(q->axfr_fd);
             q->axfr_fd = NULL;
         }
+        ixfr_journal_close(q->ixfr_journal);
+        q->ixfr_journal = NULL;
         buffer_set_position(q->buffer, q->startpos);
         return axfr(q, engine, 1);
     }
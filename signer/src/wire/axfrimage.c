@@ -0,0 +1,425 @@
+/*
+ * Copyright (c) 2011-2018 NLNet Labs.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include "file.h"
+#include "log.h"
+#include "util.h"
+#include "wire/axfr.h"
+#include "wire/axfrimage.h"
+#include "wire/buffer.h"
+
+#define AXFR_IMAGE_MAGIC "ODSAXFR1"
+#define AXFR_IMAGE_MAGIC_SIZE 8
+/* room for header, question, EDNS and TSIG in a packet */
+#define AXFR_IMAGE_RESERVED 1024
+#define AXFR_IMAGE_RUN_MAX (AXFR_MAX_MESSAGE_LEN - AXFR_IMAGE_RESERVED)
+
+static const char* axfrimage_str = "axfr";
+
+/**
+ * State while writing an image.
+ *
+ */
+typedef struct axfr_image_writer_struct axfr_image_writer_type;
+struct axfr_image_writer_struct {
+    FILE* fd;
+    ldns_buffer* wire;
+    uint8_t* index;
+    uint32_t runcount;
+    uint32_t rrcount;
+    uint32_t runrrs;
+    size_t runstart;
+    size_t runsize;
+    size_t datalen;
+    int error;
+};
+
+
+/**
+ * Close the current run and add it to the index.
+ *
+ */
+static void
+axfr_image_end_run(axfr_image_writer_type* w)
+{
+    uint8_t* index;
+    if (w->runrrs == 0) {
+        return;
+    }
+    index = realloc(w->index, (w->runcount + 1) * AXFR_IMAGE_INDEX_SIZE);
+    if (!index) {
+        w->error = 1;
+        return;
+    }
+    w->index = index;
+    index += w->runcount * AXFR_IMAGE_INDEX_SIZE;
+    write_uint32(index, (uint32_t) w->runstart);
+    write_uint32(index + 4, w->runrrs);
+    w->runcount++;
+    w->runrrs = 0;
+    w->runsize = 0;
+}
+
+
+/**
+ * Add a record to the data section, copied from the stored wire format.
+ * \return int 1 if the record was added, 0 if there are no more records
+ *
+ */
+static int
+axfr_image_add_rr(axfr_image_writer_type* w, recordset_type record,
+    ldns_rr_type rrtype, int index)
+{
+    size_t len;
+    int ret;
+    if (w->error) {
+        return 0;
+    }
+    ldns_buffer_clear(w->wire);
+    ret = names_recordwire(record, rrtype, index, w->wire);
+    if (ret <= 0) {
+        w->error = (ret < 0);
+        return 0;
+    }
+    len = ldns_buffer_position(w->wire);
+    if (w->runsize > 0 && w->runsize + len > AXFR_IMAGE_RUN_MAX) {
+        axfr_image_end_run(w);
+    }
+    if (w->datalen + len > UINT32_MAX ||
+        fwrite(ldns_buffer_begin(w->wire), len, 1, w->fd) != 1) {
+        w->error = 1;
+        return 0;
+    }
+    if (w->runrrs == 0) {
+        w->runstart = w->datalen;
+    }
+    w->datalen += len;
+    w->runsize += len;
+    w->runrrs++;
+    w->rrcount++;
+    return 1;
+}
+
+
+/**
+ * Add the records of a domain, in the same order as the zone file.
+ *
+ */
+static void
+axfr_image_add_record(axfr_image_writer_type* w, recordset_type record)
+{
+    int i;
+    ldns_rr_type rrtype;
+    names_iterator typeiter;
+    for (typeiter = names_recordalltypes(record); names_iterate(&typeiter, &rrtype); names_advance(&typeiter, NULL)) {
+        /* the soa itself opens and closes the transfer */
+        i = (rrtype == LDNS_RR_TYPE_SOA ? 1 : 0);
+        while (axfr_image_add_rr(w, record, rrtype, i)) {
+            i++;
+        }
+    }
+    i = 0;
+    while (axfr_image_add_rr(w, record, LDNS_RR_TYPE_NSEC, i)) {
+        i++;
+    }
+}
+
+
+/**
+ * Write AXFR image of a zone.
+ *
+ */
+ods_status
+axfr_image_write(zone_type* zone, names_view_type view)
+{
+    axfr_image_writer_type w;
+    uint8_t header[AXFR_IMAGE_HEADER_SIZE];
+    recordset_type record;
+    names_iterator iter;
+    ldns_rr* soa = NULL;
+    char* filename;
+    char* tmpname;
+    size_t soalen;
+    ods_log_assert(zone);
+    ods_log_assert(zone->name);
+
+    record = names_take(view, 0, NULL);
+    if (record) {
+        names_recordlookupone(record, LDNS_RR_TYPE_SOA, NULL, &soa);
+    }
+    if (!soa) {
+        ods_log_error("[%s] unable to write axfr image for zone %s: no soa",
+            axfrimage_str, zone->name);
+        return ODS_STATUS_ERR;
+    }
+    filename = ods_build_path(zone->name, ".axfr.img", 0, 1);
+    tmpname = ods_build_path(zone->name, ".axfr.img.tmp", 0, 1);
+    memset(&w, 0, sizeof(w));
+    w.wire = ldns_buffer_new(LDNS_MAX_PACKETLEN);
+    w.fd = (filename && tmpname) ? ods_fopen(tmpname, NULL, "w") : NULL;
+    if (!w.fd || !w.wire) {
+        ods_log_error("[%s] unable to write axfr image for zone %s: cannot "
+            "open %s", axfrimage_str, zone->name, tmpname);
+        goto error;
+    }
+    /* header is written when all sizes are known */
+    memset(header, 0, sizeof(header));
+    if (fwrite(header, sizeof(header), 1, w.fd) != 1 ||
+        ldns_rr2buffer_wire(w.wire, soa, LDNS_SECTION_ANSWER) != LDNS_STATUS_OK ||
+        fwrite(ldns_buffer_begin(w.wire), ldns_buffer_position(w.wire), 1, w.fd) != 1) {
+        goto write_error;
+    }
+    soalen = ldns_buffer_position(w.wire);
+    /* the first packet also carries the opening SOA */
+    w.runsize = soalen;
+    for (iter = names_viewiterator(view, NULL); names_iterate(&iter, &record); names_advance(&iter, NULL)) {
+        axfr_image_add_record(&w, record);
+    }
+    axfr_image_end_run(&w);
+    if (w.error ||
+        fwrite(w.index, AXFR_IMAGE_INDEX_SIZE, w.runcount, w.fd) != w.runcount) {
+        goto write_error;
+    }
+    memcpy(header, AXFR_IMAGE_MAGIC, AXFR_IMAGE_MAGIC_SIZE);
+    write_uint32(header + 8, ldns_rdf2native_int32(ldns_rr_rdf(soa, SE_SOA_RDATA_SERIAL)));
+    write_uint32(header + 12, ldns_rdf2native_int32(ldns_rr_rdf(soa, SE_SOA_RDATA_EXPIRE)));
+    write_uint32(header + 16, (uint32_t) soalen);
+    write_uint32(header + 20, (uint32_t) w.datalen);
+    write_uint32(header + 24, w.rrcount);
+    write_uint32(header + 28, w.runcount);
+    if (fseek(w.fd, 0, SEEK_SET) != 0 ||
+        fwrite(header, sizeof(header), 1, w.fd) != 1 ||
+        fflush(w.fd) != 0 || fsync(fileno(w.fd)) != 0) {
+        goto write_error;
+    }
+    ods_fclose(w.fd);
+    w.fd = NULL;
+    if (rename(tmpname, filename) != 0) {
+        ods_log_error("[%s] unable to write axfr image for zone %s: rename "
+            "failed (%s)", axfrimage_str, zone->name, strerror(errno));
+        goto error;
+    }
+    ods_log_debug("[%s] wrote axfr image for zone %s: %u rrs in %u runs",
+        axfrimage_str, zone->name, w.rrcount, w.runcount);
+    ldns_rr_free(soa);
+    ldns_buffer_free(w.wire);
+    free(w.index);
+    free(filename);
+    free(tmpname);
+    return ODS_STATUS_OK;
+
+write_error:
+    ods_log_error("[%s] unable to write axfr image for zone %s to %s",
+        axfrimage_str, zone->name, tmpname);
+error:
+    if (w.fd) {
+        ods_fclose(w.fd);
+    }
+    if (tmpname) {
+        (void) unlink(tmpname);
+    }
+    if (w.wire) {
+        ldns_buffer_free(w.wire);
+    }
+    ldns_rr_free(soa);
+    free(w.index);
+    free(filename);
+    free(tmpname);
+    return ODS_STATUS_ERR;
+}
+
+
+/**
+ * Walk all records of an image and check them against the runs and the
+ * record count in the header, so a torn or truncated image is never
+ * served.
+ *
+ */
+static int
+axfr_image_check(axfr_image_type* image)
+{
+    size_t pos = 0, end, len;
+    uint32_t run, count, total = 0;
+    if (axfr_image_rrlen(image->soa, image->soalen) != image->soalen) {
+        return 0;
+    }
+    for (run = 0; run < image->runcount; run++) {
+        if (read_uint32(image->index + run * AXFR_IMAGE_INDEX_SIZE) != pos) {
+            return 0;
+        }
+        end = axfr_image_run_offset(image, run + 1);
+        for (count = 0; pos < end; count++) {
+            len = axfr_image_rrlen(image->data + pos, end - pos);
+            if (!len) {
+                return 0;
+            }
+            pos += len;
+        }
+        if (count == 0 || count != axfr_image_run_count(image, run)) {
+            return 0;
+        }
+        total += count;
+    }
+    return pos == image->datalen && total == image->rrcount;
+}
+
+
+/**
+ * Map AXFR image of a zone.
+ *
+ */
+axfr_image_type*
+axfr_image_open(const char* zonename)
+{
+    axfr_image_type* image;
+    struct stat st;
+    char* filename;
+    uint8_t* map;
+    int fd;
+
+    filename = ods_build_path(zonename, ".axfr.img", 0, 1);
+    if (!filename) {
+        return NULL;
+    }
+    fd = open(filename, O_RDONLY);
+    free(filename);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size < AXFR_IMAGE_HEADER_SIZE) {
+        close(fd);
+        return NULL;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    CHECKALLOC(image = (axfr_image_type*) malloc(sizeof(axfr_image_type)));
+    image->map = map;
+    image->size = st.st_size;
+    image->serial = read_uint32(map + 8);
+    image->expire = read_uint32(map + 12);
+    image->soalen = read_uint32(map + 16);
+    image->datalen = read_uint32(map + 20);
+    image->rrcount = read_uint32(map + 24);
+    image->runcount = read_uint32(map + 28);
+    image->soa = map + AXFR_IMAGE_HEADER_SIZE;
+    image->data = image->soa + image->soalen;
+    image->index = image->data + image->datalen;
+    if (memcmp(map, AXFR_IMAGE_MAGIC, AXFR_IMAGE_MAGIC_SIZE) != 0 ||
+        image->soalen == 0 ||
+        AXFR_IMAGE_HEADER_SIZE + image->soalen + image->datalen +
+        (size_t) image->runcount * AXFR_IMAGE_INDEX_SIZE != image->size ||
+        !axfr_image_check(image)) {
+        ods_log_error("[%s] axfr image for zone %s is corrupt, ignoring",
+            axfrimage_str, zonename);
+        axfr_image_close(image);
+        return NULL;
+    }
+    return image;
+}
+
+
+/**
+ * Offset in data of a run.
+ *
+ */
+size_t
+axfr_image_run_offset(axfr_image_type* image, uint32_t run)
+{
+    size_t offset;
+    if (run >= image->runcount) {
+        return image->datalen;
+    }
+    offset = read_uint32(image->index + run * AXFR_IMAGE_INDEX_SIZE);
+    return offset < image->datalen ? offset : image->datalen;
+}
+
+
+/**
+ * Number of records in a run.
+ *
+ */
+uint32_t
+axfr_image_run_count(axfr_image_type* image, uint32_t run)
+{
+    if (run >= image->runcount) {
+        return 0;
+    }
+    return read_uint32(image->index + run * AXFR_IMAGE_INDEX_SIZE + 4);
+}
+
+
+/**
+ * Length of the record in wire format at the start of data. Records of
+ * type or class 0 are rejected, zeroed data would otherwise parse as a
+ * record at the root.
+ *
+ */
+size_t
+axfr_image_rrlen(const uint8_t* wire, size_t avail)
+{
+    size_t pos = 0;
+    while (pos < avail && wire[pos] != 0) {
+        if (wire[pos] & 0xc0) {
+            /* image is never compressed */
+            return 0;
+        }
+        pos += wire[pos] + 1;
+    }
+    /* root label, type, class, ttl and rdlength */
+    pos += 1 + 10;
+    if (pos > avail || read_uint16(wire + pos - 10) == 0 ||
+        read_uint16(wire + pos - 8) == 0) {
+        return 0;
+    }
+    pos += read_uint16(wire + pos - 2);
+    return pos > avail ? 0 : pos;
+}
+
+
+/**
+ * Unmap AXFR image.
+ *
+ */
+void
+axfr_image_close(axfr_image_type* image)
+{
+    if (!image) {
+        return;
+    }
+    (void) munmap(image->map, image->size);
+    free(image);
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2011-2018 NLNet Labs.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Precompiled AXFR image.
+ *
+ */
+
+#ifndef WIRE_AXFRIMAGE_H
+#define WIRE_AXFRIMAGE_H
+
+#include "config.h"
+#include "status.h"
+#include "signer/zone.h"
+#include "views/proto.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * The AXFR image is the signed zone in uncompressed wire format as it is
+ * sent in a zone transfer, written by the DNS output adapter next to the
+ * zone in the working directory (<zone>.axfr.img). Layout, all numbers in
+ * network byte order:
+ *
+ *   header   magic, serial, expire, soa length, data length, rr count
+ *            and run count (AXFR_IMAGE_HEADER_SIZE bytes)
+ *   soa      the apex SOA record
+ *   data     all other records in transfer order
+ *   index    per run the offset in data and the number of records
+ *
+ * A run is a sequence of records that fits in one AXFR packet, so a
+ * transfer can copy a run into the packet as is.
+ *
+ */
+#define AXFR_IMAGE_HEADER_SIZE 32
+#define AXFR_IMAGE_INDEX_SIZE 8
+
+typedef struct axfr_image_struct axfr_image_type;
+struct axfr_image_struct {
+    void* map;
+    size_t size;
+    uint32_t serial;
+    uint32_t expire;
+    uint32_t rrcount;
+    uint32_t runcount;
+    const uint8_t* soa;
+    size_t soalen;
+    const uint8_t* data;
+    size_t datalen;
+    const uint8_t* index;
+};
+
+/**
+ * Write AXFR image of a zone.
+ * \param[in] zone zone
+ * \param[in] view output view of the zone
+ * \return ods_status status
+ *
+ */
+ods_status axfr_image_write(zone_type* zone, names_view_type view);
+
+/**
+ * Map AXFR image of a zone.
+ * \param[in] zonename zone name
+ * \return axfr_image_type* image, NULL if not available or corrupt
+ *
+ */
+axfr_image_type* axfr_image_open(const char* zonename);
+
+/**
+ * Offset in data of a run.
+ * \param[in] image AXFR image
+ * \param[in] run run number
+ * \return size_t offset of the first record of the run
+ *
+ */
+size_t axfr_image_run_offset(axfr_image_type* image, uint32_t run);
+
+/**
+ * Number of records in a run.
+ * \param[in] image AXFR image
+ * \param[in] run run number
+ * \return uint32_t number of records
+ *
+ */
+uint32_t axfr_image_run_count(axfr_image_type* image, uint32_t run);
+
+/**
+ * Length of the record in wire format at the start of data.
+ * \param[in] wire record in uncompressed wire format
+ * \param[in] avail number of bytes available
+ * \return size_t length of the record, 0 if malformed
+ *
+ */
+size_t axfr_image_rrlen(const uint8_t* wire, size_t avail);
+
+/**
+ * Unmap AXFR image.
+ * \param[in] image AXFR image
+ *
+ */
+void axfr_image_close(axfr_image_type* image);
+
+#endif /* WIRE_AXFRIMAGE_H */
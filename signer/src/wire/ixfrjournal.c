@@ -0,0 +1,713 @@
+/*
+ * Copyright (c) 2011-2018 NLNet Labs.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Binary IXFR journal.
+ *
+ */
+
+#include "config.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "duration.h"
+#include "file.h"
+#include "log.h"
+#include "util.h"
+#include "signer/zonelist.h"
+#include "wire/buffer.h"
+#include "wire/ixfrjournal.h"
+
+#define IXFR_JOURNAL_MAGIC "ODSIXFRJ"
+#define IXFR_INDEX_MAGIC "ODSIXFRI"
+#define IXFR_JOURNAL_MAGIC_SIZE 8
+
+static const char* ixfrjournal_str = "ixfr";
+
+/**
+ * Index record of a journal entry.
+ *
+ */
+typedef struct ixfr_journal_entry_struct ixfr_journal_entry_type;
+struct ixfr_journal_entry_struct {
+    uint32_t from;
+    uint32_t to;
+    uint32_t offset;
+    uint32_t length;
+    uint32_t soaoffset;
+    uint32_t soalen;
+    uint32_t expire;
+};
+
+/**
+ * Index of a journal.
+ *
+ */
+typedef struct ixfr_journal_index_struct ixfr_journal_index_type;
+struct ixfr_journal_index_struct {
+    uint32_t generation;
+    uint32_t base;
+    uint32_t count;
+    ixfr_journal_entry_type* entries;
+};
+
+
+/**
+ * Write all data at offset.
+ *
+ */
+static int
+ixfr_journal_pwrite(int fd, const uint8_t* data, size_t len, off_t offset)
+{
+    ssize_t ret;
+    while (len > 0) {
+        ret = pwrite(fd, data, len, offset);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += ret;
+        len -= ret;
+        offset += ret;
+    }
+    return 0;
+}
+
+
+/**
+ * Read all data at offset.
+ *
+ */
+static int
+ixfr_journal_pread(int fd, uint8_t* data, size_t len, off_t offset)
+{
+    ssize_t ret;
+    while (len > 0) {
+        ret = pread(fd, data, len, offset);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        } else if (ret <= 0) {
+            return -1;
+        }
+        data += ret;
+        len -= ret;
+        offset += ret;
+    }
+    return 0;
+}
+
+
+/**
+ * Fill file header.
+ *
+ */
+static void
+ixfr_journal_header(uint8_t* header, const char* magic, uint32_t generation,
+    uint32_t base)
+{
+    memcpy(header, magic, IXFR_JOURNAL_MAGIC_SIZE);
+    write_uint32(header + 8, generation);
+    write_uint32(header + 12, base);
+}
+
+
+/**
+ * Encode index record.
+ *
+ */
+static void
+ixfr_journal_encode(uint8_t* p, ixfr_journal_entry_type* entry)
+{
+    write_uint32(p, entry->from);
+    write_uint32(p + 4, entry->to);
+    write_uint32(p + 8, entry->offset);
+    write_uint32(p + 12, entry->length);
+    write_uint32(p + 16, entry->soaoffset);
+    write_uint32(p + 20, entry->soalen);
+    write_uint32(p + 24, entry->expire);
+}
+
+
+/**
+ * Decode index record.
+ *
+ */
+static void
+ixfr_journal_decode(const uint8_t* p, ixfr_journal_entry_type* entry)
+{
+    entry->from = read_uint32(p);
+    entry->to = read_uint32(p + 4);
+    entry->offset = read_uint32(p + 8);
+    entry->length = read_uint32(p + 12);
+    entry->soaoffset = read_uint32(p + 16);
+    entry->soalen = read_uint32(p + 20);
+    entry->expire = read_uint32(p + 24);
+}
+
+
+/**
+ * Read index of a journal. A partially written last record is ignored.
+ *
+ */
+static int
+ixfr_journal_read_index(const char* zonename, ixfr_journal_index_type* index)
+{
+    struct stat st;
+    char* filename;
+    uint8_t* data;
+    uint32_t i;
+    int fd;
+
+    memset(index, 0, sizeof(ixfr_journal_index_type));
+    filename = ods_build_path(zonename, ".ixfr.idx", 0, 1);
+    if (!filename) {
+        return -1;
+    }
+    fd = open(filename, O_RDONLY);
+    free(filename);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size < IXFR_JOURNAL_HEADER_SIZE) {
+        close(fd);
+        return -1;
+    }
+    CHECKALLOC(data = (uint8_t*) malloc(st.st_size));
+    if (ixfr_journal_pread(fd, data, st.st_size, 0) != 0 ||
+        memcmp(data, IXFR_INDEX_MAGIC, IXFR_JOURNAL_MAGIC_SIZE) != 0) {
+        free(data);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    index->generation = read_uint32(data + 8);
+    index->base = read_uint32(data + 12);
+    index->count = (st.st_size - IXFR_JOURNAL_HEADER_SIZE) /
+        IXFR_JOURNAL_INDEX_SIZE;
+    CHECKALLOC(index->entries = (ixfr_journal_entry_type*)
+        calloc(index->count + 1, sizeof(ixfr_journal_entry_type)));
+    for (i = 0; i < index->count; i++) {
+        ixfr_journal_decode(data + IXFR_JOURNAL_HEADER_SIZE +
+            i * IXFR_JOURNAL_INDEX_SIZE, &index->entries[i]);
+    }
+    free(data);
+    return 0;
+}
+
+
+/**
+ * Replace a file with the given content. The content is written to a
+ * temporary file that is renamed over the old one once it is on disk, so
+ * readers either see the old or the new file, and those that have the old
+ * one open or mapped keep its content.
+ *
+ */
+static int
+ixfr_journal_replace(const char* zonename, const char* suffix,
+    const uint8_t* header, const uint8_t* data, size_t len)
+{
+    char* filename;
+    char* tmpname;
+    char* tmpsuffix;
+    int fd = -1;
+    int ret = -1;
+
+    CHECKALLOC(tmpsuffix = (char*) malloc(strlen(suffix) + 5));
+    strcpy(tmpsuffix, suffix);
+    strcat(tmpsuffix, ".tmp");
+    filename = ods_build_path(zonename, suffix, 0, 1);
+    tmpname = ods_build_path(zonename, tmpsuffix, 0, 1);
+    if (filename && tmpname) {
+        fd = open(tmpname, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    }
+    if (fd >= 0) {
+        if (ixfr_journal_pwrite(fd, header, IXFR_JOURNAL_HEADER_SIZE, 0) == 0 &&
+            ixfr_journal_pwrite(fd, data, len, IXFR_JOURNAL_HEADER_SIZE) == 0 &&
+            fsync(fd) == 0 && close(fd) == 0) {
+            ret = rename(tmpname, filename);
+        } else {
+            close(fd);
+        }
+        if (ret != 0) {
+            (void) unlink(tmpname);
+        }
+    }
+    if (ret != 0) {
+        ods_log_error("[%s] unable to write %s for zone %s (%s)",
+            ixfrjournal_str, suffix, zonename, strerror(errno));
+    }
+    free(tmpsuffix);
+    free(filename);
+    free(tmpname);
+    return ret;
+}
+
+
+/**
+ * Write index of a journal.
+ *
+ */
+static int
+ixfr_journal_write_index(const char* zonename, ixfr_journal_index_type* index)
+{
+    uint8_t header[IXFR_JOURNAL_HEADER_SIZE];
+    uint8_t* data;
+    uint32_t i;
+    int ret;
+
+    ixfr_journal_header(header, IXFR_INDEX_MAGIC, index->generation,
+        index->base);
+    CHECKALLOC(data = (uint8_t*) malloc(
+        (index->count + 1) * IXFR_JOURNAL_INDEX_SIZE));
+    for (i = 0; i < index->count; i++) {
+        ixfr_journal_encode(data + i * IXFR_JOURNAL_INDEX_SIZE,
+            &index->entries[i]);
+    }
+    ret = ixfr_journal_replace(zonename, ".ixfr.idx", header, data,
+        index->count * IXFR_JOURNAL_INDEX_SIZE);
+    free(data);
+    return ret;
+}
+
+
+/**
+ * Start a new, empty journal at serial. The journal is replaced before its
+ * index, readers that see an old index with the new journal notice the
+ * generation mismatch.
+ *
+ */
+static ods_status
+ixfr_journal_reset(const char* zonename, uint32_t generation, uint32_t serial)
+{
+    ixfr_journal_index_type index;
+    uint8_t header[IXFR_JOURNAL_HEADER_SIZE];
+
+    ixfr_journal_header(header, IXFR_JOURNAL_MAGIC, generation, 0);
+    if (ixfr_journal_replace(zonename, ".ixfr.jnl", header, NULL, 0) != 0) {
+        return ODS_STATUS_ERR;
+    }
+    index.generation = generation;
+    index.base = serial;
+    index.count = 0;
+    index.entries = NULL;
+    if (ixfr_journal_write_index(zonename, &index) != 0) {
+        return ODS_STATUS_ERR;
+    }
+    ods_log_debug("[%s] started ixfr journal for zone %s at serial %u",
+        ixfrjournal_str, zonename, serial);
+    return ODS_STATUS_OK;
+}
+
+
+/**
+ * Copy the live entries to a new journal.
+ *
+ */
+static ods_status
+ixfr_journal_rewrite(const char* zonename, ixfr_journal_index_type* index)
+{
+    uint8_t header[IXFR_JOURNAL_HEADER_SIZE];
+    char* filename;
+    uint8_t* data;
+    uint32_t first, last, i;
+    size_t len;
+    int fd;
+
+    first = index->entries[0].offset;
+    last = index->entries[index->count - 1].offset +
+        index->entries[index->count - 1].length;
+    len = last - first;
+    filename = ods_build_path(zonename, ".ixfr.jnl", 0, 1);
+    fd = filename ? open(filename, O_RDONLY) : -1;
+    free(filename);
+    if (fd < 0) {
+        return ODS_STATUS_ERR;
+    }
+    CHECKALLOC(data = (uint8_t*) malloc(len + 1));
+    if (ixfr_journal_pread(fd, data, len, first) != 0) {
+        free(data);
+        close(fd);
+        return ODS_STATUS_ERR;
+    }
+    close(fd);
+    index->generation++;
+    ixfr_journal_header(header, IXFR_JOURNAL_MAGIC, index->generation, 0);
+    if (ixfr_journal_replace(zonename, ".ixfr.jnl", header, data, len) != 0) {
+        free(data);
+        return ODS_STATUS_ERR;
+    }
+    free(data);
+    for (i = 0; i < index->count; i++) {
+        index->entries[i].offset -= first - IXFR_JOURNAL_HEADER_SIZE;
+    }
+    if (ixfr_journal_write_index(zonename, index) != 0) {
+        return ODS_STATUS_ERR;
+    }
+    return ODS_STATUS_OK;
+}
+
+
+/**
+ * Release the journal space of dropped entries once it exceeds the space
+ * of the live entries. The journal is never changed in place, transfers
+ * in progress may have it mapped.
+ *
+ */
+static ods_status
+ixfr_journal_release(const char* zonename, ixfr_journal_index_type* index)
+{
+    uint32_t dead, live;
+    dead = index->entries[0].offset - IXFR_JOURNAL_HEADER_SIZE;
+    live = index->entries[index->count - 1].offset +
+        index->entries[index->count - 1].length - index->entries[0].offset;
+    if (dead <= live) {
+        return ODS_STATUS_OK;
+    }
+    return ixfr_journal_rewrite(zonename, index);
+}
+
+
+/**
+ * Add the records of a domain, in the same order as the zone file, copied
+ * from the stored wire format.
+ * \return int 0 on success, -1 on error
+ *
+ */
+static int
+ixfr_journal_add_record(ldns_buffer* wire, recordset_type record)
+{
+    int i, ret;
+    ldns_rr_type rrtype;
+    names_iterator typeiter;
+    for (typeiter = names_recordalltypes(record); names_iterate(&typeiter, &rrtype); names_advance(&typeiter, NULL)) {
+        /* the soa records delimit the changes */
+        i = (rrtype == LDNS_RR_TYPE_SOA ? 1 : 0);
+        while ((ret = names_recordwire(record, rrtype, i, wire)) > 0) {
+            i++;
+        }
+        if (ret < 0) {
+            names_end(&typeiter);
+            return -1;
+        }
+    }
+    i = 0;
+    while ((ret = names_recordwire(record, LDNS_RR_TYPE_NSEC, i, wire)) > 0) {
+        i++;
+    }
+    return ret;
+}
+
+
+/**
+ * Encode the changes from serial to the current serial of the zone.
+ *
+ */
+static ldns_buffer*
+ixfr_journal_build(zone_type* zone, uint32_t serial, uint32_t current,
+    ixfr_journal_entry_type* entry)
+{
+    names_view_type view;
+    names_iterator iter;
+    recordset_type record;
+    ldns_rr* rr;
+    ldns_rr* soa1 = NULL;
+    ldns_rr* soa2 = NULL;
+    ldns_buffer* wire = NULL;
+    char* apex;
+    int error = 0;
+
+    view = zonelist_obtainresource(NULL, zone, NULL, offsetof(zone_type,changesview));
+    names_viewreset(view);
+    apex = ldns_rdf2str(zone->apex);
+    for (iter = names_viewiterator(view, names_iteratorchanges, apex, (int)serial); names_iterate(&iter, &record); names_advance(&iter, NULL)) {
+        rr = NULL;
+        names_recordlookupone(record, LDNS_RR_TYPE_SOA, NULL, &rr);
+        if (!soa1) {
+            soa1 = rr;
+        } else {
+            ldns_rr_free(soa2);
+            soa2 = rr;
+        }
+    }
+    free(apex);
+    if (!soa1 || !soa2 ||
+        ldns_rdf2native_int32(ldns_rr_rdf(soa1, SE_SOA_RDATA_SERIAL)) != serial ||
+        ldns_rdf2native_int32(ldns_rr_rdf(soa2, SE_SOA_RDATA_SERIAL)) != current ||
+        !(wire = ldns_buffer_new(LDNS_MAX_PACKETLEN))) {
+        zonelist_releaseresource(NULL, zone, NULL, offsetof(zone_type,changesview), view);
+        ldns_rr_free(soa1);
+        ldns_rr_free(soa2);
+        return NULL;
+    }
+    (void) ldns_rr2buffer_wire(wire, soa1, LDNS_SECTION_ANSWER);
+    for (iter = names_viewiterator(view, names_iteratorchangedeletes, (int)serial); names_iterate(&iter, &record); names_advance(&iter, NULL)) {
+        if (ixfr_journal_add_record(wire, record) != 0) {
+            error = 1;
+        }
+    }
+    entry->soaoffset = ldns_buffer_position(wire);
+    (void) ldns_rr2buffer_wire(wire, soa2, LDNS_SECTION_ANSWER);
+    entry->soalen = ldns_buffer_position(wire) - entry->soaoffset;
+    for (iter = names_viewiterator(view, names_iteratorchangeinserts, (int)serial); names_iterate(&iter, &record); names_advance(&iter, NULL)) {
+        if (ixfr_journal_add_record(wire, record) != 0) {
+            error = 1;
+        }
+    }
+    entry->from = serial;
+    entry->to = current;
+    entry->length = ldns_buffer_position(wire);
+    entry->expire = ldns_rdf2native_int32(ldns_rr_rdf(soa2, SE_SOA_RDATA_EXPIRE));
+    zonelist_releaseresource(NULL, zone, NULL, offsetof(zone_type,changesview), view);
+    ldns_rr_free(soa1);
+    ldns_rr_free(soa2);
+    if (error || ldns_buffer_status(wire) != LDNS_STATUS_OK) {
+        ldns_buffer_free(wire);
+        return NULL;
+    }
+    return wire;
+}
+
+
+/**
+ * Append an entry to the journal and its index. The entry is added past
+ * the end of the indexed entries, so readers do not see it until the new
+ * index replaces the old one.
+ *
+ */
+static int
+ixfr_journal_write_entry(const char* zonename, ixfr_journal_index_type* index,
+    ixfr_journal_entry_type* entry, ldns_buffer* wire)
+{
+    ixfr_journal_entry_type* last;
+    struct stat st;
+    char* filename;
+    off_t offset;
+    int fd;
+    int ret = -1;
+
+    filename = ods_build_path(zonename, ".ixfr.jnl", 0, 1);
+    fd = filename ? open(filename, O_WRONLY) : -1;
+    free(filename);
+    if (fd < 0) {
+        return -1;
+    }
+    /* entries are contiguous, a write that was interrupted before its index
+     * record was added is overwritten */
+    if (index->count > 0) {
+        last = &index->entries[index->count - 1];
+        offset = (off_t) last->offset + last->length;
+    } else if (fstat(fd, &st) == 0) {
+        offset = st.st_size;
+    } else {
+        offset = -1;
+    }
+    if (offset >= IXFR_JOURNAL_HEADER_SIZE &&
+        offset + entry->length <= UINT32_MAX &&
+        ixfr_journal_pwrite(fd, ldns_buffer_begin(wire), entry->length,
+            offset) == 0 &&
+        fsync(fd) == 0) {
+        ret = 0;
+    }
+    if (close(fd) != 0 || ret != 0) {
+        return -1;
+    }
+    entry->offset = (uint32_t) offset;
+    index->entries[index->count++] = *entry;
+    return ixfr_journal_write_index(zonename, index);
+}
+
+
+/**
+ * Append the changes since the last journaled serial to the IXFR journal.
+ *
+ */
+ods_status
+ixfr_journal_append(zone_type* zone)
+{
+    ixfr_journal_index_type index;
+    ixfr_journal_entry_type entry;
+    ldns_buffer* wire;
+    uint32_t serial, last, oldest, drop;
+    long history;
+    ods_status status = ODS_STATUS_OK;
+    ods_log_assert(zone);
+    ods_log_assert(zone->name);
+
+    if (!zone->outboundserial) {
+        return ODS_STATUS_OK;
+    }
+    serial = *zone->outboundserial;
+    if (ixfr_journal_read_index(zone->name, &index) != 0) {
+        return ixfr_journal_reset(zone->name, (uint32_t) time_now(), serial);
+    }
+    last = index.count ? index.entries[index.count - 1].to : index.base;
+    if (last == serial) {
+        free(index.entries);
+        return ODS_STATUS_OK;
+    }
+    memset(&entry, 0, sizeof(entry));
+    wire = NULL;
+    if (util_serial_gt(serial, last)) {
+        wire = ixfr_journal_build(zone, last, serial, &entry);
+    }
+    if (!wire) {
+        ods_log_verbose("[%s] changes of zone %s from serial %u to %u not "
+            "available, restarting ixfr journal", ixfrjournal_str, zone->name,
+            last, serial);
+        status = ixfr_journal_reset(zone->name, index.generation + 1, serial);
+        free(index.entries);
+        return status;
+    }
+    if (ixfr_journal_write_entry(zone->name, &index, &entry, wire) != 0) {
+        ods_log_error("[%s] unable to append serial %u to ixfr journal of "
+            "zone %s, restarting ixfr journal", ixfrjournal_str, serial,
+            zone->name);
+        ldns_buffer_free(wire);
+        status = ixfr_journal_reset(zone->name, index.generation + 1, serial);
+        free(index.entries);
+        return status;
+    }
+    ldns_buffer_free(wire);
+    ods_log_debug("[%s] journaled zone %s serial %u to %u (%u bytes)",
+        ixfrjournal_str, zone->name, entry.from, entry.to, entry.length);
+
+    /* drop the serials older than the ixfr history */
+    history = zone->operatingconf ? zone->operatingconf->ixfr_history : 4;
+    oldest = serial - (uint32_t) history;
+    for (drop = 0; drop < index.count - 1; drop++) {
+        if (!util_serial_gt(oldest, index.entries[drop].from)) {
+            break;
+        }
+    }
+    if (drop > 0) {
+        index.count -= drop;
+        memmove(index.entries, index.entries + drop,
+            index.count * sizeof(ixfr_journal_entry_type));
+        index.base = index.entries[0].from;
+        if (ixfr_journal_write_index(zone->name, &index) != 0 ||
+            ixfr_journal_release(zone->name, &index) != ODS_STATUS_OK) {
+            status = ODS_STATUS_ERR;
+        }
+    }
+    free(index.entries);
+    return status;
+}
+
+
+/**
+ * Map IXFR journal of a zone from the given serial.
+ *
+ */
+ixfr_journal_type*
+ixfr_journal_open(const char* zonename, uint32_t serial)
+{
+    ixfr_journal_index_type index;
+    ixfr_journal_entry_type* last;
+    ixfr_journal_type* journal;
+    struct stat st;
+    char* filename;
+    uint8_t* map;
+    uint32_t i;
+    int fd;
+
+    if (ixfr_journal_read_index(zonename, &index) != 0) {
+        return NULL;
+    }
+    if (index.count == 0) {
+        free(index.entries);
+        return NULL;
+    }
+    last = &index.entries[index.count - 1];
+    for (i = 0; i < index.count; i++) {
+        if (index.entries[i].from == serial) {
+            break;
+        }
+    }
+    if (i == index.count && last->to != serial) {
+        free(index.entries);
+        return NULL;
+    }
+    filename = ods_build_path(zonename, ".ixfr.jnl", 0, 1);
+    fd = filename ? open(filename, O_RDONLY) : -1;
+    free(filename);
+    if (fd < 0) {
+        free(index.entries);
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0 ||
+        st.st_size < (off_t) last->offset + last->length ||
+        last->offset < IXFR_JOURNAL_HEADER_SIZE ||
+        (size_t) last->soaoffset + last->soalen > last->length) {
+        free(index.entries);
+        close(fd);
+        return NULL;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        free(index.entries);
+        return NULL;
+    }
+    CHECKALLOC(journal = (ixfr_journal_type*) malloc(sizeof(ixfr_journal_type)));
+    journal->map = map;
+    journal->size = st.st_size;
+    journal->serial = last->to;
+    journal->expire = last->expire;
+    journal->soa = map + last->offset + last->soaoffset;
+    journal->soalen = last->soalen;
+    journal->end = (size_t) last->offset + last->length;
+    journal->start = i < index.count ? index.entries[i].offset : journal->end;
+    if (memcmp(map, IXFR_JOURNAL_MAGIC, IXFR_JOURNAL_MAGIC_SIZE) != 0 ||
+        read_uint32(map + 8) != index.generation) {
+        /* journal was replaced after the index was read */
+        ixfr_journal_close(journal);
+        journal = NULL;
+    }
+    free(index.entries);
+    return journal;
+}
+
+
+/**
+ * Unmap IXFR journal.
+ *
+ */
+void
+ixfr_journal_close(ixfr_journal_type* journal)
+{
+    if (!journal) {
+        return;
+    }
+    (void) munmap(journal->map, journal->size);
+    free(journal);
+}
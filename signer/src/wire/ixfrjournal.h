@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2011-2018 NLNet Labs.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Binary IXFR journal.
+ *
+ */
+
+#ifndef WIRE_IXFRJOURNAL_H
+#define WIRE_IXFRJOURNAL_H
+
+#include "config.h"
+#include "status.h"
+#include "signer/zone.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * The IXFR journal holds one entry per outbound serial, written by the DNS
+ * output adapter in the working directory (<zone>.ixfr.jnl). An entry is
+ * the difference sequence of RFC 1995 in uncompressed wire format: the old
+ * SOA, the deleted records, the new SOA and the added records. Entries are
+ * only appended, so an IXFR from a serial is the byte range from its entry
+ * to the end of the journal.
+ *
+ * The index (<zone>.ixfr.idx) maps serials to entries. Both files start
+ * with a header of IXFR_JOURNAL_HEADER_SIZE bytes: magic, generation and,
+ * for the index, the serial the journal starts at. The generation ties an
+ * index to its journal. An index record holds, in network byte order, the
+ * old and new serial, offset and length of the entry, offset in the entry
+ * and length of the new SOA, and the SOA expire value.
+ *
+ */
+#define IXFR_JOURNAL_HEADER_SIZE 16
+#define IXFR_JOURNAL_INDEX_SIZE 28
+
+typedef struct ixfr_journal_struct ixfr_journal_type;
+struct ixfr_journal_struct {
+    void* map;
+    size_t size;
+    uint32_t serial;
+    uint32_t expire;
+    const uint8_t* soa;
+    size_t soalen;
+    size_t start;
+    size_t end;
+};
+
+/**
+ * Append the changes since the last journaled serial to the IXFR journal
+ * of a zone, and drop entries that fall outside the IXFR history.
+ * \param[in] zone zone
+ * \return ods_status status
+ *
+ */
+ods_status ixfr_journal_append(zone_type* zone);
+
+/**
+ * Map IXFR journal of a zone from the given serial.
+ * \param[in] zonename zone name
+ * \param[in] serial serial of the requestor
+ * \return ixfr_journal_type* journal, NULL if the serial is not in the
+ *         journal or the journal is not available
+ *
+ */
+ixfr_journal_type* ixfr_journal_open(const char* zonename, uint32_t serial);
+
+/**
+ * Unmap IXFR journal.
+ * \param[in] journal IXFR journal
+ *
+ */
+void ixfr_journal_close(ixfr_journal_type* journal);
+
+#endif /* WIRE_IXFRJOURNAL_H */
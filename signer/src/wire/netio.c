@@ -23,12 +23,25 @@ int pselect(int n, fd_set* readfds, fd_set* writefds, fd_set* exceptfds,
 #else
 #include <sys/select.h>
 #endif
+#ifdef NETIO_USE_EPOLL
+#include <unistd.h>
+#endif
 
 /* One second is 1e9 nanoseconds.  */
 #define NANOSECONDS_PER_SECOND   1000000000L
+/* Maximum number of events retrieved with one epoll_pwait(2) call. */
+#define NETIO_EPOLL_EVENTS 64
 
 static const char* netio_str = "netio";
 
+#ifdef NETIO_USE_EPOLL
+/* heap_index of a handler that is not waiting for a timeout. */
+#define NETIO_NOT_QUEUED ((size_t) -1)
+
+static void netio_epoll_release(netio_type* netio,
+    netio_handler_list_type* l);
+#endif
+
 
 /*
  * Create a new netio instance.
@@ -42,9 +55,27 @@ netio_create()
     CHECKALLOC(netio = (netio_type*) malloc(sizeof(netio_type)));
     netio->handlers = NULL;
     netio->dispatch_next = NULL;
+#ifdef NETIO_USE_EPOLL
+    netio->fdtab = NULL;
+    netio->fdtab_size = 0;
+    netio->heap = NULL;
+    netio->heap_count = 0;
+    netio->heap_size = 0;
+    netio->dirty = NULL;
+    pthread_mutex_init(&netio->lock, NULL);
+    pthread_cond_init(&netio->dispatch_done, NULL);
+    netio->dispatch_current = NULL;
+    netio->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (netio->epfd == -1) {
+        ods_log_warning("[%s] unable to create epoll instance, falling "
+            "back to pselect: epoll_create1() failed (%s)", netio_str,
+            strerror(errno));
+    }
+#endif
     return netio;
 }
 
+
 /*
  * Add a new handler to netio.
  *
@@ -58,9 +89,27 @@ netio_add_handler(netio_type* netio, netio_handler_type* handler)
     ods_log_assert(handler);
 
     CHECKALLOC(l = (netio_handler_list_type*) malloc(sizeof(netio_handler_list_type)));
-    l->next = netio->handlers;
     l->handler = handler;
+#ifdef NETIO_USE_EPOLL
+    l->fd = -1;
+    l->events = 0;
+    l->heap_index = NETIO_NOT_QUEUED;
+    l->dirty = 0;
+    l->dirty_next = NULL;
+    pthread_mutex_lock(&netio->lock);
+    if (netio->epfd != -1) {
+        /* registered at the next dispatch */
+        l->dirty = 1;
+        l->dirty_next = netio->dirty;
+        netio->dirty = l;
+    }
+#endif
+    handler->entry = l;
+    l->next = netio->handlers;
     netio->handlers = l;
+#ifdef NETIO_USE_EPOLL
+    pthread_mutex_unlock(&netio->lock);
+#endif
     ods_log_debug("[%s] handler added", netio_str);
 }
 
@@ -75,22 +124,75 @@ netio_remove_handler(netio_type* netio, netio_handler_type* handler)
     if (!netio || !handler) {
         return;
     }
+#ifdef NETIO_USE_EPOLL
+    pthread_mutex_lock(&netio->lock);
+    for (;;) {
+        for (lptr = &netio->handlers; *lptr; lptr = &(*lptr)->next) {
+            if ((*lptr)->handler == handler) {
+                break;
+            }
+        }
+        /* wait if the callback runs on the dispatching thread */
+        if (!*lptr || *lptr != netio->dispatch_current ||
+            pthread_equal(netio->dispatch_thread, pthread_self())) {
+            break;
+        }
+        pthread_cond_wait(&netio->dispatch_done, &netio->lock);
+    }
+#endif
     for (lptr = &netio->handlers; *lptr; lptr = &(*lptr)->next) {
         if ((*lptr)->handler == handler) {
             netio_handler_list_type* next = (*lptr)->next;
             if ((*lptr) == netio->dispatch_next) {
                 netio->dispatch_next = next;
             }
+#ifdef NETIO_USE_EPOLL
+            if ((*lptr) == netio->dispatch_current) {
+                netio->dispatch_current = NULL;
+            }
+            netio_epoll_release(netio, *lptr);
+#endif
+            handler->entry = NULL;
             (*lptr)->handler = NULL;
 	    free(*lptr);
             *lptr = next;
             break;
         }
     }
+#ifdef NETIO_USE_EPOLL
+    pthread_mutex_unlock(&netio->lock);
+#endif
     ods_log_debug("[%s] handler removed", netio_str);
 }
 
 
+/*
+ * Announce a change to a handler made outside of its callback.
+ *
+ */
+void
+netio_update_handler(netio_type* netio, netio_handler_type* handler)
+{
+#ifdef NETIO_USE_EPOLL
+    netio_handler_list_type* l = NULL;
+    if (!netio || !handler || netio->epfd == -1) {
+        return;
+    }
+    pthread_mutex_lock(&netio->lock);
+    l = handler->entry;
+    if (l && !l->dirty) {
+        l->dirty = 1;
+        l->dirty_next = netio->dirty;
+        netio->dirty = l;
+    }
+    pthread_mutex_unlock(&netio->lock);
+#else
+    (void) netio;
+    (void) handler;
+#endif
+}
+
+
 /*
  * Convert timeval to timespec.
  *
@@ -155,6 +257,268 @@ timespec_subtract(struct timespec* left, const struct timespec* right)
 }
 
 
+#ifdef NETIO_USE_EPOLL
+/*
+ * Deregister a handler list entry from epoll.
+ *
+ */
+static void
+netio_epoll_forget(netio_type* netio, netio_handler_list_type* l)
+{
+    struct epoll_event ev;
+    if (l->fd >= 0 && (size_t) l->fd < netio->fdtab_size &&
+        netio->fdtab[l->fd] == l) {
+        /* the descriptor may already be closed, that is fine */
+        memset(&ev, 0, sizeof(ev));
+        (void) epoll_ctl(netio->epfd, EPOLL_CTL_DEL, l->fd, &ev);
+        netio->fdtab[l->fd] = NULL;
+    }
+    l->fd = -1;
+    l->events = 0;
+}
+
+/*
+ * Bring the epoll registration of a handler list entry in line with
+ * the handler. If force is set, the registration is renewed even if
+ * it looks unchanged: the handler may have closed its descriptor and
+ * opened another one that got the same number.
+ *
+ */
+static void
+netio_epoll_update(netio_type* netio, netio_handler_list_type* l, int force)
+{
+    netio_handler_type* handler = l->handler;
+    struct epoll_event ev;
+    int fd = -1;
+    int op;
+    memset(&ev, 0, sizeof(ev));
+    if (handler->fd >= 0) {
+        if (handler->event_types & NETIO_EVENT_READ) {
+            ev.events |= EPOLLIN;
+        }
+        if (handler->event_types & NETIO_EVENT_WRITE) {
+            ev.events |= EPOLLOUT;
+        }
+        if (handler->event_types & NETIO_EVENT_EXCEPT) {
+            ev.events |= EPOLLPRI;
+        }
+        if (ev.events) {
+            fd = handler->fd;
+        }
+    }
+    if (!force && fd == l->fd && ev.events == l->events) {
+        return;
+    }
+    if (l->fd != fd) {
+        netio_epoll_forget(netio, l);
+    }
+    if (fd == -1) {
+        return;
+    }
+    if ((size_t) fd >= netio->fdtab_size) {
+        size_t size = netio->fdtab_size ? netio->fdtab_size : 64;
+        while (size <= (size_t) fd) {
+            size *= 2;
+        }
+        CHECKALLOC(netio->fdtab = (netio_handler_list_type**) realloc(
+            netio->fdtab, size * sizeof(netio_handler_list_type*)));
+        memset(&netio->fdtab[netio->fdtab_size], 0,
+            (size - netio->fdtab_size) * sizeof(netio_handler_list_type*));
+        netio->fdtab_size = size;
+    }
+    ev.data.fd = fd;
+    op = (l->fd == fd) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (epoll_ctl(netio->epfd, op, fd, &ev) == -1) {
+        if (errno == ENOENT) {
+            op = EPOLL_CTL_ADD;
+        } else if (errno == EEXIST) {
+            op = EPOLL_CTL_MOD;
+        } else {
+            op = -1;
+        }
+        if (op == -1 || epoll_ctl(netio->epfd, op, fd, &ev) == -1) {
+            ods_log_error("[%s] unable to watch fd %d: epoll_ctl() failed "
+                "(%s)", netio_str, fd, strerror(errno));
+            netio_epoll_forget(netio, l);
+            return;
+        }
+    }
+    netio->fdtab[fd] = l;
+    l->fd = fd;
+    l->events = ev.events;
+}
+
+/*
+ * Timer heap, ordered on the deadline each entry was queued with.
+ *
+ */
+static void
+netio_heap_set(netio_type* netio, size_t i, netio_handler_list_type* l)
+{
+    netio->heap[i] = l;
+    l->heap_index = i;
+}
+
+static void
+netio_heap_up(netio_type* netio, size_t i)
+{
+    netio_handler_list_type* l = netio->heap[i];
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (timespec_compare(&netio->heap[parent]->deadline,
+            &l->deadline) <= 0) {
+            break;
+        }
+        netio_heap_set(netio, i, netio->heap[parent]);
+        i = parent;
+    }
+    netio_heap_set(netio, i, l);
+}
+
+static void
+netio_heap_down(netio_type* netio, size_t i)
+{
+    netio_handler_list_type* l = netio->heap[i];
+    size_t child;
+    while ((child = 2 * i + 1) < netio->heap_count) {
+        if (child + 1 < netio->heap_count &&
+            timespec_compare(&netio->heap[child + 1]->deadline,
+            &netio->heap[child]->deadline) < 0) {
+            child++;
+        }
+        if (timespec_compare(&l->deadline,
+            &netio->heap[child]->deadline) <= 0) {
+            break;
+        }
+        netio_heap_set(netio, i, netio->heap[child]);
+        i = child;
+    }
+    netio_heap_set(netio, i, l);
+}
+
+static void
+netio_heap_remove(netio_type* netio, netio_handler_list_type* l)
+{
+    size_t i = l->heap_index;
+    netio_handler_list_type* last = NULL;
+    if (i == NETIO_NOT_QUEUED) {
+        return;
+    }
+    l->heap_index = NETIO_NOT_QUEUED;
+    last = netio->heap[--netio->heap_count];
+    if (last == l) {
+        return;
+    }
+    netio_heap_set(netio, i, last);
+    netio_heap_up(netio, i);
+    netio_heap_down(netio, last->heap_index);
+}
+
+/*
+ * Queue an entry at the current timeout of its handler, or take it off
+ * the heap if the handler does not want a timeout anymore.
+ *
+ */
+static void
+netio_heap_update(netio_type* netio, netio_handler_list_type* l)
+{
+    netio_handler_type* handler = l->handler;
+    if (!handler->timeout || !(handler->event_types & NETIO_EVENT_TIMEOUT)) {
+        netio_heap_remove(netio, l);
+        return;
+    }
+    if (l->heap_index != NETIO_NOT_QUEUED) {
+        if (timespec_compare(&l->deadline, handler->timeout) != 0) {
+            l->deadline = *handler->timeout;
+            netio_heap_up(netio, l->heap_index);
+            netio_heap_down(netio, l->heap_index);
+        }
+        return;
+    }
+    if (netio->heap_count == netio->heap_size) {
+        netio->heap_size = netio->heap_size ? netio->heap_size * 2 : 64;
+        CHECKALLOC(netio->heap = (netio_handler_list_type**) realloc(
+            netio->heap, netio->heap_size * sizeof(netio_handler_list_type*)));
+    }
+    l->deadline = *handler->timeout;
+    netio_heap_set(netio, netio->heap_count++, l);
+    netio_heap_up(netio, l->heap_index);
+}
+
+/*
+ * The entry with the earliest timeout. Entries whose handler changed
+ * its timeout without telling us are requeued on the way.
+ *
+ */
+static netio_handler_list_type*
+netio_heap_first(netio_type* netio)
+{
+    netio_handler_list_type* l = NULL;
+    while (netio->heap_count > 0) {
+        l = netio->heap[0];
+        if (l->handler->timeout &&
+            (l->handler->event_types & NETIO_EVENT_TIMEOUT) &&
+            timespec_compare(&l->deadline, l->handler->timeout) == 0) {
+            return l;
+        }
+        netio_heap_update(netio, l);
+    }
+    return NULL;
+}
+
+/*
+ * Bring the epoll registration and timer of an entry in line with
+ * its handler.
+ *
+ */
+static void
+netio_epoll_sync(netio_type* netio, netio_handler_list_type* l, int force)
+{
+    netio_epoll_update(netio, l, force);
+    netio_heap_update(netio, l);
+}
+
+/*
+ * Forget everything about an entry that is about to be removed.
+ * Called with netio->lock held.
+ *
+ */
+static void
+netio_epoll_release(netio_type* netio, netio_handler_list_type* l)
+{
+    netio_handler_list_type** dptr;
+    netio_epoll_forget(netio, l);
+    netio_heap_remove(netio, l);
+    if (l->dirty) {
+        for (dptr = &netio->dirty; *dptr; dptr = &(*dptr)->dirty_next) {
+            if (*dptr == l) {
+                *dptr = l->dirty_next;
+                break;
+            }
+        }
+        l->dirty = 0;
+    }
+}
+
+/*
+ * Sync the entries that were announced with netio_update_handler().
+ * Called with netio->lock held.
+ *
+ */
+static void
+netio_epoll_sync_dirty(netio_type* netio)
+{
+    netio_handler_list_type* l = NULL;
+    while ((l = netio->dirty) != NULL) {
+        netio->dirty = l->dirty_next;
+        l->dirty_next = NULL;
+        l->dirty = 0;
+        netio_epoll_sync(netio, l, 1);
+    }
+}
+#endif /* NETIO_USE_EPOLL */
+
+
 /*
  * Retrieve the current time (using gettimeofday(2)).
  *
@@ -180,11 +544,11 @@ netio_current_time(netio_type* netio)
 
 
 /*
- * Check for events and dispatch them to the handlers.
+ * Check for events with pselect(2) and dispatch them to the handlers.
  *
  */
-int
-netio_dispatch(netio_type* netio, const struct timespec* timeout,
+static int
+netio_dispatch_select(netio_type* netio, const struct timespec* timeout,
     const sigset_t* sigmask)
 {
     fd_set readfds, writefds, exceptfds;
@@ -328,6 +692,206 @@ netio_dispatch(netio_type* netio, const struct timespec* timeout,
 }
 
 
+#ifdef NETIO_USE_EPOLL
+/*
+ * Call the handler of a list entry and resync the entry. Called with
+ * netio->lock held, which is released during the callback.
+ *
+ */
+static void
+netio_epoll_call(netio_type* netio, netio_handler_list_type* l,
+    netio_events_type event_types)
+{
+    netio_handler_type* handler = l->handler;
+    netio->dispatch_current = l;
+    netio->dispatch_thread = pthread_self();
+    pthread_mutex_unlock(&netio->lock);
+    handler->event_handler(netio, handler, event_types);
+    pthread_mutex_lock(&netio->lock);
+    /* the entry is gone if the handler removed itself */
+    if (netio->dispatch_current) {
+        netio_epoll_sync(netio, netio->dispatch_current, 1);
+    }
+    netio->dispatch_current = NULL;
+    pthread_cond_broadcast(&netio->dispatch_done);
+}
+
+
+/*
+ * Dispatch expired timeouts, at most NETIO_EPOLL_EVENTS of them so that
+ * a handler that keeps its timeout in the past cannot stall us. Called
+ * with netio->lock held.
+ * \return int the number of timeouts dispatched
+ *
+ */
+static int
+netio_epoll_timeouts(netio_type* netio)
+{
+    netio_handler_list_type* l = NULL;
+    int count = 0;
+    while (count < NETIO_EPOLL_EVENTS && (l = netio_heap_first(netio))) {
+        if (timespec_compare(&l->deadline, netio_current_time(netio)) > 0) {
+            break;
+        }
+        /* requeued by netio_epoll_call() if the handler sets a new one */
+        netio_heap_remove(netio, l);
+        netio_epoll_call(netio, l, NETIO_EVENT_TIMEOUT);
+        count++;
+    }
+    return count;
+}
+
+
+/*
+ * Check for events with epoll_pwait(2) and dispatch them to the handlers.
+ *
+ */
+static int
+netio_dispatch_epoll(netio_type* netio, const struct timespec* timeout,
+    const sigset_t* sigmask)
+{
+    struct epoll_event events[NETIO_EPOLL_EVENTS];
+    int have_timeout = 0;
+    struct timespec minimum_timeout;
+    netio_handler_list_type* l = NULL;
+    int msec = -1;
+    int rc = 0;
+    int i = 0;
+    int result = 0;
+
+    if (!netio) {
+        return 0;
+    }
+    /* The handler list, fdtab and heap are shared with the threads that
+     * add and remove handlers, the lock is only released while waiting
+     * for events and during callbacks */
+    pthread_mutex_lock(&netio->lock);
+    if (!netio->handlers) {
+        pthread_mutex_unlock(&netio->lock);
+        return 0;
+    }
+    /* Clear the cached current time */
+    netio->have_current_time = 0;
+    /* Pick up handlers changed outside of their callbacks */
+    netio_epoll_sync_dirty(netio);
+    /* Initialize the minimum timeout with the timeout parameter */
+    if (timeout) {
+        have_timeout = 1;
+        memcpy(&minimum_timeout, timeout, sizeof(struct timespec));
+    }
+    /* The earliest handler timeout is on top of the heap */
+    if ((l = netio_heap_first(netio)) != NULL) {
+        struct timespec relative;
+        relative.tv_sec = l->deadline.tv_sec;
+        relative.tv_nsec = l->deadline.tv_nsec;
+        timespec_subtract(&relative, netio_current_time(netio));
+        if (!have_timeout ||
+            timespec_compare(&relative, &minimum_timeout) < 0) {
+            have_timeout = 1;
+            minimum_timeout.tv_sec = relative.tv_sec;
+            minimum_timeout.tv_nsec = relative.tv_nsec;
+        }
+    }
+
+    if (have_timeout && minimum_timeout.tv_sec < 0) {
+        /*
+         * On negative timeout for a handler, immediately
+         * dispatch the timeout events without checking for other events.
+         */
+        ods_log_debug("[%s] dispatch timeout event without checking for "
+            "other events", netio_str);
+        netio_epoll_timeouts(netio);
+        pthread_mutex_unlock(&netio->lock);
+        return result;
+    }
+    if (have_timeout) {
+        /* round up, so that the timeout has expired when we wake up */
+        msec = (int) (minimum_timeout.tv_sec * 1000 +
+            (minimum_timeout.tv_nsec + 999999L) / 1000000L);
+    }
+    pthread_mutex_unlock(&netio->lock);
+    /* Check for events. */
+    rc = epoll_pwait(netio->epfd, events, NETIO_EPOLL_EVENTS, msec,
+        sigmask);
+    if (rc == -1) {
+        if (errno == EINVAL || errno == EBADF || errno == EFAULT) {
+            ods_fatal_exit("[%s] fatal error epoll_pwait: %s", netio_str,
+                strerror(errno));
+        }
+        return -1;
+    }
+    pthread_mutex_lock(&netio->lock);
+
+    /* Clear the cached current_time (epoll_pwait(2) may block for
+     * some time so the cached value is likely to be old).
+     */
+    netio->have_current_time = 0;
+    if (rc == 0) {
+        ods_log_debug("[%s] no events before the minimum timeout "
+            "expired", netio_str);
+        /*
+         * No events before the minimum timeout expired.
+         * Dispatch to handlers if interested.
+         */
+        netio_epoll_timeouts(netio);
+        pthread_mutex_unlock(&netio->lock);
+        return result;
+    }
+    /*
+     * Dispatch all the events to interested handlers.  A handler
+     * might deinstall itself or others, so look up each entry
+     * through fdtab, which removed handlers are cleared from.
+     */
+    for (i = 0; i < rc; i++) {
+        int fd = events[i].data.fd;
+        netio_events_type event_types = NETIO_EVENT_NONE;
+        netio_handler_type* handler = NULL;
+        if (fd < 0 || (size_t) fd >= netio->fdtab_size ||
+            !(l = netio->fdtab[fd])) {
+            continue;
+        }
+        handler = l->handler;
+        if (handler->fd != fd) {
+            continue;
+        }
+        /* pselect(2) reports errors and hangups as readable/writable */
+        if (events[i].events & (EPOLLIN|EPOLLERR|EPOLLHUP)) {
+            event_types |= NETIO_EVENT_READ;
+        }
+        if (events[i].events & (EPOLLOUT|EPOLLERR|EPOLLHUP)) {
+            event_types |= NETIO_EVENT_WRITE;
+        }
+        if (events[i].events & EPOLLPRI) {
+            event_types |= NETIO_EVENT_EXCEPT;
+        }
+        if (event_types & handler->event_types) {
+            netio_epoll_call(netio, l, event_types & handler->event_types);
+            ++result;
+        }
+    }
+    pthread_mutex_unlock(&netio->lock);
+    return result;
+}
+#endif /* NETIO_USE_EPOLL */
+
+
+/*
+ * Check for events and dispatch them to the handlers.
+ *
+ */
+int
+netio_dispatch(netio_type* netio, const struct timespec* timeout,
+    const sigset_t* sigmask)
+{
+#ifdef NETIO_USE_EPOLL
+    if (netio && netio->epfd != -1) {
+        return netio_dispatch_epoll(netio, timeout, sigmask);
+    }
+#endif
+    return netio_dispatch_select(netio, timeout, sigmask);
+}
+
+
 /**
  * Clean up netio instance
  *
@@ -345,6 +909,15 @@ netio_cleanup(netio_type* netio)
         }
         free(handler);
     }
+#ifdef NETIO_USE_EPOLL
+    if (netio->epfd != -1) {
+        close(netio->epfd);
+    }
+    free(netio->fdtab);
+    free(netio->heap);
+    pthread_cond_destroy(&netio->dispatch_done);
+    pthread_mutex_destroy(&netio->lock);
+#endif
     free(netio);
 }
 
@@ -356,6 +929,15 @@ netio_cleanup_shallow(netio_type* netio)
 {
     ods_log_assert(netio);
     free(netio->handlers);
+#ifdef NETIO_USE_EPOLL
+    if (netio->epfd != -1) {
+        close(netio->epfd);
+    }
+    free(netio->fdtab);
+    free(netio->heap);
+    pthread_cond_destroy(&netio->dispatch_done);
+    pthread_mutex_destroy(&netio->lock);
+#endif
     free(netio);
 }
 
@@ -29,12 +29,15 @@
  *
  * The event callbacks are free to modify the netio_handler_type
  * structure to change the file descriptor, timeout, event types, user
- * data, or handler functions.
+ * data, or handler functions.  Changes made to a handler outside of
+ * its own callback must be announced with netio_update_handler.
  *
  * The main loop of the program must call netio_dispatch to check for
  * events and dispatch them to the handlers.  An additional timeout
  * can be specified as well as the signal mask to install while
- * blocked in pselect(2).
+ * blocked in epoll_pwait(2) or pselect(2).  With epoll, handler
+ * timeouts are kept in a heap, so a dispatch does not need to look
+ * at handlers that have nothing to do.
  */
 
 /**
@@ -54,6 +57,12 @@
 #include "config.h"
 #include "status.h"
 
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_EPOLL_CREATE1)
+#define NETIO_USE_EPOLL 1
+#include <pthread.h>
+#include <sys/epoll.h>
+#endif
+
 #ifndef PF_INET
 #define PF_INET AF_INET
 #endif
@@ -93,6 +102,25 @@ typedef void (*netio_event_handler_type)(netio_type *netio,
 struct netio_handler_list_struct {
     netio_handler_list_type* next;
     netio_handler_type* handler;
+#ifdef NETIO_USE_EPOLL
+    /*
+     * File descriptor and events as currently registered with epoll,
+     * fd is -1 when the handler is not registered.
+     */
+    int fd;
+    uint32_t events;
+    /*
+     * Position in the timer heap, or NETIO_NOT_QUEUED, and the timeout
+     * the handler had when it was queued.
+     */
+    size_t heap_index;
+    struct timespec deadline;
+    /*
+     * Set when netio_update_handler() was called for the handler.
+     */
+    int dirty;
+    netio_handler_list_type* dirty_next;
+#endif
 };
 
 /**
@@ -130,6 +158,12 @@ struct netio_handler_struct {
      */
     netio_event_handler_type event_handler;
     int free_handler;
+    /*
+     * Private to netio, set by netio_add_handler() and cleared by
+     * netio_remove_handler(). Must be NULL for handlers that are not
+     * added, if netio_update_handler() may be called for them.
+     */
+    netio_handler_list_type* entry;
 };
 
 /**
@@ -154,6 +188,39 @@ struct netio_struct {
      * To make sure that deletes respect the state of the iterator.
      */
     netio_handler_list_type* dispatch_next;
+#ifdef NETIO_USE_EPOLL
+    /*
+     * The epoll instance, or -1 if it could not be created and
+     * pselect(2) is used instead.  A handler is (re)registered, and
+     * its timeout (re)queued on the timer heap, after each of its
+     * callbacks and at the start of the dispatch after a call to
+     * netio_update_handler().  fdtab maps a registered file descriptor
+     * back to its handler list entry.
+     */
+    int epfd;
+    netio_handler_list_type** fdtab;
+    size_t fdtab_size;
+    /*
+     * Binary min-heap of handlers waiting for a timeout.
+     */
+    netio_handler_list_type** heap;
+    size_t heap_count;
+    size_t heap_size;
+    /*
+     * Handlers changed outside of their own callbacks, the handler
+     * list and this queue are protected by lock.
+     */
+    netio_handler_list_type* dirty;
+    pthread_mutex_t lock;
+    /*
+     * Handler currently being dispatched and the thread dispatching it.
+     * Only valid during callbacks. Removing a handler from another
+     * thread waits on dispatch_done until its callback returned.
+     */
+    netio_handler_list_type* dispatch_current;
+    pthread_t dispatch_thread;
+    pthread_cond_t dispatch_done;
+#endif
 };
 
 /*
@@ -173,13 +240,26 @@ netio_type* netio_create(void);
 void netio_add_handler(netio_type* netio, netio_handler_type* handler);
 
 /*
- * Remove the handler from netio.
+ * Remove the handler from netio. When called from another thread than
+ * the one dispatching, this waits for a running callback of the handler
+ * to return, so the handler can be freed afterwards.
  * \param[in] netio netio instance
  * \param[in] handler handler
  *
  */
 void netio_remove_handler(netio_type* netio, netio_handler_type* handler);
 
+/*
+ * Tell netio that the file descriptor, event types or timeout of a
+ * handler changed outside of the handler's own callback. The change
+ * takes effect at the next dispatch. This may be called from any
+ * thread, the caller should wake up the dispatching thread if needed.
+ * \param[in] netio netio instance
+ * \param[in] handler handler
+ *
+ */
+void netio_update_handler(netio_type* netio, netio_handler_type* handler);
+
 /*
  * Retrieve the current time (using gettimeofday(2)).
  * \param[in] netio netio instance
@@ -193,7 +273,8 @@ const struct timespec* netio_current_time(netio_type* netio);
  * \param[in] netio netio instance
  * \param[in] timeout if specified, the maximum time to wait for an
  *                    event to arrive.
- * \param[in] sigmask is passed to the underlying pselect(2) call
+ * \param[in] sigmask is passed to the underlying epoll_pwait(2) or
+ *                    pselect(2) call
  * \return int the number of non-timeout events dispatched, 0 on timeout,
  *             and -1 on error (with errno set appropriately).
  *
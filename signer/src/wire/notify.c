@@ -57,6 +57,19 @@ notify_time(notify_type* notify)
 }
 
 
+/**
+ * Tell netio that the handler changed, it may be changed from another
+ * thread or from the callback of another zone.
+ *
+ */
+static void
+notify_handler_update(notify_type* notify)
+{
+    xfrhandler_type* xfrhandler = (xfrhandler_type*) notify->xfrhandler;
+    netio_update_handler(xfrhandler->netio, &notify->handler);
+}
+
+
 /**
  * Set timer.
  *
@@ -88,6 +101,7 @@ notify_set_timer(notify_type* notify, time_t t)
     notify->handler.timeout = &notify->timeout;
     notify->timeout.tv_sec = t;
     notify->timeout.tv_nsec = 0;
+    notify_handler_update(notify);
 }
 
 
@@ -120,6 +134,7 @@ notify_create(xfrhandler_type* xfrhandler, zone_type* zone)
     notify->handler.event_types =
         NETIO_EVENT_READ|NETIO_EVENT_TIMEOUT;
     notify->handler.event_handler = notify_handle_zone;
+    notify->handler.entry = NULL;
     return notify;
 }
 
@@ -172,6 +187,7 @@ notify_disable(notify_type* notify)
         close(notify->handler.fd);
         notify->handler.fd = -1;
     }
+    notify_handler_update(notify);
     if (xfrhandler->notify_udp_num == NOTIFY_MAX_UDP) {
         while (xfrhandler->notify_waiting_first) {
             notify_type* wn = xfrhandler->notify_waiting_first;
@@ -573,6 +589,7 @@ notify_enable(notify_type* notify, ldns_rr* soa)
     }
     xfrhandler->notify_waiting_last = notify;
     notify->handler.timeout = NULL;
+    notify_handler_update(notify);
     ods_log_debug("[%s] zone %s notify on waiting list", notify_str,
         zone->name);
 }
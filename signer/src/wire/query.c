@@ -32,10 +32,13 @@
 #include "config.h"
 #include "daemon/dnshandler.h"
 #include "daemon/engine.h"
+#include "daemon/metrics.h"
 #include "file.h"
 #include "util.h"
+#include "wire/apexcache.h"
 #include "wire/axfr.h"
 #include "wire/query.h"
+#include "wire/update.h"
 
 const char* query_str = "query";
 
@@ -52,6 +55,8 @@ query_create(void)
     q->buffer = NULL;
     q->tsig_rr = NULL;
     q->axfr_fd = NULL;
+    q->axfr_image = NULL;
+    q->ixfr_journal = NULL;
     q->buffer = buffer_create(PACKET_BUFFER_SIZE);
     if (!q->buffer) {
         query_cleanup(q);
@@ -100,6 +105,12 @@ query_reset(query_type* q, size_t maxlen, int is_tcp)
         ods_fclose(q->axfr_fd);
         q->axfr_fd = NULL;
     }
+    axfr_image_close(q->axfr_image);
+    q->axfr_image = NULL;
+    ixfr_journal_close(q->ixfr_journal);
+    q->ixfr_journal = NULL;
+    q->axfr_run = 0;
+    q->axfr_pos = 0;
     q->serial = 0;
     q->startpos = 0;
 }
@@ -536,12 +547,8 @@ query_response(names_view_type view, query_type* q, ldns_rr_type qtype)
     if (!q || !q->zone) {
         return QUERY_DISCARDED;
     }
-    r.answersection = ldns_rr_list_new();
-    r.answersectionsigs = ldns_rr_list_new();
-    r.authoritysection = ldns_rr_list_new();
-    r.authoritysectionsigs = ldns_rr_list_new();
-    r.additionalsection = ldns_rr_list_new();
-    r.additionalsectionsigs =  ldns_rr_list_new();
+    /* the lists own the records, they are built for this response */
+    memset(&r, 0, sizeof(r));
     names_viewlookupall(view, NULL, qtype, &r.answersection, &r.answersectionsigs);
     if (r.answersection) {
         /* NS RRset goes into Authority Section */
@@ -550,6 +557,7 @@ query_response(names_view_type view, query_type* q, ldns_rr_type qtype)
     } else if (qtype != LDNS_RR_TYPE_SOA) {
         names_viewlookupall(view, NULL, LDNS_RR_TYPE_SOA, &r.authoritysection, &r.authoritysectionsigs);
     } else {
+        ldns_rr_list_deep_free(r.answersectionsigs);
         return query_servfail(q);
     }
     response_encode(q, &r);
@@ -557,13 +565,69 @@ query_response(names_view_type view, query_type* q, ldns_rr_type qtype)
     ldns_rr_list_deep_free(r.answersectionsigs);
     ldns_rr_list_deep_free(r.authoritysection);
     ldns_rr_list_deep_free(r.authoritysectionsigs);
-    ldns_rr_list_deep_free(r.answersection);
-    ldns_rr_list_deep_free(r.answersectionsigs);
     /* compression */
     return QUERY_PROCESSED;
 }
 
 
+/**
+ * Answer apex query from the precomputed answers of the zone.
+ * \return int 1 if answered, 0 if the query needs the view
+ *
+ */
+static int
+query_apex_response(query_type* q, ldns_rr_type qtype)
+{
+    apex_answer_type* answer = NULL;
+    int index = apex_cache_index(qtype);
+    int dnssec_ok = (q->edns_rr && q->edns_rr->dnssec_ok) ? 1 : 0;
+    time_t expire = 0;
+    if (index < 0) {
+        return 0;
+    }
+    pthread_mutex_lock(&q->zone->apex_lock);
+    if (!q->zone->apexcache ||
+        !q->zone->apexcache->answer[index][dnssec_ok].wire) {
+        pthread_mutex_unlock(&q->zone->apex_lock);
+        return 0;
+    }
+    answer = &q->zone->apexcache->answer[index][dnssec_ok];
+    if (index == APEX_CACHE_SOA && q->zone->xfrd) {
+        expire = q->zone->xfrd->serial_xfr_acquired;
+        expire += q->zone->apexcache->expire;
+        if (expire < time_now()) {
+            pthread_mutex_unlock(&q->zone->apex_lock);
+            ods_log_warning("[%s] zone %s expired, not serving soa",
+                query_str, q->zone->name);
+            buffer_pkt_set_rcode(q->buffer, LDNS_RCODE_SERVFAIL);
+            return 1;
+        }
+    }
+    if (!buffer_available(q->buffer, answer->len) ||
+        buffer_position(q->buffer) + answer->len >
+        q->maxlen - q->reserved_space) {
+        pthread_mutex_unlock(&q->zone->apex_lock);
+        TC_SET(q->buffer);
+        buffer_pkt_set_ancount(q->buffer, 0);
+        buffer_pkt_set_nscount(q->buffer, 0);
+        buffer_pkt_set_arcount(q->buffer, 0);
+        buffer_pkt_set_aa(q->buffer);
+        return 1;
+    }
+    buffer_write(q->buffer, answer->wire, answer->len);
+    buffer_pkt_set_ancount(q->buffer, answer->ancount);
+    buffer_pkt_set_nscount(q->buffer, answer->nscount);
+    pthread_mutex_unlock(&q->zone->apex_lock);
+    buffer_pkt_set_arcount(q->buffer, 0);
+    buffer_pkt_set_aa(q->buffer);
+    /* check if it needs TSIG signatures */
+    if (q->tsig_rr->status == TSIG_OK) {
+        q->tsig_sign_it = 1;
+    }
+    return 1;
+}
+
+
 /**
  * Prepare response.
  *
@@ -633,6 +697,7 @@ query_process_query(query_type* q, ldns_rr_type qtype, engine_type* engine)
         ods_log_assert(q->zone->name);
         ods_log_debug("[%s] incoming ixfr request serial=%u for zone %s",
             query_str, q->serial, q->zone->name);
+        metrics_count(METRICS_XFR_OUT_IXFR, 1);
         return ixfr(q, engine);
     }
     /* axfr? */
@@ -640,8 +705,13 @@ query_process_query(query_type* q, ldns_rr_type qtype, engine_type* engine)
         ods_log_assert(q->zone->name);
         ods_log_debug("[%s] incoming axfr request for zone %s",
             query_str, q->zone->name);
+        metrics_count(METRICS_XFR_OUT_AXFR, 1);
         return axfr(q, engine, 0);
     }
+    /* apex soa, ns and dnskey without touching the views */
+    if (query_apex_response(q, qtype)) {
+        return QUERY_PROCESSED;
+    }
     /* (soa) query */
     if (qtype == LDNS_RR_TYPE_SOA) {
         ods_log_assert(q->zone->name);
@@ -660,16 +730,91 @@ query_process_query(query_type* q, ldns_rr_type qtype, engine_type* engine)
 
 /**
  * UPDATE.
+ * Check the prerequisites of a TSIG signed update and apply it to the
+ * input view of the zone. When the zone changed, it is signed right away,
+ * which only signs the changed names. The reply echoes the zone section.
  *
  */
 static query_state
-query_process_update(query_type* q)
+query_process_update(query_type* q, ldns_pkt* pkt, engine_type* engine)
 {
-    if (!q || !q->zone) {
+    dnsin_type* dnsin = NULL;
+    names_view_type view;
+    ldns_pkt_rcode rcode;
+    uint16_t count = 0;
+    uint16_t rrcount = 0;
+    size_t pos = 0;
+    int changed = 0;
+    char address[128];
+    if (!engine || !q || !q->zone || !pkt) {
         return QUERY_DISCARDED;
     }
-    ods_log_debug("[%s] dynamic update not implemented", query_str);
-    return query_notimpl(q);
+    ods_log_assert(q->zone->name);
+    ods_log_verbose("[%s] incoming update for zone %s", query_str,
+        q->zone->name);
+    if (!q->zone->adinbound || q->zone->adinbound->type != ADAPTER_DNS) {
+        ods_log_error("[%s] zone %s is not configured to have input dns "
+            "adapter", query_str, q->zone->name);
+        return query_notauth(q);
+    }
+    ods_log_assert(q->zone->adinbound->config);
+    dnsin = (dnsin_type*) q->zone->adinbound->config;
+    if (q->tsig_rr->status != TSIG_OK ||
+        !acl_find(dnsin->allow_update, &q->addr, q->tsig_rr)) {
+        if (addr2ip(q->addr, address, sizeof(address))) {
+            ods_log_info("[%s] unauthorized update for zone %s from %s: "
+                "no acl matches", query_str, q->zone->name, address);
+        } else {
+            ods_log_info("[%s] unauthorized update for zone %s from unknown "
+                "source: no acl matches", query_str, q->zone->name);
+        }
+        return query_refused(q);
+    }
+    /* skip header and zone section */
+    buffer_set_position(q->buffer, BUFFER_PKT_HEADER_SIZE);
+    count = buffer_pkt_qdcount(q->buffer);
+    for (rrcount = 0; rrcount < count; rrcount++) {
+        if (!buffer_skip_rr(q->buffer, 1)) {
+            return query_formerr(q);
+        }
+    }
+    pos = buffer_position(q->buffer);
+
+    /* the input view is also changed by the zone tasks, which hold the
+     * zone lock while they run; the listener does not wait for them, the
+     * client retries the update */
+    if (pthread_mutex_trylock(&q->zone->zone_lock)) {
+        ods_log_verbose("[%s] zone %s busy, update not applied", query_str,
+            q->zone->name);
+        return query_servfail(q);
+    }
+    view = zonelist_obtainresource(NULL, q->zone, NULL,
+        offsetof(zone_type, inputview));
+    rcode = update_apply(q->zone, view, pkt, &changed);
+    zonelist_releaseresource(NULL, q->zone, NULL,
+        offsetof(zone_type, inputview), view);
+    if (rcode == LDNS_RCODE_NOERROR && changed) {
+        /* sign the update ahead of the regular resigning of zones */
+        schedule_unscheduletask(engine->taskq, TASK_SIGN, q->zone->name);
+        schedule_unscheduletask(engine->taskq, TASK_FORCESIGN, q->zone->name);
+        schedule_scheduletask(engine->taskq, TASK_FORCESIGN, q->zone->name,
+            q->zone, &q->zone->zone_lock, schedule_PROMPTLY);
+    }
+    pthread_mutex_unlock(&q->zone->zone_lock);
+
+    /* send update reply */
+    buffer_pkt_set_qr(q->buffer);
+    buffer_pkt_set_rcode(q->buffer, rcode);
+    buffer_pkt_set_ancount(q->buffer, 0);
+    buffer_pkt_set_nscount(q->buffer, 0);
+    buffer_pkt_set_arcount(q->buffer, 0);
+
+    buffer_clear(q->buffer); /* lim = pos, pos = 0; */
+    buffer_set_position(q->buffer, pos);
+    buffer_set_limit(q->buffer, buffer_capacity(q->buffer));
+    q->reserved_space = edns_rr_reserved_space(q->edns_rr);
+    q->reserved_space += tsig_rr_reserved_space(q->tsig_rr);
+    return QUERY_PROCESSED;
 }
 
 
@@ -811,6 +956,7 @@ query_process(query_type* q, engine_type* engine)
     ldns_pkt_rcode rcode = LDNS_RCODE_NOERROR;
     ldns_pkt_opcode opcode = LDNS_PACKET_QUERY;
     ldns_rr_type qtype = LDNS_RR_TYPE_SOA;
+    query_state qstate;
     ods_log_assert(engine);
     ods_log_assert(q);
     ods_log_assert(q->buffer);
@@ -884,14 +1030,18 @@ query_process(query_type* q, engine_type* engine)
         return query_error(q, LDNS_RCODE_NOERROR);
     }
     /* handle incoming request */
+    if (opcode == LDNS_PACKET_UPDATE) {
+        /* the parsed update is applied to the zone */
+        qstate = query_process_update(q, pkt, engine);
+        ldns_pkt_free(pkt);
+        return qstate;
+    }
     ldns_pkt_free(pkt);
     switch (opcode) {
         case LDNS_PACKET_NOTIFY:
             return query_process_notify(q, qtype, engine);
         case LDNS_PACKET_QUERY:
             return query_process_query(q, qtype, engine);
-        case LDNS_PACKET_UPDATE:
-            return query_process_update(q);
         default:
             break;
     }
@@ -1062,6 +1212,10 @@ query_cleanup(query_type* q)
         ods_fclose(q->axfr_fd);
         q->axfr_fd = NULL;
     }
+    axfr_image_close(q->axfr_image);
+    q->axfr_image = NULL;
+    ixfr_journal_close(q->ixfr_journal);
+    q->ixfr_journal = NULL;
     buffer_cleanup(q->buffer);
     tsig_rr_cleanup(q->tsig_rr);
     edns_rr_cleanup(q->edns_rr);
@@ -35,6 +35,8 @@
 #include "config.h"
 #include "status.h"
 #include "signer/zone.h"
+#include "wire/axfrimage.h"
+#include "wire/ixfrjournal.h"
 #include "wire/buffer.h"
 #include "wire/edns.h"
 #include "wire/tsig.h"
@@ -79,6 +81,10 @@ struct query_struct {
 
     /* AXFR IXFR */
     FILE* axfr_fd;
+    axfr_image_type* axfr_image;
+    ixfr_journal_type* ixfr_journal;
+    uint32_t axfr_run;
+    size_t axfr_pos;
     uint32_t serial;
     size_t startpos;
     /* Bits */
@@ -125,6 +125,37 @@ sock_tcp_reuseaddr(sock_type* sock, const char* node, const char* port,
 }
 
 
+/**
+ * Let several sockets bind to the same address and port, the kernel
+ * spreads incoming queries and connections over them.
+ *
+ */
+static ods_status
+sock_reuseport(sock_type* sock, const char* node, const char* port,
+    const char* stype, const char* fam)
+{
+    int on = 1;
+    ods_log_assert(sock);
+    ods_log_assert(port);
+    ods_log_assert(stype);
+    ods_log_assert(fam);
+#ifdef SO_REUSEPORT
+    if (setsockopt(sock->s, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0) {
+        ods_log_error("[%s] unable to set %s/%s socket '%s:%s' to "
+            "reuse-port: setsockopt() failed (%s)", sock_str, stype, fam,
+            node?node:"localhost", port, strerror(errno));
+        return ODS_STATUS_SOCK_SETSOCKOPT_REUSEPORT;
+    }
+    return ODS_STATUS_OK;
+#else
+    (void) on;
+    ods_log_error("[%s] unable to set %s/%s socket '%s:%s' to reuse-port: "
+        "not supported", sock_str, stype, fam, node?node:"localhost", port);
+    return ODS_STATUS_SOCK_SETSOCKOPT_REUSEPORT;
+#endif
+}
+
+
 /**
  * Listen on tcp socket.
  *
@@ -152,7 +183,7 @@ sock_tcp_listen(sock_type* sock, const char* node, const char* port,
  */
 static ods_status
 sock_server_udp(sock_type* sock, const char* node, const char* port,
-    unsigned* ip6_support)
+    unsigned* ip6_support, int reuseport)
 {
     int on = 0;
     ods_status status = ODS_STATUS_OK;
@@ -176,11 +207,20 @@ sock_server_udp(sock_type* sock, const char* node, const char* port,
     }
     /* ipv4 */
     if (sock->addr->ai_family == AF_INET) {
+        if (reuseport) {
+            status = sock_reuseport(sock, node, port, "udp", "ipv4");
+            if (status != ODS_STATUS_OK) {
+                return status;
+            }
+        }
         status = sock_fcntl_and_bind(sock, node, port, "udp", "ipv4");
     }
     /* ipv6 */
     else if (sock->addr->ai_family == AF_INET6) {
         status = sock_v6only(sock, node, port, on, "udp");
+        if (status == ODS_STATUS_OK && reuseport) {
+            status = sock_reuseport(sock, node, port, "udp", "ipv6");
+        }
         if (status != ODS_STATUS_OK) {
             return status;
         }
@@ -196,7 +236,7 @@ sock_server_udp(sock_type* sock, const char* node, const char* port,
  */
 static ods_status
 sock_server_tcp(sock_type* sock, const char* node, const char* port,
-    unsigned* ip6_support)
+    unsigned* ip6_support, int reuseport)
 {
     int on = 0;
     ods_status status = ODS_STATUS_OK;
@@ -221,6 +261,12 @@ sock_server_tcp(sock_type* sock, const char* node, const char* port,
     /* ipv4 */
     if (sock->addr->ai_family == AF_INET) {
         sock_tcp_reuseaddr(sock, node, port, on, "ipv4");
+        if (reuseport) {
+            status = sock_reuseport(sock, node, port, "tcp", "ipv4");
+            if (status != ODS_STATUS_OK) {
+                return status;
+            }
+        }
         status = sock_fcntl_and_bind(sock, node, port, "tcp", "ipv4");
         if (status == ODS_STATUS_OK) {
             status = sock_tcp_listen(sock, node, port, "ipv4");
@@ -233,6 +279,12 @@ sock_server_tcp(sock_type* sock, const char* node, const char* port,
             return status;
         }
         sock_tcp_reuseaddr(sock, node, port, on, "ipv6");
+        if (reuseport) {
+            status = sock_reuseport(sock, node, port, "tcp", "ipv6");
+            if (status != ODS_STATUS_OK) {
+                return status;
+            }
+        }
         status = sock_fcntl_and_bind(sock, node, port, "tcp", "ipv6");
         if (status == ODS_STATUS_OK) {
             status = sock_tcp_listen(sock, node, port, "ipv6");
@@ -248,7 +300,8 @@ sock_server_tcp(sock_type* sock, const char* node, const char* port,
  */
 static ods_status
 socket_listen(sock_type* sock, struct addrinfo hints, int socktype,
-    const char* node, const char* port, unsigned* ip6_support)
+    const char* node, const char* port, unsigned* ip6_support,
+    int reuseport)
 {
     ods_status status = ODS_STATUS_OK;
     int r = 0;
@@ -274,9 +327,9 @@ socket_listen(sock_type* sock, struct addrinfo hints, int socktype,
     }
     /* socket */
     if (socktype == SOCK_DGRAM) {
-        status = sock_server_udp(sock, node, port, ip6_support);
+        status = sock_server_udp(sock, node, port, ip6_support, reuseport);
     } else if (socktype == SOCK_STREAM) {
-        status = sock_server_tcp(sock, node, port, ip6_support);
+        status = sock_server_tcp(sock, node, port, ip6_support, reuseport);
     }
     ods_log_debug("[%s] socket listening to %s:%s", sock_str,
         node?node:"localhost", port);
@@ -289,7 +342,7 @@ socket_listen(sock_type* sock, struct addrinfo hints, int socktype,
  *
  */
 ods_status
-sock_listen(socklist_type* sockets, listener_type* listener)
+sock_listen(socklist_type* sockets, listener_type* listener, int reuseport)
 {
     ods_status status = ODS_STATUS_OK;
     struct addrinfo hints[MAX_INTERFACES];
@@ -326,7 +379,7 @@ sock_listen(socklist_type* sockets, listener_type* listener)
         }
         /* udp */
         status = socket_listen(&sockets->udp[i], hints[i], SOCK_DGRAM,
-            node, port, &ip6_support);
+            node, port, &ip6_support, reuseport);
         if (status != ODS_STATUS_OK) {
             if (!ip6_support) {
                 ods_log_warning("[%s] fallback to udp/ipv4, no udp/ipv6: "
@@ -338,7 +391,7 @@ sock_listen(socklist_type* sockets, listener_type* listener)
         }
         /* tcp */
         status = socket_listen(&sockets->tcp[i], hints[i], SOCK_STREAM,
-            node, port, &ip6_support);
+            node, port, &ip6_support, reuseport);
         if (status != ODS_STATUS_OK) {
             if (!ip6_support) {
                 ods_log_warning("[%s] fallback to udp/ipv4, no udp/ipv6: "
@@ -355,6 +408,169 @@ sock_listen(socklist_type* sockets, listener_type* listener)
 }
 
 
+/**
+ * Create udp query batch.
+ *
+ */
+struct udp_batch*
+sock_udp_batch_create(void)
+{
+    struct udp_batch* batch = NULL;
+    size_t i = 0;
+    CHECKALLOC(batch = (struct udp_batch*) calloc(1, sizeof(struct udp_batch)));
+#ifdef SOCK_USE_MMSG
+    batch->size = SOCK_UDP_BATCH;
+#else
+    batch->size = 1;
+#endif
+    for (i = 0; i < batch->size; i++) {
+        batch->queries[i] = query_create();
+        if (!batch->queries[i]) {
+            sock_udp_batch_cleanup(batch);
+            return NULL;
+        }
+    }
+    return batch;
+}
+
+
+/**
+ * Clean up udp query batch.
+ *
+ */
+void
+sock_udp_batch_cleanup(struct udp_batch* batch)
+{
+    size_t i = 0;
+    if (!batch) {
+        return;
+    }
+    for (i = 0; i < batch->size; i++) {
+        query_cleanup(batch->queries[i]);
+    }
+    free(batch);
+}
+
+
+/**
+ * Process a udp query, leaving the answer (if any) flipped in q->buffer.
+ *
+ */
+static int
+process_udp(struct udp_data* data, query_type* q, size_t received)
+{
+    query_state qstate = QUERY_PROCESSED;
+    buffer_skip(q->buffer, received);
+    buffer_flip(q->buffer);
+    qstate = query_process(q, data->engine);
+    if (qstate == QUERY_DISCARDED) {
+        return 0;
+    }
+    ods_log_debug("[%s] query processed qstate=%d", sock_str, qstate);
+    query_add_optional(q, data->engine);
+    buffer_flip(q->buffer);
+    return 1;
+}
+
+
+#ifdef SOCK_USE_MMSG
+/**
+ * Send the first count answers of a batch over udp.
+ *
+ */
+static void
+send_udp_batch(struct udp_data* data, unsigned int count)
+{
+    struct udp_batch* batch = data->batch;
+    unsigned int sent = 0;
+    unsigned int i = 0;
+    int nb = 0;
+    ods_log_deeebug("[%s] sending %u messages over udp", sock_str, count);
+    while (sent < count) {
+        nb = sendmmsg(data->socket->s, &batch->msgs[sent], count - sent, 0);
+        if (nb == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ods_log_error("[%s] unable to send data over udp: sendmmsg() "
+                "failed (%s)", sock_str, strerror(errno));
+            /* the first message failed, skip it and go on */
+            sent++;
+            continue;
+        }
+        for (i = sent; i < sent + (unsigned int) nb; i++) {
+            if (batch->msgs[i].msg_len != batch->iovecs[i].iov_len) {
+                ods_log_error("[%s] unable to send data over udp: only "
+                    "sent %u of %u octets", sock_str,
+                    (unsigned) batch->msgs[i].msg_len,
+                    (unsigned) batch->iovecs[i].iov_len);
+            }
+        }
+        sent += (unsigned int) nb;
+    }
+}
+
+
+/**
+ * Handle incoming udp queries, as many as one batch at once.
+ *
+ */
+void
+sock_handle_udp(netio_type* ATTR_UNUSED(netio), netio_handler_type* handler,
+    netio_events_type event_types)
+{
+    struct udp_data* data = (struct udp_data*) handler->user_data;
+    struct udp_batch* batch = data->batch;
+    query_type* q = NULL;
+    int received = 0;
+    int i = 0;
+    unsigned int count = 0;
+
+    if (!(event_types & NETIO_EVENT_READ)) {
+        return;
+    }
+    ods_log_debug("[%s] incoming udp messages", sock_str);
+    for (i = 0; i < (int) batch->size; i++) {
+        q = batch->queries[i];
+        query_reset(q, UDP_MAX_MESSAGE_LEN, 0);
+        batch->iovecs[i].iov_base = buffer_begin(q->buffer);
+        batch->iovecs[i].iov_len = buffer_remaining(q->buffer);
+        memset(&batch->msgs[i], 0, sizeof(struct mmsghdr));
+        batch->msgs[i].msg_hdr.msg_name = &q->addr;
+        batch->msgs[i].msg_hdr.msg_namelen = q->addrlen;
+        batch->msgs[i].msg_hdr.msg_iov = &batch->iovecs[i];
+        batch->msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    received = recvmmsg(handler->fd, batch->msgs, batch->size, 0, NULL);
+    if (received < 1) {
+        if (errno != EAGAIN && errno != EINTR) {
+            ods_log_error("[%s] recvmmsg() failed: %s", sock_str,
+                strerror(errno));
+        }
+        return;
+    }
+    /* answers are packed at the front, i is never behind count */
+    for (i = 0; i < received; i++) {
+        q = batch->queries[i];
+        q->addrlen = batch->msgs[i].msg_hdr.msg_namelen;
+        if (batch->msgs[i].msg_len < 1 ||
+            !process_udp(data, q, batch->msgs[i].msg_len)) {
+            continue;
+        }
+        batch->iovecs[count].iov_base = buffer_begin(q->buffer);
+        batch->iovecs[count].iov_len = buffer_remaining(q->buffer);
+        memset(&batch->msgs[count], 0, sizeof(struct mmsghdr));
+        batch->msgs[count].msg_hdr.msg_name = &q->addr;
+        batch->msgs[count].msg_hdr.msg_namelen = q->addrlen;
+        batch->msgs[count].msg_hdr.msg_iov = &batch->iovecs[count];
+        batch->msgs[count].msg_hdr.msg_iovlen = 1;
+        count++;
+    }
+    if (count > 0) {
+        send_udp_batch(data, count);
+    }
+}
+#else /* !SOCK_USE_MMSG */
 /**
  * Send data over udp.
  *
@@ -390,8 +606,7 @@ sock_handle_udp(netio_type* ATTR_UNUSED(netio), netio_handler_type* handler,
 {
     struct udp_data* data = (struct udp_data*) handler->user_data;
     int received = 0;
-    query_type* q = data->query;
-    query_state qstate = QUERY_PROCESSED;
+    query_type* q = data->batch->queries[0];
 
     if (!(event_types & NETIO_EVENT_READ)) {
         return;
@@ -408,16 +623,11 @@ sock_handle_udp(netio_type* ATTR_UNUSED(netio), netio_handler_type* handler,
         }
         return;
     }
-    buffer_skip(q->buffer, received);
-    buffer_flip(q->buffer);
-    qstate = query_process(q, data->engine);
-    if (qstate != QUERY_DISCARDED) {
-        ods_log_debug("[%s] query processed qstate=%d", sock_str, qstate);
-        query_add_optional(q, data->engine);
-        buffer_flip(q->buffer);
+    if (process_udp(data, q, received)) {
         send_udp(data, q);
     }
 }
+#endif /* SOCK_USE_MMSG */
 
 
 /**
@@ -38,6 +38,16 @@
 #include "wire/netio.h"
 #include "wire/query.h"
 
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG)
+#define SOCK_USE_MMSG 1
+#endif
+
+/* Maximum number of udp queries received and answered at once. */
+#define SOCK_UDP_BATCH 32
+
 /**
  * Socket.
  *
@@ -58,6 +68,20 @@ struct socklist_struct {
     sock_type udp[MAX_INTERFACES];
 };
 
+/**
+ * Queries received and answered with one recvmmsg/sendmmsg call. A batch
+ * is shared by the udp handlers that are served by the same thread.
+ *
+ */
+struct udp_batch {
+    size_t size;
+    query_type* queries[SOCK_UDP_BATCH];
+#ifdef SOCK_USE_MMSG
+    struct mmsghdr msgs[SOCK_UDP_BATCH];
+    struct iovec iovecs[SOCK_UDP_BATCH];
+#endif
+};
+
 /**
  * Data for udp handlers.
  *
@@ -65,7 +89,7 @@ struct socklist_struct {
 struct udp_data {
     engine_type* engine;
     sock_type* socket;
-    query_type* query;
+    struct udp_batch* batch;
 };
 
 /**
@@ -96,10 +120,28 @@ struct tcp_data {
  * Create sockets and listen.
  * \param[out] sockets sockets
  * \param[in] listener interfaces
+ * \param[in] reuseport set SO_REUSEPORT, so that other threads can
+ *            listen on the same interfaces
  * \return ods_status status
  *
  */
-ods_status sock_listen(socklist_type* sockets, listener_type* listener);
+ods_status sock_listen(socklist_type* sockets, listener_type* listener,
+    int reuseport);
+
+/**
+ * Create udp query batch.
+ * \return struct udp_batch* batch, with one query if recvmmsg/sendmmsg
+ *         are not available
+ *
+ */
+struct udp_batch* sock_udp_batch_create(void);
+
+/**
+ * Clean up udp query batch.
+ * \param[in] batch batch
+ *
+ */
+void sock_udp_batch_cleanup(struct udp_batch* batch);
 
 /**
  * Handle incoming udp queries.
@@ -64,22 +64,164 @@ tcp_conn_create()
  *
  */
 tcp_set_type*
-tcp_set_create()
+tcp_set_create(size_t max, size_t max_master)
 {
     size_t i = 0;
     tcp_set_type* tcp_set = NULL;
+    if (max == 0) {
+        max = 1;
+    }
     CHECKALLOC(tcp_set = (tcp_set_type*) malloc(sizeof(tcp_set_type)));
     memset(tcp_set, 0, sizeof(tcp_set_type));
+    CHECKALLOC(tcp_set->tcp_conn = (tcp_conn_type**) calloc(max,
+        sizeof(tcp_conn_type*)));
+    tcp_set->tcp_max = max;
+    tcp_set->tcp_max_master = max_master;
     tcp_set->tcp_count = 0;
-    for (i=0; i < TCPSET_MAX; i++) {
+    for (i=0; i < max; i++) {
         tcp_set->tcp_conn[i] = tcp_conn_create();
     }
-    tcp_set->tcp_waiting_first = NULL;
-    tcp_set->tcp_waiting_last = NULL;
+    tcp_set->masters = NULL;
+    tcp_set->master_next = NULL;
     return tcp_set;
 }
 
 
+/**
+ * Look up master in set, add it if it is not there yet.
+ *
+ */
+tcp_master_type*
+tcp_set_master(tcp_set_type* set, const char* address, unsigned int port)
+{
+    tcp_master_type* master = NULL;
+    ods_log_assert(set);
+    ods_log_assert(address);
+    for (master = set->masters; master; master = master->next) {
+        if (master->port == port && strcmp(master->address, address) == 0) {
+            return master;
+        }
+    }
+    CHECKALLOC(master = (tcp_master_type*) malloc(sizeof(tcp_master_type)));
+    CHECKALLOC(master->address = strdup(address));
+    master->port = port;
+    master->tcp_count = 0;
+    master->tcp_waiting_first = NULL;
+    master->tcp_waiting_last = NULL;
+    master->next = set->masters;
+    set->masters = master;
+    return master;
+}
+
+
+/**
+ * Can a new connection to master be used?
+ *
+ */
+int
+tcp_set_available(tcp_set_type* set, tcp_master_type* master)
+{
+    ods_log_assert(set);
+    ods_log_assert(master);
+    if (set->tcp_count >= set->tcp_max) {
+        return 0;
+    }
+    return !set->tcp_max_master || master->tcp_count < set->tcp_max_master;
+}
+
+
+/**
+ * Take a free slot in the set for a connection to master.
+ *
+ */
+int
+tcp_set_take(tcp_set_type* set, tcp_master_type* master)
+{
+    size_t i = 0;
+    ods_log_assert(set);
+    ods_log_assert(master);
+    ods_log_assert(set->tcp_count < set->tcp_max);
+    for (i=0; i < set->tcp_max; i++) {
+        if (set->tcp_conn[i]->fd == -1) {
+            set->tcp_count++;
+            master->tcp_count++;
+            return (int) i;
+        }
+    }
+    ods_log_assert(0);
+    return -1;
+}
+
+
+/**
+ * Give a slot back.
+ *
+ */
+void
+tcp_set_give(tcp_set_type* set, tcp_master_type* master)
+{
+    ods_log_assert(set);
+    ods_log_assert(master);
+    ods_log_assert(set->tcp_count > 0);
+    ods_log_assert(master->tcp_count > 0);
+    set->tcp_count--;
+    master->tcp_count--;
+}
+
+
+/**
+ * Add zone to the end of the waiting queue of its master.
+ *
+ */
+void
+tcp_master_push(tcp_master_type* master, xfrd_type* xfrd)
+{
+    ods_log_assert(master);
+    ods_log_assert(xfrd);
+    xfrd->tcp_waiting_next = NULL;
+    if (master->tcp_waiting_last) {
+        master->tcp_waiting_last->tcp_waiting_next = xfrd;
+    } else {
+        master->tcp_waiting_first = xfrd;
+    }
+    master->tcp_waiting_last = xfrd;
+}
+
+
+/**
+ * Take the next waiting zone.
+ *
+ */
+xfrd_type*
+tcp_set_pop(tcp_set_type* set)
+{
+    tcp_master_type* start = NULL;
+    tcp_master_type* master = NULL;
+    xfrd_type* xfrd = NULL;
+    ods_log_assert(set);
+    if (!set->masters || set->tcp_count >= set->tcp_max) {
+        return NULL;
+    }
+    start = set->master_next ? set->master_next : set->masters;
+    master = start;
+    do {
+        if (master->tcp_waiting_first && tcp_set_available(set, master)) {
+            xfrd = master->tcp_waiting_first;
+            master->tcp_waiting_first = xfrd->tcp_waiting_next;
+            if (!master->tcp_waiting_first) {
+                master->tcp_waiting_last = NULL;
+            }
+            xfrd->tcp_waiting_next = NULL;
+            /* next turn goes to the master after this one */
+            set->master_next = master->next;
+            return xfrd;
+        }
+        master = master->next ? master->next : set->masters;
+    } while (master != start);
+    return NULL;
+}
+
+
 /**
  * Make tcp connection ready for reading.
  * \param[in] tcp tcp connection
@@ -242,11 +384,19 @@ void
 tcp_set_cleanup(tcp_set_type* set)
 {
     size_t i = 0;
+    tcp_master_type* master = NULL;
     if (!set) {
         return;
     }
-    for (i=0; i < TCPSET_MAX; i++) {
+    for (i=0; i < set->tcp_max; i++) {
         tcp_conn_cleanup(set->tcp_conn[i]);
     }
+    while (set->masters) {
+        master = set->masters;
+        set->masters = master->next;
+        free(master->address);
+        free(master);
+    }
+    free(set->tcp_conn);
     free(set);
 }
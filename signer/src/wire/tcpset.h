@@ -36,14 +36,13 @@
 #include <stdint.h>
 
 typedef struct tcp_conn_struct tcp_conn_type;
+typedef struct tcp_master_struct tcp_master_type;
 typedef struct tcp_set_struct tcp_set_type;
 
 #include "status.h"
 #include "wire/buffer.h"
 #include "wire/xfrd.h"
 
-#define TCPSET_MAX 50
-
 /**
  * tcp connection.
  *
@@ -58,6 +57,23 @@ struct tcp_conn_struct {
    buffer_type* packet;
    /* state: reading or writing */
    unsigned is_reading : 1;
+   /* connection was handed over from a previous transfer */
+   unsigned is_reused : 1;
+};
+
+/**
+ * Master that zones transfer from over tcp, with the zones that wait
+ * for a connection to it.
+ *
+ */
+struct tcp_master_struct {
+    tcp_master_type* next;
+    char* address;
+    unsigned int port;
+    /* connections in use to this master */
+    size_t tcp_count;
+    xfrd_type* tcp_waiting_first;
+    xfrd_type* tcp_waiting_last;
 };
 
 /*
@@ -65,10 +81,14 @@ struct tcp_conn_struct {
  *
  */
 struct tcp_set_struct {
-    tcp_conn_type* tcp_conn[TCPSET_MAX];
-    xfrd_type* tcp_waiting_first;
-    xfrd_type* tcp_waiting_last;
+    tcp_conn_type** tcp_conn;
+    size_t tcp_max;
+    /* max connections per master, 0 for no limit */
+    size_t tcp_max_master;
     size_t tcp_count;
+    /* masters seen, waiting zones are served round robin */
+    tcp_master_type* masters;
+    tcp_master_type* master_next;
 };
 
 /**
@@ -81,11 +101,66 @@ tcp_conn_type* tcp_conn_create(void);
 
 /**
  * Create a set of tcp connections.
- * \param[in] allocator memory allocator
+ * \param[in] max number of connections in the set
+ * \param[in] max_master number of connections per master, 0 for no limit
  * \return tcp_set_type* set of tcp connection.
  *
  */
-tcp_set_type* tcp_set_create(void);
+tcp_set_type* tcp_set_create(size_t max, size_t max_master);
+
+/**
+ * Look up master in set, add it if it is not there yet.
+ * \param[in] set set of tcp connections
+ * \param[in] address master address
+ * \param[in] port master port
+ * \return tcp_master_type* master
+ *
+ */
+tcp_master_type* tcp_set_master(tcp_set_type* set, const char* address,
+    unsigned int port);
+
+/**
+ * Can a new connection to master be used?
+ * \param[in] set set of tcp connections
+ * \param[in] master master
+ * \return int 1 if there is room in the set and for the master
+ *
+ */
+int tcp_set_available(tcp_set_type* set, tcp_master_type* master);
+
+/**
+ * Take a free slot in the set for a connection to master.
+ * \param[in] set set of tcp connections
+ * \param[in] master master
+ * \return int slot number
+ *
+ */
+int tcp_set_take(tcp_set_type* set, tcp_master_type* master);
+
+/**
+ * Give a slot back, the connection itself is not closed.
+ * \param[in] set set of tcp connections
+ * \param[in] master master
+ *
+ */
+void tcp_set_give(tcp_set_type* set, tcp_master_type* master);
+
+/**
+ * Add zone to the end of the waiting queue of its master.
+ * \param[in] master master
+ * \param[in] xfrd zone transfer state
+ *
+ */
+void tcp_master_push(tcp_master_type* master, xfrd_type* xfrd);
+
+/**
+ * Take the next waiting zone. Masters take turns, masters that are at
+ * their connection limit are skipped.
+ * \param[in] set set of tcp connections
+ * \return xfrd_type* waiting zone, NULL if none can go
+ *
+ */
+xfrd_type* tcp_set_pop(tcp_set_type* set);
 
 /**
  * Make tcp connection ready for reading.
@@ -0,0 +1,489 @@
+/*
+ * Copyright (c) 2011-2018 NLNet Labs.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Dynamic update.
+ *
+ */
+
+#include "config.h"
+#include <string.h>
+#include "adapter/adapi.h"
+#include "log.h"
+#include "util.h"
+#include "wire/update.h"
+
+static const char* update_str = "update";
+
+
+/**
+ * Whether a name is the zone apex or below it.
+ *
+ */
+static int
+update_inzone(zone_type* zone, ldns_rdf* dname)
+{
+    return !ldns_dname_compare(dname, zone->apex) ||
+        ldns_dname_is_subdomain(dname, zone->apex);
+}
+
+
+/**
+ * Whether a type is a meta type, which can not be added to a zone.
+ *
+ */
+static int
+update_metatype(ldns_rr_type type)
+{
+    switch (type) {
+        case LDNS_RR_TYPE_ANY:
+        case LDNS_RR_TYPE_AXFR:
+        case LDNS_RR_TYPE_IXFR:
+        case LDNS_RR_TYPE_MAILA:
+        case LDNS_RR_TYPE_MAILB:
+        case LDNS_RR_TYPE_OPT:
+        case LDNS_RR_TYPE_TSIG:
+            return 1;
+        default:
+            break;
+    }
+    return 0;
+}
+
+
+/**
+ * Whether records of a type are maintained by the signer. Updates do not
+ * delete them.
+ *
+ */
+static int
+update_signertype(ldns_rr_type type)
+{
+    return type == LDNS_RR_TYPE_RRSIG || type == LDNS_RR_TYPE_NSEC ||
+        type == LDNS_RR_TYPE_NSEC3 || type == LDNS_RR_TYPE_NSEC3PARAMS ||
+        type == LDNS_RR_TYPE_DNSKEY;
+}
+
+
+/**
+ * Look up the record of a name.
+ *
+ */
+static recordset_type
+update_lookup(names_view_type view, ldns_rdf* dname)
+{
+    recordset_type record;
+    char* name;
+    name = ldns_rdf2str(dname);
+    record = names_take(view, 0, name);
+    free(name);
+    return record;
+}
+
+
+/**
+ * Whether a record holds data that can not live next to a CNAME.
+ *
+ */
+static int
+update_hasnoncname(recordset_type record)
+{
+    names_iterator iter;
+    ldns_rr_type rrtype;
+    int found = 0;
+    for (iter = names_recordalltypes(record); names_iterate(&iter, &rrtype);
+        names_advance(&iter, NULL)) {
+        if (rrtype != LDNS_RR_TYPE_CNAME && !update_signertype(rrtype)) {
+            found = 1;
+        }
+    }
+    return found;
+}
+
+
+/**
+ * Check a value dependent prerequisite: the rrset in the zone must be
+ * exactly the set of records with the same name and type in the
+ * prerequisite section.
+ *
+ */
+static ldns_pkt_rcode
+update_rrsetequal(names_view_type view, ldns_rr_list* prereqs, size_t first,
+    uint8_t* done)
+{
+    ldns_rr* rr = ldns_rr_list_rr(prereqs, first);
+    ldns_rr* other;
+    ldns_rr_type type = ldns_rr_get_type(rr);
+    ldns_rr_list* rrs = NULL;
+    recordset_type record;
+    size_t i, j, count = 0;
+    int duplicate;
+
+    record = update_lookup(view, ldns_rr_owner(rr));
+    for (i = first; i < ldns_rr_list_rr_count(prereqs); i++) {
+        other = ldns_rr_list_rr(prereqs, i);
+        if (done[i] || ldns_rr_get_type(other) != type ||
+            ldns_dname_compare(ldns_rr_owner(other), ldns_rr_owner(rr))) {
+            continue;
+        }
+        done[i] = 1;
+        if (!names_recordhasdata(record, type, other, 0)) {
+            return LDNS_RCODE_NXRRSET;
+        }
+        duplicate = 0;
+        for (j = first; j < i && !duplicate; j++) {
+            duplicate = (ldns_rr_get_type(ldns_rr_list_rr(prereqs, j)) == type &&
+                ldns_rr_compare(ldns_rr_list_rr(prereqs, j), other) == 0);
+        }
+        if (!duplicate) {
+            count++;
+        }
+    }
+    names_recordlookupall(record, type, NULL, &rrs, NULL);
+    if (!rrs || ldns_rr_list_rr_count(rrs) != count) {
+        ldns_rr_list_deep_free(rrs);
+        return LDNS_RCODE_NXRRSET;
+    }
+    ldns_rr_list_deep_free(rrs);
+    return LDNS_RCODE_NOERROR;
+}
+
+
+/**
+ * Check the prerequisite section (RFC 2136 section 3.2).
+ *
+ */
+static ldns_pkt_rcode
+update_prerequisites(zone_type* zone, names_view_type view,
+    ldns_rr_list* prereqs)
+{
+    ldns_rr* rr;
+    ldns_rr_type type;
+    ldns_rr_class klass;
+    recordset_type record;
+    ldns_pkt_rcode rcode = LDNS_RCODE_NOERROR;
+    uint8_t* done = NULL;
+    size_t i, count = ldns_rr_list_rr_count(prereqs);
+
+    CHECKALLOC(done = (uint8_t*) calloc(count + 1, sizeof(uint8_t)));
+    for (i = 0; i < count && rcode == LDNS_RCODE_NOERROR; i++) {
+        rr = ldns_rr_list_rr(prereqs, i);
+        type = ldns_rr_get_type(rr);
+        klass = ldns_rr_get_class(rr);
+        if (ldns_rr_ttl(rr) != 0) {
+            rcode = LDNS_RCODE_FORMERR;
+        } else if (!update_inzone(zone, ldns_rr_owner(rr))) {
+            rcode = LDNS_RCODE_NOTZONE;
+        } else if (klass == LDNS_RR_CLASS_ANY || klass == LDNS_RR_CLASS_NONE) {
+            if (ldns_rr_rd_count(rr) != 0) {
+                rcode = LDNS_RCODE_FORMERR;
+                continue;
+            }
+            record = update_lookup(view, ldns_rr_owner(rr));
+            if (type == LDNS_RR_TYPE_ANY) {
+                /* name is in use, or not */
+                if (names_recordhasdata(record, 0, NULL, 0)) {
+                    rcode = (klass == LDNS_RR_CLASS_NONE ?
+                        LDNS_RCODE_YXDOMAIN : LDNS_RCODE_NOERROR);
+                } else {
+                    rcode = (klass == LDNS_RR_CLASS_ANY ?
+                        LDNS_RCODE_NXDOMAIN : LDNS_RCODE_NOERROR);
+                }
+            } else {
+                /* rrset exists (value independent), or not */
+                if (names_recordhasdata(record, type, NULL, 0)) {
+                    rcode = (klass == LDNS_RR_CLASS_NONE ?
+                        LDNS_RCODE_YXRRSET : LDNS_RCODE_NOERROR);
+                } else {
+                    rcode = (klass == LDNS_RR_CLASS_ANY ?
+                        LDNS_RCODE_NXRRSET : LDNS_RCODE_NOERROR);
+                }
+            }
+        } else if (klass == zone->klass) {
+            /* rrset exists (value dependent) */
+            if (!done[i]) {
+                rcode = update_rrsetequal(view, prereqs, i, done);
+            }
+        } else {
+            rcode = LDNS_RCODE_FORMERR;
+        }
+    }
+    free(done);
+    return rcode;
+}
+
+
+/**
+ * Check the update section (RFC 2136 section 3.4.1).
+ *
+ */
+static ldns_pkt_rcode
+update_prescan(zone_type* zone, ldns_rr_list* updates)
+{
+    ldns_rr* rr;
+    ldns_rr_type type;
+    ldns_rr_class klass;
+    size_t i;
+    for (i = 0; i < ldns_rr_list_rr_count(updates); i++) {
+        rr = ldns_rr_list_rr(updates, i);
+        type = ldns_rr_get_type(rr);
+        klass = ldns_rr_get_class(rr);
+        if (!update_inzone(zone, ldns_rr_owner(rr))) {
+            return LDNS_RCODE_NOTZONE;
+        }
+        if (klass == zone->klass) {
+            if (update_metatype(type) || ldns_rr_rd_count(rr) == 0) {
+                return LDNS_RCODE_FORMERR;
+            }
+        } else if (klass == LDNS_RR_CLASS_ANY) {
+            if (ldns_rr_ttl(rr) != 0 || ldns_rr_rd_count(rr) != 0 ||
+                (type != LDNS_RR_TYPE_ANY && update_metatype(type))) {
+                return LDNS_RCODE_FORMERR;
+            }
+        } else if (klass == LDNS_RR_CLASS_NONE) {
+            if (ldns_rr_ttl(rr) != 0 || update_metatype(type)) {
+                return LDNS_RCODE_FORMERR;
+            }
+        } else {
+            return LDNS_RCODE_FORMERR;
+        }
+    }
+    return LDNS_RCODE_NOERROR;
+}
+
+
+/**
+ * Add a record to the zone. The SOA belongs to the primary of the zone and
+ * is not changed by updates.
+ * \return int 1 if the zone changed, 0 if not, -1 on error
+ *
+ */
+static int
+update_add(zone_type* zone, names_view_type view, ldns_rr* rr)
+{
+    recordset_type record;
+    ldns_rr_type type = ldns_rr_get_type(rr);
+    char* name;
+    if (type == LDNS_RR_TYPE_SOA) {
+        return 0;
+    }
+    if (adapi_filter_rr(zone, rr, 1, 0) != ODS_STATUS_OK) {
+        return 0;
+    }
+    name = ldns_rdf2str(ldns_rr_owner(rr));
+    record = names_take(view, 0, name);
+    if (record) {
+        if (type == LDNS_RR_TYPE_CNAME ? update_hasnoncname(record) :
+            (!update_signertype(type) &&
+            names_recordhasdata(record, LDNS_RR_TYPE_CNAME, NULL, 0))) {
+            ods_log_debug("[%s] zone %s ignore %s: cname conflict",
+                update_str, zone->name, name);
+            free(name);
+            return 0;
+        }
+        if (names_recordhasdata(record, type, rr, 1)) {
+            free(name);
+            return 0;
+        }
+    } else {
+        record = names_place(view, name);
+        if (!record || namedb_domain_entize(view, record, ldns_rr_owner(rr),
+            zone->apex) != ODS_STATUS_OK) {
+            ods_log_error("[%s] unable to add %s to zone %s", update_str,
+                name, zone->name);
+            free(name);
+            return -1;
+        }
+    }
+    free(name);
+    names_overwrite(view, &record);
+    if (type == LDNS_RR_TYPE_CNAME) {
+        names_recorddelall(record, type);
+    } else if (names_recordhasdata(record, type, rr, 0)) {
+        /* same data with another ttl */
+        names_recorddeldata(record, type, rr);
+    }
+    names_recordadddata(record, rr);
+    return 1;
+}
+
+
+/**
+ * Delete records from the zone. The SOA and the apex NS rrset are never
+ * deleted as a whole, nor are records maintained by the signer.
+ * \return int 1 if the zone changed, 0 if not
+ *
+ */
+static int
+update_del(zone_type* zone, names_view_type view, ldns_rr* rr)
+{
+    recordset_type record;
+    names_iterator iter;
+    ldns_rr_type rrtype;
+    ldns_rr_type* types = NULL;
+    ldns_rr_type type = ldns_rr_get_type(rr);
+    ldns_rr_list* rrs = NULL;
+    int apex, i, count = 0;
+
+    record = update_lookup(view, ldns_rr_owner(rr));
+    if (!record || type == LDNS_RR_TYPE_SOA || update_signertype(type)) {
+        return 0;
+    }
+    apex = !ldns_dname_compare(ldns_rr_owner(rr), zone->apex);
+    if (ldns_rr_get_class(rr) == LDNS_RR_CLASS_NONE) {
+        /* delete a record from an rrset */
+        ldns_rr_set_class(rr, zone->klass);
+        if (!names_recordhasdata(record, type, rr, 0)) {
+            return 0;
+        }
+        if (apex && type == LDNS_RR_TYPE_NS) {
+            names_recordlookupall(record, type, NULL, &rrs, NULL);
+            count = (rrs ? ldns_rr_list_rr_count(rrs) : 0);
+            ldns_rr_list_deep_free(rrs);
+            if (count <= 1) {
+                return 0;
+            }
+        }
+        names_overwrite(view, &record);
+        names_recorddeldata(record, type, rr);
+        return 1;
+    } else if (type != LDNS_RR_TYPE_ANY) {
+        /* delete an rrset */
+        if ((apex && type == LDNS_RR_TYPE_NS) ||
+            !names_recordhasdata(record, type, NULL, 0)) {
+            return 0;
+        }
+        names_overwrite(view, &record);
+        names_recorddelall(record, type);
+        return 1;
+    }
+    /* delete all rrsets from a name */
+    for (iter = names_recordalltypes(record); names_iterate(&iter, &rrtype);
+        names_advance(&iter, NULL)) {
+        if (update_signertype(rrtype) || (apex && (rrtype ==
+            LDNS_RR_TYPE_SOA || rrtype == LDNS_RR_TYPE_NS))) {
+            continue;
+        }
+        CHECKALLOC(types = (ldns_rr_type*) realloc(types,
+            (count + 1) * sizeof(ldns_rr_type)));
+        types[count++] = rrtype;
+    }
+    if (count) {
+        names_overwrite(view, &record);
+        for (i = 0; i < count; i++) {
+            names_recorddelall(record, types[i]);
+        }
+    }
+    free(types);
+    return count > 0;
+}
+
+
+/**
+ * Apply dynamic update.
+ *
+ */
+ldns_pkt_rcode
+update_apply(zone_type* zone, names_view_type view, ldns_pkt* pkt,
+    int* changed)
+{
+    ldns_rr_list* prereqs = ldns_pkt_answer(pkt);
+    ldns_rr_list* updates = ldns_pkt_authority(pkt);
+    ldns_rr* rr;
+    ldns_pkt_rcode rcode;
+    size_t i;
+    int ret, count = 0;
+    ods_log_assert(zone);
+    ods_log_assert(zone->apex);
+    ods_log_assert(zone->name);
+    ods_log_assert(pkt);
+
+    if (changed) {
+        *changed = 0;
+    }
+    /* zone section */
+    rr = ldns_rr_list_rr(ldns_pkt_question(pkt), 0);
+    if (ldns_pkt_qdcount(pkt) != 1 || !rr ||
+        ldns_rr_get_type(rr) != LDNS_RR_TYPE_SOA ||
+        ldns_rr_get_class(rr) != zone->klass ||
+        ldns_dname_compare(ldns_rr_owner(rr), zone->apex)) {
+        return LDNS_RCODE_FORMERR;
+    }
+    /* the serial of the unsigned zone stays that of the primary, the
+     * signed zone gets a new serial from the signer */
+    if (!zone->signconf || !zone->signconf->soa_serial ||
+        !strcmp(zone->signconf->soa_serial, "keep")) {
+        ods_log_warning("[%s] zone %s update refused: signed serial is "
+            "kept from the primary", update_str, zone->name);
+        return LDNS_RCODE_REFUSED;
+    }
+    for (i = 0; i < ldns_rr_list_rr_count(prereqs); i++) {
+        ldns_dname2canonical(ldns_rr_owner(ldns_rr_list_rr(prereqs, i)));
+    }
+    for (i = 0; i < ldns_rr_list_rr_count(updates); i++) {
+        ldns_dname2canonical(ldns_rr_owner(ldns_rr_list_rr(updates, i)));
+    }
+    /* start from the latest committed state of the zone */
+    names_viewreset(view);
+    rcode = update_prerequisites(zone, view, prereqs);
+    if (rcode == LDNS_RCODE_NOERROR) {
+        rcode = update_prescan(zone, updates);
+    }
+    if (rcode != LDNS_RCODE_NOERROR) {
+        ods_log_verbose("[%s] zone %s update rejected (rcode %d)",
+            update_str, zone->name, (int) rcode);
+        return rcode;
+    }
+    for (i = 0; i < ldns_rr_list_rr_count(updates); i++) {
+        rr = ldns_rr_list_rr(updates, i);
+        if (ldns_rr_get_class(rr) == zone->klass) {
+            ret = update_add(zone, view, rr);
+        } else {
+            ret = update_del(zone, view, rr);
+        }
+        if (ret < 0) {
+            names_viewreset(view);
+            return LDNS_RCODE_SERVFAIL;
+        }
+        count += ret;
+    }
+    if (!count) {
+        names_viewreset(view);
+        return LDNS_RCODE_NOERROR;
+    }
+    if (names_viewcommit(view)) {
+        ods_log_error("[%s] unable to update zone %s: commit conflict",
+            update_str, zone->name);
+        names_viewreset(view);
+        return LDNS_RCODE_SERVFAIL;
+    }
+    ods_log_verbose("[%s] zone %s updated, %d changes", update_str,
+        zone->name, count);
+    if (changed) {
+        *changed = count;
+    }
+    return LDNS_RCODE_NOERROR;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2011-2018 NLNet Labs.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Dynamic update.
+ *
+ */
+
+#ifndef WIRE_UPDATE_H
+#define WIRE_UPDATE_H
+
+#include "config.h"
+#include "signer/zone.h"
+#include "views/proto.h"
+
+#include <ldns/ldns.h>
+
+/**
+ * Apply a dynamic update (RFC 2136) to the input view of a zone. The
+ * prerequisite section is checked against the view, after which the
+ * update section is applied and committed as one change, or not at all.
+ * The SOA and its serial are left to the primary of the zone, so a later
+ * IXFR from the primary still applies; the signed zone gets a new serial
+ * when it is signed. Updates are refused when the signed serial is kept
+ * from the unsigned zone. The caller must hold the zone lock.
+ * \param[in] zone zone
+ * \param[in] view input view of the zone
+ * \param[in] pkt update message, owner names and classes are modified
+ * \param[out] changed number of records added or deleted, may be NULL
+ * \return ldns_pkt_rcode response code
+ *
+ */
+ldns_pkt_rcode update_apply(zone_type* zone, names_view_type view,
+    ldns_pkt* pkt, int* changed);
+
+#endif /* WIRE_UPDATE_H */
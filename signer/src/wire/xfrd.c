@@ -30,6 +30,7 @@
  */
 
 #include "config.h"
+#include "adapter/addns.h"
 #include "daemon/engine.h"
 #include "daemon/xfrhandler.h"
 #include "duration.h"
@@ -43,6 +44,7 @@
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/uio.h>
 
 #define XFRD_TSIG_MAX_UNSIGNED 100
 
@@ -68,7 +70,9 @@ static xfrd_pkt_status xfrd_handle_packet(xfrd_type* xfrd,
 
 static void xfrd_tcp_obtain(xfrd_type* xfrd, tcp_set_type* set);
 static void xfrd_tcp_read(xfrd_type* xfrd, tcp_set_type* set);
-static void xfrd_tcp_release(xfrd_type* xfrd, tcp_set_type* set, int open_waiting);
+static void xfrd_tcp_release(xfrd_type* xfrd, tcp_set_type* set,
+    int open_waiting, int keep_open);
+static int xfrd_tcp_reopen(xfrd_type* xfrd, tcp_set_type* set);
 static void xfrd_tcp_write(xfrd_type* xfrd, tcp_set_type* set);
 static void xfrd_tcp_xfr(xfrd_type* xfrd, tcp_set_type* set);
 static int xfrd_tcp_open(xfrd_type* xfrd, tcp_set_type* set);
@@ -103,7 +107,10 @@ xfrd_create(xfrhandler_type* xfrhandler, zone_type* zone)
 
     xfrd->xfrhandler = xfrhandler;
     xfrd->zone = zone;
+    xfrd->spool_fd = -1;
+    xfrd->stream = NULL;
     xfrd->tcp_conn = -1;
+    xfrd->tcp_master = NULL;
     xfrd->round_num = -1;
     xfrd->master_num = 0;
     xfrd->next_master = -1;
@@ -148,6 +155,7 @@ xfrd_create(xfrhandler_type* xfrhandler, zone_type* zone)
     xfrd->handler.event_types =
         NETIO_EVENT_READ|NETIO_EVENT_TIMEOUT;
     xfrd->handler.event_handler = xfrd_handle_zone;
+    xfrd->handler.entry = NULL;
     xfrd_set_timer_time(xfrd, 0);
     return xfrd;
 }
@@ -166,6 +174,19 @@ xfrd_time(xfrd_type* xfrd)
 }
 
 
+/**
+ * Tell netio that the handler changed, it may be changed from another
+ * thread or from the callback of another zone.
+ *
+ */
+static void
+xfrd_handler_update(xfrd_type* xfrd)
+{
+    xfrhandler_type* xfrhandler = (xfrhandler_type*) xfrd->xfrhandler;
+    netio_update_handler(xfrhandler->netio, &xfrd->handler);
+}
+
+
 /**
  * Set timer.
  *
@@ -197,6 +218,7 @@ xfrd_set_timer(xfrd_type* xfrd, time_t t)
     xfrd->handler.timeout = &xfrd->timeout;
     xfrd->timeout.tv_sec = t;
     xfrd->timeout.tv_nsec = 0;
+    xfrd_handler_update(xfrd);
 }
 
 
@@ -209,6 +231,7 @@ xfrd_unset_timer(xfrd_type* xfrd)
 {
     ods_log_assert(xfrd);
     xfrd->handler.timeout = NULL;
+    xfrd_handler_update(xfrd);
 }
 
 
@@ -421,6 +444,75 @@ xfrd_tsig_process(xfrd_type* xfrd, buffer_type* buffer)
 }
 
 
+/**
+ * Append a record to the transfer spool, opening it if needed.
+ * Called with rw_lock held.
+ *
+ */
+static int
+xfrd_spool_write(xfrd_type* xfrd, char type, uint8_t* data, size_t len,
+    int truncate)
+{
+    zone_type* zone = (zone_type*) xfrd->zone;
+    char* xfrfile = NULL;
+    uint8_t hdr[XFRD_SPOOL_HDRLEN];
+    struct iovec iov[2];
+    ssize_t written;
+    size_t total = XFRD_SPOOL_HDRLEN + len;
+
+    if (xfrd->spool_fd == -1) {
+        xfrfile = ods_build_path(zone->name, ".xfrd", 0, 1);
+        if (!xfrfile) {
+            ods_log_crit("[%s] unable to spool xfr zone %s: build path "
+                "failed", xfrd_str, zone->name);
+            return -1;
+        }
+        xfrd->spool_fd = open(xfrfile, O_WRONLY|O_CREAT|O_APPEND, 0644);
+        free((void*) xfrfile);
+        if (xfrd->spool_fd == -1) {
+            ods_log_crit("[%s] unable to spool xfr zone %s: open() failed "
+                "(%s)", xfrd_str, zone->name, strerror(errno));
+            return -1;
+        }
+    }
+    if (truncate && ftruncate(xfrd->spool_fd, 0) != 0) {
+        ods_log_crit("[%s] unable to spool xfr zone %s: ftruncate() failed "
+            "(%s)", xfrd_str, zone->name, strerror(errno));
+        return -1;
+    }
+    hdr[0] = (uint8_t) type;
+    write_uint32(&hdr[1], (uint32_t) len);
+    iov[0].iov_base = hdr;
+    iov[0].iov_len = XFRD_SPOOL_HDRLEN;
+    iov[1].iov_base = data;
+    iov[1].iov_len = len;
+    /* the spool is opened for appending, a record is written at once */
+    written = writev(xfrd->spool_fd, iov, (len ? 2 : 1));
+    if (written != (ssize_t) total) {
+        ods_log_crit("[%s] unable to spool xfr zone %s: writev() failed "
+            "(%s)", xfrd_str, zone->name,
+            written < 0 ? strerror(errno) : "short write");
+        xfrd_spool_close(xfrd);
+        return -1;
+    }
+    return 0;
+}
+
+
+/**
+ * Close the transfer spool.
+ *
+ */
+void
+xfrd_spool_close(xfrd_type* xfrd)
+{
+    if (xfrd->spool_fd != -1) {
+        close(xfrd->spool_fd);
+        xfrd->spool_fd = -1;
+    }
+}
+
+
 /**
  * Commit answer on disk.
  *
@@ -429,34 +521,34 @@ static void
 xfrd_commit_packet(xfrd_type* xfrd)
 {
     zone_type* zone = NULL;
-    char* xfrfile = NULL;
-    FILE* fd = NULL;
     time_t serial_disk_acq = 0;
+    int streamed = 0;
     ods_log_assert(xfrd);
     zone = (zone_type*) xfrd->zone;
-    xfrfile = ods_build_path(zone->name, ".xfrd", 0, 1);
-    if (!xfrfile) {
-        ods_log_crit("[%s] unable to commit xfr zone %s: build path failed",
-            xfrd_str, zone->name);
-        return;
-    }
     ods_log_assert(zone);
     ods_log_assert(zone->name);
     pthread_mutex_lock(&zone->zone_lock);
+    if (xfrd->stream) {
+        /* the transfer was applied while it came in, commit it */
+        streamed = (addns_stream_finish(xfrd->stream, 1) == ODS_STATUS_OK);
+        xfrd->stream = NULL;
+    }
     pthread_mutex_lock(&xfrd->rw_lock);
     pthread_mutex_lock(&xfrd->serial_lock);
-    /* mark end packet */
-    fd = ods_fopen(xfrfile, NULL, "a");
-    free((void*)xfrfile);
-    if (fd) {
-        fprintf(fd, ";;ENDPACKET\n");
-        ods_fclose(fd);
-    } else {
+    if (streamed && xfrd->spool_fd != -1 &&
+        ftruncate(xfrd->spool_fd, 0) != 0) {
+        /* reading the spool again will not do harm */
+        ods_log_warning("[%s] unable to clear spool zone %s: ftruncate() "
+            "failed (%s)", xfrd_str, zone->name, strerror(errno));
+    }
+    /* mark end of transfer */
+    if (!streamed &&
+        xfrd_spool_write(xfrd, XFRD_SPOOL_END, NULL, 0, 0) != 0) {
         pthread_mutex_unlock(&xfrd->rw_lock);
         pthread_mutex_unlock(&zone->zone_lock);
         pthread_mutex_unlock(&xfrd->serial_lock);
-        ods_log_crit("[%s] unable to commit xfr zone %s: ods_fopen() failed "
-            "(%s)", xfrd_str, zone->name, strerror(errno));
+        ods_log_crit("[%s] unable to commit xfr zone %s", xfrd_str,
+            zone->name);
         return;
     }
     /* update soa serial management */
@@ -468,7 +560,12 @@ xfrd_commit_packet(xfrd_type* xfrd)
         xfrd->serial_disk_acquired++;
     }
     xfrd->soa.serial = xfrd->serial_disk;
-    if (xfrd->msg_do_retransfer ||
+    if (streamed) {
+        /* already in the input view, the spool is not read again */
+        xfrd->serial_xfr = xfrd->serial_disk;
+        xfrd->serial_xfr_acquired = xfrd->serial_disk_acquired;
+    }
+    if (streamed || xfrd->msg_do_retransfer ||
             (util_serial_gt(xfrd->serial_disk, xfrd->serial_xfr) &&
              xfrd->serial_disk_acquired > xfrd->serial_xfr_acquired)) {
         /* reschedule task */
@@ -502,50 +599,45 @@ static void
 xfrd_dump_packet(xfrd_type* xfrd, buffer_type* buffer)
 {
     zone_type* zone = NULL;
-    char* xfrfile = NULL;
-    FILE* fd = NULL;
-    ldns_pkt* pkt = NULL;
-    ldns_status status = LDNS_STATUS_OK;
+    int truncate = 0;
+    int pending = 0;
     ods_log_assert(buffer);
     ods_log_assert(xfrd);
     zone = (zone_type*) xfrd->zone;
     ods_log_assert(zone);
     ods_log_assert(zone->name);
-    status = ldns_wire2pkt(&pkt, buffer_begin(buffer), buffer_limit(buffer));
-    if (status != LDNS_STATUS_OK) {
-        ods_log_crit("[%s] unable to dump packet zone %s: ldns_wire2pkt() "
-            "failed (%s)", xfrd_str, zone->name,
-            ldns_get_errorstr_by_id(status));
-        return;
-    }
-    ods_log_assert(pkt);
-    xfrfile = ods_build_path(zone->name, ".xfrd", 0, 1);
-    if (!xfrfile) {
-        ods_log_crit("[%s] unable to dump packet zone %s: build path failed",
-            xfrd_str, zone->name);
-        return;
-    }
     pthread_mutex_lock(&xfrd->rw_lock);
     if (xfrd->msg_do_retransfer && !xfrd->msg_seq_nr && !xfrd->msg_is_ixfr) {
-        fd = ods_fopen(xfrfile, NULL, "w");
-    } else {
-        fd = ods_fopen(xfrfile, NULL, "a");
-    }
-    free((void*) xfrfile);
-    if (!fd) {
-        ods_log_crit("[%s] unable to dump packet zone %s: ods_fopen() failed "
-            "(%s)", xfrd_str, zone->name, strerror(errno));
-        pthread_mutex_unlock(&xfrd->rw_lock);
-        return;
+        truncate = 1;
     }
-    ods_log_assert(fd);
     if (xfrd->msg_seq_nr == 0) {
-        fprintf(fd, ";;BEGINPACKET\n");
+        if (xfrd->stream) {
+            (void) addns_stream_finish(xfrd->stream, 0);
+            xfrd->stream = NULL;
+        }
+        /* the transfer can only be applied to the input view while it
+         * comes in if there are no earlier transfers waiting on disk */
+        pthread_mutex_lock(&xfrd->serial_lock);
+        pending = (xfrd->serial_disk_acquired > xfrd->serial_xfr_acquired);
+        pthread_mutex_unlock(&xfrd->serial_lock);
+        if (truncate || !pending) {
+            xfrd->stream = addns_stream_start(zone);
+        }
+    }
+    /* the packet is stored as received, the answer section is
+     * decoded when the transfer is read into the zone */
+    if ((xfrd->msg_seq_nr == 0 &&
+         xfrd_spool_write(xfrd, XFRD_SPOOL_BEGIN, NULL, 0, truncate) != 0) ||
+        xfrd_spool_write(xfrd, XFRD_SPOOL_PACKET, buffer_begin(buffer),
+            buffer_limit(buffer), 0) != 0) {
+        ods_log_crit("[%s] unable to dump packet zone %s", xfrd_str,
+            zone->name);
+    }
+    if (xfrd->stream) {
+        addns_stream_packet(xfrd->stream, buffer_begin(buffer),
+            buffer_limit(buffer));
     }
-    ldns_rr_list_print(fd, ldns_pkt_answer(pkt));
-    ods_fclose(fd);
     pthread_mutex_unlock(&xfrd->rw_lock);
-    ldns_pkt_free(pkt);
 }
 
 
@@ -977,6 +1069,12 @@ xfrd_handle_packet(xfrd_type* xfrd, buffer_type* buffer)
         case XFRD_PKT_BAD:
         default:
             /* rollback */
+            if (xfrd->stream) {
+                pthread_mutex_lock(&xfrd->rw_lock);
+                (void) addns_stream_finish(xfrd->stream, 0);
+                xfrd->stream = NULL;
+                pthread_mutex_unlock(&xfrd->rw_lock);
+            }
             if (xfrd->msg_seq_nr > 0) {
                 buffer_clear(buffer);
                 ods_log_info("[%s] zone %s xfr rollback", xfrd_str,
@@ -1062,20 +1160,34 @@ xfrd_tcp_write(xfrd_type* xfrd, tcp_set_type* set)
                 xfrd_str, zone->name, strerror(error));
             return; /* try again later */
         }
+        if (error != 0 && tcp->is_reused) {
+            ods_log_verbose("[%s] zone %s reused tcp connection to %s "
+                "failed: %s", xfrd_str, zone->name, xfrd->master->address,
+                strerror(error));
+            xfrd_tcp_reopen(xfrd, set);
+            return;
+        }
         if (error != 0) {
             ods_log_error("[%s] zone %s cannot tcp connect to %s: %s",
                 xfrd_str, zone->name, xfrd->master->address, strerror(errno));
             xfrd_set_timer_now(xfrd);
-            xfrd_tcp_release(xfrd, set, 1);
+            xfrd_tcp_release(xfrd, set, 1, 0);
             return;
         }
     }
     ret = tcp_conn_write(tcp);
+    if (ret == -1 && tcp->is_reused) {
+        ods_log_verbose("[%s] zone %s reused tcp connection to %s failed: "
+            "%s", xfrd_str, zone->name, xfrd->master->address,
+            strerror(errno));
+        xfrd_tcp_reopen(xfrd, set);
+        return;
+    }
     if(ret == -1) {
         ods_log_error("[%s] zone %s cannot tcp write to %s: %s",
             xfrd_str, zone->name, xfrd->master->address, strerror(errno));
         xfrd_set_timer_now(xfrd);
-        xfrd_tcp_release(xfrd, set, 1);
+        xfrd_tcp_release(xfrd, set, 1, 0);
         return;
     }
     if (ret == 0) {
@@ -1118,6 +1230,7 @@ xfrd_tcp_open(xfrd_type* xfrd, tcp_set_type* set)
     set->tcp_conn[xfrd->tcp_conn]->is_reading = 0;
     set->tcp_conn[xfrd->tcp_conn]->total_bytes = 0;
     set->tcp_conn[xfrd->tcp_conn]->msglen = 0;
+    set->tcp_conn[xfrd->tcp_conn]->is_reused = 0;
     if (xfrd->master->family == AF_INET6) {
         family = PF_INET6;
     } else {
@@ -1129,14 +1242,14 @@ xfrd_tcp_open(xfrd_type* xfrd, tcp_set_type* set)
         ods_log_error("[%s] zone %s cannot create tcp socket to %s: %s",
             xfrd_str, zone->name, xfrd->master->address, strerror(errno));
         xfrd_set_timer_now(xfrd);
-        xfrd_tcp_release(xfrd, set, 0);
+        xfrd_tcp_release(xfrd, set, 0, 0);
         return 0;
     }
     if (fcntl(fd, F_SETFL, O_NONBLOCK) == -1) {
         ods_log_error("[%s] zone %s cannot fcntl tcp socket: %s",
             xfrd_str, zone->name, strerror(errno));
         xfrd_set_timer_now(xfrd);
-        xfrd_tcp_release(xfrd, set, 0);
+        xfrd_tcp_release(xfrd, set, 0, 0);
         return 0;
     }
     to_len = xfrd_acl_sockaddr_to(xfrd->master, &to);
@@ -1172,7 +1285,7 @@ xfrd_tcp_open(xfrd_type* xfrd, tcp_set_type* set)
         ods_log_error("[%s] zone %s cannot connect tcp socket to %s: %s",
             xfrd_str, zone->name, xfrd->master->address, strerror(errno));
         xfrd_set_timer_now(xfrd);
-        xfrd_tcp_release(xfrd, set, 0);
+        xfrd_tcp_release(xfrd, set, 0, 0);
         return 0;
     }
     xfrd->handler.fd = fd;
@@ -1189,23 +1302,19 @@ xfrd_tcp_open(xfrd_type* xfrd, tcp_set_type* set)
 static void
 xfrd_tcp_obtain(xfrd_type* xfrd, tcp_set_type* set)
 {
-    xfrhandler_type* xfrhandler;
-    int i = 0;
+    tcp_master_type* master = NULL;
 
     ods_log_assert(set);
     ods_log_assert(xfrd);
+    ods_log_assert(xfrd->master);
+    ods_log_assert(xfrd->master->address);
     ods_log_assert(xfrd->tcp_conn == -1);
     ods_log_assert(xfrd->tcp_waiting == 0);
-    if (set->tcp_count < TCPSET_MAX) {
-        ods_log_assert(!set->tcp_waiting_first);
-        set->tcp_count ++;
-        /* find a free tcp_buffer */
-        for (i=0; i < TCPSET_MAX; i++) {
-            if (set->tcp_conn[i]->fd == -1) {
-                xfrd->tcp_conn = i;
-                break;
-            }
-        }
+    master = tcp_set_master(set, xfrd->master->address, xfrd->master->port);
+    xfrd->tcp_master = master;
+    /* zones already waiting for this master go first */
+    if (!master->tcp_waiting_first && tcp_set_available(set, master)) {
+        xfrd->tcp_conn = tcp_set_take(set, master);
         ods_log_assert(xfrd->tcp_conn != -1);
         xfrd->tcp_waiting = 0;
         /* stop udp use (if any) */
@@ -1219,15 +1328,12 @@ xfrd_tcp_obtain(xfrd_type* xfrd, tcp_set_type* set)
         return;
     }
     /* wait, at end of line */
-    ods_log_verbose("[%s] max number of tcp connections (%d) reached",
-        xfrd_str, TCPSET_MAX);
+    ods_log_verbose("[%s] max number of tcp connections (%u, %u to %s) "
+        "reached", xfrd_str, (unsigned) set->tcp_max,
+        (unsigned) master->tcp_count, master->address);
     xfrd->tcp_waiting = 1;
     xfrd_unset_timer(xfrd);
-
-    /* add it to the waiting queue */
-    xfrhandler = (xfrhandler_type*) xfrd->xfrhandler;
-    xfrd->tcp_waiting_next = xfrhandler->tcp_waiting_first;
-    xfrhandler->tcp_waiting_first = xfrd;
+    tcp_master_push(master, xfrd);
 }
 
 
@@ -1298,9 +1404,16 @@ xfrd_tcp_read(xfrd_type* xfrd, tcp_set_type* set)
     ods_log_assert(xfrd->tcp_conn != -1);
     tcp = set->tcp_conn[xfrd->tcp_conn];
     ret = tcp_conn_read(tcp);
+    if (ret == -1 && tcp->is_reused && xfrd->msg_seq_nr == 0) {
+        /* master closed the idle connection, try a fresh one */
+        ods_log_verbose("[%s] reused tcp connection to %s closed, reconnect",
+            xfrd_str, xfrd->master->address);
+        xfrd_tcp_reopen(xfrd, set);
+        return;
+    }
     if (ret == -1) {
         xfrd_set_timer_now(xfrd);
-        xfrd_tcp_release(xfrd, set, 1);
+        xfrd_tcp_release(xfrd, set, 1, 0);
         return;
     }
     if (ret == 0) {
@@ -1317,7 +1430,7 @@ xfrd_tcp_read(xfrd_type* xfrd, tcp_set_type* set)
         case XFRD_PKT_NEWLEASE:
             ods_log_verbose("[%s] tcp read %s: release connection", xfrd_str,
                 XFRD_PKT_XFR?"xfr":"newlease");
-            xfrd_tcp_release(xfrd, set, 1);
+            xfrd_tcp_release(xfrd, set, 1, 1);
             ods_log_assert(xfrd->round_num == -1);
             break;
         case XFRD_PKT_NOTIMPL:
@@ -1330,22 +1443,82 @@ xfrd_tcp_read(xfrd_type* xfrd, tcp_set_type* set)
         default:
             ods_log_debug("[%s] tcp read %s: release connection", xfrd_str,
                 ret==XFRD_PKT_BAD?"bad":"notimpl");
-            xfrd_tcp_release(xfrd, set, 1);
+            xfrd_tcp_release(xfrd, set, 1, 0);
             xfrd_make_request(xfrd);
             break;
     }
 }
 
 
+/**
+ * Reopen the tcp connection of xfrd after a reused connection turned out
+ * to be closed by the master. The slot in the set is kept.
+ *
+ */
+static int
+xfrd_tcp_reopen(xfrd_type* xfrd, tcp_set_type* set)
+{
+    tcp_conn_type* tcp = NULL;
+
+    ods_log_assert(set);
+    ods_log_assert(xfrd);
+    ods_log_assert(xfrd->tcp_conn != -1);
+    tcp = set->tcp_conn[xfrd->tcp_conn];
+    if (tcp->fd != -1) {
+        close(tcp->fd);
+    }
+    tcp->fd = -1;
+    xfrd->handler.fd = -1;
+    if (!xfrd_tcp_open(xfrd, set)) {
+        return 0;
+    }
+    xfrd_tcp_xfr(xfrd, set);
+    return 1;
+}
+
+
+/**
+ * Hand the open tcp connection in slot conn over to xfrd, that waited
+ * for the same master.
+ *
+ */
+static void
+xfrd_tcp_reuse(xfrd_type* xfrd, tcp_set_type* set, int conn)
+{
+    tcp_conn_type* tcp = NULL;
+    zone_type* zone = NULL;
+
+    ods_log_assert(set);
+    ods_log_assert(xfrd);
+    zone = (zone_type*) xfrd->zone;
+    tcp = set->tcp_conn[conn];
+    ods_log_debug("[%s] zone %s reuse tcp connection to %s", xfrd_str,
+        zone->name, xfrd->master->address);
+    xfrd->tcp_conn = conn;
+    tcp->is_reading = 0;
+    tcp->is_reused = 1;
+    tcp->total_bytes = 0;
+    tcp->msglen = 0;
+    xfrd->handler.fd = tcp->fd;
+    xfrd->handler.event_types = NETIO_EVENT_WRITE|NETIO_EVENT_TIMEOUT;
+    xfrd_set_timer(xfrd, xfrd_time(xfrd) + XFRD_TCP_TIMEOUT);
+    xfrd_tcp_xfr(xfrd, set);
+}
+
+
 /**
  * Release tcp connection from set for xfrd. If there are waiting TCP
- * connections open as many as free slots in set. This step is skipped
- * if open_waiting flag is unset.
+ * connections open as many as free slots in set, taking turns between
+ * masters. This step is skipped if open_waiting flag is unset. If
+ * keep_open is set the connection is clean and is handed to the next
+ * zone waiting for the same master, if it is that master's turn.
  */
 static void
-xfrd_tcp_release(xfrd_type* xfrd, tcp_set_type* set, int open_waiting)
+xfrd_tcp_release(xfrd_type* xfrd, tcp_set_type* set, int open_waiting,
+    int keep_open)
 {
-    xfrhandler_type* xfrhandler;
+    tcp_master_type* master = NULL;
+    xfrd_type* waiting_xfrd = NULL;
     int conn = 0;
     zone_type* zone = NULL;
 
@@ -1354,39 +1527,42 @@ xfrd_tcp_release(xfrd_type* xfrd, tcp_set_type* set, int open_waiting)
     ods_log_assert(xfrd->master);
     ods_log_assert(xfrd->master->address);
     ods_log_assert(xfrd->tcp_conn != -1);
+    ods_log_assert(xfrd->tcp_master);
     ods_log_assert(xfrd->tcp_waiting == 0);
     zone = (zone_type*) xfrd->zone;
     ods_log_debug("[%s] zone %s release tcp connection to %s", xfrd_str,
         zone->name, xfrd->master->address);
     conn = xfrd->tcp_conn;
+    master = xfrd->tcp_master;
     xfrd->tcp_conn = -1;
+    xfrd->tcp_master = NULL;
     xfrd->tcp_waiting = 0;
     xfrd->handler.fd = -1;
     xfrd->handler.event_types = NETIO_EVENT_READ|NETIO_EVENT_TIMEOUT;
-
-    if (set->tcp_conn[conn]->fd != -1) {
-        close(set->tcp_conn[conn]->fd);
-    }
-    set->tcp_conn[conn]->fd = -1;
-    set->tcp_count --;
+    tcp_set_give(set, master);
 
     /* see if there are any connections waiting for a slot. Or return. */
-    if (!open_waiting) return;
-    xfrhandler = (xfrhandler_type*) xfrd->xfrhandler;
-    while (xfrhandler->tcp_waiting_first && set->tcp_count < TCPSET_MAX) {
-        int i;
-        xfrd_type* waiting_xfrd = xfrhandler->tcp_waiting_first;
-        xfrhandler->tcp_waiting_first = waiting_xfrd->tcp_waiting_next;
-        waiting_xfrd->tcp_waiting_next = NULL;
-
-        /* find a free tcp_buffer */
-        for (i=0; i < TCPSET_MAX; i++) {
-            if (set->tcp_conn[i]->fd == -1) {
-                waiting_xfrd->tcp_conn = i;
-                set->tcp_count++;
-                break;
-            }
+    waiting_xfrd = open_waiting ? tcp_set_pop(set) : NULL;
+    if (keep_open && waiting_xfrd && waiting_xfrd->tcp_master == master &&
+        set->tcp_conn[conn]->fd != -1) {
+        ods_log_assert(tcp_set_available(set, master));
+        set->tcp_count++;
+        master->tcp_count++;
+        waiting_xfrd->tcp_waiting = 0;
+        /* stop udp use (if any) */
+        if (waiting_xfrd->handler.fd != -1) {
+            xfrd_udp_release(waiting_xfrd);
         }
+        xfrd_tcp_reuse(waiting_xfrd, set, conn);
+        xfrd_handler_update(waiting_xfrd);
+        waiting_xfrd = tcp_set_pop(set);
+    } else if (set->tcp_conn[conn]->fd != -1) {
+        close(set->tcp_conn[conn]->fd);
+        set->tcp_conn[conn]->fd = -1;
+    }
+    while (waiting_xfrd) {
+        waiting_xfrd->tcp_conn = tcp_set_take(set,
+            waiting_xfrd->tcp_master);
         waiting_xfrd->tcp_waiting = 0;
         /* stop udp use (if any) */
         if (waiting_xfrd->handler.fd != -1) {
@@ -1399,6 +1575,8 @@ xfrd_tcp_release(xfrd_type* xfrd, tcp_set_type* set, int open_waiting)
         if (xfrd_tcp_open(waiting_xfrd, set)) {
             xfrd_tcp_xfr(waiting_xfrd, set);
         }
+        xfrd_handler_update(waiting_xfrd);
+        waiting_xfrd = tcp_set_pop(set);
     }
 }
 
@@ -1514,7 +1692,7 @@ xfrd_udp_obtain(xfrd_type* xfrd)
     xfrhandler = (void*) xfrd->xfrhandler;
     if (xfrd->tcp_conn != -1) {
         /* no tcp and udp at the same time */
-        xfrd_tcp_release(xfrd, xfrhandler->tcp_set, 1);
+        xfrd_tcp_release(xfrd, xfrhandler->tcp_set, 1, 0);
     }
     if (xfrhandler->udp_use_num < XFRD_MAX_UDP) {
             xfrhandler->udp_use_num++;
@@ -1652,6 +1830,7 @@ xfrd_udp_release(xfrd_type* xfrd)
             /* see if this zone needs udp connection */
             if (wf->tcp_conn == -1) {
                 wf->handler.fd = xfrd_udp_send_request_ixfr(wf);
+                xfrd_handler_update(wf);
                 if (wf->handler.fd != -1) {
                     return;
                 }
@@ -1803,7 +1982,7 @@ xfrd_handle_zone(netio_type* ATTR_UNUSED(netio),
            /* tcp connection timed out. Stop it. */
            ods_log_deeebug("[%s] zone %s event tcp timeout", xfrd_str,
                zone->name);
-           xfrd_tcp_release(xfrd, xfrhandler->tcp_set, 1);
+           xfrd_tcp_release(xfrd, xfrhandler->tcp_set, 1, 0);
            /* continue to retry; as if a timeout happened */
            event_types = NETIO_EVENT_TIMEOUT;
         }
@@ -1965,6 +2144,11 @@ xfrd_cleanup(xfrd_type* xfrd, int backup)
         xfrd_unlink(xfrd);
     }
 
+    if (xfrd->stream) {
+        (void) addns_stream_finish(xfrd->stream, 0);
+        xfrd->stream = NULL;
+    }
+    xfrd_spool_close(xfrd);
     tsig_rr_cleanup(xfrd->tsig_rr);
     pthread_mutex_destroy(&xfrd->serial_lock);
     pthread_mutex_destroy(&xfrd->rw_lock);
@@ -86,6 +86,17 @@ struct soa_struct {
     uint32_t minimum;
 };
 
+/**
+ * Received transfers are spooled in <zone>.xfrd as a sequence of records,
+ * each a type byte and a 32-bit length in network order followed by that
+ * many bytes of data.
+ *
+ */
+#define XFRD_SPOOL_BEGIN 'B' /* start of a transfer, no data */
+#define XFRD_SPOOL_PACKET 'P' /* one received packet in wire format */
+#define XFRD_SPOOL_END 'E' /* transfer complete, no data */
+#define XFRD_SPOOL_HDRLEN 5
+
 /**
  * Zone transfer state.
  *
@@ -96,9 +107,12 @@ struct xfrd_struct
     zone_type* zone;
     pthread_mutex_t serial_lock; /* mutexes soa serial management */
     pthread_mutex_t rw_lock; /* mutexes <zone>.xfrd file */
+    int spool_fd; /* <zone>.xfrd, kept open while receiving */
+    struct addns_stream_struct* stream; /* transfer applied while received */
 
     /* transfer request handling */
     int tcp_conn;
+    struct tcp_master_struct* tcp_master; /* master of tcp_conn or wait */
     int round_num;
     int master_num;
     int next_master;
@@ -180,6 +194,14 @@ void xfrd_set_timer_refresh(xfrd_type* xfrd);
 socklen_t xfrd_acl_sockaddr_to(acl_type* acl,
     struct sockaddr_storage* to);
 
+/**
+ * Close the transfer spool, to be called with rw_lock held whenever
+ * <zone>.xfrd is moved away.
+ * \param[in] xfrd zone transfer structure.
+ *
+ */
+void xfrd_spool_close(xfrd_type* xfrd);
+
 /**
  * Cleanup zone transfer structure.
  * \param[in] xfrd zone transfer structure.